@@ -0,0 +1,517 @@
+/*
+ * Measure the C++ interface against std::filesystem.
+ *
+ * Generate a directory tree with mktree first and then run
+ *
+ *     b-cxx -csv results.csv tree
+ *
+ * to read every directory of the tree with dirent_cxx::directory_range and
+ * with std::filesystem::directory_iterator, once retrieving names and types
+ * only and once retrieving the size of each file too.  Each directory is
+ * also scanned with the C function scandir and with the dirent_cxx::scandir
+ * template, leaving out sub-directories and sorting the rest with each
+ * comparison function.  Scans of the whole tree are finally repeated with
+ * listing_cache, which serves every directory from memory after the first
+ * round.  Each benchmark is repeated five times (option
+ * -repeat) and the results give the best and mean time per entry, or per
+ * directory for scans, in nanoseconds together with the number of calls to
+ * operator new.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <dirent.hpp>
+
+using namespace dirent_cxx;
+namespace fs = std::filesystem;
+
+/* Comparison function of scandir */
+typedef int (*compare_fn)(const struct dirent **, const struct dirent **);
+
+static void collect(const char *dirname);
+static void run(const char *name, unsigned long (*fn)(void));
+static void check(const char *name, unsigned long files,
+	unsigned long long bytes);
+static unsigned long bench_range(void);
+static unsigned long bench_iterator(void);
+static unsigned long bench_range_size(void);
+static unsigned long bench_iterator_size(void);
+static unsigned long bench_scandir(compare_fn compare);
+static unsigned long bench_scandir_alpha(void);
+static unsigned long bench_template_alpha(void);
+#if defined(DIRENT_H) || defined(__GLIBC__)
+static unsigned long bench_scandir_version(void);
+static unsigned long bench_template_version(void);
+#endif
+static unsigned long bench_template_byte(void);
+static unsigned long bench_cache(void);
+static int skip_dirs(const struct dirent *entry);
+static bool has_suffix(std::string_view name, std::string_view suffix);
+static double now(void);
+static int _main(int argc, char *argv[]);
+
+/* Options */
+static int repeat = 5;
+static const char *csv = NULL;
+
+/* Output file or NULL */
+static FILE *out = NULL;
+
+/* Directories of tree */
+static std::vector<std::string> dirs;
+static unsigned long entry_count = 0;
+static unsigned long file_count = 0;
+static unsigned long long file_bytes = 0;
+
+/* Number of entries outside names ending with .d */
+static unsigned long kept_count = 0;
+
+/* Cache of every directory in tree */
+static listing_cache *cache = NULL;
+
+/* Number of calls to operator new */
+static unsigned long allocations = 0;
+
+/* Keep compiler from optimizing loops away */
+static volatile unsigned long long sink;
+
+void *
+operator new(std::size_t size)
+{
+	allocations++;
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void
+operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept
+{
+	free(p);
+}
+
+static int
+_main(int argc, char *argv[])
+{
+	/* Parse options */
+	int i = 1;
+	while (i + 1 < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-repeat") == 0) {
+			repeat = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-csv") == 0) {
+			csv = argv[i + 1];
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		i += 2;
+	}
+	if (i + 1 != argc || repeat < 1) {
+		fprintf(stderr,
+			"Usage: b-cxx [-repeat N] [-csv FILE] DIRECTORY\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (csv) {
+		out = fopen(csv, "w");
+		if (!out) {
+			fprintf(stderr, "Cannot create %s (%s)\n",
+				csv, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		fprintf(out, "name,operations,best_ns,mean_ns,allocations\n");
+	}
+
+	/* Find directories of tree */
+	collect(argv[i]);
+	fprintf(stderr, "%lu directories, %lu entries\n",
+		(unsigned long) dirs.size(), entry_count);
+
+	/* Run benchmarks */
+	run("directory_range", bench_range);
+	run("directory_iterator", bench_iterator);
+	run("directory_range/size", bench_range_size);
+	run("directory_iterator/size", bench_iterator_size);
+	run("scandir/alphasort", bench_scandir_alpha);
+	run("dirent_cxx::scandir/alpha_less", bench_template_alpha);
+#if defined(DIRENT_H) || defined(__GLIBC__)
+	run("scandir/versionsort", bench_scandir_version);
+	run("dirent_cxx::scandir/version_less", bench_template_version);
+#endif
+
+	/* Read whole tree from cache after the first round */
+	run("dirent_cxx::scandir/byte_less", bench_template_byte);
+	cache = new listing_cache(dirs.size());
+	run("listing_cache", bench_cache);
+	listing_cache::statistics s = cache->stats();
+	fprintf(stderr, "listing_cache: hit rate %.1f%%, hit %.1f us,"
+		" miss %.1f us\n", s.hit_rate() * 100, s.mean_hit_ns() / 1e3,
+		s.mean_miss_ns() / 1e3);
+	if (s.misses != dirs.size()) {
+		fprintf(stderr, "listing_cache read %llu directories again\n",
+			s.misses - (unsigned long long) dirs.size());
+		exit(EXIT_FAILURE);
+	}
+	delete cache;
+
+	if (out && fclose(out) != 0) {
+		fprintf(stderr, "Cannot write %s\n", csv);
+		exit(EXIT_FAILURE);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Store names of directory and its sub-directories */
+static void
+collect(const char *dirname)
+{
+	/* Stop rather than measure part of the tree */
+	std::error_code ec;
+	dirs.push_back(dirname);
+	fs::recursive_directory_iterator i(dirname, ec);
+	fs::recursive_directory_iterator end;
+	for (; !ec && i != end; i.increment(ec)) {
+		entry_count++;
+		if (!has_suffix(i->path().filename().string(), ".d"))
+			kept_count++;
+		if (i->is_directory(ec)) {
+			dirs.push_back(i->path().string());
+		} else if (i->is_regular_file(ec)) {
+			file_count++;
+			file_bytes += i->file_size(ec);
+		}
+		if (ec)
+			break;
+	}
+	if (ec) {
+		fprintf(stderr, "Cannot read directory %s (%s)\n",
+			dirname, ec.message().c_str());
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* Run benchmark repeatedly and output the best result */
+static void
+run(const char *name, unsigned long (*fn)(void))
+{
+	double best = 0;
+	double total = 0;
+	unsigned long operations = 0;
+	unsigned long allocated = 0;
+	for (int i = 0; i <= repeat; i++) {
+		unsigned long before = allocations;
+		double start = now();
+		operations = fn();
+		double t = now() - start;
+
+		/* First round warms up caches */
+		if (i == 0)
+			continue;
+		if (i == 1 || t < best)
+			best = t;
+		total += t;
+		allocated = allocations - before;
+	}
+	if (operations == 0) {
+		fprintf(stderr, "No entries in %s\n", name);
+		exit(EXIT_FAILURE);
+	}
+
+	double best_ns = best * 1e9 / (double) operations;
+	double mean_ns = total * 1e9 / repeat / (double) operations;
+	double per = (double) allocated / (double) operations;
+	fprintf(stderr, "%-32s %10.1f ns %8.2f allocations\n",
+		name, best_ns, per);
+	if (out) {
+		fprintf(out, "%s,%lu,%.1f,%.1f,%.2f\n",
+			name, operations, best_ns, mean_ns, per);
+	}
+}
+
+/* Stop if benchmark did not see the whole tree */
+static void
+check(const char *name, unsigned long files, unsigned long long bytes)
+{
+	if (files != file_count || bytes != file_bytes) {
+		fprintf(stderr, "%s found %lu files with %llu bytes\n",
+			name, files, bytes);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* Read names and types with directory_range */
+static unsigned long
+bench_range(void)
+{
+	unsigned long n = 0;
+	unsigned long files = 0;
+	unsigned long long length = 0;
+	for (const std::string &dirname : dirs) {
+		directory_range dir(dirname.c_str());
+		for (const directory_entry &entry : dir) {
+			if (entry.type() == file_type::regular) {
+				length += entry.name().size();
+				files++;
+			}
+			n++;
+		}
+	}
+	sink = length;
+	check("directory_range", files, file_bytes);
+	return n;
+}
+
+/* Read names and types with std::filesystem */
+static unsigned long
+bench_iterator(void)
+{
+	unsigned long n = 0;
+	unsigned long files = 0;
+	unsigned long long length = 0;
+	for (const std::string &dirname : dirs) {
+		for (const fs::directory_entry &entry
+			: fs::directory_iterator(dirname)) {
+			if (entry.is_regular_file()) {
+				length += entry.path().filename().native().size();
+				files++;
+			}
+			n++;
+		}
+	}
+	sink = length;
+	check("directory_iterator", files, file_bytes);
+	return n;
+}
+
+/* Read sizes of files with directory_range */
+static unsigned long
+bench_range_size(void)
+{
+	unsigned long n = 0;
+	unsigned long files = 0;
+	unsigned long long bytes = 0;
+	for (const std::string &dirname : dirs) {
+		directory_range dir(dirname.c_str());
+		for (const directory_entry &entry : dir) {
+			if (entry.type() == file_type::regular) {
+				bytes += entry.size();
+				files++;
+			}
+			n++;
+		}
+	}
+	sink = bytes;
+	check("directory_range/size", files, bytes);
+	return n;
+}
+
+/* Read sizes of files with std::filesystem */
+static unsigned long
+bench_iterator_size(void)
+{
+	unsigned long n = 0;
+	unsigned long files = 0;
+	unsigned long long bytes = 0;
+	for (const std::string &dirname : dirs) {
+		for (const fs::directory_entry &entry
+			: fs::directory_iterator(dirname)) {
+			if (entry.is_regular_file()) {
+				bytes += entry.file_size();
+				files++;
+			}
+			n++;
+		}
+	}
+	sink = bytes;
+	check("directory_iterator/size", files, bytes);
+	return n;
+}
+
+/* Scan each directory with the C function */
+static unsigned long
+bench_scandir(compare_fn compare)
+{
+	unsigned long kept = 0;
+	for (const std::string &dirname : dirs) {
+		struct dirent **files;
+		int n = ::scandir(dirname.c_str(), &files, skip_dirs, compare);
+		if (n < 0) {
+			fprintf(stderr, "Cannot scan directory %s (%s)\n",
+				dirname.c_str(), strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		for (int i = 0; i < n; i++)
+			free(files[i]);
+		free(files);
+		kept += (unsigned long) n;
+	}
+	if (kept != kept_count) {
+		fprintf(stderr, "scandir kept %lu entries\n", kept);
+		exit(EXIT_FAILURE);
+	}
+	return (unsigned long) dirs.size();
+}
+
+/* Scan each directory with the template */
+template <class Compare>
+static unsigned long
+bench_template(Compare compare)
+{
+	auto filter = [](const directory_entry &e) {
+		return !has_suffix(e.name(), ".d");
+	};
+	unsigned long kept = 0;
+	for (const std::string &dirname : dirs) {
+		std::error_code ec;
+		directory_list list = dirent_cxx::scandir(
+			dirname.c_str(), filter, compare, ec);
+		if (ec) {
+			fprintf(stderr, "Cannot scan directory %s (%s)\n",
+				dirname.c_str(), ec.message().c_str());
+			exit(EXIT_FAILURE);
+		}
+		kept += (unsigned long) list.size();
+	}
+	if (kept != kept_count) {
+		fprintf(stderr, "dirent_cxx::scandir kept %lu entries\n", kept);
+		exit(EXIT_FAILURE);
+	}
+	return (unsigned long) dirs.size();
+}
+
+static unsigned long
+bench_scandir_alpha(void)
+{
+	return bench_scandir(alphasort);
+}
+
+static unsigned long
+bench_template_alpha(void)
+{
+	return bench_template(alpha_less());
+}
+
+#if defined(DIRENT_H) || defined(__GLIBC__)
+static unsigned long
+bench_scandir_version(void)
+{
+	return bench_scandir(versionsort);
+}
+
+static unsigned long
+bench_template_version(void)
+{
+	return bench_template(version_less());
+}
+#endif
+
+/* Read and sort each directory without filter */
+static unsigned long
+bench_template_byte(void)
+{
+	unsigned long n = 0;
+	for (const std::string &dirname : dirs) {
+		std::error_code ec;
+		directory_list list = dirent_cxx::scandir(
+			dirname.c_str(), accept_all(), byte_less(), ec);
+		if (ec) {
+			fprintf(stderr, "Cannot scan directory %s (%s)\n",
+				dirname.c_str(), ec.message().c_str());
+			exit(EXIT_FAILURE);
+		}
+		n += (unsigned long) list.size();
+	}
+	if (n != entry_count) {
+		fprintf(stderr, "dirent_cxx::scandir found %lu entries\n", n);
+		exit(EXIT_FAILURE);
+	}
+	return (unsigned long) dirs.size();
+}
+
+/* Get each directory from cache */
+static unsigned long
+bench_cache(void)
+{
+	unsigned long n = 0;
+	for (const std::string &dirname : dirs) {
+		std::error_code ec;
+		std::shared_ptr<const directory_list> p = cache->get(
+			dirname.c_str(), ec);
+		if (ec) {
+			fprintf(stderr, "Cannot scan directory %s (%s)\n",
+				dirname.c_str(), ec.message().c_str());
+			exit(EXIT_FAILURE);
+		}
+		n += (unsigned long) p->size();
+	}
+	if (n != entry_count) {
+		fprintf(stderr, "listing_cache found %lu entries\n", n);
+		exit(EXIT_FAILURE);
+	}
+	return (unsigned long) dirs.size();
+}
+
+/* Pass entries other than sub-directories, . and .. */
+static int
+skip_dirs(const struct dirent *entry)
+{
+	const char *name = entry->d_name;
+	if (name[0] == '.' && (name[1] == '\0'
+		|| (name[1] == '.' && name[2] == '\0')))
+		return 0;
+	return !has_suffix(name, ".d");
+}
+
+/* Returns true if name ends with suffix */
+static bool
+has_suffix(std::string_view name, std::string_view suffix)
+{
+	return name.size() >= suffix.size()
+		&& name.compare(name.size() - suffix.size(),
+			std::string_view::npos, suffix) == 0;
+}
+
+/* Monotonic time in seconds */
+static double
+now(void)
+{
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int
+main(int argc, char *argv[])
+{
+	/*
+	 * Use UTF-8 file names.  Other systems do not know locale ".utf8" so
+	 * convert file names with C.UTF-8 or the locale of the environment
+	 * there, keeping the C locale for sorting.
+	 */
+	if (!setlocale(LC_ALL, ".utf8") && !setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+	return _main(argc, argv);
+}
@@ -0,0 +1,774 @@
+/*
+ * Measure the speed of directory functions.
+ *
+ * Generate a directory tree with mktree first and then run
+ *
+ *     b-dirent -json results.json -csv results.csv tree
+ *
+ * to time opendir, readdir, scandir with each comparison function,
+ * telldir, seekdir and recursive walks over every directory in the tree.
+ * Walks open sub-directories by path and, where available, relative to
+ * the parent directory with opendirat.  Where opendir_pattern is available,
+ * selecting names with pattern *.d is compared to reading
+ * every entry and filtering the names in the application.
+ * Each benchmark is repeated five times (option -repeat) and the results
+ * give the best and mean time per operation in nanoseconds.  Results are
+ * printed to screen as JSON unless options -json or -csv name the output
+ * files.  Compare the output files of different builds to spot
+ * regressions.
+ *
+ * When compiled with DIRENT_TRACE, benchmarks ending in /trace register
+ * trace hooks which count events.  Compare them to the benchmarks without
+ * hooks and to a build without DIRENT_TRACE to see the overhead of tracing.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+/* Include prototype for versionsort (Linux) */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <locale.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifdef _WIN32
+#	include <windows.h>
+#endif
+#ifdef _MSC_VER
+#	define stat _stat64
+#endif
+
+/* Maximum number of benchmarks */
+#define MAX_RESULTS 32
+
+/* Result of one benchmark */
+struct result {
+	const char *name;
+
+	/* Operations per round */
+	unsigned long operations;
+
+	/* Best and mean time per operation in nanoseconds */
+	double best;
+	double mean;
+};
+
+/* Comparison function of scandir */
+typedef int (*compare_fn)(const struct dirent **, const struct dirent **);
+
+static void collect(char *path, size_t n);
+static void run(const char *name, unsigned long (*fn)(void));
+static unsigned long bench_opendir(void);
+static unsigned long bench_readdir(void);
+#ifdef _DIRENT_HAVE_OPENDIR_PATTERN
+static unsigned long bench_filter(void);
+static unsigned long bench_pattern(void);
+#endif
+static unsigned long bench_scandir(compare_fn compare);
+static unsigned long bench_scandir_none(void);
+static unsigned long bench_alphasort(void);
+static unsigned long bench_strcmp(void);
+#ifdef _DIRENT_HAVE_BYTESORT
+static unsigned long bench_bytesort(void);
+#endif
+#if defined(DIRENT_H) || defined(__GLIBC__)
+static unsigned long bench_versionsort(void);
+#endif
+#ifdef _DIRENT_HAVE_NATSORT
+static unsigned long bench_natsort(void);
+static unsigned long bench_natcasesort(void);
+#endif
+static unsigned long bench_telldir(void);
+static unsigned long bench_seekdir(void);
+static unsigned long bench_walk(void);
+static unsigned long bench_walk_stat(void);
+#ifdef _DIRENT_HAVE_OPENDIRAT
+static unsigned long bench_walk_at(void);
+static unsigned long walk_at(DIR *dir);
+#endif
+#ifdef _DIRENT_HAVE_TRACE
+static unsigned long bench_readdir_trace(void);
+static unsigned long bench_scandir_trace(void);
+static unsigned long bench_walk_trace(void);
+static void count_event(const struct dirent_trace *event, void *data);
+#endif
+static unsigned long walk(char *path, size_t n, int use_stat);
+static int compare_strcmp(const struct dirent **a, const struct dirent **b);
+static int is_dots(const char *name);
+static void save(const char *filename, void (*print)(FILE *fp));
+static void print_json(FILE *fp);
+static void print_csv(FILE *fp);
+static double now(void);
+static void *allocate(size_t size);
+static void *reallocate(void *p, size_t size);
+static int _main(int argc, char *argv[]);
+
+/* Options */
+static int repeat = 5;
+static const char *json = NULL;
+static const char *csv = NULL;
+static const char *root = NULL;
+
+/* Directories of tree */
+static char **dirs = NULL;
+static size_t dir_count = 0;
+static size_t dirs_allocated = 0;
+static unsigned long entry_count = 0;
+
+#ifdef _DIRENT_HAVE_OPENDIR_PATTERN
+/* Number of names picked by bench_filter */
+static unsigned long filter_count = 0;
+#endif
+
+/* Positions and number of entries in each directory for seekdir */
+static long *positions = NULL;
+static unsigned long *counts = NULL;
+
+/* Results */
+static struct result results[MAX_RESULTS];
+static size_t result_count = 0;
+
+/* Prevents compiler from optimizing reads away */
+static volatile unsigned long sink;
+
+int
+_main(int argc, char *argv[])
+{
+	/* Parse options */
+	int i = 1;
+	while (i + 1 < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-repeat") == 0) {
+			repeat = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-json") == 0) {
+			json = argv[i + 1];
+		} else if (strcmp(argv[i], "-csv") == 0) {
+			csv = argv[i + 1];
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		i += 2;
+	}
+	if (i + 1 != argc || repeat < 1) {
+		fprintf(stderr,
+			"Usage: b-dirent [-repeat N] [-json FILE] [-csv FILE]"
+			" DIRECTORY\n");
+		exit(EXIT_FAILURE);
+	}
+	root = argv[i];
+
+	/* Find directories in tree */
+	static char path[PATH_MAX + 2];
+	size_t n = strlen(root);
+	if (n > PATH_MAX) {
+		fprintf(stderr, "Path too long %s\n", root);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(path, root, n + 1);
+	collect(path, n);
+	fprintf(stderr, "%lu directories, %lu entries\n",
+		(unsigned long) dir_count, entry_count);
+
+	/* Run benchmarks */
+	run("opendir", bench_opendir);
+	run("readdir", bench_readdir);
+#ifdef _DIRENT_HAVE_OPENDIR_PATTERN
+	run("readdir/filter", bench_filter);
+	run("opendir_pattern", bench_pattern);
+#endif
+	run("scandir", bench_scandir_none);
+	run("scandir/alphasort", bench_alphasort);
+	run("scandir/strcmp", bench_strcmp);
+#ifdef _DIRENT_HAVE_BYTESORT
+	run("scandir/bytesort", bench_bytesort);
+#endif
+#if defined(DIRENT_H) || defined(__GLIBC__)
+	run("scandir/versionsort", bench_versionsort);
+#endif
+#ifdef _DIRENT_HAVE_NATSORT
+	run("scandir/natsort", bench_natsort);
+	run("scandir/natcasesort", bench_natcasesort);
+#endif
+	run("telldir", bench_telldir);
+	run("seekdir", bench_seekdir);
+	run("walk", bench_walk);
+	run("walk/stat", bench_walk_stat);
+#ifdef _DIRENT_HAVE_OPENDIRAT
+	run("walk/opendirat", bench_walk_at);
+#endif
+#ifdef _DIRENT_HAVE_TRACE
+	run("readdir/trace", bench_readdir_trace);
+	run("scandir/alphasort/trace", bench_scandir_trace);
+	run("walk/trace", bench_walk_trace);
+#endif
+
+	/* Output results */
+	if (json)
+		save(json, print_json);
+	if (csv)
+		save(csv, print_csv);
+	if (!json && !csv)
+		print_json(stdout);
+	return EXIT_SUCCESS;
+}
+
+/* Store names of directory in path[0 ... n - 1] and its sub-directories */
+static void
+collect(char *path, size_t n)
+{
+	/* Stop rather than measure part of the tree */
+	DIR *dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "Cannot open directory %s (%s)\n",
+			path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if (dir_count >= dirs_allocated) {
+		dirs_allocated = dirs_allocated * 2 + 256;
+		dirs = (char**) reallocate(dirs, dirs_allocated * sizeof(char*));
+	}
+	dirs[dir_count] = (char*) allocate(n + 1);
+	memcpy(dirs[dir_count], path, n + 1);
+	dir_count++;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (is_dots(ent->d_name))
+			continue;
+		entry_count++;
+
+		size_t k = strlen(ent->d_name);
+		if (n + k + 1 > PATH_MAX)
+			continue;
+		path[n] = '/';
+		memcpy(path + n + 1, ent->d_name, k + 1);
+
+		struct stat st;
+		if (stat(path, &st) != 0) {
+			fprintf(stderr, "Cannot stat %s (%s)\n",
+				path, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		if (S_ISDIR(st.st_mode))
+			collect(path, n + 1 + k);
+	}
+	path[n] = '\0';
+	closedir(dir);
+}
+
+/* Run benchmark and store result */
+static void
+run(const char *name, unsigned long (*fn)(void))
+{
+	if (result_count >= MAX_RESULTS)
+		return;
+
+	/* Warm up caches */
+	unsigned long operations = fn();
+
+	double best = 0;
+	double total = 0;
+	for (int i = 0; i < repeat; i++) {
+		double start = now();
+		fn();
+		double t = now() - start;
+		if (i == 0 || t < best)
+			best = t;
+		total += t;
+	}
+
+	struct result *r = &results[result_count++];
+	r->name = name;
+	r->operations = operations;
+	r->best = operations ? best * 1e9 / operations : 0;
+	r->mean = operations ? total * 1e9 / repeat / operations : 0;
+	fprintf(stderr, "%-24s %10.1f ns\n", name, r->best);
+}
+
+/* Open and close each directory */
+static unsigned long
+bench_opendir(void)
+{
+	for (size_t i = 0; i < dir_count; i++) {
+		DIR *dir = opendir(dirs[i]);
+		if (!dir) {
+			fprintf(stderr, "Cannot open %s\n", dirs[i]);
+			exit(EXIT_FAILURE);
+		}
+		closedir(dir);
+	}
+	return (unsigned long) dir_count;
+}
+
+/* Read each entry of each directory */
+static unsigned long
+bench_readdir(void)
+{
+	unsigned long n = 0;
+	for (size_t i = 0; i < dir_count; i++) {
+		DIR *dir = opendir(dirs[i]);
+		if (!dir)
+			continue;
+		struct dirent *ent;
+		while ((ent = readdir(dir)) != NULL) {
+			if (!is_dots(ent->d_name))
+				n++;
+		}
+		closedir(dir);
+	}
+	sink = n;
+	return n;
+}
+
+#ifdef _DIRENT_HAVE_OPENDIR_PATTERN
+/* Read each directory and pick names ending with .d in any case */
+static unsigned long
+bench_filter(void)
+{
+	unsigned long n = 0;
+	for (size_t i = 0; i < dir_count; i++) {
+		DIR *dir = opendir(dirs[i]);
+		if (!dir)
+			continue;
+		struct dirent *ent;
+		while ((ent = readdir(dir)) != NULL) {
+			size_t k = strlen(ent->d_name);
+			if (k > 2 && ent->d_name[k - 2] == '.'
+				&& (ent->d_name[k - 1] == 'd'
+				|| ent->d_name[k - 1] == 'D'))
+				n++;
+		}
+		closedir(dir);
+	}
+	sink = n;
+	filter_count = n;
+	return dir_count;
+}
+
+/* Read names ending with .d from each directory */
+static unsigned long
+bench_pattern(void)
+{
+	unsigned long n = 0;
+	for (size_t i = 0; i < dir_count; i++) {
+		DIR *dir = opendir_pattern(dirs[i], "*.d");
+		if (!dir)
+			continue;
+		while (readdir(dir) != NULL)
+			n++;
+		closedir(dir);
+	}
+	sink = n;
+
+	/* Pattern must select the same names as the filter */
+	if (n != filter_count) {
+		fprintf(stderr, "Pattern found %lu names, filter %lu\n",
+			n, filter_count);
+		exit(EXIT_FAILURE);
+	}
+	return dir_count;
+}
+#endif
+
+/* Read and sort each directory */
+static unsigned long
+bench_scandir(compare_fn compare)
+{
+	unsigned long n = 0;
+	for (size_t i = 0; i < dir_count; i++) {
+		struct dirent **files;
+		int k = scandir(dirs[i], &files, NULL, compare);
+		for (int j = 0; j < k; j++) {
+			if (!is_dots(files[j]->d_name))
+				n++;
+			free(files[j]);
+		}
+		if (k >= 0)
+			free(files);
+	}
+	sink = n;
+	return n;
+}
+
+static unsigned long
+bench_scandir_none(void)
+{
+	return bench_scandir(NULL);
+}
+
+static unsigned long
+bench_alphasort(void)
+{
+	return bench_scandir(alphasort);
+}
+
+static unsigned long
+bench_strcmp(void)
+{
+	return bench_scandir(compare_strcmp);
+}
+
+#ifdef _DIRENT_HAVE_BYTESORT
+static unsigned long
+bench_bytesort(void)
+{
+	return bench_scandir(bytesort);
+}
+#endif
+
+#if defined(DIRENT_H) || defined(__GLIBC__)
+static unsigned long
+bench_versionsort(void)
+{
+	return bench_scandir(versionsort);
+}
+#endif
+
+#ifdef _DIRENT_HAVE_NATSORT
+static unsigned long
+bench_natsort(void)
+{
+	return bench_scandir(natsort);
+}
+
+static unsigned long
+bench_natcasesort(void)
+{
+	return bench_scandir(natcasesort);
+}
+#endif
+
+/* Read each directory and remember position of each entry */
+static unsigned long
+bench_telldir(void)
+{
+	/* Room for current and parent directory in each directory */
+	if (!positions) {
+		positions = (long*) allocate(
+			(entry_count + 2 * dir_count) * sizeof(long));
+		counts = (unsigned long*) allocate(
+			dir_count * sizeof(unsigned long));
+	}
+
+	unsigned long n = 0;
+	for (size_t i = 0; i < dir_count; i++) {
+		unsigned long first = n;
+		DIR *dir = opendir(dirs[i]);
+		if (dir) {
+			for (;;) {
+				long pos = telldir(dir);
+				if (!readdir(dir))
+					break;
+				positions[n++] = pos;
+			}
+			closedir(dir);
+		}
+		counts[i] = n - first;
+	}
+	return n;
+}
+
+/* Jump to positions saved by bench_telldir in reverse order */
+static unsigned long
+bench_seekdir(void)
+{
+	unsigned long n = 0;
+	unsigned long first = 0;
+	for (size_t i = 0; i < dir_count; i++) {
+		unsigned long k = counts[i];
+		DIR *dir = opendir(dirs[i]);
+		if (!dir) {
+			first += k;
+			continue;
+		}
+
+		for (unsigned long j = k; j > 0; j--) {
+			seekdir(dir, positions[first + j - 1]);
+			if (!readdir(dir)) {
+				fprintf(stderr, "Cannot seek %s\n", dirs[i]);
+				exit(EXIT_FAILURE);
+			}
+			n++;
+		}
+		first += k;
+		closedir(dir);
+	}
+	return n;
+}
+
+/* Walk tree using file type from directory entry */
+static unsigned long
+bench_walk(void)
+{
+	static char path[PATH_MAX + 2];
+	size_t n = strlen(root);
+	memcpy(path, root, n + 1);
+	return walk(path, n, 0);
+}
+
+/* Walk tree and retrieve file information on each entry */
+static unsigned long
+bench_walk_stat(void)
+{
+	static char path[PATH_MAX + 2];
+	size_t n = strlen(root);
+	memcpy(path, root, n + 1);
+	return walk(path, n, 1);
+}
+
+#ifdef _DIRENT_HAVE_OPENDIRAT
+/* Walk tree opening sub-directories relative to their parent */
+static unsigned long
+bench_walk_at(void)
+{
+	DIR *dir = opendir(root);
+	if (!dir) {
+		fprintf(stderr, "Cannot open directory %s\n", root);
+		exit(EXIT_FAILURE);
+	}
+	unsigned long n = walk_at(dir);
+	closedir(dir);
+	return n;
+}
+#endif
+
+#ifdef _DIRENT_HAVE_TRACE
+/* Read each directory with trace hooks */
+static unsigned long
+bench_readdir_trace(void)
+{
+	dirent_settrace(count_event, count_event, NULL);
+	unsigned long n = bench_readdir();
+	dirent_settrace(NULL, NULL, NULL);
+	return n;
+}
+
+/* Read and sort each directory with trace hooks */
+static unsigned long
+bench_scandir_trace(void)
+{
+	dirent_settrace(count_event, count_event, NULL);
+	unsigned long n = bench_scandir(alphasort);
+	dirent_settrace(NULL, NULL, NULL);
+	return n;
+}
+
+/* Walk tree with trace hooks */
+static unsigned long
+bench_walk_trace(void)
+{
+	dirent_settrace(count_event, count_event, NULL);
+	unsigned long n = bench_walk();
+	dirent_settrace(NULL, NULL, NULL);
+	return n;
+}
+
+/* Trace hook which does as little as possible */
+static void
+count_event(const struct dirent_trace *event, void *data)
+{
+	(void) data;
+	sink += event->count;
+}
+#endif
+
+/* Count entries in directory path[0 ... n - 1] recursively */
+static unsigned long
+walk(char *path, size_t n, int use_stat)
+{
+	DIR *dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	unsigned long count = 0;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (is_dots(ent->d_name))
+			continue;
+		count++;
+
+		size_t k = strlen(ent->d_name);
+		if (n + k + 1 > PATH_MAX)
+			continue;
+		path[n] = '/';
+		memcpy(path + n + 1, ent->d_name, k + 1);
+
+		int is_dir;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (!use_stat && ent->d_type != DT_UNKNOWN) {
+			is_dir = ent->d_type == DT_DIR;
+		} else
+#endif
+		{
+			struct stat st;
+			is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+		}
+		if (is_dir)
+			count += walk(path, n + 1 + k, use_stat);
+	}
+	path[n] = '\0';
+	closedir(dir);
+	return count;
+}
+
+#ifdef _DIRENT_HAVE_OPENDIRAT
+/* Count entries in directory stream recursively */
+static unsigned long
+walk_at(DIR *dir)
+{
+	unsigned long count = 0;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (is_dots(ent->d_name))
+			continue;
+		count++;
+
+		if (ent->d_type != DT_DIR)
+			continue;
+		DIR *subdir = opendirat(dir, ent->d_name);
+		if (!subdir) {
+			fprintf(stderr, "Cannot open directory %s\n",
+				ent->d_name);
+			exit(EXIT_FAILURE);
+		}
+		count += walk_at(subdir);
+		closedir(subdir);
+	}
+	return count;
+}
+#endif
+
+/* Sort by byte values with plain strcmp */
+static int
+compare_strcmp(const struct dirent **a, const struct dirent **b)
+{
+	return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+/* Returns true for current and parent directory */
+static int
+is_dots(const char *name)
+{
+	return name[0] == '.' && (name[1] == '\0'
+		|| (name[1] == '.' && name[2] == '\0'));
+}
+
+/* Write results to file */
+static void
+save(const char *filename, void (*print)(FILE *fp))
+{
+	FILE *fp = fopen(filename, "w");
+	if (!fp) {
+		fprintf(stderr, "Cannot create %s (%s)\n",
+			filename, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	print(fp);
+	if (fclose(fp) != 0) {
+		fprintf(stderr, "Cannot write %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* Output results as JSON */
+static void
+print_json(FILE *fp)
+{
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"tree\": \"");
+	for (const char *p = root; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			putc('\\', fp);
+		putc(*p, fp);
+	}
+	fprintf(fp, "\",\n");
+	fprintf(fp, "  \"directories\": %lu,\n", (unsigned long) dir_count);
+	fprintf(fp, "  \"entries\": %lu,\n", entry_count);
+	fprintf(fp, "  \"repeat\": %d,\n", repeat);
+	fprintf(fp, "  \"results\": [\n");
+	for (size_t i = 0; i < result_count; i++) {
+		const struct result *r = &results[i];
+		fprintf(fp, "    {\"name\": \"%s\", \"operations\": %lu,"
+			" \"best_ns\": %.1f, \"mean_ns\": %.1f}%s\n",
+			r->name, r->operations, r->best, r->mean,
+			i + 1 < result_count ? "," : "");
+	}
+	fprintf(fp, "  ]\n");
+	fprintf(fp, "}\n");
+}
+
+/* Output results as comma-separated values */
+static void
+print_csv(FILE *fp)
+{
+	fprintf(fp, "name,operations,best_ns,mean_ns\n");
+	for (size_t i = 0; i < result_count; i++) {
+		const struct result *r = &results[i];
+		fprintf(fp, "%s,%lu,%.1f,%.1f\n",
+			r->name, r->operations, r->best, r->mean);
+	}
+}
+
+/* Monotonic time in seconds */
+static double
+now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+#endif
+}
+
+/* Allocate memory or exit */
+static void *
+allocate(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+	if (!p) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return p;
+}
+
+/* Resize memory block or exit */
+static void *
+reallocate(void *p, size_t size)
+{
+	void *q = realloc(p, size ? size : 1);
+	if (!q) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return q;
+}
+
+int
+main(int argc, char *argv[])
+{
+	/*
+	 * Use UTF-8 file names.  Other systems do not know locale ".utf8" so
+	 * convert file names with C.UTF-8 or the locale of the environment
+	 * there, keeping the C locale for sorting.
+	 */
+	if (!setlocale(LC_ALL, ".utf8") && !setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+	return _main(argc, argv);
+}
@@ -0,0 +1,324 @@
+/*
+ * Measure how the fetch options of opendir_fetch() affect reading speed.
+ *
+ * Generate a directory tree with mktree first and then run
+ *
+ *     b-fetch -latency 100000 -sizes 1024,4096,65536 tree
+ *
+ * to read every directory in the tree with the default options, with
+ * DIRENT_FETCH_BASIC and with DIRENT_FETCH_LARGE.  Results give the best
+ * time per entry in nanoseconds and the number of entries per second.
+ *
+ * Windows decides the buffer size of large fetch on its own.  With the
+ * emulated Win32 API on Linux, option -sizes lists buffer sizes of large
+ * fetch in bytes and option -latency adds a delay in nanoseconds to each
+ * round trip, which lets the benchmark compare buffer sizes on a simulated
+ * network drive.
+ *
+ * Compile with DIRENT_BULK to measure the bulk backend instead.  The bulk
+ * backend reads DIRENT_BULK_SIZE bytes of records per round trip, or
+ * DIRENT_BULK_LARGE bytes with DIRENT_FETCH_LARGE, and the sizes are fixed
+ * at compile time.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <locale.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifdef _WIN32
+#	include <windows.h>
+#endif
+#ifdef _MSC_VER
+#	define stat _stat64
+#endif
+
+#ifdef _DIRENT_HAVE_FETCH
+static void collect(char *path, size_t n);
+static void run(const char *name, int flags, const char *size);
+static unsigned long read_all(int flags);
+static int is_dots(const char *name);
+static double now(void);
+static void *allocate(size_t size);
+static void *reallocate(void *p, size_t size);
+#endif
+static int _main(int argc, char *argv[]);
+
+#ifdef _DIRENT_HAVE_FETCH
+/* Options */
+static int repeat = 5;
+static const char *csv = NULL;
+
+/* Directories of tree */
+static char **dirs = NULL;
+static size_t dir_count = 0;
+static size_t dirs_allocated = 0;
+static unsigned long entry_count = 0;
+
+/* Output file or NULL */
+static FILE *out = NULL;
+#endif
+
+static int
+_main(int argc, char *argv[])
+{
+#ifdef _DIRENT_HAVE_FETCH
+	/* Parse options */
+	const char *latency = NULL;
+	char *sizes = NULL;
+	int i = 1;
+	while (i + 1 < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-repeat") == 0) {
+			repeat = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-latency") == 0) {
+			latency = argv[i + 1];
+		} else if (strcmp(argv[i], "-sizes") == 0) {
+			sizes = argv[i + 1];
+		} else if (strcmp(argv[i], "-csv") == 0) {
+			csv = argv[i + 1];
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		i += 2;
+	}
+	if (i + 1 != argc || repeat < 1) {
+		fprintf(stderr,
+			"Usage: b-fetch [-repeat N] [-latency NS] [-sizes LIST]"
+			" [-csv FILE] DIRECTORY\n");
+		exit(EXIT_FAILURE);
+	}
+
+#ifdef _WIN32
+	if (latency || sizes) {
+		fprintf(stderr, "Options -latency and -sizes require the"
+			" emulated Win32 API\n");
+		exit(EXIT_FAILURE);
+	}
+#endif
+#ifdef _DIRENT_HAVE_BULK
+	if (sizes) {
+		fprintf(stderr, "Option -sizes is not available with"
+			" DIRENT_BULK\n");
+		exit(EXIT_FAILURE);
+	}
+#endif
+#ifndef _WIN32
+	/* Configure emulated Win32 API before the first call */
+	if (latency)
+		setenv("DIRENT_WIN32_LATENCY", latency, 1);
+#endif
+
+	/* Find directories in tree */
+	static char path[PATH_MAX + 2];
+	size_t n = strlen(argv[i]);
+	if (n > PATH_MAX) {
+		fprintf(stderr, "Path too long %s\n", argv[i]);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(path, argv[i], n + 1);
+	collect(path, n);
+	fprintf(stderr, "%lu directories, %lu entries\n",
+		(unsigned long) dir_count, entry_count);
+
+	if (csv) {
+		out = fopen(csv, "w");
+		if (!out) {
+			fprintf(stderr, "Cannot create %s (%s)\n",
+				csv, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		fprintf(out, "name,size,best_ns,entries_per_s\n");
+	}
+
+	/* Run benchmarks */
+	run("standard", 0, NULL);
+	run("basic", DIRENT_FETCH_BASIC, NULL);
+	if (!sizes) {
+		run("large", DIRENT_FETCH_LARGE, NULL);
+	} else {
+		/* Run large fetch with each buffer size */
+		char *p = strtok(sizes, ",");
+		while (p) {
+			run("large", DIRENT_FETCH_LARGE, p);
+			p = strtok(NULL, ",");
+		}
+	}
+
+	if (out && fclose(out) != 0) {
+		fprintf(stderr, "Cannot write %s\n", csv);
+		exit(EXIT_FAILURE);
+	}
+	return EXIT_SUCCESS;
+#else
+	(void) argc;
+	(void) argv;
+	fprintf(stderr, "Function opendir_fetch is not available\n");
+	return EXIT_FAILURE;
+#endif
+}
+
+#ifdef _DIRENT_HAVE_FETCH
+/* Store names of directory in path[0 ... n - 1] and its sub-directories */
+static void
+collect(char *path, size_t n)
+{
+	/* Stop rather than measure part of the tree */
+	DIR *dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "Cannot open directory %s (%s)\n",
+			path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if (dir_count >= dirs_allocated) {
+		dirs_allocated = dirs_allocated * 2 + 256;
+		dirs = (char**) reallocate(dirs, dirs_allocated * sizeof(char*));
+	}
+	dirs[dir_count] = (char*) allocate(n + 1);
+	memcpy(dirs[dir_count], path, n + 1);
+	dir_count++;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (is_dots(ent->d_name))
+			continue;
+		entry_count++;
+
+		size_t k = strlen(ent->d_name);
+		if (n + k + 1 > PATH_MAX)
+			continue;
+		path[n] = '/';
+		memcpy(path + n + 1, ent->d_name, k + 1);
+
+		if (ent->d_type == DT_DIR)
+			collect(path, n + 1 + k);
+	}
+	path[n] = '\0';
+	closedir(dir);
+}
+
+/* Read tree with flags and buffer size, and output result */
+static void
+run(const char *name, int flags, const char *size)
+{
+#ifndef _WIN32
+	if (size)
+		setenv("DIRENT_WIN32_FETCH", size, 1);
+	else
+		unsetenv("DIRENT_WIN32_FETCH");
+#endif
+
+	/* Warm up caches */
+	unsigned long n = read_all(flags);
+
+	double best = 0;
+	for (int i = 0; i < repeat; i++) {
+		double start = now();
+		read_all(flags);
+		double t = now() - start;
+		if (i == 0 || t < best)
+			best = t;
+	}
+
+	double ns = n ? best * 1e9 / n : 0;
+	double rate = best > 0 ? n / best : 0;
+	fprintf(stderr, "%-8s %8s %10.1f ns %12.0f entries/s\n",
+		name, size ? size : "", ns, rate);
+	if (out)
+		fprintf(out, "%s,%s,%.1f,%.0f\n",
+			name, size ? size : "", ns, rate);
+}
+
+/* Read each entry of each directory */
+static unsigned long
+read_all(int flags)
+{
+	unsigned long n = 0;
+	for (size_t i = 0; i < dir_count; i++) {
+		DIR *dir = opendir_fetch(dirs[i], flags);
+		if (!dir) {
+			fprintf(stderr, "Cannot open %s\n", dirs[i]);
+			exit(EXIT_FAILURE);
+		}
+		struct dirent *ent;
+		while ((ent = readdir(dir)) != NULL)
+			n++;
+		closedir(dir);
+	}
+	return n;
+}
+
+/* Returns true for current and parent directory */
+static int
+is_dots(const char *name)
+{
+	return name[0] == '.' && (name[1] == '\0'
+		|| (name[1] == '.' && name[2] == '\0'));
+}
+
+/* Monotonic time in seconds */
+static double
+now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+#endif
+}
+
+/* Allocate memory or exit */
+static void *
+allocate(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+	if (!p) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return p;
+}
+
+/* Resize memory block or exit */
+static void *
+reallocate(void *p, size_t size)
+{
+	void *q = realloc(p, size ? size : 1);
+	if (!q) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return q;
+}
+
+#endif
+
+int
+main(int argc, char *argv[])
+{
+	/*
+	 * Use UTF-8 file names.  Other systems do not know locale ".utf8" so
+	 * convert file names with C.UTF-8 or the locale of the environment
+	 * there, keeping the C locale for sorting.
+	 */
+	if (!setlocale(LC_ALL, ".utf8") && !setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+	return _main(argc, argv);
+}
@@ -0,0 +1,152 @@
+/*
+ * Measure memory taken by open directory streams.
+ *
+ * Run
+ *
+ *     b-footprint tests/3
+ *
+ * to open a number of streams to the directory, read the first entry of
+ * each and report the number of bytes allocated per stream, along with the
+ * size of DIR and _WDIR structures.  Compile once more with DIRENT_SLIM to
+ * compare slim streams against streams with an embedded entry.  Memory is
+ * only counted when compiled with DIRENT_STATS.  Requires dirent.h of this
+ * package as the size of DIR is not known on other systems.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <dirent.h>
+
+static void measure(const char *dirname, int read);
+static unsigned long long alloc_bytes(void);
+static int _main(int argc, char *argv[]);
+
+/* Options */
+static int streams = 100;
+static const char *csv = NULL;
+
+/* Output file or NULL */
+static FILE *out = NULL;
+
+static int
+_main(int argc, char *argv[])
+{
+	/* Parse options */
+	int i = 1;
+	while (i + 1 < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-streams") == 0) {
+			streams = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-csv") == 0) {
+			csv = argv[i + 1];
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		i += 2;
+	}
+	if (i + 1 != argc || streams < 1) {
+		fprintf(stderr,
+			"Usage: b-footprint [-streams N] [-csv FILE] DIRECTORY\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (csv) {
+		out = fopen(csv, "w");
+		if (!out) {
+			fprintf(stderr, "Cannot create %s (%s)\n",
+				csv, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		fprintf(out, "name,bytes_per_stream,sizeof_dir,sizeof_wdir\n");
+	}
+
+	/* Run benchmarks */
+	measure(argv[i], 0);
+	measure(argv[i], 1);
+
+	if (out && fclose(out) != 0) {
+		fprintf(stderr, "Cannot write %s\n", csv);
+		exit(EXIT_FAILURE);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Keep streams open at once and output memory per stream */
+static void
+measure(const char *dirname, int read)
+{
+	DIR **dirs = (DIR**) malloc(sizeof(DIR*) * (size_t) streams);
+	if (!dirs) {
+		puts("Out of memory");
+		exit(3);
+	}
+
+#ifdef _DIRENT_HAVE_POOL
+	/* Count every block rather than blocks of the previous round */
+	dirent_releasepool();
+#endif
+
+	unsigned long long before = alloc_bytes();
+	for (int i = 0; i < streams; i++) {
+		dirs[i] = opendir(dirname);
+		if (!dirs[i]) {
+			fprintf(stderr, "Cannot open directory %s (%s)\n",
+				dirname, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		if (read && readdir(dirs[i]) == NULL) {
+			fprintf(stderr, "Directory %s is empty\n", dirname);
+			exit(EXIT_FAILURE);
+		}
+	}
+	double bytes = (double) (alloc_bytes() - before) / streams;
+
+	for (int i = 0; i < streams; i++)
+		closedir(dirs[i]);
+	free(dirs);
+
+	const char *name = read ? "open/read" : "open";
+	unsigned long dir_size = (unsigned long) sizeof(DIR);
+	unsigned long wdir_size = (unsigned long) sizeof(_WDIR);
+	fprintf(stderr, "%-10s %10.1f bytes/stream %6lu DIR %6lu _WDIR\n",
+		name, bytes, dir_size, wdir_size);
+	if (out) {
+		fprintf(out, "%s,%.1f,%lu,%lu\n",
+			name, bytes, dir_size, wdir_size);
+	}
+}
+
+/* Bytes allocated by directory streams so far */
+static unsigned long long
+alloc_bytes(void)
+{
+#ifdef _DIRENT_HAVE_STATS
+	struct dirent_stats s;
+	dirent_getstats(NULL, &s);
+	return s.alloc_bytes;
+#else
+	return 0;
+#endif
+}
+
+int
+main(int argc, char *argv[])
+{
+	/*
+	 * Use UTF-8 file names.  Other systems do not know locale ".utf8" so
+	 * convert file names with C.UTF-8 or the locale of the environment
+	 * there, keeping the C locale for sorting.
+	 */
+	if (!setlocale(LC_ALL, ".utf8") && !setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+	return _main(argc, argv);
+}
@@ -0,0 +1,271 @@
+/*
+ * Measure how fast directory streams are opened and closed.
+ *
+ * Generate a deep tree of tiny directories with mktree first, e.g.
+ *
+ *     mktree -fanout 2 -depth 12 -files 1 tiny
+ *
+ * and then run
+ *
+ *     b-open tiny
+ *
+ * to open and close every directory in the tree, first without reading
+ * and then reading each directory to the end.  Results give the best time
+ * per directory in nanoseconds, the number of directories per second and,
+ * when compiled with DIRENT_STATS, the number of memory blocks allocated
+ * per directory.  Compile once with DIRENT_POOL and once without to compare
+ * the pool of directory streams against plain malloc() and free().
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <locale.h>
+#include <time.h>
+#include <dirent.h>
+#ifdef _WIN32
+#	include <windows.h>
+#endif
+
+static void collect(char *path, size_t n);
+static void run(const char *name, int read);
+static void open_all(int read);
+static unsigned long long allocs(void);
+static int is_dots(const char *name);
+static double now(void);
+static void *allocate(size_t size);
+static void *reallocate(void *p, size_t size);
+static int _main(int argc, char *argv[]);
+
+/* Options */
+static int repeat = 5;
+static const char *csv = NULL;
+
+/* Directories of tree */
+static char **dirs = NULL;
+static size_t dir_count = 0;
+static size_t dirs_allocated = 0;
+
+/* Output file or NULL */
+static FILE *out = NULL;
+
+static int
+_main(int argc, char *argv[])
+{
+	/* Parse options */
+	int i = 1;
+	while (i + 1 < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-repeat") == 0) {
+			repeat = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-csv") == 0) {
+			csv = argv[i + 1];
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		i += 2;
+	}
+	if (i + 1 != argc || repeat < 1) {
+		fprintf(stderr,
+			"Usage: b-open [-repeat N] [-csv FILE] DIRECTORY\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Find directories in tree */
+	static char path[PATH_MAX + 2];
+	size_t n = strlen(argv[i]);
+	if (n > PATH_MAX) {
+		fprintf(stderr, "Path too long %s\n", argv[i]);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(path, argv[i], n + 1);
+	collect(path, n);
+	fprintf(stderr, "%lu directories\n", (unsigned long) dir_count);
+
+	if (csv) {
+		out = fopen(csv, "w");
+		if (!out) {
+			fprintf(stderr, "Cannot create %s (%s)\n",
+				csv, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		fprintf(out, "name,best_ns,dirs_per_s,allocs_per_dir\n");
+	}
+
+	/* Run benchmarks */
+	run("open/close", 0);
+	run("open/read/close", 1);
+
+	if (out && fclose(out) != 0) {
+		fprintf(stderr, "Cannot write %s\n", csv);
+		exit(EXIT_FAILURE);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Store names of directory in path[0 ... n - 1] and its sub-directories */
+static void
+collect(char *path, size_t n)
+{
+	/* Stop rather than measure part of the tree */
+	DIR *dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "Cannot open directory %s (%s)\n",
+			path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	if (dir_count >= dirs_allocated) {
+		dirs_allocated = dirs_allocated * 2 + 256;
+		dirs = (char**) reallocate(dirs, dirs_allocated * sizeof(char*));
+	}
+	dirs[dir_count] = (char*) allocate(n + 1);
+	memcpy(dirs[dir_count], path, n + 1);
+	dir_count++;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (is_dots(ent->d_name))
+			continue;
+
+		size_t k = strlen(ent->d_name);
+		if (n + k + 1 > PATH_MAX)
+			continue;
+		path[n] = '/';
+		memcpy(path + n + 1, ent->d_name, k + 1);
+
+		if (ent->d_type == DT_DIR)
+			collect(path, n + 1 + k);
+	}
+	path[n] = '\0';
+	closedir(dir);
+}
+
+/* Open every directory repeatedly and output the best result */
+static void
+run(const char *name, int read)
+{
+	/* Warm up caches */
+	open_all(read);
+
+	double best = 0;
+	unsigned long long blocks = 0;
+	for (int i = 0; i < repeat; i++) {
+		unsigned long long before = allocs();
+		double start = now();
+		open_all(read);
+		double t = now() - start;
+		if (i == 0 || t < best)
+			best = t;
+		blocks += allocs() - before;
+	}
+
+	double ns = best * 1e9 / (double) dir_count;
+	double rate = best > 0 ? (double) dir_count / best : 0;
+	double per_dir = (double) blocks / repeat / (double) dir_count;
+	fprintf(stderr, "%-16s %10.1f ns %12.0f dirs/s %8.3f allocs/dir\n",
+		name, ns, rate, per_dir);
+	if (out)
+		fprintf(out, "%s,%.1f,%.0f,%.3f\n", name, ns, rate, per_dir);
+}
+
+/* Open and close each directory, and optionally read it */
+static void
+open_all(int read)
+{
+	for (size_t i = 0; i < dir_count; i++) {
+		DIR *dir = opendir(dirs[i]);
+		if (!dir) {
+			fprintf(stderr, "Cannot open %s\n", dirs[i]);
+			exit(EXIT_FAILURE);
+		}
+		if (read) {
+			while (readdir(dir) != NULL)
+				/*NOP*/;
+		}
+		closedir(dir);
+	}
+}
+
+/* Memory blocks allocated by directory streams so far */
+static unsigned long long
+allocs(void)
+{
+#ifdef _DIRENT_HAVE_STATS
+	struct dirent_stats s;
+	dirent_getstats(NULL, &s);
+	return s.allocs;
+#else
+	return 0;
+#endif
+}
+
+/* Returns true for current and parent directory */
+static int
+is_dots(const char *name)
+{
+	return name[0] == '.' && (name[1] == '\0'
+		|| (name[1] == '.' && name[2] == '\0'));
+}
+
+/* Monotonic time in seconds */
+static double
+now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+#endif
+}
+
+/* Allocate memory or exit */
+static void *
+allocate(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+	if (!p) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return p;
+}
+
+/* Resize memory block or exit */
+static void *
+reallocate(void *p, size_t size)
+{
+	void *q = realloc(p, size ? size : 1);
+	if (!q) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return q;
+}
+
+int
+main(int argc, char *argv[])
+{
+	/*
+	 * Use UTF-8 file names.  Other systems do not know locale ".utf8" so
+	 * convert file names with C.UTF-8 or the locale of the environment
+	 * there, keeping the C locale for sorting.
+	 */
+	if (!setlocale(LC_ALL, ".utf8") && !setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+	return _main(argc, argv);
+}
@@ -0,0 +1,348 @@
+/*
+ * Measure the speed of comparison functions on generated file names.
+ *
+ * Run
+ *
+ *     b-sort -csv results.csv
+ *
+ * to sort lists of typical file names with each comparison function.  The
+ * names are generated from a fixed seed so that results of different
+ * builds can be compared.  Each benchmark is repeated five times (option
+ * -repeat) and the results give the best and mean time per name in
+ * nanoseconds.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+/* Include prototype for strverscmp (Linux) */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <stddef.h>
+#include <time.h>
+#include <dirent.h>
+#ifdef _WIN32
+#	include <windows.h>
+#endif
+
+/* Comparison function of qsort */
+typedef int (*compare_fn)(const void *a, const void *b);
+
+static void run(const char *name, void *list, size_t n,
+	compare_fn compare);
+static char **make_packages(size_t n);
+#ifdef _DIRENT_HAVE_BYTESORT
+static struct dirent **make_reports(size_t n);
+#endif
+#ifdef _DIRENT_HAVE_NATSORT
+static char **make_photos(size_t n);
+static char **make_keys(char **names, size_t n);
+#endif
+static void free_names(void *list, size_t n);
+static int compare_strverscmp(const void *a, const void *b);
+#ifdef _DIRENT_HAVE_NATSORT
+static int compare_strcoll(const void *a, const void *b);
+static int compare_strcmp(const void *a, const void *b);
+static int compare_natcmp(const void *a, const void *b);
+#endif
+#ifdef _DIRENT_HAVE_BYTESORT
+static int compare_alphasort(const void *a, const void *b);
+static int compare_bytesort(const void *a, const void *b);
+#endif
+static double now(void);
+static void *allocate(size_t size);
+static int _main(int argc, char *argv[]);
+
+/* Options */
+static int repeat = 5;
+static const char *csv = NULL;
+
+/* Output file or NULL */
+static FILE *out = NULL;
+
+static int
+_main(int argc, char *argv[])
+{
+	/* Parse options */
+	int i = 1;
+	while (i + 1 < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-repeat") == 0) {
+			repeat = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-csv") == 0) {
+			csv = argv[i + 1];
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		i += 2;
+	}
+	if (i != argc || repeat < 1) {
+		fprintf(stderr, "Usage: b-sort [-repeat N] [-csv FILE]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (csv) {
+		out = fopen(csv, "w");
+		if (!out) {
+			fprintf(stderr, "Cannot create %s (%s)\n",
+				csv, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		fprintf(out, "name,names,best_ns,mean_ns\n");
+	}
+
+	/* Package names with version numbers */
+	srand(1);
+	char **packages = make_packages(20000);
+	run("strverscmp/packages", packages, 20000, compare_strverscmp);
+	free_names(packages, 20000);
+
+#ifdef _DIRENT_HAVE_NATSORT
+	/* Photos with numbers, sorted naturally and with keys */
+	char **photos = make_photos(100000);
+	run("strcoll/photos", photos, 100000, compare_strcoll);
+	run("natcmp/photos", photos, 100000, compare_natcmp);
+	char **keys = make_keys(photos, 100000);
+	run("natkey/photos", keys, 100000, compare_strcmp);
+	free_names(keys, 100000);
+	free_names(photos, 100000);
+#endif
+
+#ifdef _DIRENT_HAVE_BYTESORT
+	/* Directory entries in mixed case sorted in C locale */
+	struct dirent **reports = make_reports(1000000);
+	run("alphasort/reports", reports, 1000000, compare_alphasort);
+	run("bytesort/reports", reports, 1000000, compare_bytesort);
+
+	/* Sort with alphasort() in UTF-8 locale, if available */
+	if (setlocale(LC_COLLATE, ".utf8")
+		|| setlocale(LC_COLLATE, "C.UTF-8")
+		|| setlocale(LC_COLLATE, "en_US.UTF-8")) {
+		run("alphasort/reports/utf8", reports, 1000000,
+			compare_alphasort);
+		setlocale(LC_COLLATE, "C");
+	}
+	free_names(reports, 1000000);
+#endif
+
+	if (out && fclose(out) != 0) {
+		fprintf(stderr, "Cannot write %s\n", csv);
+		exit(EXIT_FAILURE);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Sort copy of list repeatedly and output the best result */
+static void
+run(const char *name, void *list, size_t n, compare_fn compare)
+{
+	void **sorted = (void**) allocate(n * sizeof(void*));
+
+	double best = 0;
+	double total = 0;
+	for (int i = 0; i <= repeat; i++) {
+		memcpy(sorted, list, n * sizeof(void*));
+		double start = now();
+		qsort(sorted, n, sizeof(void*), compare);
+		double t = now() - start;
+
+		/* First round warms up caches */
+		if (i == 0)
+			continue;
+		if (i == 1 || t < best)
+			best = t;
+		total += t;
+	}
+
+	/* Make sure that the list is in order */
+	for (size_t i = 1; i < n; i++) {
+		if (compare(&sorted[i - 1], &sorted[i]) > 0) {
+			fprintf(stderr, "Invalid order in %s\n", name);
+			exit(EXIT_FAILURE);
+		}
+	}
+	free(sorted);
+
+	double best_ns = best * 1e9 / (double) n;
+	double mean_ns = total * 1e9 / repeat / (double) n;
+	fprintf(stderr, "%-24s %10.1f ns\n", name, best_ns);
+	if (out) {
+		fprintf(out, "%s,%lu,%.1f,%.1f\n",
+			name, (unsigned long) n, best_ns, mean_ns);
+	}
+}
+
+/* Generate package names such as gcc-1.12.103.tar.gz */
+static char **
+make_packages(size_t n)
+{
+	static const char *names[] = {
+		"sane-backends", "libreoffice-core", "python3-numpy",
+		"linux-image", "gcc", "libstdc++", "openssl-libs", "zlib"
+	};
+	static const char *suffixes[] = {
+		".dat", ".tar.gz", "-1.el8.x86_64.rpm", "_amd64.deb"
+	};
+	char **packages = (char**) allocate(n * sizeof(char*));
+	for (size_t i = 0; i < n; i++) {
+		char tmp[100];
+		snprintf(tmp, sizeof(tmp), "%s-%d.%d.%d%s",
+			names[rand() % (sizeof(names) / sizeof(names[0]))],
+			rand() % 3, rand() % 20, rand() % 200,
+			suffixes[rand() % (sizeof(suffixes) / sizeof(suffixes[0]))]);
+		packages[i] = (char*) allocate(strlen(tmp) + 1);
+		strcpy(packages[i], tmp);
+	}
+	return packages;
+}
+
+#ifdef _DIRENT_HAVE_NATSORT
+/* Generate photo names such as IMG_1234-Holiday56.jpg */
+static char **
+make_photos(size_t n)
+{
+	char **photos = (char**) allocate(n * sizeof(char*));
+	for (size_t i = 0; i < n; i++) {
+		char tmp[100];
+		snprintf(tmp, sizeof(tmp), "IMG_%d-%s%d.jpg",
+			rand() % 10000, (rand() % 2) ? "Holiday" : "holiday",
+			rand() % 100);
+		photos[i] = (char*) allocate(strlen(tmp) + 1);
+		strcpy(photos[i], tmp);
+	}
+	return photos;
+}
+
+/* Compute sort keys of names so that strcmp gives the natural order */
+static char **
+make_keys(char **names, size_t n)
+{
+	char **keys = (char**) allocate(n * sizeof(char*));
+	for (size_t i = 0; i < n; i++) {
+		size_t size = DIRENT_NATKEY_SIZE(strlen(names[i]));
+		keys[i] = (char*) allocate(size);
+		dirent_natkey(keys[i], size, names[i], DIRENT_NAT_CASE);
+	}
+	return keys;
+}
+#endif
+
+#ifdef _DIRENT_HAVE_BYTESORT
+/*
+ * Generate directory entries such as Report-1234.txt.  Only allocate room
+ * for the name rather than the whole struct dirent to keep memory usage
+ * down.
+ */
+static struct dirent **
+make_reports(size_t n)
+{
+	struct dirent **reports = (struct dirent**) allocate(
+		n * sizeof(struct dirent*));
+	for (size_t i = 0; i < n; i++) {
+		char tmp[100];
+		snprintf(tmp, sizeof(tmp), "%c%s-%d.%s",
+			"aAbBzZ_"[rand() % 7],
+			(rand() % 2) ? "report" : "Report",
+			rand() % 100000, (rand() % 2) ? "txt" : "dat");
+		size_t k = strlen(tmp);
+		reports[i] = (struct dirent*) allocate(
+			offsetof(struct dirent, d_name) + k + 1);
+		memcpy(reports[i]->d_name, tmp, k + 1);
+	}
+	return reports;
+}
+#endif
+
+/* Release each item and the list */
+static void
+free_names(void *list, size_t n)
+{
+	void **items = (void**) list;
+	for (size_t i = 0; i < n; i++)
+		free(items[i]);
+	free(items);
+}
+
+static int
+compare_strverscmp(const void *a, const void *b)
+{
+	return strverscmp(*(char* const*) a, *(char* const*) b);
+}
+
+#ifdef _DIRENT_HAVE_NATSORT
+static int
+compare_strcoll(const void *a, const void *b)
+{
+	return strcoll(*(char* const*) a, *(char* const*) b);
+}
+
+static int
+compare_strcmp(const void *a, const void *b)
+{
+	return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+static int
+compare_natcmp(const void *a, const void *b)
+{
+	return dirent_natcmp(
+		*(char* const*) a, *(char* const*) b, DIRENT_NAT_CASE);
+}
+#endif
+
+#ifdef _DIRENT_HAVE_BYTESORT
+static int
+compare_alphasort(const void *a, const void *b)
+{
+	return alphasort((const struct dirent**) a, (const struct dirent**) b);
+}
+
+static int
+compare_bytesort(const void *a, const void *b)
+{
+	return bytesort((const struct dirent**) a, (const struct dirent**) b);
+}
+#endif
+
+/* Monotonic time in seconds */
+static double
+now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+#endif
+}
+
+/* Allocate memory or exit */
+static void *
+allocate(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+	if (!p) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return p;
+}
+
+int
+main(int argc, char *argv[])
+{
+	return _main(argc, argv);
+}
@@ -0,0 +1,260 @@
+/*
+ * Measure the cost of remembering visited files.
+ *
+ * Run
+ *
+ *     b-visited -keys 10000000
+ *
+ * to insert keys of device and file number to visited_set and to look them
+ * up again.  Results give the time per insertion, per successful lookup and
+ * per failed lookup in nanoseconds, and the number of bytes taken per key.
+ * Same measurements are made with std::unordered_set for comparison.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <chrono>
+#include <new>
+#include <unordered_set>
+#include <vector>
+#include <dirent.hpp>
+
+using namespace dirent_cxx;
+
+/* Key of std::unordered_set */
+struct file_key {
+	unsigned long long dev;
+	unsigned long long ino;
+
+	bool
+	operator==(const file_key &other) const noexcept
+	{
+		return dev == other.dev && ino == other.ino;
+	}
+};
+struct file_key_hash {
+	std::size_t
+	operator()(const file_key &k) const noexcept
+	{
+		return (std::size_t) (k.ino * 0x9e3779b97f4a7c15ULL) ^ k.dev;
+	}
+};
+
+static void run_visited(const char *name, const std::vector<file_key> &keys);
+static void run_unordered(const char *name, const std::vector<file_key> &keys);
+static void report(const char *name, const char *set, double insert_ns,
+	double hit_ns, double miss_ns, double bytes);
+static std::vector<file_key> make_keys(int random);
+static double now(void);
+static int _main(int argc, char *argv[]);
+
+/* Options */
+static std::size_t key_count = 1000000;
+static const char *csv = NULL;
+
+/* Output file or NULL */
+static FILE *out = NULL;
+
+/* Bytes allocated with operator new and not yet released */
+static std::size_t live_bytes = 0;
+
+void *
+operator new(std::size_t size)
+{
+	/* Keep size of block in front of block */
+	void *p = malloc(size + sizeof(std::max_align_t));
+	if (!p)
+		throw std::bad_alloc();
+	*(std::size_t*) p = size;
+	live_bytes += size;
+	return (char*) p + sizeof(std::max_align_t);
+}
+
+void
+operator delete(void *p) noexcept
+{
+	if (!p)
+		return;
+	char *q = (char*) p - sizeof(std::max_align_t);
+	live_bytes -= *(std::size_t*) q;
+	free(q);
+}
+
+void
+operator delete(void *p, std::size_t) noexcept
+{
+	operator delete(p);
+}
+
+static int
+_main(int argc, char *argv[])
+{
+	/* Parse options */
+	int i = 1;
+	while (i + 1 < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-keys") == 0) {
+			key_count = (std::size_t) atol(argv[i + 1]);
+		} else if (strcmp(argv[i], "-csv") == 0) {
+			csv = argv[i + 1];
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		i += 2;
+	}
+	if (i != argc || key_count < 1) {
+		fprintf(stderr, "Usage: b-visited [-keys N] [-csv FILE]\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (csv) {
+		out = fopen(csv, "w");
+		if (!out) {
+			fprintf(stderr, "Cannot create %s (%s)\n",
+				csv, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		fprintf(out, "keys,set,insert_ns,hit_ns,miss_ns,bytes_per_key\n");
+	}
+
+	/* File numbers in order of creation and scattered file numbers */
+	std::vector<file_key> keys = make_keys(0);
+	run_visited("sequential", keys);
+	run_unordered("sequential", keys);
+	keys = make_keys(1);
+	run_visited("random", keys);
+	run_unordered("random", keys);
+
+	if (out && fclose(out) != 0) {
+		fprintf(stderr, "Cannot write %s\n", csv);
+		exit(EXIT_FAILURE);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Insert and look up keys in visited_set */
+static void
+run_visited(const char *name, const std::vector<file_key> &keys)
+{
+	std::size_t before = live_bytes;
+	visited_set set;
+
+	double start = now();
+	for (const file_key &k : keys)
+		set.insert(k.dev, k.ino);
+	double t1 = now() - start;
+	double bytes = (double) (live_bytes - before) / (double) keys.size();
+
+	start = now();
+	std::size_t found = 0;
+	for (const file_key &k : keys)
+		found += set.contains(k.dev, k.ino);
+	double t2 = now() - start;
+
+	/* Keys differing in file number only */
+	start = now();
+	for (const file_key &k : keys)
+		found += set.contains(k.dev, ~k.ino);
+	double t3 = now() - start;
+
+	if (found != keys.size() || set.size() != keys.size()) {
+		fprintf(stderr, "Invalid result\n");
+		exit(EXIT_FAILURE);
+	}
+	double n = (double) keys.size();
+	report(name, "visited_set", t1 * 1e9 / n, t2 * 1e9 / n, t3 * 1e9 / n,
+		bytes);
+}
+
+/* Insert and look up keys in std::unordered_set for comparison */
+static void
+run_unordered(const char *name, const std::vector<file_key> &keys)
+{
+	std::size_t before = live_bytes;
+	std::unordered_set<file_key, file_key_hash> set;
+
+	double start = now();
+	for (const file_key &k : keys)
+		set.insert(k);
+	double t1 = now() - start;
+	double bytes = (double) (live_bytes - before) / (double) keys.size();
+
+	start = now();
+	std::size_t found = 0;
+	for (const file_key &k : keys)
+		found += set.count(k);
+	double t2 = now() - start;
+
+	start = now();
+	for (const file_key &k : keys)
+		found += set.count(file_key{ k.dev, ~k.ino });
+	double t3 = now() - start;
+
+	if (found != keys.size() || set.size() != keys.size()) {
+		fprintf(stderr, "Invalid result\n");
+		exit(EXIT_FAILURE);
+	}
+	double n = (double) keys.size();
+	report(name, "unordered_set", t1 * 1e9 / n, t2 * 1e9 / n, t3 * 1e9 / n,
+		bytes);
+}
+
+/* Output result to terminal and to CSV file */
+static void
+report(const char *name, const char *set, double insert_ns, double hit_ns,
+	double miss_ns, double bytes)
+{
+	fprintf(stderr, "%-10s %-13s %7.1f ns insert %7.1f ns hit"
+		" %7.1f ns miss %7.1f bytes/key\n",
+		name, set, insert_ns, hit_ns, miss_ns, bytes);
+	if (out) {
+		fprintf(out, "%s,%s,%.1f,%.1f,%.1f,%.1f\n",
+			name, set, insert_ns, hit_ns, miss_ns, bytes);
+	}
+}
+
+/* Unique keys on two devices */
+static std::vector<file_key>
+make_keys(int random)
+{
+	std::vector<file_key> keys;
+	keys.reserve(key_count);
+	unsigned long long x = 88172645463325252ULL;
+	for (std::size_t i = 0; i < key_count; i++) {
+		unsigned long long ino;
+		if (random) {
+			/* Xorshift with low bits replaced by index */
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			ino = (x & ~0xffffffffULL) | (unsigned long long) i;
+		} else {
+			ino = 1000 + i;
+		}
+		keys.push_back(file_key{ (unsigned long long) (i & 1) + 64769,
+			ino });
+	}
+	return keys;
+}
+
+/* Monotonic time in seconds */
+static double
+now(void)
+{
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int
+main(int argc, char *argv[])
+{
+	return _main(argc, argv);
+}
@@ -0,0 +1,344 @@
+/*
+ * Measure breadth-first walks with different budgets of open directories.
+ *
+ * Generate a directory tree with mktree first and then run
+ *
+ *     b-walk -budgets 1,2,4,16,64 tree
+ *
+ * to walk the tree with tree_walker once for each budget.  Results give the
+ * best time per entry in nanoseconds, the number of entries per second, the
+ * peak number of open directory streams, the peak number of directories
+ * waiting in the queue and the peak memory taken by the queue.  The last
+ * budget is measured once more with option unique, and the recursive
+ * coroutine walk() when the compiler supports C++20 coroutines.  For
+ * comparison, the tree is also walked with a plain recursive function
+ * calling opendir and readdir, and with
+ * std::filesystem::recursive_directory_iterator.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <dirent.hpp>
+
+using namespace dirent_cxx;
+
+static void run_budget(const char *dirname, std::size_t budget, bool unique);
+#ifdef DIRENT_CXX_HAVE_WALK
+static void run_recursive(const char *dirname);
+#endif
+static void run_loop(const char *dirname);
+static std::size_t walk_loop(std::string &path);
+static void run_iterator(const char *dirname);
+static void report(const char *name, double best, std::size_t entries,
+	const tree_walker::statistics *s);
+static double now(void);
+static int _main(int argc, char *argv[]);
+
+/* Options */
+static int repeat = 5;
+static const char *csv = NULL;
+static std::vector<std::size_t> budgets = { 1, 2, 4, 16, 64 };
+
+/* Output file or NULL */
+static FILE *out = NULL;
+
+static int
+_main(int argc, char *argv[])
+{
+	/* Parse options */
+	int i = 1;
+	while (i + 1 < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-repeat") == 0) {
+			repeat = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "-csv") == 0) {
+			csv = argv[i + 1];
+		} else if (strcmp(argv[i], "-budgets") == 0) {
+			/* Comma-separated list of budgets */
+			budgets.clear();
+			const char *p = argv[i + 1];
+			while (*p) {
+				char *end;
+				long k = strtol(p, &end, 10);
+				if (end == p || k < 1) {
+					fprintf(stderr, "Invalid budget %s\n", p);
+					exit(EXIT_FAILURE);
+				}
+				budgets.push_back((std::size_t) k);
+				p = *end == ',' ? end + 1 : end;
+			}
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		i += 2;
+	}
+	if (i + 1 != argc || repeat < 1 || budgets.empty()) {
+		fprintf(stderr, "Usage: b-walk [-repeat N] [-budgets N,N,...]"
+			" [-csv FILE] DIRECTORY\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (csv) {
+		out = fopen(csv, "w");
+		if (!out) {
+			fprintf(stderr, "Cannot create %s (%s)\n",
+				csv, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		fprintf(out, "name,best_ns,entries_per_s,max_open,"
+			"max_pending,queue_bytes\n");
+	}
+
+	/* Run benchmarks */
+	for (std::size_t budget : budgets)
+		run_budget(argv[i], budget, false);
+	run_budget(argv[i], budgets.back(), true);
+#ifdef DIRENT_CXX_HAVE_WALK
+	run_recursive(argv[i]);
+#endif
+	run_loop(argv[i]);
+	run_iterator(argv[i]);
+
+	if (out && fclose(out) != 0) {
+		fprintf(stderr, "Cannot write %s\n", csv);
+		exit(EXIT_FAILURE);
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Walk tree breadth-first repeatedly and output the best result.  Option
+ * unique detects hard-linked files and directories seen before.
+ */
+static void
+run_budget(const char *dirname, std::size_t budget, bool unique)
+{
+	double best = 0;
+	std::size_t entries = 0;
+	tree_walker::statistics s = tree_walker::statistics();
+	for (int i = 0; i <= repeat; i++) {
+		std::error_code ec;
+		double start = now();
+		walk_options options;
+		options.max_handles = budget;
+		options.unique = unique;
+		tree_walker walker(dirname, ec, options);
+		if (ec) {
+			fprintf(stderr, "Cannot open directory %s (%s)\n",
+				dirname, ec.message().c_str());
+			exit(EXIT_FAILURE);
+		}
+		std::size_t n = 0;
+		for (walk_entry &entry : walker) {
+			(void) entry;
+			n++;
+		}
+		double t = now() - start;
+
+		/* Stop rather than measure part of the tree */
+		if (walker.stats().errors != 0) {
+			fprintf(stderr, "Cannot open %lu directories of %s\n",
+				(unsigned long) walker.stats().errors, dirname);
+			exit(EXIT_FAILURE);
+		}
+
+		/* First round warms up caches */
+		if (i == 0)
+			continue;
+		if (i == 1 || t < best)
+			best = t;
+		entries = n;
+		s = walker.stats();
+	}
+
+	char name[64];
+	sprintf(name, "budget %lu%s", (unsigned long) budget,
+		unique ? " unique" : "");
+	report(name, best, entries, &s);
+}
+
+#ifdef DIRENT_CXX_HAVE_WALK
+/* Walk tree depth-first with coroutines for comparison */
+static void
+run_recursive(const char *dirname)
+{
+	double best = 0;
+	std::size_t entries = 0;
+	for (int i = 0; i <= repeat; i++) {
+		std::error_code ec;
+		double start = now();
+		std::size_t n = 0;
+		for (walk_entry &entry : walk(dirname, ec)) {
+			(void) entry;
+			n++;
+		}
+		double t = now() - start;
+		if (ec) {
+			fprintf(stderr, "Cannot walk %s (%s)\n",
+				dirname, ec.message().c_str());
+			exit(EXIT_FAILURE);
+		}
+		if (i == 0)
+			continue;
+		if (i == 1 || t < best)
+			best = t;
+		entries = n;
+	}
+	report("recursive walk", best, entries, NULL);
+}
+#endif
+
+/* Walk tree depth-first with opendir and readdir for comparison */
+static void
+run_loop(const char *dirname)
+{
+	double best = 0;
+	std::size_t entries = 0;
+	for (int i = 0; i <= repeat; i++) {
+		std::string path(dirname);
+		path.reserve(PATH_MAX + 1);
+		double start = now();
+		std::size_t n = walk_loop(path);
+		double t = now() - start;
+		if (i == 0)
+			continue;
+		if (i == 1 || t < best)
+			best = t;
+		entries = n;
+	}
+	report("readdir loop", best, entries, NULL);
+}
+
+/* Count entries in directory tree with a plain recursive function */
+static std::size_t
+walk_loop(std::string &path)
+{
+	/* Stop rather than measure part of the tree */
+	DIR *dir = opendir(path.c_str());
+	if (!dir) {
+		fprintf(stderr, "Cannot open directory %s (%s)\n",
+			path.c_str(), strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	std::size_t n = path.size();
+	path += '/';
+
+	std::size_t count = 0;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		const char *name = ent->d_name;
+		if (name[0] == '.' && (name[1] == '\0'
+			|| (name[1] == '.' && name[2] == '\0')))
+			continue;
+		count++;
+
+		/* Descend into sub-directory */
+		path.resize(n + 1);
+		path.append(name);
+		bool is_dir;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (ent->d_type != DT_UNKNOWN) {
+			is_dir = ent->d_type == DT_DIR;
+		} else
+#endif
+		{
+			struct stat st;
+			is_dir = stat(path.c_str(), &st) == 0
+				&& S_ISDIR(st.st_mode);
+		}
+		if (is_dir)
+			count += walk_loop(path);
+	}
+
+	path.resize(n);
+	closedir(dir);
+	return count;
+}
+
+/* Walk tree with the standard library for comparison */
+static void
+run_iterator(const char *dirname)
+{
+	double best = 0;
+	std::size_t entries = 0;
+	for (int i = 0; i <= repeat; i++) {
+		std::error_code ec;
+		double start = now();
+		std::size_t n = 0;
+		std::filesystem::recursive_directory_iterator it(dirname, ec);
+		std::filesystem::recursive_directory_iterator end;
+		for (; !ec && it != end; it.increment(ec))
+			n++;
+		double t = now() - start;
+		if (ec) {
+			fprintf(stderr, "Cannot walk %s (%s)\n",
+				dirname, ec.message().c_str());
+			exit(EXIT_FAILURE);
+		}
+		if (i == 0)
+			continue;
+		if (i == 1 || t < best)
+			best = t;
+		entries = n;
+	}
+	report("recursive_directory_iterator", best, entries, NULL);
+}
+
+/* Output result to terminal and to CSV file */
+static void
+report(const char *name, double best, std::size_t entries,
+	const tree_walker::statistics *s)
+{
+	if (entries == 0) {
+		fprintf(stderr, "No entries\n");
+		exit(EXIT_FAILURE);
+	}
+	double ns = best * 1e9 / (double) entries;
+	double rate = best > 0 ? (double) entries / best : 0;
+	unsigned long open = s ? (unsigned long) s->max_open : 0;
+	unsigned long pending = s ? (unsigned long) s->max_pending : 0;
+	unsigned long bytes = s ? (unsigned long) s->max_queue_bytes : 0;
+	fprintf(stderr, "%-28s %8.1f ns %12.0f entries/s %6lu open"
+		" %8lu pending %10lu bytes\n",
+		name, ns, rate, open, pending, bytes);
+	if (out) {
+		fprintf(out, "%s,%.1f,%.0f,%lu,%lu,%lu\n",
+			name, ns, rate, open, pending, bytes);
+	}
+}
+
+/* Monotonic time in seconds */
+static double
+now(void)
+{
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int
+main(int argc, char *argv[])
+{
+	/*
+	 * Use UTF-8 file names.  Other systems do not know locale ".utf8" so
+	 * convert file names with C.UTF-8 or the locale of the environment
+	 * there, keeping the C locale for sorting.
+	 */
+	if (!setlocale(LC_ALL, ".utf8") && !setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+	return _main(argc, argv);
+}
@@ -0,0 +1,392 @@
+/*
+ * Generate a reproducible directory tree for benchmarks.
+ *
+ * Command
+ *
+ *     mktree -fanout 10 -depth 3 -files 50 -seed 1 tree
+ *
+ * creates directory tree with 10 sub-directories in each directory down to
+ * three levels and 50 files in every directory.  The same options and seed
+ * always produce the same names and file sizes, so results measured on
+ * different computers and at different times can be compared.  Options
+ *
+ *     -name MIN:MAX     Length of names in characters (default 4:24)
+ *     -unicode PERCENT  Share of names with non-ASCII characters (default 10)
+ *     -size MIN:MAX     Size of files in bytes (default 0:4096)
+ *
+ * control the names and sizes.  File sizes are distributed evenly on a
+ * logarithmic scale so that most files are small.  The options are saved
+ * to file .mktree in the root of the tree and running the command again
+ * with the same options does nothing.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <locale.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifdef _WIN32
+#	include <direct.h>
+#	define mkdir(path, mode) _mkdir(path)
+#endif
+
+/* Name of file holding options */
+#define STAMP ".mktree"
+
+static int make_directory(char *path, size_t n, int level);
+static int make_file(const char *path);
+static size_t make_name(char *buffer, int dir);
+static unsigned long random_between(unsigned long lo, unsigned long hi);
+static uint64_t next_random(void);
+static int parse_range(const char *s, unsigned long *lo, unsigned long *hi);
+static int check_stamp(const char *dirname, const char *options);
+static int _main(int argc, char *argv[]);
+
+/* Options */
+static unsigned long fanout = 10;
+static unsigned long depth = 3;
+static unsigned long files = 50;
+static unsigned long name_min = 4;
+static unsigned long name_max = 24;
+static unsigned long unicode = 10;
+static unsigned long size_min = 0;
+static unsigned long size_max = 4096;
+static unsigned long seed = 1;
+
+/* Random number generator state */
+static uint64_t state;
+
+/* Statistics */
+static unsigned long dirs_created = 0;
+static unsigned long files_created = 0;
+static unsigned long long bytes_written = 0;
+
+/* Non-ASCII characters in UTF-8 */
+static const char *const unicode_chars[] = {
+	"\xC3\xA4", "\xC3\xB6", "\xC3\xA5", "\xC3\xB1", "\xC3\xA9", "\xC3\x9F",
+	"\xCE\xA9", "\xD0\x96", "\xE6\x97\xA5", "\xE6\x9C\xAC",
+	"\xE2\x82\xAC", "\xF0\x9F\x90\xAC",
+};
+
+/* ASCII characters safe on all file systems */
+static const char ascii_chars[] =
+	"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-.";
+
+int
+_main(int argc, char *argv[])
+{
+	/* Parse options */
+	int i = 1;
+	while (i < argc && argv[i][0] == '-') {
+		const char *opt = argv[i];
+		const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+		int ok = val != NULL;
+		if (!ok) {
+			/*NOP*/;
+		} else if (strcmp(opt, "-fanout") == 0) {
+			fanout = strtoul(val, NULL, 10);
+		} else if (strcmp(opt, "-depth") == 0) {
+			depth = strtoul(val, NULL, 10);
+		} else if (strcmp(opt, "-files") == 0) {
+			files = strtoul(val, NULL, 10);
+		} else if (strcmp(opt, "-name") == 0) {
+			ok = parse_range(val, &name_min, &name_max)
+				&& name_min > 0 && name_max < 200;
+		} else if (strcmp(opt, "-unicode") == 0) {
+			unicode = strtoul(val, NULL, 10);
+			ok = unicode <= 100;
+		} else if (strcmp(opt, "-size") == 0) {
+			ok = parse_range(val, &size_min, &size_max);
+		} else if (strcmp(opt, "-seed") == 0) {
+			seed = strtoul(val, NULL, 10);
+		} else {
+			ok = 0;
+		}
+		if (!ok) {
+			fprintf(stderr, "Invalid option %s\n", opt);
+			exit(EXIT_FAILURE);
+		}
+		i += 2;
+	}
+	if (i + 1 != argc) {
+		fprintf(stderr,
+			"Usage: mktree [-fanout N] [-depth N] [-files N]"
+			" [-name MIN:MAX]\n"
+			"              [-unicode PERCENT] [-size MIN:MAX] [-seed N]"
+			" DIRECTORY\n");
+		exit(EXIT_FAILURE);
+	}
+	const char *dirname = argv[i];
+
+	/* Do nothing if tree was generated with the same options */
+	char options[256];
+	sprintf(options,
+		"fanout=%lu depth=%lu files=%lu name=%lu:%lu unicode=%lu"
+		" size=%lu:%lu seed=%lu\n",
+		fanout, depth, files, name_min, name_max, unicode,
+		size_min, size_max, seed);
+	switch (check_stamp(dirname, options)) {
+	case 1:
+		printf("Tree %s is up to date\n", dirname);
+		return EXIT_SUCCESS;
+	case -1:
+		fprintf(stderr,
+			"Directory %s exists with different options\n", dirname);
+		return EXIT_FAILURE;
+	default:
+		break;
+	}
+
+	/* Create root directory */
+	if (mkdir(dirname, 0777) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Cannot create %s (%s)\n",
+			dirname, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	/* Generate tree */
+	state = seed * 0x9E3779B97F4A7C15ull + 1;
+	static char path[PATH_MAX + 2];
+	size_t n = strlen(dirname);
+	if (n + 1 > PATH_MAX) {
+		fprintf(stderr, "Path too long %s\n", dirname);
+		return EXIT_FAILURE;
+	}
+	memcpy(path, dirname, n + 1);
+	if (!make_directory(path, n, 0))
+		return EXIT_FAILURE;
+
+	/* Mark tree complete */
+	memcpy(path + n, "/" STAMP, sizeof(STAMP) + 1);
+	FILE *fp = fopen(path, "w");
+	if (!fp || fputs(options, fp) < 0 || fclose(fp) != 0) {
+		fprintf(stderr, "Cannot write %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	printf("Created %lu directories and %lu files with %llu bytes\n",
+		dirs_created, files_created, bytes_written);
+	return EXIT_SUCCESS;
+}
+
+/* Fill directory in path[0 ... n - 1] with files and sub-directories */
+static int
+make_directory(char *path, size_t n, int level)
+{
+	path[n++] = '/';
+
+	/* Create files */
+	for (unsigned long i = 0; i < files; i++) {
+		size_t k;
+		int retry = 0;
+		int ok;
+		do {
+			k = make_name(path + n, 0);
+			if (n + k > PATH_MAX) {
+				fprintf(stderr, "Path too long %s\n", path);
+				return /*failure*/ 0;
+			}
+			ok = make_file(path);
+		} while (!ok && errno == EEXIST && ++retry < 100);
+		if (!ok) {
+			fprintf(stderr, "Cannot create %s (%s)\n",
+				path, strerror(errno));
+			return /*failure*/ 0;
+		}
+	}
+
+	/* Create sub-directories recursively */
+	if ((unsigned long) level >= depth)
+		return /*success*/ 1;
+	for (unsigned long i = 0; i < fanout; i++) {
+		size_t k;
+		int retry = 0;
+		int ok;
+		do {
+			k = make_name(path + n, 1);
+			if (n + k > PATH_MAX) {
+				fprintf(stderr, "Path too long %s\n", path);
+				return /*failure*/ 0;
+			}
+			ok = mkdir(path, 0777) == 0;
+		} while (!ok && errno == EEXIST && ++retry < 100);
+		if (!ok) {
+			fprintf(stderr, "Cannot create %s (%s)\n",
+				path, strerror(errno));
+			return /*failure*/ 0;
+		}
+		dirs_created++;
+
+		if (!make_directory(path, n + k, level + 1))
+			return /*failure*/ 0;
+	}
+	return /*success*/ 1;
+}
+
+/* Create file with random size or return 0 with errno set */
+static int
+make_file(const char *path)
+{
+	/* Mode x fails if file exists */
+	FILE *fp = fopen(path, "wbx");
+	if (!fp)
+		return /*failure*/ 0;
+
+	/* Choose number of bits first so that sizes are even on log scale */
+	int lo = 0;
+	while ((size_min + 1) >> (lo + 1))
+		lo++;
+	int hi = 0;
+	while ((size_max + 1) >> (hi + 1))
+		hi++;
+	unsigned long bits = random_between((unsigned long) lo,
+		(unsigned long) hi);
+	unsigned long size = random_between(1ul << bits,
+		(2ul << bits) - 1) - 1;
+	if (size < size_min)
+		size = size_min;
+	if (size > size_max)
+		size = size_max;
+
+	static char block[4096];
+	if (block[0] != 'x')
+		memset(block, 'x', sizeof(block));
+	unsigned long left = size;
+	while (left > 0) {
+		size_t k = left < sizeof(block) ? left : sizeof(block);
+		fwrite(block, 1, k, fp);
+		left -= (unsigned long) k;
+	}
+	if (fclose(fp) != 0) {
+		fprintf(stderr, "Cannot write %s (%s)\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	files_created++;
+	bytes_written += size;
+	return /*success*/ 1;
+}
+
+/* Generate random name to buffer and return its length in bytes */
+static size_t
+make_name(char *buffer, int dir)
+{
+	unsigned long len = random_between(name_min, name_max);
+	int wide = random_between(1, 100) <= unicode;
+	size_t n = 0;
+
+	for (unsigned long i = 0; i < len; i++) {
+		/* First and last character are alphanumeric */
+		unsigned long max = sizeof(ascii_chars) - 2;
+		if (i == 0 || i + 1 == len)
+			max -= 3;
+
+		if (wide && (i == 0 || random_between(0, 3) == 0)) {
+			/* Non-ASCII character */
+			const char *c = unicode_chars[random_between(0,
+				sizeof(unicode_chars) / sizeof(unicode_chars[0]) - 1)];
+			size_t k = strlen(c);
+			memcpy(buffer + n, c, k);
+			n += k;
+		} else {
+			buffer[n++] = ascii_chars[random_between(0, max)];
+		}
+	}
+
+	/* Give directories a recognizable suffix */
+	if (dir) {
+		memcpy(buffer + n, ".d", 2);
+		n += 2;
+	}
+
+	buffer[n] = '\0';
+	return n;
+}
+
+/* Random integer lo ... hi */
+static unsigned long
+random_between(unsigned long lo, unsigned long hi)
+{
+	return lo + (unsigned long) (next_random() % (hi - lo + 1));
+}
+
+/* Next number from xorshift64* generator */
+static uint64_t
+next_random(void)
+{
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545F4914F6CDD1Dull;
+}
+
+/* Parse range MIN:MAX */
+static int
+parse_range(const char *s, unsigned long *lo, unsigned long *hi)
+{
+	char *end;
+	*lo = strtoul(s, &end, 10);
+	if (*end != ':')
+		return /*failure*/ 0;
+	*hi = strtoul(end + 1, &end, 10);
+	return *end == '\0' && *lo <= *hi;
+}
+
+/*
+ * Returns 1 if tree exists with the same options, -1 if directory exists
+ * with different options and 0 if directory does not exist or is empty.
+ */
+static int
+check_stamp(const char *dirname, const char *options)
+{
+	DIR *dir = opendir(dirname);
+	if (!dir)
+		return 0;
+	int empty = 1;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (strcmp(ent->d_name, ".") != 0
+			&& strcmp(ent->d_name, "..") != 0) {
+			empty = 0;
+			break;
+		}
+	}
+	closedir(dir);
+	if (empty)
+		return 0;
+
+	char path[PATH_MAX + 2];
+	if (strlen(dirname) + sizeof(STAMP) + 1 > sizeof(path))
+		return -1;
+	sprintf(path, "%s/%s", dirname, STAMP);
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	char line[256];
+	int same = fgets(line, sizeof(line), fp) != NULL
+		&& strcmp(line, options) == 0;
+	fclose(fp);
+	return same ? 1 : -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	/*
+	 * Use UTF-8 file names.  Other systems do not know locale ".utf8" so
+	 * convert file names with C.UTF-8 or the locale of the environment
+	 * there, keeping the C locale for sorting.
+	 */
+	if (!setlocale(LC_ALL, ".utf8") && !setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+	return _main(argc, argv);
+}
@@ -1,13 +1,28 @@
 /*
  * This example code is written by AFASSI Mohamed
  *
- * It uses the Dirent library to search for files with specific extension in a
- * directory.  In this example I just print out the files found but instead
- * you could manipulate them.  For i.e. I used this script in a project to
- * find csv files and format them into Binary files
+ * It uses the Dirent library to search for files with specific extensions
+ * in a directory tree.  In this example I just print out the files found
+ * but instead you could manipulate them.  For i.e. I used this script in a
+ * project to find csv files and format them into Binary files
  *
  * Compile this file with Visual Studio and run the produced command in
- * console with an extension name and directory name argument.
+ * console with a comma-separated list of extensions and directory names.
+ * For example, command
+ *
+ *     extension_lookup csv,tsv,.txt c:\data
+ *
+ * outputs all files in c:\data and its sub-directories whose name ends in
+ * .csv, .tsv or .txt.  Long lists of extensions can be read from a file
+ * with option -f, one extension per line.  Option -i matches extensions
+ * regardless of case.
+ *
+ * Extensions are stored in an open addressing hash set.  For each file,
+ * the program locates the final suffix of the file name and looks it up
+ * in the set without copying or modifying the directory entry, so the
+ * time spent per file does not depend on the number of extensions.
+ * Option -naive splits each name with strtok and compares the extension
+ * against every extension in turn for comparison.
  *
  * Copyright (C) 1998-2019 Toni Ronkko
  * This file is part of dirent.  Dirent may be freely distributed
@@ -18,53 +33,400 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include <iostream>
 #include <fstream>
-#include <sstream>
+#include <string>
 #include <vector>
 #include <dirent.h>
 #include <stdio.h>
-#include <cstring>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#	define stat _stat64
+#	define strcasecmp _stricmp
+#endif
+
+/* Length of file name in directory entry */
+#ifndef _D_EXACT_NAMLEN
+#	define _D_EXACT_NAMLEN(p) strlen((p)->d_name)
+#endif
 
 using namespace std;
 
+/* Set of file name extensions */
+class extension_set {
+public:
+	explicit extension_set(bool fold);
+	void insert(const char *ext, size_t n);
+	bool contains(const char *ext, size_t n) const;
+	size_t size() const { return count; }
+	const string &at(size_t i) const { return list[i]; }
+
+private:
+	/* Slot of hash table, zero length marks empty slot */
+	struct slot {
+		unsigned long hash;
+		size_t offset;
+		size_t length;
+	};
+
+	unsigned long hash(const char *s, size_t n) const;
+	bool equal(const slot &s, const char *ext, size_t n) const;
+	void grow();
+	char lower(char c) const;
+
+	bool fold;
+	vector<char> chars;
+	vector<slot> slots;
+	vector<string> list;
+	size_t count;
+	size_t longest;
+};
+
+static bool find_directory(const string &dirname);
+static bool find_files(string &path);
+static bool is_directory(const string &path, const struct dirent *ent);
+static void add_extensions(const string &list);
+static bool read_extensions(const char *filename);
+static bool match_naive(const struct dirent *ent);
+static bool match_hash(const struct dirent *ent);
+
+/* Options */
+static bool ignore_case = false;
+static bool naive = false;
+
+/* Extensions to search for */
+static extension_set *extensions;
+
 int
 main(int argc, char *argv[])
 {
-    string directory, extension;
-
-    DIR *di;
-    char *ptr1, *ptr2;
-    int retn;
-    struct dirent *dir;
-
-    cout << "What extension you search for? ";
-    cin >> extension;
-
-    cout << "Directory where you want to search for " + extension + " extension : ";
-    cin >> directory;
-
-    size_t length = directory.length();
-    char *char_array = new char[length + 1];
-    strcpy(char_array, directory.c_str());
-
-    size_t length2 = extension.length();
-    char *char_array2 = new char[length2 + 1];
-    strcpy(char_array2, extension.c_str());
-
-    di = opendir(char_array); //specify the directory name
-    if (!di) {
-        return 3;
-    }
-    while ((dir = readdir(di)) != NULL) {
-        ptr1 = strtok(dir->d_name, ".");
-        ptr2 = strtok(NULL, ".");
-        if (ptr2 != NULL) {
-            retn = strcmp(ptr2, char_array2);
-            if (retn == 0) {
-                cout << ptr1 << "\n";
-            }
-        }
-    }
-    closedir(di);
-    return 0;
+	/* Parse options */
+	int i = 1;
+	const char *filename = NULL;
+	while (i < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-i") == 0) {
+			ignore_case = true;
+		} else if (strcmp(argv[i], "-naive") == 0) {
+			naive = true;
+		} else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			filename = argv[++i];
+		} else {
+			cerr << "Invalid option " << argv[i] << endl;
+			return EXIT_FAILURE;
+		}
+		i++;
+	}
+
+	/* Collect extensions */
+	extension_set set(ignore_case);
+	extensions = &set;
+	if (filename) {
+		if (!read_extensions(filename))
+			return EXIT_FAILURE;
+	} else if (i < argc) {
+		add_extensions(argv[i++]);
+	}
+	if (set.size() == 0) {
+		cerr << "Usage: extension_lookup [-i] [-naive] "
+			<< "(-f file | ext[,ext...]) [directory...]" << endl;
+		return EXIT_FAILURE;
+	}
+
+	/* Output matches in large blocks */
+	static char buffer[65536];
+	setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+	/* Search each directory in command line or the current directory */
+	int status = EXIT_SUCCESS;
+	if (i == argc) {
+		if (!find_directory("."))
+			status = EXIT_FAILURE;
+	}
+	while (i < argc) {
+		if (!find_directory(argv[i]))
+			status = EXIT_FAILURE;
+		i++;
+	}
+
+	fflush(stdout);
+	return status;
+}
+
+/* Search directory tree */
+static bool
+find_directory(const string &dirname)
+{
+	/* Path grows and shrinks in place as the tree is traversed */
+	string path(dirname);
+	path.reserve(PATH_MAX + 1);
+	return find_files(path);
+}
+
+/* Output matching files in directory and descend into sub-directories */
+static bool
+find_files(string &path)
+{
+	DIR *dir = opendir(path.c_str());
+	if (!dir) {
+		cerr << "Cannot open " << path << " (" << strerror(errno)
+			<< ")" << endl;
+		return false;
+	}
+
+	/* Append directory separator if not already there */
+	size_t n = path.size();
+	if (n > 0 && path[n - 1] != '/' && path[n - 1] != '\\'
+		&& path[n - 1] != ':') {
+		path += '/';
+		n++;
+	}
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		/* Skip current and parent directory */
+		const char *name = ent->d_name;
+		if (name[0] == '.' && (name[1] == '\0'
+			|| (name[1] == '.' && name[2] == '\0')))
+			continue;
+
+		/* Output file if extension matches */
+		bool matches = naive ? match_naive(ent) : match_hash(ent);
+		if (matches) {
+			fwrite(path.data(), 1, n, stdout);
+			fputs(name, stdout);
+			fputc('\n', stdout);
+		}
+
+		/* Descend into sub-directory */
+		if (ent->d_type == DT_DIR || ent->d_type == DT_UNKNOWN) {
+			path.append(name);
+			if (is_directory(path, ent))
+				find_files(path);
+			path.resize(n);
+		}
+	}
+
+	closedir(dir);
+	return true;
+}
+
+/* Returns true if directory entry refers to a directory */
+static bool
+is_directory(const string &path, const struct dirent *ent)
+{
+	if (ent->d_type == DT_DIR)
+		return true;
+
+	/* Some file systems do not report file type in directory entry */
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+	return S_ISDIR(st.st_mode);
+}
+
+/* Add comma-separated extensions */
+static void
+add_extensions(const string &list)
+{
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t end = list.find(',', start);
+		if (end == string::npos)
+			end = list.size();
+
+		/* Leading dot is optional */
+		size_t first = start;
+		if (first < end && list[first] == '.')
+			first++;
+		if (first < end)
+			extensions->insert(list.data() + first, end - first);
+
+		start = end + 1;
+	}
+}
+
+/* Read extensions from file, one or more per line */
+static bool
+read_extensions(const char *filename)
+{
+	ifstream in(filename);
+	if (!in) {
+		cerr << "Cannot open " << filename << " (" << strerror(errno)
+			<< ")" << endl;
+		return false;
+	}
+
+	string line;
+	while (getline(in, line)) {
+		/* Remove carriage return and ignore comments */
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.resize(line.size() - 1);
+		if (line.empty() || line[0] == '#')
+			continue;
+		add_extensions(line);
+	}
+	return true;
+}
+
+/* Look up final suffix of file name in hash set */
+static bool
+match_hash(const struct dirent *ent)
+{
+	/* Find the last dot without modifying the name */
+	const char *name = ent->d_name;
+	size_t n = _D_EXACT_NAMLEN(ent);
+	size_t k = n;
+	while (k > 0 && name[k - 1] != '.')
+		k--;
+
+	/* Name without dot or starting with the only dot has no extension */
+	if (k <= 1)
+		return false;
+	return extensions->contains(name + k, n - k);
+}
+
+/* Split file name with strtok and compare extension to every entry */
+static bool
+match_naive(const struct dirent *ent)
+{
+	char buffer[PATH_MAX + 1];
+	strcpy(buffer, ent->d_name);
+
+	/* Name starting with the only dot has no extension */
+	if (buffer[0] == '.' && strchr(buffer + 1, '.') == NULL)
+		return false;
+
+	/* Find the final part of name */
+	char *last = NULL;
+	char *p = strtok(buffer, ".");
+	while (p != NULL) {
+		last = p;
+		p = strtok(NULL, ".");
+	}
+	if (last == NULL || last == buffer)
+		return false;
+
+	/* Compare against each extension */
+	for (size_t i = 0; i < extensions->size(); i++) {
+		const string &ext = extensions->at(i);
+		int cmp = ignore_case
+			? strcasecmp(last, ext.c_str())
+			: strcmp(last, ext.c_str());
+		if (cmp == 0)
+			return true;
+	}
+	return false;
+}
+
+extension_set::extension_set(bool fold)
+	: fold(fold), slots(64), count(0), longest(0)
+{
+	for (size_t i = 0; i < slots.size(); i++)
+		slots[i].length = 0;
+}
+
+/* Add extension to set */
+void
+extension_set::insert(const char *ext, size_t n)
+{
+	if (contains(ext, n))
+		return;
+
+	/* Keep the table at most half full */
+	if ((count + 1) * 2 > slots.size())
+		grow();
+
+	/* Store extension in lower case if case is ignored */
+	slot s;
+	s.hash = hash(ext, n);
+	s.offset = chars.size();
+	s.length = n;
+	for (size_t i = 0; i < n; i++)
+		chars.push_back(lower(ext[i]));
+	list.push_back(string(chars.data() + s.offset, n));
+
+	size_t mask = slots.size() - 1;
+	size_t k = s.hash & mask;
+	while (slots[k].length != 0)
+		k = (k + 1) & mask;
+	slots[k] = s;
+	count++;
+	if (n > longest)
+		longest = n;
+}
+
+/* Returns true if extension is in set */
+bool
+extension_set::contains(const char *ext, size_t n) const
+{
+	/* Reject extensions longer than any in set without hashing */
+	if (n == 0 || n > longest)
+		return false;
+
+	unsigned long h = hash(ext, n);
+	size_t mask = slots.size() - 1;
+	size_t k = h & mask;
+	while (slots[k].length != 0) {
+		if (slots[k].hash == h && equal(slots[k], ext, n))
+			return true;
+		k = (k + 1) & mask;
+	}
+	return false;
+}
+
+/* Compute FNV-1a hash of extension */
+unsigned long
+extension_set::hash(const char *s, size_t n) const
+{
+	unsigned long h = 2166136261UL;
+	for (size_t i = 0; i < n; i++) {
+		h ^= (unsigned char) lower(s[i]);
+		h = (h * 16777619UL) & 0xffffffffUL;
+	}
+	return h;
+}
+
+/* Compare stored extension to candidate */
+bool
+extension_set::equal(const slot &s, const char *ext, size_t n) const
+{
+	if (s.length != n)
+		return false;
+	const char *p = chars.data() + s.offset;
+	for (size_t i = 0; i < n; i++) {
+		if (p[i] != lower(ext[i]))
+			return false;
+	}
+	return true;
+}
+
+/* Double the size of hash table */
+void
+extension_set::grow()
+{
+	vector<slot> old;
+	old.swap(slots);
+	slots.resize(old.size() * 2);
+	for (size_t i = 0; i < slots.size(); i++)
+		slots[i].length = 0;
+
+	size_t mask = slots.size() - 1;
+	for (size_t i = 0; i < old.size(); i++) {
+		if (old[i].length == 0)
+			continue;
+		size_t k = old[i].hash & mask;
+		while (slots[k].length != 0)
+			k = (k + 1) & mask;
+		slots[k] = old[i];
+	}
+}
+
+/* Convert ASCII letter to lower case if case is ignored */
+char
+extension_set::lower(char c) const
+{
+	if (fold && c >= 'A' && c <= 'Z')
+		return (char) (c - 'A' + 'a');
+	return c;
 }
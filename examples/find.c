@@ -1,5 +1,5 @@
 /*
- * List files and directories recursively.
+ * Find files and directories recursively.
  *
  * Compile this file with Visual Studio and run the produced command in
  * console with a directory name argument.  For example, command
@@ -8,6 +8,7 @@
  *
  * will output thousands of file names such as
  *
+ *     c:\Program Files/7-Zip
  *     c:\Program Files/7-Zip/7-zip.chm
  *     c:\Program Files/7-Zip/7-zip.dll
  *     c:\Program Files/7-Zip/7z.dll
@@ -16,9 +17,59 @@
  *     c:\Program Files/Windows NT/Accessories/wordpad.exe
  *     c:\Program Files/Windows NT/Accessories/write.wpc
  *
- * The find command provided by this file is only an example: the command does
- * not provide options to restrict the output to certain files as the Linux
- * version does.
+ * Directory names may be followed by an expression which selects the
+ * files to output as in the Linux version.  The expression may consist
+ * of the following primaries combined with operators ( ), !, -a and -o.
+ *
+ *     -name PATTERN   File name matches pattern
+ *     -path PATTERN   Path name matches pattern
+ *     -rules FILE     File matches any pattern listed in FILE
+ *     -type C         File is of type C (f, d, l, b, c, p or s)
+ *     -size [+-]N     File size is N blocks of 512 bytes, or N bytes,
+ *                     kilobytes, megabytes or gigabytes with suffix c, k,
+ *                     M or G, respectively
+ *     -mtime [+-]N    File was last modified N days ago
+ *     -newer FILE     File was modified more recently than FILE
+ *     -prune          Do not descend into directory
+ *     -print          Output path name
+ *
+ * Numbers preceded by + and - mean greater than and less than N,
+ * respectively.  Patterns may contain wild-cards * and ? which match any
+ * number of characters and exactly one character, respectively.  For
+ * example, command
+ *
+ *     find -i "C:\Program Files" -name .git -prune -o -type f -size +1M ( -name "*.dll" -o -name "*.exe" )
+ *
+ * outputs DLL and EXE files larger than one megabyte regardless of case,
+ * skipping Git repositories.  The rules file contains one pattern per
+ * line.  Patterns containing a slash are matched against the full path of
+ * the file, as with -path, and other patterns are matched against the
+ * file name.
+ *
+ * The expression is compiled into a plan before searching.  Operands of
+ * -a and -o are reordered such that file name and type predicates, which
+ * only need the directory entry, are evaluated before predicates which
+ * need to stat the file.  Predicates are never moved across -print or
+ * -prune, though.  Hence, a file is only stat'ed when a cheap predicate
+ * cannot decide the outcome.
+ *
+ * Alternative name patterns are compiled into a single Aho-Corasick
+ * automaton which tests a file name against every pattern in one pass.
+ * Literal patterns with optional leading or trailing asterisks, such as
+ * file extensions, are matched by the automaton directly.  Other
+ * patterns are represented in the automaton by their longest literal
+ * part, and only patterns whose literal occurs in the file name are
+ * verified with a non-backtracking matcher.  Thus, matching time grows
+ * with the length of the file name rather than the number of patterns.
+ *
+ * Options -i, -naive and -stats may precede directory names.  Option -i
+ * matches patterns regardless of case.  Option -naive evaluates the
+ * expression as given, stats every file and tests patterns one by one
+ * for comparison.  Option -stats prints the plan, the number of stat
+ * calls and timing information.
+ *
+ * The find command provided by this file is only an example: the command
+ * does not provide all the options of the Linux version.
  *
  * Copyright (C) 1998-2019 Toni Ronkko
  * This file is part of dirent.  Dirent may be freely distributed
@@ -32,28 +83,326 @@
 #include <dirent.h>
 #include <errno.h>
 #include <locale.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#	define stat _stat64
+#	define lstat _stat64
+#endif
+
+/* Kinds of literal patterns */
+#define LIT_EXACT 1
+#define LIT_PREFIX 2
+#define LIT_SUFFIX 4
+#define LIT_CONTAINS 8
+
+/* Operators and primaries of expression */
+#define OP_AND 1
+#define OP_OR 2
+#define OP_NOT 3
+#define OP_NAME 4
+#define OP_PATH 5
+#define OP_MATCH 6
+#define OP_TYPE 7
+#define OP_SIZE 8
+#define OP_MTIME 9
+#define OP_NEWER 10
+#define OP_PRUNE 11
+#define OP_PRINT 12
+
+/* Relative cost of evaluating primaries */
+#define COST_ENTRY 1
+#define COST_STAT 100
+
+/*
+ * Aho-Corasick automaton for literal patterns name, name*, *name and
+ * *name*, and for required literals of patterns with wild-cards.
+ */
+struct automaton {
+	/* Byte classes: bytes not occurring in patterns map to zero */
+	unsigned char cls[256];
+	int nclasses;
+
+	/* Transition table indexed by node * nclasses + class */
+	int *next;
+
+	/* LIT_* flags, distance from root and failure link of each node */
+	unsigned char *flags;
+	int *depth;
+	int *fail;
+	int nodes;
+
+	/*
+	 * Wild-card patterns whose required literal ends at node n are
+	 * outputs[first[n]] ... outputs[first[n + 1] - 1].  Report[n] is
+	 * the nearest node on the failure chain of n which has outputs.
+	 */
+	int *first;
+	int *outputs;
+	int *report;
+};
+
+/* Set of patterns */
+struct matcher {
+	/* Patterns as given by the user */
+	char **rules;
+	size_t nrules;
+	size_t maxrules;
+
+	/* Literal patterns without asterisks */
+	char **literals;
+	int *kinds;
+	size_t nliterals;
+
+	/* Patterns with wild-cards in the middle */
+	char **globs;
+	size_t nglobs;
+
+	/* Wild-card patterns without required literal such as ?* */
+	int *always;
+	size_t nalways;
 
+	/* Marks patterns verified for the current name */
+	unsigned *seen;
+	unsigned stamp;
+
+	/* Compiled automaton */
+	struct automaton ac;
+};
+
+/* Node of expression */
+struct node {
+	/* OP_* code */
+	int op;
+
+	/* Operands of OP_AND, OP_OR and OP_NOT */
+	struct node **kids;
+	int nkids;
+
+	/* Pattern of OP_NAME and OP_PATH */
+	char *pattern;
+
+	/* Patterns of OP_MATCH and whether they apply to path */
+	struct matcher *matcher;
+	int path;
+
+	/* File type of OP_TYPE */
+	int type;
+
+	/* Comparison of OP_SIZE and OP_MTIME: -1 less, 0 equal, +1 more */
+	int sign;
+	long long value;
+	long long unit;
+
+	/* Modification time of OP_NEWER */
+	time_t time;
+	long nsec;
+
+	/* Estimated cost and whether node has side effects */
+	int cost;
+	int effects;
+};
+
+/* File being evaluated */
+struct entry {
+	/* Path name and file name */
+	const char *path;
+	const char *name;
+
+	/* DT_* type from directory entry or DT_UNKNOWN */
+	int type;
+
+	/* File status: 0 if not retrieved yet, 1 if valid, -1 on error */
+	struct stat st;
+	int status;
+
+	/* True if directory should not be descended into */
+	int prune;
+};
+
+static int find_path(const char *path);
 static int find_directory(const char *dirname);
+static struct node *parse_or(void);
+static struct node *parse_and(void);
+static struct node *parse_unary(void);
+static struct node *parse_primary(void);
+static const char *parse_argument(const char *option);
+static void parse_number(struct node *n, const char *s, int size);
+static struct node *new_node(int op);
+static void add_kid(struct node *n, struct node *kid);
+static int has_print(const struct node *n);
+static struct node *plan(struct node *n);
+static void merge_patterns(struct node *n, int op);
+static void print_plan(const struct node *n);
+static void free_node(struct node *n);
+static int evaluate(const struct node *n, struct entry *e);
+static int entry_stat(struct entry *e);
+static long mtime_nsec(const struct stat *st);
+static int entry_type(struct entry *e);
+static struct node *read_rules(const char *filename);
+static int match_naive(const char *patt, const char *name);
+static int match_glob(const char *patt, const char *name);
+static int match_segment(const char *patt, const char *name, size_t k);
+static int fold(int c);
+static void *allocate(size_t size);
+static void *reallocate(void *p, size_t size);
+static void matcher_add(struct matcher *m, const char *pattern);
+static void matcher_compile(struct matcher *m);
+static int matcher_match(struct matcher *m, const char *name);
+static int matcher_verify(struct matcher *m, int id, const char *name);
+static void matcher_free(struct matcher *m);
+static void automaton_compile(struct automaton *ac,
+	char **patterns, const int *kinds, size_t count,
+	char **factors, const int *ids, size_t nfactors);
 static int _main(int argc, char *argv[]);
 
+/* Expression and command line arguments being parsed */
+static struct node *expression;
+static char **args;
+static int nargs;
+static int argi;
+
+/* File types of -type */
+static const char type_letters[] = "fdlbcps";
+static const int type_codes[] = {
+	DT_REG, DT_DIR, DT_LNK, DT_BLK, DT_CHR, DT_FIFO, DT_SOCK
+};
+
+/* Current time for -mtime */
+static time_t now;
+
+/* Options */
+static int ignore_case = 0;
+static int naive = 0;
+static int stats = 0;
+
+/* Statistics */
+static unsigned long entries = 0;
+static unsigned long stats_called = 0;
+static unsigned long printed = 0;
+static unsigned long verified = 0;
+
 int
 _main(int argc, char *argv[])
 {
-	/* For each directory in command line */
+	/* Parse options */
 	int i = 1;
 	while (i < argc) {
-		if (!find_directory(argv[i]))
-			exit(EXIT_FAILURE);
+		if (strcmp(argv[i], "-i") == 0) {
+			ignore_case = 1;
+		} else if (strcmp(argv[i], "-naive") == 0) {
+			naive = 1;
+		} else if (strcmp(argv[i], "-stats") == 0) {
+			stats = 1;
+		} else {
+			break;
+		}
+		i++;
+	}
+
+	/* Directory names precede expression */
+	int first = i;
+	while (i < argc && argv[i][0] != '-'
+		&& strcmp(argv[i], "(") != 0 && strcmp(argv[i], "!") != 0) {
 		i++;
 	}
+	int last = i;
+
+	/* Parse expression */
+	clock_t start = clock();
+	now = time(NULL);
+	args = argv;
+	nargs = argc;
+	argi = i;
+	expression = NULL;
+	if (argi < nargs) {
+		expression = parse_or();
+		if (argi < nargs) {
+			fprintf(stderr, "Unexpected %s\n", args[argi]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* Print matching files unless expression has -print */
+	if (!expression || !has_print(expression)) {
+		struct node *n = new_node(OP_AND);
+		if (expression)
+			add_kid(n, expression);
+		add_kid(n, new_node(OP_PRINT));
+		expression = n;
+	}
+
+	/* Compile plan */
+	if (!naive)
+		expression = plan(expression);
+	if (stats) {
+		print_plan(expression);
+		fputc('\n', stderr);
+	}
+	clock_t compiled = clock();
+
+	/* For each directory in command line */
+	for (i = first; i < last; i++) {
+		if (!find_path(argv[i]))
+			exit(EXIT_FAILURE);
+	}
 
-	/* List current working directory if no arguments on command line */
-	if (argc == 1)
-		find_directory(".");
+	/* Search current working directory if no directories given */
+	if (first == last)
+		find_path(".");
 
+	/* Output statistics */
+	if (stats) {
+		clock_t finished = clock();
+		fprintf(stderr, "%lu files, %lu stat calls, %lu printed\n",
+			entries, stats_called, printed);
+		fprintf(stderr, "%lu patterns verified\n", verified);
+		fprintf(stderr, "Compile %.3f s, search %.3f s\n",
+			(double) (compiled - start) / CLOCKS_PER_SEC,
+			(double) (finished - compiled) / CLOCKS_PER_SEC);
+	}
+
+	free_node(expression);
 	return EXIT_SUCCESS;
 }
 
+/* Evaluate expression for starting point and search it recursively */
+static int
+find_path(const char *path)
+{
+	/* Find file name from path */
+	size_t n = strlen(path);
+	while (n > 1 && (path[n - 1] == '/' || path[n - 1] == '\\'))
+		n--;
+	size_t k = n;
+	while (k > 0 && path[k - 1] != '/' && path[k - 1] != '\\')
+		k--;
+	char name[PATH_MAX + 1];
+	if (n - k > PATH_MAX)
+		n = k + PATH_MAX;
+	memcpy(name, path + k, n - k);
+	name[n - k] = '\0';
+
+	/* Starting point must exist */
+	struct entry e;
+	e.path = path;
+	e.name = name;
+	e.type = DT_UNKNOWN;
+	e.status = 0;
+	e.prune = 0;
+	if (!entry_stat(&e)) {
+		fprintf(stderr, "Cannot access %s (%s)\n", path, strerror(errno));
+		return /*failure*/ 0;
+	}
+
+	/* Evaluate expression and descend into directory */
+	entries++;
+	evaluate(expression, &e);
+	if (!e.prune && entry_type(&e) == DT_DIR)
+		return find_directory(path);
+	return /*success*/ 1;
+}
+
 /* Find files and subdirectories recursively */
 static int
 find_directory(const char *dirname)
@@ -78,12 +427,17 @@ find_directory(const char *dirname)
 		return /*failure*/ 0;
 	}
 
-	/* Print all files and directories within the directory */
+	/* Evaluate expression for all files and directories */
 	struct dirent *ent;
 	while ((ent = readdir(dir)) != NULL) {
 		char *q = p;
 		char c;
 
+		/* Skip current and parent directory */
+		if (strcmp(ent->d_name, ".") == 0
+			|| strcmp(ent->d_name, "..") == 0)
+			continue;
+
 		/* Get final character of directory name */
 		if (buffer < q)
 			c = q[-1];
@@ -101,31 +455,1125 @@ find_directory(const char *dirname)
 		}
 		*q = '\0';
 
-		/* Decide what to do with the directory entry */
-		switch (ent->d_type) {
-		case DT_LNK:
-		case DT_REG:
-			/* Output file name with directory */
-			printf("%s\n", buffer);
+		/* Naive evaluation retrieves file status up front */
+		struct entry e;
+		e.path = buffer;
+		e.name = ent->d_name;
+		e.type = ent->d_type;
+		e.status = 0;
+		e.prune = 0;
+		if (naive)
+			entry_stat(&e);
+
+		/* Evaluate expression */
+		entries++;
+		evaluate(expression, &e);
+
+		/* Scan sub-directory recursively */
+		if (!e.prune && entry_type(&e) == DT_DIR)
+			find_directory(buffer);
+	}
+
+	closedir(dir);
+	return /*success*/ 1;
+}
+
+/* Parse alternatives separated by -o */
+static struct node *
+parse_or(void)
+{
+	struct node *n = parse_and();
+	while (argi < nargs && (strcmp(args[argi], "-o") == 0
+		|| strcmp(args[argi], "-or") == 0)) {
+		argi++;
+		if (n->op != OP_OR) {
+			struct node *alt = new_node(OP_OR);
+			add_kid(alt, n);
+			n = alt;
+		}
+		add_kid(n, parse_and());
+	}
+	return n;
+}
+
+/* Parse terms separated by -a or nothing at all */
+static struct node *
+parse_and(void)
+{
+	struct node *n = parse_unary();
+	while (argi < nargs && strcmp(args[argi], ")") != 0
+		&& strcmp(args[argi], "-o") != 0
+		&& strcmp(args[argi], "-or") != 0) {
+		if (strcmp(args[argi], "-a") == 0
+			|| strcmp(args[argi], "-and") == 0)
+			argi++;
+		if (n->op != OP_AND) {
+			struct node *all = new_node(OP_AND);
+			add_kid(all, n);
+			n = all;
+		}
+		add_kid(n, parse_unary());
+	}
+	return n;
+}
+
+/* Parse negation, parenthesized expression or primary */
+static struct node *
+parse_unary(void)
+{
+	if (argi >= nargs) {
+		fprintf(stderr, "Incomplete expression\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (strcmp(args[argi], "!") == 0 || strcmp(args[argi], "-not") == 0) {
+		argi++;
+		struct node *n = new_node(OP_NOT);
+		add_kid(n, parse_unary());
+		return n;
+	}
+
+	if (strcmp(args[argi], "(") == 0) {
+		argi++;
+		struct node *n = parse_or();
+		if (argi >= nargs || strcmp(args[argi], ")") != 0) {
+			fprintf(stderr, "Missing )\n");
+			exit(EXIT_FAILURE);
+		}
+		argi++;
+		return n;
+	}
+
+	return parse_primary();
+}
+
+/* Parse primary and its argument */
+static struct node *
+parse_primary(void)
+{
+	const char *option = args[argi++];
+	struct node *n;
+
+	if (strcmp(option, "-name") == 0 || strcmp(option, "-path") == 0) {
+		n = new_node(option[1] == 'n' ? OP_NAME : OP_PATH);
+		const char *pattern = parse_argument(option);
+		size_t len = strlen(pattern);
+		n->pattern = (char*) allocate(len + 1);
+		for (size_t i = 0; i <= len; i++)
+			n->pattern[i] = (char) fold((unsigned char) pattern[i]);
+	} else if (strcmp(option, "-rules") == 0) {
+		n = read_rules(parse_argument(option));
+	} else if (strcmp(option, "-type") == 0) {
+		n = new_node(OP_TYPE);
+		const char *type = parse_argument(option);
+		const char *p = strchr(type_letters, type[0]);
+		if (!p || type[0] == '\0' || type[1] != '\0') {
+			fprintf(stderr, "Invalid file type %s\n", type);
+			exit(EXIT_FAILURE);
+		}
+		n->type = type_codes[p - type_letters];
+	} else if (strcmp(option, "-size") == 0) {
+		n = new_node(OP_SIZE);
+		parse_number(n, parse_argument(option), 1);
+	} else if (strcmp(option, "-mtime") == 0) {
+		n = new_node(OP_MTIME);
+		parse_number(n, parse_argument(option), 0);
+	} else if (strcmp(option, "-newer") == 0) {
+		n = new_node(OP_NEWER);
+		const char *filename = parse_argument(option);
+		struct stat st;
+		if (stat(filename, &st) != /*OK*/0) {
+			fprintf(stderr, "Cannot access %s (%s)\n",
+				filename, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		n->time = st.st_mtime;
+		n->nsec = mtime_nsec(&st);
+	} else if (strcmp(option, "-prune") == 0) {
+		n = new_node(OP_PRUNE);
+	} else if (strcmp(option, "-print") == 0) {
+		n = new_node(OP_PRINT);
+	} else {
+		fprintf(stderr, "Invalid expression %s\n", option);
+		exit(EXIT_FAILURE);
+	}
+	return n;
+}
+
+/* Return argument of primary */
+static const char *
+parse_argument(const char *option)
+{
+	if (argi >= nargs) {
+		fprintf(stderr, "Missing argument to %s\n", option);
+		exit(EXIT_FAILURE);
+	}
+	return args[argi++];
+}
+
+/* Parse [+-]N with optional size suffix */
+static void
+parse_number(struct node *n, const char *s, int size)
+{
+	const char *p = s;
+	n->sign = 0;
+	if (*p == '+') {
+		n->sign = 1;
+		p++;
+	} else if (*p == '-') {
+		n->sign = -1;
+		p++;
+	}
+
+	if (*p < '0' || *p > '9')
+		goto exit_failure;
+	n->value = 0;
+	while (*p >= '0' && *p <= '9')
+		n->value = n->value * 10 + (*p++ - '0');
+
+	/* Size is measured in blocks of 512 bytes by default */
+	n->unit = 1;
+	if (size) {
+		switch (*p) {
+		case '\0':
+			n->unit = 512;
 			break;
 
-		case DT_DIR:
-			/* Scan sub-directory recursively */
-			if (strcmp(ent->d_name, ".") != 0
-				&&  strcmp(ent->d_name, "..") != 0) {
-				find_directory(buffer);
-			}
+		case 'c':
+			p++;
+			break;
+
+		case 'k':
+			n->unit = 1024;
+			p++;
+			break;
+
+		case 'M':
+			n->unit = 1024 * 1024;
+			p++;
+			break;
+
+		case 'G':
+			n->unit = 1024 * 1024 * 1024;
+			p++;
 			break;
 
 		default:
-			/* Ignore device entries */
 			/*NOP*/;
 		}
+	}
+	if (*p != '\0')
+		goto exit_failure;
+	return;
+
+exit_failure:
+	fprintf(stderr, "Invalid number %s\n", s);
+	exit(EXIT_FAILURE);
+}
 
+/* Allocate node */
+static struct node *
+new_node(int op)
+{
+	struct node *n = (struct node*) allocate(sizeof(struct node));
+	memset(n, 0, sizeof(struct node));
+	n->op = op;
+	return n;
+}
+
+/* Append operand to node */
+static void
+add_kid(struct node *n, struct node *kid)
+{
+	n->kids = (struct node**) reallocate(
+		n->kids, (n->nkids + 1) * sizeof(struct node*));
+	n->kids[n->nkids++] = kid;
+}
+
+/* Returns true if expression outputs anything on its own */
+static int
+has_print(const struct node *n)
+{
+	if (n->op == OP_PRINT)
+		return 1;
+	for (int i = 0; i < n->nkids; i++) {
+		if (has_print(n->kids[i]))
+			return 1;
 	}
+	return 0;
+}
 
-	closedir(dir);
-	return /*success*/ 1;
+/*
+ * Compile expression into plan.
+ *
+ * Nested operators of the same kind are flattened, alternative patterns
+ * are merged into a single matcher and operands are sorted by cost such
+ * that predicates requiring stat are evaluated last.  Since -a and -o
+ * evaluate operands from left to right until the result is known,
+ * operands are only reordered between operands with side effects.
+ */
+static struct node *
+plan(struct node *n)
+{
+	/* Plan operands first */
+	for (int i = 0; i < n->nkids; i++)
+		n->kids[i] = plan(n->kids[i]);
+
+	switch (n->op) {
+	case OP_AND:
+	case OP_OR: {
+		/* Flatten nested operators of the same kind */
+		int i = 0;
+		while (i < n->nkids) {
+			struct node *kid = n->kids[i];
+			if (kid->op != n->op) {
+				i++;
+				continue;
+			}
+			int m = kid->nkids;
+			n->kids = (struct node**) reallocate(n->kids,
+				(n->nkids + m) * sizeof(struct node*));
+			memmove(n->kids + i + m, n->kids + i + 1,
+				(n->nkids - i - 1) * sizeof(struct node*));
+			memcpy(n->kids + i, kid->kids, m * sizeof(struct node*));
+			n->nkids += m - 1;
+			kid->nkids = 0;
+			free_node(kid);
+		}
+
+		/* Merge alternative patterns */
+		if (n->op == OP_OR) {
+			merge_patterns(n, OP_NAME);
+			merge_patterns(n, OP_PATH);
+		}
+
+		/* Sort operands without side effects by cost */
+		for (i = 1; i < n->nkids; i++) {
+			struct node *kid = n->kids[i];
+			if (kid->effects)
+				continue;
+			int j = i;
+			while (j > 0 && !n->kids[j - 1]->effects
+				&& n->kids[j - 1]->cost > kid->cost) {
+				n->kids[j] = n->kids[j - 1];
+				j--;
+			}
+			n->kids[j] = kid;
+		}
+
+		/* Operator with single operand is the operand itself */
+		if (n->nkids == 1) {
+			struct node *kid = n->kids[0];
+			n->nkids = 0;
+			free_node(n);
+			return kid;
+		}
+
+		n->cost = 0;
+		n->effects = 0;
+		for (i = 0; i < n->nkids; i++) {
+			n->cost += n->kids[i]->cost;
+			n->effects |= n->kids[i]->effects;
+		}
+		break;
+	}
+
+	case OP_NOT:
+		n->cost = n->kids[0]->cost;
+		n->effects = n->kids[0]->effects;
+		break;
+
+	case OP_SIZE:
+	case OP_MTIME:
+	case OP_NEWER:
+		n->cost = COST_STAT;
+		break;
+
+	case OP_PRUNE:
+	case OP_PRINT:
+		n->cost = COST_ENTRY;
+		n->effects = 1;
+		break;
+
+	default:
+		n->cost = COST_ENTRY;
+	}
+	return n;
+}
+
+/*
+ * Replace -name or -path operands of -o with a single matcher.  Only
+ * operands between the same pair of operands with side effects are
+ * merged, so that the order of side effects is retained.
+ */
+static void
+merge_patterns(struct node *n, int op)
+{
+	struct node *match = NULL;
+	int j = 0;
+	for (int i = 0; i < n->nkids; i++) {
+		struct node *kid = n->kids[i];
+		if (kid->effects) {
+			/* Start new group after side effect */
+			match = NULL;
+		} else if (kid->op == op) {
+			if (!match) {
+				/* Convert first pattern to matcher */
+				match = new_node(OP_MATCH);
+				match->matcher = (struct matcher*)
+					allocate(sizeof(struct matcher));
+				memset(match->matcher, 0, sizeof(struct matcher));
+				match->path = op == OP_PATH;
+				match->cost = COST_ENTRY;
+				n->kids[j++] = match;
+			}
+			matcher_add(match->matcher, kid->pattern);
+			free_node(kid);
+			continue;
+		}
+		n->kids[j++] = kid;
+	}
+	n->nkids = j;
+
+	/* Compile matchers but leave single patterns as they were */
+	for (int i = 0; i < n->nkids; i++) {
+		struct node *kid = n->kids[i];
+		if (kid->op != OP_MATCH || kid->matcher->literals != NULL)
+			continue;
+		if (kid->matcher->nrules == 1) {
+			struct node *single = new_node(op);
+			single->pattern = kid->matcher->rules[0];
+			single->cost = COST_ENTRY;
+			kid->matcher->rules[0] = NULL;
+			free_node(kid);
+			n->kids[i] = single;
+			continue;
+		}
+		matcher_compile(kid->matcher);
+	}
+}
+
+/* Output plan in the syntax of expression */
+static void
+print_plan(const struct node *n)
+{
+	switch (n->op) {
+	case OP_AND:
+	case OP_OR:
+		fputs("( ", stderr);
+		for (int i = 0; i < n->nkids; i++) {
+			if (i > 0)
+				fputs(n->op == OP_AND ? " -a " : " -o ", stderr);
+			print_plan(n->kids[i]);
+		}
+		fputs(" )", stderr);
+		break;
+
+	case OP_NOT:
+		fputs("! ", stderr);
+		print_plan(n->kids[0]);
+		break;
+
+	case OP_NAME:
+		fprintf(stderr, "-name %s", n->pattern);
+		break;
+
+	case OP_PATH:
+		fprintf(stderr, "-path %s", n->pattern);
+		break;
+
+	case OP_MATCH:
+		fprintf(stderr, "-%s-any-of-%lu", n->path ? "path" : "name",
+			(unsigned long) n->matcher->nrules);
+		break;
+
+	case OP_TYPE:
+		for (int i = 0; type_letters[i]; i++) {
+			if (type_codes[i] == n->type)
+				fprintf(stderr, "-type %c", type_letters[i]);
+		}
+		break;
+
+	case OP_SIZE:
+		fprintf(stderr, "-size %s%lld%s",
+			n->sign > 0 ? "+" : n->sign < 0 ? "-" : "", n->value,
+			n->unit == 1 ? "c" : n->unit == 1024 ? "k" :
+			n->unit == 1024 * 1024 ? "M" :
+			n->unit == 1024 * 1024 * 1024 ? "G" : "");
+		break;
+
+	case OP_MTIME:
+		fprintf(stderr, "-mtime %s%lld",
+			n->sign > 0 ? "+" : n->sign < 0 ? "-" : "", n->value);
+		break;
+
+	case OP_NEWER:
+		fputs("-newer", stderr);
+		break;
+
+	case OP_PRUNE:
+		fputs("-prune", stderr);
+		break;
+
+	case OP_PRINT:
+		fputs("-print", stderr);
+		break;
+
+	default:
+		/*NOP*/;
+	}
+}
+
+/* Release expression */
+static void
+free_node(struct node *n)
+{
+	for (int i = 0; i < n->nkids; i++)
+		free_node(n->kids[i]);
+	free(n->kids);
+	free(n->pattern);
+	if (n->matcher) {
+		matcher_free(n->matcher);
+		free(n->matcher);
+	}
+	free(n);
+}
+
+/* Evaluate expression for file */
+static int
+evaluate(const struct node *n, struct entry *e)
+{
+	switch (n->op) {
+	case OP_AND:
+		for (int i = 0; i < n->nkids; i++) {
+			if (!evaluate(n->kids[i], e))
+				return 0;
+		}
+		return 1;
+
+	case OP_OR:
+		for (int i = 0; i < n->nkids; i++) {
+			if (evaluate(n->kids[i], e))
+				return 1;
+		}
+		return 0;
+
+	case OP_NOT:
+		return !evaluate(n->kids[0], e);
+
+	case OP_NAME:
+		return match_glob(n->pattern, e->name);
+
+	case OP_PATH:
+		return match_glob(n->pattern, e->path);
+
+	case OP_MATCH:
+		return matcher_match(n->matcher, n->path ? e->path : e->name);
+
+	case OP_TYPE:
+		return entry_type(e) == n->type;
+
+	case OP_SIZE: {
+		if (!entry_stat(e))
+			return 0;
+
+		/* Round size up to the next unit */
+		long long size = (long long) e->st.st_size;
+		long long units = (size + n->unit - 1) / n->unit;
+		if (n->sign > 0)
+			return units > n->value;
+		if (n->sign < 0)
+			return units < n->value;
+		return units == n->value;
+	}
+
+	case OP_MTIME: {
+		if (!entry_stat(e))
+			return 0;
+
+		/* Count days since last modification rounding down */
+		long long days = (long long) (now - e->st.st_mtime) / 86400;
+		if (n->sign > 0)
+			return days > n->value;
+		if (n->sign < 0)
+			return days < n->value;
+		return days == n->value;
+	}
+
+	case OP_NEWER:
+		if (!entry_stat(e))
+			return 0;
+		if (e->st.st_mtime != n->time)
+			return e->st.st_mtime > n->time;
+		return mtime_nsec(&e->st) > n->nsec;
+
+	case OP_PRUNE:
+		e->prune = 1;
+		return 1;
+
+	case OP_PRINT:
+		printf("%s\n", e->path);
+		printed++;
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+/* Retrieve file status once.  Returns true on success. */
+static int
+entry_stat(struct entry *e)
+{
+	if (e->status == 0) {
+		stats_called++;
+		e->status = lstat(e->path, &e->st) == /*OK*/0 ? 1 : -1;
+	}
+	return e->status > 0;
+}
+
+/* Get nanoseconds of modification time, or zero if not available */
+static long
+mtime_nsec(const struct stat *st)
+{
+#if defined(_WIN32)
+	(void) st;
+	return 0;
+#elif defined(__APPLE__)
+	return (long) st->st_mtimespec.tv_nsec;
+#else
+	return (long) st->st_mtim.tv_nsec;
+#endif
+}
+
+/* Get file type from directory entry or file status */
+static int
+entry_type(struct entry *e)
+{
+	if (e->type != DT_UNKNOWN)
+		return e->type;
+	if (!entry_stat(e))
+		return DT_UNKNOWN;
+
+	if (S_ISREG(e->st.st_mode))
+		e->type = DT_REG;
+	else if (S_ISDIR(e->st.st_mode))
+		e->type = DT_DIR;
+	else if (S_ISLNK(e->st.st_mode))
+		e->type = DT_LNK;
+	else if (S_ISCHR(e->st.st_mode))
+		e->type = DT_CHR;
+	else if (S_ISBLK(e->st.st_mode))
+		e->type = DT_BLK;
+	else if (S_ISFIFO(e->st.st_mode))
+		e->type = DT_FIFO;
+	else if (S_ISSOCK(e->st.st_mode))
+		e->type = DT_SOCK;
+	return e->type;
+}
+
+/*
+ * Read patterns from file, one per line, and return primary matching
+ * any of them
+ */
+static struct node *
+read_rules(const char *filename)
+{
+	FILE *fp = fopen(filename, "r");
+	if (!fp) {
+		fprintf(stderr,
+			"Cannot open %s (%s)\n", filename, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	/* Match patterns with slash against path and others against name */
+	struct node *alt = new_node(OP_OR);
+	for (int i = 0; i < 2; i++) {
+		struct node *n = new_node(OP_MATCH);
+		n->matcher = (struct matcher*) allocate(sizeof(struct matcher));
+		memset(n->matcher, 0, sizeof(struct matcher));
+		n->path = i;
+		add_kid(alt, n);
+	}
+
+	char line[PATH_MAX + 2];
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		/* Remove line feed */
+		size_t n = strlen(line);
+		while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+			line[--n] = '\0';
+
+		/* Ignore empty lines and comments */
+		if (n == 0 || line[0] == '#')
+			continue;
+
+		if (strchr(line, '/'))
+			matcher_add(alt->kids[1]->matcher, line);
+		else
+			matcher_add(alt->kids[0]->matcher, line);
+	}
+	fclose(fp);
+
+	matcher_compile(alt->kids[0]->matcher);
+	matcher_compile(alt->kids[1]->matcher);
+	return alt;
+}
+
+/* Add pattern to matcher */
+static void
+matcher_add(struct matcher *m, const char *pattern)
+{
+	if (m->nrules >= m->maxrules) {
+		m->maxrules = m->maxrules ? m->maxrules * 2 : 64;
+		m->rules = (char**) reallocate(
+			m->rules, m->maxrules * sizeof(char*));
+	}
+	size_t n = strlen(pattern);
+	char *copy = (char*) allocate(n + 1);
+	memcpy(copy, pattern, n + 1);
+	m->rules[m->nrules++] = copy;
+}
+
+/* Sort patterns by kind and compile automaton */
+static void
+matcher_compile(struct matcher *m)
+{
+	size_t size = m->nrules + 1;
+	m->literals = (char**) allocate(size * sizeof(char*));
+	m->kinds = (int*) allocate(size * sizeof(int));
+	m->globs = (char**) allocate(size * sizeof(char*));
+	m->always = (int*) allocate(size * sizeof(int));
+	char **factors = (char**) allocate(size * sizeof(char*));
+	int *ids = (int*) allocate(size * sizeof(int));
+	size_t nfactors = 0;
+
+	for (size_t i = 0; i < m->nrules; i++) {
+		/* Convert pattern to lower case if -i is in effect */
+		char *p = m->rules[i];
+		for (char *q = p; *q; q++)
+			*q = (char) fold((unsigned char) *q);
+		size_t n = strlen(p);
+
+		/* Find literal between leading and trailing asterisks */
+		size_t lead = 0;
+		while (lead < n && p[lead] == '*')
+			lead++;
+		size_t trail = 0;
+		while (trail < n - lead && p[n - 1 - trail] == '*')
+			trail++;
+
+		/* Find the longest run of literal characters */
+		int literal = 1;
+		size_t best = 0;
+		size_t bestlen = 0;
+		size_t run = 0;
+		for (size_t j = 0; j <= n; j++) {
+			if (j < n && p[j] != '*' && p[j] != '?') {
+				run++;
+				continue;
+			}
+			if (run > bestlen) {
+				best = j - run;
+				bestlen = run;
+			}
+			run = 0;
+			if (j >= lead && j < n - trail)
+				literal = 0;
+		}
+
+		/*
+		 * Pattern with wild-cards in the middle is verified only if
+		 * its longest literal occurs in the name
+		 */
+		if (!literal) {
+			int id = (int) m->nglobs;
+			m->globs[m->nglobs++] = p;
+			if (bestlen == 0) {
+				m->always[m->nalways++] = id;
+				continue;
+			}
+			char *f = (char*) allocate(bestlen + 1);
+			memcpy(f, p + best, bestlen);
+			f[bestlen] = '\0';
+			factors[nfactors] = f;
+			ids[nfactors] = id;
+			nfactors++;
+			continue;
+		}
+
+		/* Pattern consisting of asterisks only matches all names */
+		int kind;
+		if (lead == n)
+			kind = LIT_CONTAINS;
+		else if (lead && trail)
+			kind = LIT_CONTAINS;
+		else if (lead)
+			kind = LIT_SUFFIX;
+		else if (trail)
+			kind = LIT_PREFIX;
+		else
+			kind = LIT_EXACT;
+
+		/* Store literal without asterisks */
+		char *q = (char*) allocate(n - lead - trail + 1);
+		memcpy(q, p + lead, n - lead - trail);
+		q[n - lead - trail] = '\0';
+		m->literals[m->nliterals] = q;
+		m->kinds[m->nliterals] = kind;
+		m->nliterals++;
+	}
+
+	automaton_compile(&m->ac, m->literals, m->kinds, m->nliterals,
+		factors, ids, nfactors);
+	for (size_t i = 0; i < nfactors; i++)
+		free(factors[i]);
+	free(factors);
+	free(ids);
+
+	/* Allocate marks for verified patterns */
+	m->seen = (unsigned*) allocate(size * sizeof(unsigned));
+	memset(m->seen, 0, size * sizeof(unsigned));
+	m->stamp = 0;
+}
+
+/* Returns non-zero if name matches any pattern */
+static int
+matcher_match(struct matcher *m, const char *name)
+{
+	if (m->nrules == 0)
+		return 0;
+
+	/* Test patterns one by one */
+	if (naive) {
+		for (size_t i = 0; i < m->nrules; i++) {
+			if (match_naive(m->rules[i], name))
+				return 1;
+		}
+		return 0;
+	}
+
+	/* Start new round of verifications */
+	if (++m->stamp == 0) {
+		memset(m->seen, 0, (m->nglobs + 1) * sizeof(unsigned));
+		m->stamp = 1;
+	}
+
+	/* Pattern consisting of asterisks only */
+	const struct automaton *ac = &m->ac;
+	if (ac->flags[0] & LIT_CONTAINS)
+		return 1;
+
+	/*
+	 * Feed name to automaton.  As long as the depth of current node
+	 * equals to the number of bytes consumed, the name so far equals
+	 * to the path from the root and prefix patterns may match.
+	 */
+	int s = 0;
+	int anchored = 1;
+	int depth = 0;
+	const int n = ac->nclasses;
+	for (const unsigned char *p = (const unsigned char*) name; *p; p++) {
+		s = ac->next[s * n + ac->cls[*p]];
+		int flags = ac->flags[s];
+		if (flags & LIT_CONTAINS)
+			return 1;
+		if (anchored) {
+			if (ac->depth[s] != ++depth)
+				anchored = 0;
+			else if (flags & LIT_PREFIX)
+				return 1;
+		}
+
+		/* Verify wild-card patterns whose literal ends here */
+		for (int r = ac->report[s]; r; r = ac->report[ac->fail[r]]) {
+			for (int i = ac->first[r]; i < ac->first[r + 1]; i++) {
+				if (matcher_verify(m, ac->outputs[i], name))
+					return 1;
+			}
+		}
+	}
+
+	/* Check patterns which must match at the end of name */
+	if (ac->flags[s] & LIT_SUFFIX)
+		return 1;
+	if (anchored && (ac->flags[s] & LIT_EXACT))
+		return 1;
+
+	/* Verify wild-card patterns without literals */
+	for (size_t i = 0; i < m->nalways; i++) {
+		if (matcher_verify(m, m->always[i], name))
+			return 1;
+	}
+	return 0;
+}
+
+/* Match wild-card pattern unless already done for the current name */
+static int
+matcher_verify(struct matcher *m, int id, const char *name)
+{
+	if (m->seen[id] == m->stamp)
+		return 0;
+	m->seen[id] = m->stamp;
+	verified++;
+	return match_glob(m->globs[id], name);
+}
+
+/* Release memory */
+static void
+matcher_free(struct matcher *m)
+{
+	for (size_t i = 0; i < m->nrules; i++)
+		free(m->rules[i]);
+	free(m->rules);
+	for (size_t i = 0; i < m->nliterals; i++)
+		free(m->literals[i]);
+	free(m->literals);
+	free(m->kinds);
+	free(m->globs);
+	free(m->always);
+	free(m->seen);
+	free(m->ac.next);
+	free(m->ac.flags);
+	free(m->ac.depth);
+	free(m->ac.fail);
+	free(m->ac.first);
+	free(m->ac.outputs);
+	free(m->ac.report);
+}
+
+/* Build Aho-Corasick automaton from literals and factors */
+static void
+automaton_compile(struct automaton *ac,
+	char **patterns, const int *kinds, size_t count,
+	char **factors, const int *ids, size_t nfactors)
+{
+	/* Assign a class to each byte occurring in patterns */
+	memset(ac->cls, 0, sizeof(ac->cls));
+	ac->nclasses = 1;
+	size_t total = 1;
+	for (size_t i = 0; i < count + nfactors; i++) {
+		const char *p = i < count ? patterns[i] : factors[i - count];
+		while (*p) {
+			unsigned char c = (unsigned char) *p++;
+			if (ac->cls[c] == 0) {
+				ac->cls[c] = (unsigned char) ac->nclasses;
+				if (ignore_case && c >= 'a' && c <= 'z')
+					ac->cls[c - 'a' + 'A'] = ac->cls[c];
+				ac->nclasses++;
+			}
+			total++;
+		}
+	}
+
+	/* Allocate room for trie with one node for each character */
+	int n = ac->nclasses;
+	ac->next = (int*) allocate(total * n * sizeof(int));
+	memset(ac->next, 0, total * n * sizeof(int));
+	ac->flags = (unsigned char*) allocate(total);
+	memset(ac->flags, 0, total);
+	ac->depth = (int*) allocate(total * sizeof(int));
+	ac->depth[0] = 0;
+	ac->nodes = 1;
+
+	/* Build trie such that zero marks a missing edge */
+	int *ends = (int*) allocate((nfactors + 1) * sizeof(int));
+	for (size_t i = 0; i < count + nfactors; i++) {
+		const char *p = i < count ? patterns[i] : factors[i - count];
+		int s = 0;
+		while (*p) {
+			int *t = &ac->next[s * n + ac->cls[(unsigned char) *p++]];
+			if (*t == 0) {
+				*t = ac->nodes;
+				ac->depth[ac->nodes] = ac->depth[s] + 1;
+				ac->nodes++;
+			}
+			s = *t;
+		}
+		if (i < count)
+			ac->flags[s] |= (unsigned char) kinds[i];
+		else
+			ends[i - count] = s;
+	}
+
+	/* Group wild-card patterns by the node where their factor ends */
+	ac->first = (int*) allocate((ac->nodes + 1) * sizeof(int));
+	memset(ac->first, 0, (ac->nodes + 1) * sizeof(int));
+	for (size_t i = 0; i < nfactors; i++)
+		ac->first[ends[i] + 1]++;
+	for (int i = 0; i < ac->nodes; i++)
+		ac->first[i + 1] += ac->first[i];
+	ac->outputs = (int*) allocate((nfactors + 1) * sizeof(int));
+	int *fill = (int*) allocate((ac->nodes + 1) * sizeof(int));
+	memcpy(fill, ac->first, (ac->nodes + 1) * sizeof(int));
+	for (size_t i = 0; i < nfactors; i++)
+		ac->outputs[fill[ends[i]]++] = ids[i];
+	free(fill);
+	free(ends);
+
+	/*
+	 * Compute failure links in breadth-first order and replace missing
+	 * edges with the transitions of the failure node.  Suffix and
+	 * contains flags are inherited from the failure node, since a
+	 * pattern ending at the failure node also ends at this node.
+	 */
+	ac->fail = (int*) allocate(ac->nodes * sizeof(int));
+	ac->report = (int*) allocate(ac->nodes * sizeof(int));
+	int *queue = (int*) allocate(ac->nodes * sizeof(int));
+	int head = 0;
+	int tail = 0;
+	ac->fail[0] = 0;
+	ac->report[0] = 0;
+	queue[tail++] = 0;
+	while (head < tail) {
+		int u = queue[head++];
+		for (int c = 0; c < n; c++) {
+			int v = ac->next[u * n + c];
+			int w = u ? ac->next[ac->fail[u] * n + c] : 0;
+			if (v) {
+				ac->fail[v] = w;
+				ac->flags[v] |= ac->flags[w]
+					& (LIT_SUFFIX | LIT_CONTAINS);
+				if (ac->first[v] < ac->first[v + 1])
+					ac->report[v] = v;
+				else
+					ac->report[v] = ac->report[w];
+				queue[tail++] = v;
+			} else {
+				ac->next[u * n + c] = w;
+			}
+		}
+	}
+	free(queue);
+}
+
+/*
+ * Match name against pattern without backtracking.
+ *
+ * Pattern is split into segments separated by asterisks.  Each segment
+ * is matched at the leftmost position after the previous one and the
+ * last segment is matched at the end of the name.  Since the asterisks
+ * between the segments absorb any characters, the leftmost match never
+ * needs to be reconsidered.
+ */
+static int
+match_glob(const char *patt, const char *name)
+{
+	/* Match leading segment exactly */
+	while (*patt != '*') {
+		if (*patt == '\0')
+			return *name == '\0';
+		if (*name == '\0')
+			return 0;
+		if (*patt != '?' && *patt != (char) fold((unsigned char) *name))
+			return 0;
+		name++;
+		patt++;
+	}
+
+	while (1) {
+		/* Skip asterisks */
+		while (*patt == '*')
+			patt++;
+
+		/* Trailing asterisk matches rest of the name */
+		if (*patt == '\0')
+			return 1;
+
+		/* Find the end of segment */
+		size_t k = 0;
+		while (patt[k] != '*' && patt[k] != '\0')
+			k++;
+
+		/* Last segment must match the end of name */
+		if (patt[k] == '\0') {
+			size_t n = strlen(name);
+			if (n < k)
+				return 0;
+			return match_segment(patt, name + n - k, k);
+		}
+
+		/* Find the leftmost match of segment */
+		while (!match_segment(patt, name, k)) {
+			if (*name == '\0')
+				return 0;
+			name++;
+		}
+		name += k;
+		patt += k;
+	}
+}
+
+/* Match k characters of name against segment without asterisks */
+static int
+match_segment(const char *patt, const char *name, size_t k)
+{
+	for (size_t i = 0; i < k; i++) {
+		if (name[i] == '\0')
+			return 0;
+		if (patt[i] != '?'
+			&& patt[i] != (char) fold((unsigned char) name[i]))
+			return 0;
+	}
+	return 1;
+}
+
+/* Match name against pattern by backtracking */
+static int
+match_naive(const char *patt, const char *name)
+{
+	const char *star = NULL;
+	const char *retry = NULL;
+	while (*name) {
+		if (*patt == '*') {
+			star = ++patt;
+			retry = name;
+		} else if (*patt == '?'
+			|| *patt == (char) fold((unsigned char) *name)) {
+			patt++;
+			name++;
+		} else if (star) {
+			patt = star;
+			name = ++retry;
+		} else {
+			return 0;
+		}
+	}
+	while (*patt == '*')
+		patt++;
+	return *patt == '\0';
+}
+
+/* Convert upper case ASCII letter to lower case if -i is in effect */
+static int
+fold(int c)
+{
+	if (ignore_case && c >= 'A' && c <= 'Z')
+		return c - 'A' + 'a';
+	return c;
+}
+
+/* Allocate memory or exit */
+static void *
+allocate(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+	if (!p) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return p;
+}
+
+/* Resize memory block or exit */
+static void *
+reallocate(void *p, size_t size)
+{
+	void *q = realloc(p, size ? size : 1);
+	if (!q) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return q;
 }
 
 /* Convert arguments to UTF-8 */
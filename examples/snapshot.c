@@ -0,0 +1,872 @@
+/*
+ * Save directory trees to snapshot files and compare them.
+ *
+ * Compile this file with Visual Studio and run the produced command in
+ * console.  Command
+ *
+ *     snapshot save monday.snap c:\data
+ *
+ * walks c:\data recursively and saves the name, type, size, modification
+ * time and file ID of each file into monday.snap.  Later on, command
+ *
+ *     snapshot diff monday.snap c:\data
+ *
+ * prints files which have been added, deleted or modified since the
+ * snapshot was taken, one per line as
+ *
+ *     A reports/2019/june.csv
+ *     D reports/2019/draft.txt
+ *     M reports/2019/may.csv
+ *
+ * Either argument of diff may be a snapshot file or a directory, so two
+ * snapshot files may be compared without accessing the directory tree at
+ * all.  Command "snapshot list FILE" prints the contents of a snapshot.
+ * Option -stats prints the number of entries and timing information.
+ *
+ * The snapshot file consists of a header, an array of fixed-size records
+ * and a table of file names.  Records are stored in depth-first order
+ * with the entries of each directory sorted by name, so each record only
+ * needs to store its own name and depth.  Records are written as the
+ * tree is walked and only file names are buffered in memory.  When
+ * compared, snapshot files are mapped to memory and used in place
+ * without parsing or sorting.  Because both snapshots are in the same
+ * order, they are compared in one linear pass like merging two sorted
+ * lists.
+ *
+ * Snapshot files use the byte order of the computer which saved them.
+ * File IDs are only available on systems that report inode numbers.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <errno.h>
+#include <locale.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#endif
+#ifdef _MSC_VER
+#	define stat _stat64
+#	define lstat _stat64
+#endif
+
+/* Identifies snapshot file */
+#define SNAPSHOT_MAGIC "DIRSNAP1"
+#define SNAPSHOT_ORDER 0x01020304u
+
+/* File types stored in records */
+#define TYPE_UNKNOWN 0
+#define TYPE_REG 1
+#define TYPE_DIR 2
+#define TYPE_LNK 3
+#define TYPE_BLK 4
+#define TYPE_CHR 5
+#define TYPE_FIFO 6
+#define TYPE_SOCK 7
+
+/* Maximum length of file name and depth of directory tree */
+#define MAX_NAME 4095
+#define MAX_DEPTH (PATH_MAX / 2 + 1)
+
+/* Beginning of snapshot file */
+struct header {
+	/* SNAPSHOT_MAGIC without zero terminator */
+	char magic[8];
+
+	/* SNAPSHOT_ORDER in byte order of file */
+	uint32_t order;
+
+	/* Size of record in bytes */
+	uint32_t record_size;
+
+	/* Number of records following the header */
+	uint64_t count;
+
+	/* Offset and size of name table in bytes */
+	uint64_t names;
+	uint64_t names_size;
+
+	uint64_t reserved[3];
+};
+
+/* File in snapshot */
+struct record {
+	uint64_t size;
+	int64_t mtime;
+	uint64_t id;
+
+	/* Offset of zero-terminated name in name table */
+	uint32_t name;
+
+	/* Number of directories between root and file */
+	uint16_t depth;
+
+	/* Length of name in low 12 bits and type in high 4 bits */
+	uint16_t info;
+};
+
+/* Snapshot mapped from file or taken from live directory tree */
+struct snapshot {
+	const struct record *records;
+	size_t count;
+	const char *names;
+	size_t names_size;
+
+	/* Memory owned by snapshot */
+	struct record *record_buffer;
+	size_t records_allocated;
+	char *name_buffer;
+	size_t names_allocated;
+	void *map;
+	size_t map_size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+/* Snapshot being saved */
+struct writer {
+	/* Output file or NULL to keep records in memory */
+	FILE *fp;
+	struct snapshot *snap;
+	size_t count;
+
+	/* Path of directory being read */
+	char path[PATH_MAX + 2];
+};
+
+static int save(const char *filename, const char *dirname);
+static int list(const char *filename);
+static int diff(const char *old, const char *current);
+static int open_snapshot(struct snapshot *s, const char *name);
+static int take_snapshot(struct snapshot *s, const char *dirname);
+static int walk(struct writer *w, const char *dirname);
+static int walk_directory(struct writer *w, size_t n, int depth);
+static int add_record(
+	struct writer *w, const char *name, const struct dirent *ent,
+	int depth);
+static int map_snapshot(struct snapshot *s, const char *filename);
+static int check_snapshot(const struct snapshot *s);
+static void close_snapshot(struct snapshot *s);
+static int compare_names(const struct dirent **a, const struct dirent **b);
+static int compare_records(
+	const struct snapshot *a, const struct record **sa,
+	const struct record *ra,
+	const struct snapshot *b, const struct record **sb,
+	const struct record *rb);
+static int modified(const struct record *a, const struct record *b);
+static void print_path(
+	char c, const struct snapshot *s, const struct record **stack,
+	const struct record *r);
+static int record_type(const struct record *r);
+static size_t record_length(const struct record *r);
+static int entry_type(const struct dirent *ent, const struct stat *st);
+static double seconds(clock_t start);
+static void *allocate(size_t size);
+static void *reallocate(void *p, size_t size);
+static int _main(int argc, char *argv[]);
+
+/* Options */
+static int stats = 0;
+
+/* Statistics */
+static unsigned long added = 0;
+static unsigned long deleted = 0;
+static unsigned long changed = 0;
+
+/* Letters for file types */
+static const char type_letters[] = "?fdlbcps";
+
+int
+_main(int argc, char *argv[])
+{
+	/* Parse options */
+	int i = 1;
+	while (i < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-stats") == 0) {
+			stats = 1;
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		i++;
+	}
+
+	/* Output file names in large blocks */
+	static char buffer[65536];
+	setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+
+	/* Execute command */
+	int ok;
+	if (i + 3 == argc && strcmp(argv[i], "save") == 0) {
+		ok = save(argv[i + 1], argv[i + 2]);
+	} else if (i + 3 == argc && strcmp(argv[i], "diff") == 0) {
+		ok = diff(argv[i + 1], argv[i + 2]);
+	} else if (i + 2 == argc && strcmp(argv[i], "list") == 0) {
+		ok = list(argv[i + 1]);
+	} else {
+		fprintf(stderr,
+			"Usage: snapshot [-stats] save FILE DIRECTORY\n"
+			"       snapshot [-stats] diff OLD NEW\n"
+			"       snapshot [-stats] list FILE\n");
+		exit(EXIT_FAILURE);
+	}
+
+	fflush(stdout);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Walk directory tree and save snapshot to file */
+static int
+save(const char *filename, const char *dirname)
+{
+	clock_t start = clock();
+
+	FILE *fp = fopen(filename, "wb");
+	if (!fp) {
+		fprintf(stderr, "Cannot create %s (%s)\n",
+			filename, strerror(errno));
+		return /*failure*/ 0;
+	}
+	static char buffer[65536];
+	setvbuf(fp, buffer, _IOFBF, sizeof(buffer));
+
+	/* Leave room for header and write records during walk */
+	struct header h;
+	memset(&h, 0, sizeof(h));
+	fwrite(&h, sizeof(h), 1, fp);
+	struct snapshot s;
+	memset(&s, 0, sizeof(s));
+	struct writer *w = (struct writer*) allocate(sizeof(struct writer));
+	w->fp = fp;
+	w->snap = &s;
+	w->count = 0;
+	int ok = walk(w, dirname);
+
+	/* Append name table and fill in header */
+	memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+	h.order = SNAPSHOT_ORDER;
+	h.record_size = (uint32_t) sizeof(struct record);
+	h.count = w->count;
+	h.names = sizeof(h) + w->count * sizeof(struct record);
+	h.names_size = s.names_size;
+	fwrite(s.name_buffer, 1, s.names_size, fp);
+	fseek(fp, 0, SEEK_SET);
+	fwrite(&h, sizeof(h), 1, fp);
+	if (ferror(fp) || fclose(fp) != 0) {
+		fprintf(stderr, "Cannot write %s (%s)\n",
+			filename, strerror(errno));
+		ok = 0;
+	}
+
+	if (stats) {
+		fprintf(stderr, "%lu entries, %lu bytes, %.3f s\n",
+			(unsigned long) w->count,
+			(unsigned long) (h.names + h.names_size),
+			seconds(start));
+	}
+
+	free(w);
+	close_snapshot(&s);
+	return ok;
+}
+
+/* Print contents of snapshot */
+static int
+list(const char *filename)
+{
+	struct snapshot s;
+	if (!open_snapshot(&s, filename))
+		return /*failure*/ 0;
+
+	static const struct record *stack[MAX_DEPTH];
+	for (size_t i = 0; i < s.count; i++) {
+		const struct record *r = &s.records[i];
+		stack[r->depth] = r;
+		printf("%c %12llu %lld ", type_letters[record_type(r)],
+			(unsigned long long) r->size, (long long) r->mtime);
+		print_path(0, &s, stack, r);
+	}
+
+	close_snapshot(&s);
+	return /*success*/ 1;
+}
+
+/* Print differences between two snapshots */
+static int
+diff(const char *old, const char *current)
+{
+	clock_t start = clock();
+
+	struct snapshot a;
+	if (!open_snapshot(&a, old))
+		return /*failure*/ 0;
+	struct snapshot b;
+	if (!open_snapshot(&b, current)) {
+		close_snapshot(&a);
+		return /*failure*/ 0;
+	}
+	clock_t opened = clock();
+
+	/* Names of parent directories of current records by depth */
+	static const struct record *sa[MAX_DEPTH];
+	static const struct record *sb[MAX_DEPTH];
+
+	/* Merge records in the same order as in snapshots */
+	size_t i = 0;
+	size_t j = 0;
+	while (i < a.count || j < b.count) {
+		const struct record *ra = i < a.count ? &a.records[i] : NULL;
+		const struct record *rb = j < b.count ? &b.records[j] : NULL;
+		if (ra)
+			sa[ra->depth] = ra;
+		if (rb)
+			sb[rb->depth] = rb;
+
+		int cmp;
+		if (!ra)
+			cmp = 1;
+		else if (!rb)
+			cmp = -1;
+		else
+			cmp = compare_records(&a, sa, ra, &b, sb, rb);
+
+		if (cmp < 0) {
+			/* File only in old snapshot */
+			print_path('D', &a, sa, ra);
+			deleted++;
+			i++;
+		} else if (cmp > 0) {
+			/* File only in new snapshot */
+			print_path('A', &b, sb, rb);
+			added++;
+			j++;
+		} else {
+			/* File in both snapshots */
+			if (modified(ra, rb)) {
+				print_path('M', &b, sb, rb);
+				changed++;
+			}
+			i++;
+			j++;
+		}
+	}
+
+	if (stats) {
+		fprintf(stderr, "%lu and %lu entries\n",
+			(unsigned long) a.count, (unsigned long) b.count);
+		fprintf(stderr, "%lu added, %lu deleted, %lu modified\n",
+			added, deleted, changed);
+		fprintf(stderr, "Open %.3f s, compare %.3f s\n",
+			(double) (opened - start) / CLOCKS_PER_SEC,
+			seconds(opened));
+	}
+
+	close_snapshot(&a);
+	close_snapshot(&b);
+	return /*success*/ 1;
+}
+
+/* Map snapshot file or take snapshot of directory */
+static int
+open_snapshot(struct snapshot *s, const char *name)
+{
+	struct stat st;
+	if (stat(name, &st) != 0) {
+		fprintf(stderr, "Cannot access %s (%s)\n", name, strerror(errno));
+		return /*failure*/ 0;
+	}
+	if (S_ISDIR(st.st_mode))
+		return take_snapshot(s, name);
+	return map_snapshot(s, name);
+}
+
+/* Walk directory tree and keep records in memory */
+static int
+take_snapshot(struct snapshot *s, const char *dirname)
+{
+	memset(s, 0, sizeof(*s));
+	struct writer *w = (struct writer*) allocate(sizeof(struct writer));
+	w->fp = NULL;
+	w->snap = s;
+	w->count = 0;
+	int ok = walk(w, dirname);
+	s->records = s->record_buffer;
+	s->count = w->count;
+	s->names = s->name_buffer;
+	free(w);
+	return ok;
+}
+
+/* Add records of directory tree in depth-first order */
+static int
+walk(struct writer *w, const char *dirname)
+{
+	size_t n = strlen(dirname);
+	if (n > PATH_MAX) {
+		fprintf(stderr, "Path too long %s\n", dirname);
+		return /*failure*/ 0;
+	}
+	memcpy(w->path, dirname, n + 1);
+
+	/* Append directory separator if not already there */
+	if (n > 0 && w->path[n - 1] != '/' && w->path[n - 1] != '\\'
+		&& w->path[n - 1] != ':') {
+		w->path[n++] = '/';
+		w->path[n] = '\0';
+	}
+	return walk_directory(w, n, 0);
+}
+
+/* Add records of directory in w->path[0 ... n - 1] and sub-directories */
+static int
+walk_directory(struct writer *w, size_t n, int depth)
+{
+	if (depth >= MAX_DEPTH) {
+		fprintf(stderr, "Directory tree too deep %s\n", w->path);
+		return /*failure*/ 0;
+	}
+
+	/* Read entries sorted by name */
+	struct dirent **files;
+	w->path[n] = '\0';
+	int count = scandir(n > 0 ? w->path : ".", &files, NULL, compare_names);
+	if (count < 0) {
+		fprintf(stderr, "Cannot open %s (%s)\n", w->path, strerror(errno));
+		return /*failure*/ depth > 0;
+	}
+
+	for (int i = 0; i < count; i++) {
+		/* Skip current and parent directory */
+		const char *name = files[i]->d_name;
+		if (name[0] == '.' && (name[1] == '\0'
+			|| (name[1] == '.' && name[2] == '\0')))
+			continue;
+
+		/* Append file name to path */
+		size_t k = strlen(name);
+		if (n + k + 1 > PATH_MAX || k > MAX_NAME) {
+			fprintf(stderr, "Name too long %s%s\n", w->path, name);
+			continue;
+		}
+		memcpy(w->path + n, name, k + 1);
+
+		/* Descend into sub-directory */
+		if (add_record(w, name, files[i], depth) == TYPE_DIR) {
+			w->path[n + k] = '/';
+			walk_directory(w, n + k + 1, depth + 1);
+		}
+	}
+
+	for (int i = 0; i < count; i++)
+		free(files[i]);
+	free(files);
+	return /*success*/ 1;
+}
+
+/* Store information on file in w->path and return its type */
+static int
+add_record(
+	struct writer *w, const char *name, const struct dirent *ent,
+	int depth)
+{
+	struct snapshot *s = w->snap;
+
+	/* Retrieve file information without following symbolic links */
+	struct stat st;
+	if (lstat(w->path, &st) != 0) {
+		fprintf(stderr, "Cannot access %s (%s)\n",
+			w->path, strerror(errno));
+		memset(&st, 0, sizeof(st));
+	}
+
+	/* Append name to name table */
+	size_t k = strlen(name);
+	if (s->names_size + k + 1 > s->names_allocated) {
+		s->names_allocated = (s->names_size + k + 1) * 2 + 4096;
+		s->name_buffer = (char*) reallocate(
+			s->name_buffer, s->names_allocated);
+	}
+	struct record r;
+	r.name = (uint32_t) s->names_size;
+	memcpy(s->name_buffer + s->names_size, name, k + 1);
+	s->names_size += k + 1;
+
+	r.size = (uint64_t) st.st_size;
+	r.mtime = (int64_t) st.st_mtime;
+	r.id = (uint64_t) st.st_ino;
+	r.depth = (uint16_t) depth;
+	int type = entry_type(ent, &st);
+	r.info = (uint16_t) (k | (type << 12));
+
+	/* Write record to file or keep in memory */
+	if (w->fp) {
+		fwrite(&r, sizeof(r), 1, w->fp);
+	} else {
+		if (w->count >= s->records_allocated) {
+			s->records_allocated = s->records_allocated * 2 + 1024;
+			s->record_buffer = (struct record*) reallocate(
+				s->record_buffer,
+				s->records_allocated * sizeof(struct record));
+		}
+		s->record_buffer[w->count] = r;
+	}
+	w->count++;
+	return type;
+}
+
+/* Map snapshot file to memory */
+static int
+map_snapshot(struct snapshot *s, const char *filename)
+{
+	memset(s, 0, sizeof(*s));
+#ifdef _WIN32
+	s->file = CreateFileA(
+		filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (s->file == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Cannot open %s\n", filename);
+		return /*failure*/ 0;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(s->file, &size) || size.QuadPart < 1) {
+		fprintf(stderr, "Invalid snapshot %s\n", filename);
+		CloseHandle(s->file);
+		return /*failure*/ 0;
+	}
+	s->map_size = (size_t) size.QuadPart;
+	s->mapping = CreateFileMappingA(
+		s->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (s->mapping)
+		s->map = MapViewOfFile(s->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!s->map) {
+		fprintf(stderr, "Cannot map %s\n", filename);
+		if (s->mapping)
+			CloseHandle(s->mapping);
+		CloseHandle(s->file);
+		return /*failure*/ 0;
+	}
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open %s (%s)\n",
+			filename, strerror(errno));
+		return /*failure*/ 0;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < 1) {
+		fprintf(stderr, "Invalid snapshot %s\n", filename);
+		close(fd);
+		return /*failure*/ 0;
+	}
+	s->map_size = (size_t) st.st_size;
+	s->map = mmap(NULL, s->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (s->map == MAP_FAILED) {
+		fprintf(stderr, "Cannot map %s (%s)\n",
+			filename, strerror(errno));
+		s->map = NULL;
+		return /*failure*/ 0;
+	}
+#endif
+
+	/* Locate records and names */
+	const struct header *h = (const struct header*) s->map;
+	if (s->map_size < sizeof(*h)
+		|| memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0
+		|| h->order != SNAPSHOT_ORDER
+		|| h->record_size != sizeof(struct record)
+		|| h->count > (s->map_size - sizeof(*h)) / sizeof(struct record)
+		|| h->names != sizeof(*h) + h->count * sizeof(struct record)
+		|| h->names_size > s->map_size - h->names) {
+		fprintf(stderr, "Invalid snapshot %s\n", filename);
+		close_snapshot(s);
+		return /*failure*/ 0;
+	}
+	s->records = (const struct record*) (h + 1);
+	s->count = (size_t) h->count;
+	s->names = (const char*) s->map + h->names;
+	s->names_size = (size_t) h->names_size;
+
+	if (!check_snapshot(s)) {
+		fprintf(stderr, "Corrupted snapshot %s\n", filename);
+		close_snapshot(s);
+		return /*failure*/ 0;
+	}
+	return /*success*/ 1;
+}
+
+/* Make sure that names and depths of records are consistent */
+static int
+check_snapshot(const struct snapshot *s)
+{
+	int depth = 0;
+	for (size_t i = 0; i < s->count; i++) {
+		const struct record *r = &s->records[i];
+		size_t k = record_length(r);
+		if (r->name >= s->names_size || k >= s->names_size - r->name)
+			return 0;
+		if (s->names[r->name + k] != '\0')
+			return 0;
+
+		/* Depth may only grow by one from a directory */
+		if (r->depth > depth || r->depth >= MAX_DEPTH)
+			return 0;
+		depth = record_type(r) == TYPE_DIR ? r->depth + 1 : r->depth;
+	}
+	return 1;
+}
+
+/* Release snapshot */
+static void
+close_snapshot(struct snapshot *s)
+{
+#ifdef _WIN32
+	if (s->map) {
+		UnmapViewOfFile(s->map);
+		CloseHandle(s->mapping);
+		CloseHandle(s->file);
+	}
+#else
+	if (s->map)
+		munmap(s->map, s->map_size);
+#endif
+	free(s->record_buffer);
+	free(s->name_buffer);
+	memset(s, 0, sizeof(*s));
+}
+
+/* Sort file names by byte values regardless of locale */
+static int
+compare_names(const struct dirent **a, const struct dirent **b)
+{
+	return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+/*
+ * Compare position of records in depth-first order given the records of
+ * their parent directories.
+ */
+static int
+compare_records(
+	const struct snapshot *a, const struct record **sa,
+	const struct record *ra,
+	const struct snapshot *b, const struct record **sb,
+	const struct record *rb)
+{
+	int depth = ra->depth < rb->depth ? ra->depth : rb->depth;
+	for (int d = 0; d <= depth; d++) {
+		/* Compare names of files or parent directories at depth d */
+		const struct record *x = sa[d];
+		const struct record *y = sb[d];
+		size_t n = record_length(x);
+		size_t m = record_length(y);
+		int cmp = memcmp(a->names + x->name, b->names + y->name,
+			n < m ? n : m);
+		if (cmp != 0)
+			return cmp;
+		if (n != m)
+			return n < m ? -1 : 1;
+	}
+
+	/* Parent directory goes before its contents */
+	return ra->depth - rb->depth;
+}
+
+/* Returns true if file has been modified */
+static int
+modified(const struct record *a, const struct record *b)
+{
+	if (record_type(a) != record_type(b) || a->id != b->id)
+		return 1;
+
+	/* Time and size of directory changes with its contents */
+	if (record_type(a) == TYPE_DIR)
+		return 0;
+	return a->size != b->size || a->mtime != b->mtime;
+}
+
+/* Output path of record relative to root of snapshot */
+static void
+print_path(
+	char c, const struct snapshot *s, const struct record **stack,
+	const struct record *r)
+{
+	if (c) {
+		putchar(c);
+		putchar(' ');
+	}
+	for (int d = 0; d <= r->depth; d++) {
+		if (d > 0)
+			putchar('/');
+		fwrite(s->names + stack[d]->name, 1, record_length(stack[d]),
+			stdout);
+	}
+	putchar('\n');
+}
+
+/* Get type of file in record */
+static int
+record_type(const struct record *r)
+{
+	return r->info >> 12;
+}
+
+/* Get length of file name in record */
+static size_t
+record_length(const struct record *r)
+{
+	return r->info & 0xfff;
+}
+
+/* Get type of file from directory entry or file status */
+static int
+entry_type(const struct dirent *ent, const struct stat *st)
+{
+	switch (ent->d_type) {
+	case DT_REG:
+		return TYPE_REG;
+	case DT_DIR:
+		return TYPE_DIR;
+	case DT_LNK:
+		return TYPE_LNK;
+	case DT_BLK:
+		return TYPE_BLK;
+	case DT_CHR:
+		return TYPE_CHR;
+	case DT_FIFO:
+		return TYPE_FIFO;
+	case DT_SOCK:
+		return TYPE_SOCK;
+	default:
+		break;
+	}
+
+	/* File system did not report type in directory entry */
+	switch (st->st_mode & S_IFMT) {
+	case S_IFREG:
+		return TYPE_REG;
+	case S_IFDIR:
+		return TYPE_DIR;
+#ifdef S_IFLNK
+	case S_IFLNK:
+		return TYPE_LNK;
+#endif
+#ifdef S_IFBLK
+	case S_IFBLK:
+		return TYPE_BLK;
+#endif
+	case S_IFCHR:
+		return TYPE_CHR;
+#ifdef S_IFIFO
+	case S_IFIFO:
+		return TYPE_FIFO;
+#endif
+#ifdef S_IFSOCK
+	case S_IFSOCK:
+		return TYPE_SOCK;
+#endif
+	default:
+		return TYPE_UNKNOWN;
+	}
+}
+
+/* Seconds of processor time since start */
+static double
+seconds(clock_t start)
+{
+	return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Allocate memory or exit */
+static void *
+allocate(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+	if (!p) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return p;
+}
+
+/* Resize memory block or exit */
+static void *
+reallocate(void *p, size_t size)
+{
+	void *q = realloc(p, size ? size : 1);
+	if (!q) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return q;
+}
+
+/* Convert arguments to UTF-8 */
+#ifdef _MSC_VER
+int
+wmain(int argc, wchar_t *argv[])
+{
+	/* Select UTF-8 locale */
+	setlocale(LC_ALL, ".utf8");
+	SetConsoleCP(CP_UTF8);
+	SetConsoleOutputCP(CP_UTF8);
+
+	/* Allocate memory for multi-byte argv table */
+	char **mbargv;
+	mbargv = (char**) malloc(argc * sizeof(char*));
+	if (!mbargv) {
+		puts("Out of memory");
+		exit(3);
+	}
+
+	/* Convert each argument to UTF-8 */
+	for (int i = 0; i < argc; i++) {
+		/* Compute the size of corresponding UTF-8 string */
+		size_t n;
+		wcstombs_s(&n, NULL, 0, argv[i], 0);
+
+		/* Allocate room for UTF-8 string */
+		mbargv[i] = (char*) malloc(n + 1);
+		if (!mbargv[i]) {
+			puts("Out of memory");
+			exit(3);
+		}
+
+		/* Convert ith argument to UTF-8 */
+		wcstombs_s(NULL, mbargv[i], n + 1, argv[i], n);
+	}
+
+	/* Pass UTF-8 arguments to the real main program */
+	int errorcode = _main(argc, mbargv);
+
+	/* Release UTF-8 arguments */
+	for (int i = 0; i < argc; i++) {
+		free(mbargv[i]);
+	}
+
+	/* Release the multi-byte argv table */
+	free(mbargv);
+	return errorcode;
+}
+#else
+int
+main(int argc, char *argv[])
+{
+	return _main(argc, argv);
+}
+#endif
@@ -0,0 +1,263 @@
+/*
+ * Record directory operations to a trace file.
+ *
+ * Compile this file with Visual Studio and run the produced command in
+ * console with a directory name argument.  For example, command
+ *
+ *     trace -o trace.json "c:\Program Files"
+ *
+ * reads each directory under "c:\Program Files" and writes the beginning
+ * and end of every opendir, readdir and closedir to trace.json in the
+ * Chrome trace event format.  Sub-directories are opened relative to their
+ * parent stream.  Open the file with chrome://tracing or
+ * https://ui.perfetto.dev to see where time goes.
+ *
+ * The program demonstrates trace hooks which are enabled by defining
+ * DIRENT_TRACE before including dirent.h.  Trace hooks are only available
+ * in the dirent.h of this package.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _CRT_SECURE_NO_WARNINGS
+
+/* Enable trace hooks */
+#define DIRENT_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <locale.h>
+
+#ifdef _DIRENT_HAVE_TRACE
+static void walk(DIR *parent, const char *name);
+static void begin(const struct dirent_trace *event, void *data);
+static void end(const struct dirent_trace *event, void *data);
+static void emit(const struct dirent_trace *event, FILE *fp, char phase);
+static void print_path(FILE *fp, const wchar_t *path, size_t n);
+static void print_utf8(FILE *fp, unsigned long c);
+#endif
+static int _main(int argc, char *argv[]);
+
+#ifdef _DIRENT_HAVE_TRACE
+/* Time of first event in nanoseconds */
+static unsigned long long epoch = 0;
+
+/* Number of events written */
+static unsigned long events = 0;
+#endif
+
+static int
+_main(int argc, char *argv[])
+{
+#ifdef _DIRENT_HAVE_TRACE
+	/* Parse options */
+	const char *output = "trace.json";
+	int i = 1;
+	if (i + 1 < argc && strcmp(argv[i], "-o") == 0) {
+		output = argv[i + 1];
+		i += 2;
+	}
+	if (i + 1 != argc) {
+		fprintf(stderr, "Usage: trace [-o FILE] DIRECTORY\n");
+		exit(EXIT_FAILURE);
+	}
+
+	FILE *fp = fopen(output, "w");
+	if (!fp) {
+		fprintf(stderr, "Cannot create %s (%s)\n",
+			output, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	fprintf(fp, "{\"traceEvents\": [\n");
+
+	/* Call hooks on each directory operation from now on */
+	dirent_settrace(begin, end, fp);
+	walk(NULL, argv[i]);
+	dirent_settrace(NULL, NULL, NULL);
+
+	fprintf(fp, "\n], \"displayTimeUnit\": \"ns\"}\n");
+	if (fclose(fp) != 0) {
+		fprintf(stderr, "Cannot write %s\n", output);
+		exit(EXIT_FAILURE);
+	}
+	printf("%lu events written to %s\n", events, output);
+	return EXIT_SUCCESS;
+#else
+	(void) argc;
+	(void) argv;
+	fprintf(stderr, "Trace hooks are not available\n");
+	return EXIT_FAILURE;
+#endif
+}
+
+#ifdef _DIRENT_HAVE_TRACE
+/* Read directory name and its sub-directories */
+static void
+walk(DIR *parent, const char *name)
+{
+	/* Open directory once and keep it open for sub-directories */
+	DIR *dir;
+	if (parent)
+		dir = opendirat(parent, name);
+	else
+		dir = opendir(name);
+	if (!dir) {
+		fprintf(stderr, "Cannot open %s (%s)\n",
+			name, strerror(errno));
+		return;
+	}
+
+	/* Open sub-directories relative to the stream */
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (ent->d_type == DT_DIR
+			&& strcmp(ent->d_name, ".") != 0
+			&& strcmp(ent->d_name, "..") != 0)
+			walk(dir, ent->d_name);
+	}
+	closedir(dir);
+}
+
+/* Called on the beginning of directory operation */
+static void
+begin(const struct dirent_trace *event, void *data)
+{
+	emit(event, (FILE*) data, 'B');
+}
+
+/* Called on the end of directory operation */
+static void
+end(const struct dirent_trace *event, void *data)
+{
+	emit(event, (FILE*) data, 'E');
+}
+
+/* Write event in Chrome trace event format */
+static void
+emit(const struct dirent_trace *event, FILE *fp, char phase)
+{
+	static const char *names[] = {
+		"", "opendir", "readdir", "sort", "seekdir", "closedir"
+	};
+
+	if (events == 0)
+		epoch = event->time;
+
+	/* Time stamps are in microseconds */
+	unsigned long long t = event->time - epoch;
+	fprintf(fp, "%s{\"name\": \"%s\", \"ph\": \"%c\","
+		" \"ts\": %llu.%03u, \"pid\": 1, \"tid\": 1,"
+		" \"args\": {\"path\": \"",
+		events ? ",\n" : "", names[event->operation], phase,
+		t / 1000, (unsigned) (t % 1000));
+	print_path(fp, event->path, event->length);
+	fprintf(fp, "\", \"count\": %lu}}", (unsigned long) event->count);
+	events++;
+}
+
+/* Write wide-character path as UTF-8 string with JSON escapes */
+static void
+print_path(FILE *fp, const wchar_t *path, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		unsigned long c = (unsigned long) path[i];
+
+		/* Combine UTF-16 surrogate pair */
+		if (c >= 0xd800 && c < 0xdc00 && i + 1 < n) {
+			unsigned long d = (unsigned long) path[i + 1];
+			if (d >= 0xdc00 && d < 0xe000) {
+				c = 0x10000 + ((c - 0xd800) << 10) + (d - 0xdc00);
+				i++;
+			}
+		}
+
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", (char) c);
+		else if (c < 0x20)
+			fprintf(fp, "\\u%04lx", c);
+		else
+			print_utf8(fp, c);
+	}
+}
+
+/* Write character as UTF-8 */
+static void
+print_utf8(FILE *fp, unsigned long c)
+{
+	if (c < 0x80) {
+		putc((int) c, fp);
+	} else if (c < 0x800) {
+		putc((int) (0xc0 | (c >> 6)), fp);
+		putc((int) (0x80 | (c & 0x3f)), fp);
+	} else if (c < 0x10000) {
+		putc((int) (0xe0 | (c >> 12)), fp);
+		putc((int) (0x80 | ((c >> 6) & 0x3f)), fp);
+		putc((int) (0x80 | (c & 0x3f)), fp);
+	} else {
+		putc((int) (0xf0 | (c >> 18)), fp);
+		putc((int) (0x80 | ((c >> 12) & 0x3f)), fp);
+		putc((int) (0x80 | ((c >> 6) & 0x3f)), fp);
+		putc((int) (0x80 | (c & 0x3f)), fp);
+	}
+}
+#endif
+
+/* Convert arguments to UTF-8 */
+#ifdef _MSC_VER
+int
+wmain(int argc, wchar_t *argv[])
+{
+	/* Select UTF-8 locale */
+	setlocale(LC_ALL, ".utf8");
+	SetConsoleCP(CP_UTF8);
+	SetConsoleOutputCP(CP_UTF8);
+
+	/* Allocate memory for multi-byte argv table */
+	char **mbargv;
+	mbargv = (char**) malloc(argc * sizeof(char*));
+	if (!mbargv) {
+		puts("Out of memory");
+		exit(3);
+	}
+
+	/* Convert each argument to UTF-8 */
+	for (int i = 0; i < argc; i++) {
+		/* Compute the size of corresponding UTF-8 string */
+		size_t n;
+		wcstombs_s(&n, NULL, 0, argv[i], 0);
+
+		/* Allocate room for UTF-8 string */
+		mbargv[i] = (char*) malloc(n + 1);
+		if (!mbargv[i]) {
+			puts("Out of memory");
+			exit(3);
+		}
+
+		/* Convert ith argument to UTF-8 */
+		wcstombs_s(NULL, mbargv[i], n + 1, argv[i], n);
+	}
+
+	/* Pass UTF-8 arguments to the real main program */
+	int errorcode = _main(argc, mbargv);
+
+	/* Release UTF-8 arguments */
+	for (int i = 0; i < argc; i++) {
+		free(mbargv[i]);
+	}
+
+	/* Release the multi-byte argv table */
+	free(mbargv);
+	return errorcode;
+}
+#else
+int
+main(int argc, char *argv[])
+{
+	return _main(argc, argv);
+}
+#endif
@@ -19,6 +19,20 @@
  * Be ware that this file uses wide-character API which is not compatible
  * with Linux or other major Unixes.
  *
+ * On Linux, command
+ *
+ *     updatedb -daemon /srv/data
+ *
+ * builds locate.db once and keeps it up to date with inotify instead of
+ * scanning the directory tree again.  Events are collected for a short
+ * while (option -batch MILLISECONDS, 100 by default) and the affected
+ * file names are then checked, appended to the end of the database and
+ * removed by blanking their lines in place.  The database is rewritten
+ * without blank lines once the blanked lines take more room than the
+ * remaining names or every -compact SECONDS (600 by default).  Option
+ * -stats prints the cost of the initial build and the latency of updates
+ * when the daemon is stopped with Ctrl-C.
+ *
  * Copyright (C) 1998-2019 Toni Ronkko
  * This file is part of dirent.  Dirent may be freely distributed
  * under the MIT license.  For all details and documentation, see
@@ -32,16 +46,50 @@
 #	include <io.h>
 #	include <fcntl.h>
 #endif
+#ifdef __linux__
+#	include <errno.h>
+#	include <fcntl.h>
+#	include <poll.h>
+#	include <signal.h>
+#	include <stdint.h>
+#	include <time.h>
+#	include <unistd.h>
+#	include <sys/inotify.h>
+#	include <sys/resource.h>
+#	include <sys/stat.h>
+#endif
 #include <dirent.h>
 
 /* File name and location of database file */
 #define DB_LOCATION L"locate.db"
+#define DB_FILE "locate.db"
 
 /* Forward-decl */
 static int update_directory(const wchar_t *dirname);
 static void db_open(void);
 static void db_close(void);
 static void db_store(const wchar_t *dirname);
+#ifdef __linux__
+static int daemon_main(int argc, char *argv[]);
+static void rebuild(void);
+static int scan_directory(char *path, size_t n);
+static void watch_directory(const char *path);
+static int handle_event(const struct inotify_event *ev);
+static void drop_directory(const char *path);
+static void mark_pending(const char *path);
+static void apply_pending(void);
+static void db_insert(const char *path);
+static void db_remove(const char *path);
+static void db_flush(void);
+static void db_compact(void);
+static struct db_entry **db_find(const char *path);
+static size_t hash(const char *path);
+static double now(void);
+static double cpu_time(void);
+static void stop(int sig);
+static void *allocate(size_t size);
+static void *reallocate(void *p, size_t size);
+#endif
 
 /* Module local variables */
 static FILE *db = NULL;
@@ -80,7 +128,13 @@ wmain(int argc, wchar_t *argv[])
 int
 main(int argc, char *argv[])
 {
+#ifdef __linux__
+	if (argc > 1 && strcmp(argv[1], "-daemon") == 0)
+		return daemon_main(argc, argv);
+	printf("updatedb only works on Microsoft Windows or with -daemon\n");
+#else
 	printf("updatedb only works on Microsoft Windows\n");
+#endif
 	return EXIT_SUCCESS;
 }
 #endif
@@ -203,3 +257,660 @@ db_close(void)
 	fclose(db);
 	db = NULL;
 }
+
+#ifdef __linux__
+/* File name stored in database */
+struct db_entry {
+	struct db_entry *next;
+
+	/* Offset of line in database file */
+	off_t offset;
+
+	char path[];
+};
+
+/* Options */
+static int batch_ms = 100;
+static int compact_seconds = 600;
+static int stats = 0;
+
+/* Root directory and inotify file descriptor */
+static const char *root = NULL;
+static int notify = -1;
+
+/* Directory names by inotify watch descriptor */
+static char **watches = NULL;
+static size_t watches_allocated = 0;
+static size_t watch_count = 0;
+
+/* Hash table of file names in database */
+static struct db_entry **table = NULL;
+static size_t table_size = 0;
+static size_t entry_count = 0;
+
+/* Database file and lines waiting to be appended */
+static int db_fd = -1;
+static off_t db_end = 0;
+static off_t live_bytes = 0;
+static off_t dead_bytes = 0;
+static char *out = NULL;
+static size_t out_size = 0;
+static size_t out_allocated = 0;
+
+/* File names changed since the last batch */
+static char **pending = NULL;
+static size_t pending_count = 0;
+static size_t pending_allocated = 0;
+static double batch_start = 0;
+
+/* Statistics */
+static volatile sig_atomic_t running = 1;
+static unsigned long events = 0;
+static unsigned long batches = 0;
+static unsigned long inserted = 0;
+static unsigned long removed = 0;
+static unsigned long compactions = 0;
+static unsigned long overflows = 0;
+static double latency_sum = 0;
+static double latency_max = 0;
+
+/* Build database and keep it up to date until interrupted */
+static int
+daemon_main(int argc, char *argv[])
+{
+	/* Parse options */
+	int i = 2;
+	while (i < argc && argv[i][0] == '-') {
+		if (strcmp(argv[i], "-batch") == 0 && i + 1 < argc) {
+			batch_ms = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-compact") == 0 && i + 1 < argc) {
+			compact_seconds = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-stats") == 0) {
+			stats = 1;
+		} else {
+			fprintf(stderr, "Invalid option %s\n", argv[i]);
+			exit(EXIT_FAILURE);
+		}
+		i++;
+	}
+	if (i + 1 != argc || batch_ms < 0 || compact_seconds <= 0) {
+		fprintf(stderr, "Usage: updatedb -daemon [-batch MILLISECONDS]"
+			" [-compact SECONDS] [-stats] DIRECTORY\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Remove trailing separators from root directory */
+	size_t n = strlen(argv[i]);
+	while (n > 1 && argv[i][n - 1] == '/')
+		argv[i][--n] = '\0';
+	root = argv[i];
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+
+	/* Scan directory tree once */
+	double start = now();
+	double cpu = cpu_time();
+	rebuild();
+	double build = now() - start;
+	double build_cpu = cpu_time() - cpu;
+	if (stats) {
+		fprintf(stderr, "Built %lu files in %.3f s (%.3f s CPU)\n",
+			(unsigned long) entry_count, build, build_cpu);
+	}
+	inserted = 0;
+	cpu = cpu_time();
+	start = now();
+	double compacted = start;
+
+	/* Process events until interrupted */
+	static char buffer[65536]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	while (running) {
+		/* Wait for events or end of current batch */
+		int timeout = -1;
+		if (pending_count > 0) {
+			timeout = (int) ((batch_start - now()) * 1000 + batch_ms);
+			if (timeout < 0)
+				timeout = 0;
+		}
+		struct pollfd p = { notify, POLLIN, 0 };
+		int k = poll(&p, 1, timeout);
+		if (k < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+
+		if (k > 0) {
+			ssize_t len = read(notify, buffer, sizeof(buffer));
+			if (len < 0 && errno != EINTR && errno != EAGAIN) {
+				perror("read");
+				break;
+			}
+			for (ssize_t off = 0; off < len; ) {
+				const struct inotify_event *ev
+					= (const struct inotify_event*) (buffer + off);
+				if (!handle_event(ev))
+					break;
+				off += sizeof(struct inotify_event) + ev->len;
+			}
+		}
+
+		/* Apply batch once the oldest event has waited long enough */
+		if (pending_count > 0
+			&& now() - batch_start >= batch_ms / 1000.0)
+			apply_pending();
+
+		/* Drop blank lines from database */
+		if (dead_bytes > live_bytes
+			|| (dead_bytes > 0 && now() - compacted >= compact_seconds)) {
+			db_compact();
+			compacted = now();
+		}
+	}
+
+	/* Save changes made before interrupt */
+	if (pending_count > 0)
+		apply_pending();
+
+	if (stats) {
+		double elapsed = now() - start;
+		double used = cpu_time() - cpu;
+		fprintf(stderr, "%lu events in %lu batches, %lu inserted,"
+			" %lu removed, %lu compactions, %lu overflows\n",
+			events, batches, inserted, removed, compactions, overflows);
+		fprintf(stderr, "Latency mean %.1f ms, max %.1f ms\n",
+			batches ? latency_sum * 1000 / batches : 0,
+			latency_max * 1000);
+		fprintf(stderr, "Updates used %.3f s CPU in %.1f s (%.2f%%)\n",
+			used, elapsed, elapsed > 0 ? used * 100 / elapsed : 0);
+	}
+
+	close(db_fd);
+	close(notify);
+	return EXIT_SUCCESS;
+}
+
+/* Build database from scratch */
+static void
+rebuild(void)
+{
+	/* Forget old watches and file names */
+	if (notify >= 0)
+		close(notify);
+	notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (notify < 0) {
+		perror("inotify_init1");
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < watches_allocated; i++) {
+		free(watches[i]);
+		watches[i] = NULL;
+	}
+	watch_count = 0;
+	for (size_t i = 0; i < table_size; i++) {
+		struct db_entry *e = table[i];
+		while (e) {
+			struct db_entry *next = e->next;
+			free(e);
+			e = next;
+		}
+		table[i] = NULL;
+	}
+	entry_count = 0;
+	for (size_t i = 0; i < pending_count; i++)
+		free(pending[i]);
+	pending_count = 0;
+
+	/* Create empty database */
+	if (db_fd >= 0)
+		close(db_fd);
+	db_fd = open(DB_FILE, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (db_fd < 0) {
+		fprintf(stderr, "Cannot open %s (%s)\n", DB_FILE, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	db_end = 0;
+	live_bytes = 0;
+	dead_bytes = 0;
+
+	/* Watch and store each directory in tree */
+	static char path[PATH_MAX + 2];
+	size_t n = strlen(root);
+	if (n > PATH_MAX) {
+		fprintf(stderr, "Path too long %s\n", root);
+		exit(EXIT_FAILURE);
+	}
+	memcpy(path, root, n + 1);
+	if (!scan_directory(path, n)) {
+		fprintf(stderr, "Cannot open directory %s\n", root);
+		exit(EXIT_FAILURE);
+	}
+	db_flush();
+}
+
+/* Watch directory in path[0 ... n - 1] and store its files recursively */
+static int
+scan_directory(char *path, size_t n)
+{
+	/* Watch before reading so that no file is missed */
+	path[n] = '\0';
+	watch_directory(path);
+
+	DIR *dir = opendir(path);
+	if (!dir)
+		return /*failure*/ 0;
+
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		const char *name = ent->d_name;
+		if (name[0] == '.' && (name[1] == '\0'
+			|| (name[1] == '.' && name[2] == '\0')))
+			continue;
+
+		/* Append file name to path */
+		size_t k = strlen(name);
+		if (n + k + 1 > PATH_MAX)
+			continue;
+		path[n] = '/';
+		memcpy(path + n + 1, name, k + 1);
+
+		/* Get file type from file system if not reported */
+		int type = ent->d_type;
+		if (type == DT_UNKNOWN) {
+			struct stat st;
+			if (lstat(path, &st) != 0)
+				continue;
+			if (S_ISDIR(st.st_mode))
+				type = DT_DIR;
+			else if (S_ISREG(st.st_mode))
+				type = DT_REG;
+		}
+
+		switch (type) {
+		case DT_REG:
+			db_insert(path);
+			break;
+
+		case DT_DIR:
+			scan_directory(path, n + 1 + k);
+			break;
+
+		default:
+			/* Do not store device entries */
+			/*NOP*/;
+		}
+	}
+
+	path[n] = '\0';
+	closedir(dir);
+	return /*success*/ 1;
+}
+
+/* Receive events about files created, deleted or moved in directory */
+static void
+watch_directory(const char *path)
+{
+	int wd = inotify_add_watch(notify, path,
+		IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+		| IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK);
+	if (wd < 0) {
+		fprintf(stderr, "Cannot watch %s (%s)\n", path, strerror(errno));
+		return;
+	}
+
+	/* Remember directory name of watch */
+	if ((size_t) wd >= watches_allocated) {
+		size_t n = watches_allocated * 2 + 1024;
+		while (n <= (size_t) wd)
+			n *= 2;
+		watches = (char**) reallocate(watches, n * sizeof(char*));
+		memset(watches + watches_allocated, 0,
+			(n - watches_allocated) * sizeof(char*));
+		watches_allocated = n;
+	}
+	if (!watches[wd])
+		watch_count++;
+	free(watches[wd]);
+	watches[wd] = strdup(path);
+	if (!watches[wd]) {
+		puts("Out of memory");
+		exit(3);
+	}
+}
+
+/* Update database according to inotify event or return 0 if rebuilt */
+static int
+handle_event(const struct inotify_event *ev)
+{
+	events++;
+
+	/* Events were lost so start over */
+	if (ev->mask & IN_Q_OVERFLOW) {
+		overflows++;
+		rebuild();
+		return 0;
+	}
+
+	/* Find directory of event */
+	if (ev->wd < 0 || (size_t) ev->wd >= watches_allocated)
+		return 1;
+	const char *dirname = watches[ev->wd];
+	if (!dirname)
+		return 1;
+
+	/* Directory was deleted or moved away */
+	if (ev->mask & IN_IGNORED) {
+		free(watches[ev->wd]);
+		watches[ev->wd] = NULL;
+		watch_count--;
+		return 1;
+	}
+	if (ev->len == 0)
+		return 1;
+
+	/* Construct full path of file */
+	static char path[PATH_MAX + 2];
+	size_t n = strlen(dirname);
+	size_t k = strlen(ev->name);
+	if (n + k + 1 > PATH_MAX)
+		return 1;
+	memcpy(path, dirname, n);
+	path[n] = '/';
+	memcpy(path + n + 1, ev->name, k + 1);
+
+	if (ev->mask & IN_ISDIR) {
+		if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+			/* Store files already in new directory */
+			scan_directory(path, n + 1 + k);
+			db_flush();
+		} else {
+			drop_directory(path);
+		}
+	} else {
+		/* Check file once batch is complete */
+		mark_pending(path);
+	}
+	return 1;
+}
+
+/* Forget files and watches under directory */
+static void
+drop_directory(const char *path)
+{
+	size_t n = strlen(path);
+
+	for (size_t i = 0; i < watches_allocated; i++) {
+		const char *w = watches[i];
+		if (w && strncmp(w, path, n) == 0
+			&& (w[n] == '/' || w[n] == '\0')) {
+			inotify_rm_watch(notify, (int) i);
+			free(watches[i]);
+			watches[i] = NULL;
+			watch_count--;
+		}
+	}
+
+	for (size_t i = 0; i < table_size; i++) {
+		struct db_entry *e = table[i];
+		while (e) {
+			struct db_entry *next = e->next;
+			if (strncmp(e->path, path, n) == 0 && e->path[n] == '/')
+				db_remove(e->path);
+			e = next;
+		}
+	}
+}
+
+/* Remember file name to check at the end of batch */
+static void
+mark_pending(const char *path)
+{
+	if (pending_count == 0)
+		batch_start = now();
+	if (pending_count >= pending_allocated) {
+		pending_allocated = pending_allocated * 2 + 1024;
+		pending = (char**) reallocate(pending,
+			pending_allocated * sizeof(char*));
+	}
+	pending[pending_count] = strdup(path);
+	if (!pending[pending_count]) {
+		puts("Out of memory");
+		exit(3);
+	}
+	pending_count++;
+}
+
+/* Store files which exist and remove files which do not */
+static void
+apply_pending(void)
+{
+	for (size_t i = 0; i < pending_count; i++) {
+		struct stat st;
+		if (lstat(pending[i], &st) == 0 && S_ISREG(st.st_mode))
+			db_insert(pending[i]);
+		else
+			db_remove(pending[i]);
+		free(pending[i]);
+	}
+	pending_count = 0;
+	db_flush();
+
+	double latency = now() - batch_start;
+	latency_sum += latency;
+	if (latency > latency_max)
+		latency_max = latency;
+	batches++;
+}
+
+/* Add file name to the end of database unless already there */
+static void
+db_insert(const char *path)
+{
+	/* Grow hash table as needed */
+	if (entry_count >= table_size) {
+		size_t n = table_size * 2 + 4096;
+		struct db_entry **t = (struct db_entry**) allocate(
+			n * sizeof(struct db_entry*));
+		memset(t, 0, n * sizeof(struct db_entry*));
+		for (size_t i = 0; i < table_size; i++) {
+			struct db_entry *e = table[i];
+			while (e) {
+				struct db_entry *next = e->next;
+				size_t j = hash(e->path) % n;
+				e->next = t[j];
+				t[j] = e;
+				e = next;
+			}
+		}
+		free(table);
+		table = t;
+		table_size = n;
+	}
+
+	struct db_entry **p = db_find(path);
+	if (*p)
+		return;
+
+	/* Queue line for writing */
+	size_t k = strlen(path);
+	if (out_size + k + 1 > out_allocated) {
+		out_allocated = (out_size + k + 1) * 2 + 65536;
+		out = (char*) reallocate(out, out_allocated);
+	}
+	memcpy(out + out_size, path, k);
+	out[out_size + k] = '\n';
+
+	struct db_entry *e = (struct db_entry*) allocate(
+		sizeof(struct db_entry) + k + 1);
+	e->next = NULL;
+	e->offset = db_end + (off_t) out_size;
+	memcpy(e->path, path, k + 1);
+	*p = e;
+
+	out_size += k + 1;
+	live_bytes += (off_t) (k + 1);
+	entry_count++;
+	inserted++;
+}
+
+/* Blank line of file name in database */
+static void
+db_remove(const char *path)
+{
+	struct db_entry **p = db_find(path);
+	struct db_entry *e = *p;
+	if (!e)
+		return;
+
+	/* Overwrite name with line feeds so that it matches nothing */
+	size_t k = strlen(e->path);
+	if (e->offset >= db_end) {
+		memset(out + (e->offset - db_end), '\n', k);
+	} else {
+		static char blank[PATH_MAX + 2];
+		if (blank[0] != '\n')
+			memset(blank, '\n', sizeof(blank));
+		if (pwrite(db_fd, blank, k, e->offset) != (ssize_t) k)
+			perror("pwrite");
+	}
+
+	live_bytes -= (off_t) (k + 1);
+	dead_bytes += (off_t) (k + 1);
+	*p = e->next;
+	free(e);
+	entry_count--;
+	removed++;
+}
+
+/* Append queued lines to database */
+static void
+db_flush(void)
+{
+	size_t done = 0;
+	while (done < out_size) {
+		ssize_t k = pwrite(db_fd, out + done, out_size - done,
+			db_end + (off_t) done);
+		if (k <= 0) {
+			fprintf(stderr, "Cannot write %s (%s)\n",
+				DB_FILE, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		done += (size_t) k;
+	}
+	db_end += (off_t) out_size;
+	out_size = 0;
+}
+
+/* Rewrite database without blank lines */
+static void
+db_compact(void)
+{
+	FILE *fp = fopen(DB_FILE ".tmp", "w");
+	if (!fp) {
+		fprintf(stderr, "Cannot create %s.tmp (%s)\n",
+			DB_FILE, strerror(errno));
+		return;
+	}
+
+	off_t offset = 0;
+	for (size_t i = 0; i < table_size; i++) {
+		for (struct db_entry *e = table[i]; e; e = e->next) {
+			size_t k = strlen(e->path);
+			fwrite(e->path, 1, k, fp);
+			putc('\n', fp);
+			e->offset = offset;
+			offset += (off_t) (k + 1);
+		}
+	}
+	if (fclose(fp) != 0 || rename(DB_FILE ".tmp", DB_FILE) != 0) {
+		fprintf(stderr, "Cannot write %s (%s)\n", DB_FILE, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	/* Continue with the new file */
+	close(db_fd);
+	db_fd = open(DB_FILE, O_RDWR | O_CLOEXEC);
+	if (db_fd < 0) {
+		fprintf(stderr, "Cannot open %s (%s)\n", DB_FILE, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	db_end = offset;
+	live_bytes = offset;
+	dead_bytes = 0;
+	compactions++;
+}
+
+/* Find link to entry or the null link where entry would go */
+static struct db_entry **
+db_find(const char *path)
+{
+	struct db_entry **p = &table[hash(path) % table_size];
+	while (*p && strcmp((*p)->path, path) != 0)
+		p = &(*p)->next;
+	return p;
+}
+
+/* FNV-1a hash of file name */
+static size_t
+hash(const char *path)
+{
+	uint64_t h = 14695981039346656037ull;
+	while (*path) {
+		h ^= (unsigned char) *path++;
+		h *= 1099511628211ull;
+	}
+	return (size_t) h;
+}
+
+/* Wall-clock time in seconds */
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Processor time used by process in seconds */
+static double
+cpu_time(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+		+ ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+/* Stop daemon on signal */
+static void
+stop(int sig)
+{
+	(void) sig;
+	running = 0;
+}
+
+/* Allocate memory or exit */
+static void *
+allocate(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+	if (!p) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return p;
+}
+
+/* Resize memory block or exit */
+static void *
+reallocate(void *p, size_t size)
+{
+	void *q = realloc(p, size ? size : 1);
+	if (!q) {
+		puts("Out of memory");
+		exit(3);
+	}
+	return q;
+}
+#endif
@@ -0,0 +1,2376 @@
+/*
+ * C++ interface for dirent
+ *
+ * Wraps the directory stream of dirent.h, or the dirent.h of the operating
+ * system, in a move-only range whose input iterators return entries by
+ * reference.  Entries are views into the directory stream: the name is a
+ * std::string_view of d_name and stat fields are retrieved only when asked
+ * for, so iterating over a directory allocates no memory per entry.
+ *
+ *     dirent_cxx::directory_range dir("c:\\data");
+ *     for (const auto &entry : dir) {
+ *         if (entry.type() == dirent_cxx::file_type::regular)
+ *             std::cout << entry.name() << ' ' << entry.size() << '\n';
+ *     }
+ *
+ * Function walk() traverses a directory tree recursively with C++20
+ * coroutines.  The whole walk shares a single path buffer and each
+ * directory costs one coroutine frame, so entries are returned without
+ * allocating memory.
+ *
+ *     for (auto &entry : dirent_cxx::walk("c:\\data")) {
+ *         if (entry.name() == ".git")
+ *             entry.prune();
+ *         else
+ *             std::cout << entry.path() << '\n';
+ *     }
+ *
+ * Class tree_walker traverses a directory tree breadth-first with a bounded
+ * number of open directory streams, so walks of huge trees run out of
+ * neither file handles nor memory.
+ *
+ *     dirent_cxx::walk_options options;
+ *     options.max_handles = 4;
+ *     dirent_cxx::tree_walker walker("c:\\data", options);
+ *     for (auto &entry : walker)
+ *         std::cout << entry.path() << '\n';
+ *
+ * Function template scandir() reads a whole directory into a contiguous
+ * array.  The filter and sort functions are template arguments, so lambdas
+ * and function objects are inlined into the scan and into std::sort.
+ *
+ *     auto list = dirent_cxx::scandir("c:\\data",
+ *         [](const dirent_cxx::directory_entry &e) {
+ *             return e.type() == dirent_cxx::file_type::regular;
+ *         },
+ *         dirent_cxx::version_less());
+ *
+ * Class listing_cache keeps scanned directories in memory and returns
+ * shared snapshots until the directory changes.
+ *
+ * Requires C++17, walk() requires C++20.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#ifndef DIRENT_HPP
+#define DIRENT_HPP
+
+#if __cplusplus < 201703L && (!defined(_MSVC_LANG) || _MSVC_LANG < 201703L)
+#	error "dirent.hpp requires C++17"
+#endif
+
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <locale.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <deque>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#	if __has_include(<coroutine>)
+#		include <coroutine>
+#		include <exception>
+#		define DIRENT_CXX_HAVE_WALK
+#	endif
+#endif
+#if !defined(_WIN32)
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+#if defined(__linux__) && !defined(_WIN32) && defined(__has_include)
+#	if __has_include(<sys/inotify.h>)
+#		include <sys/inotify.h>
+#		define DIRENT_CXX_HAVE_INOTIFY
+#	endif
+#endif
+
+/* Length of file name in directory entry */
+#ifdef _D_EXACT_NAMLEN
+#	define DIRENT_CXX_NAMLEN(p) ((std::size_t) _D_EXACT_NAMLEN(p))
+#else
+#	define DIRENT_CXX_NAMLEN(p) strlen((p)->d_name)
+#endif
+
+namespace dirent_cxx {
+
+/* File information returned by directory_entry::status() */
+#if defined(_MSC_VER)
+using stat_type = struct ::_stat64;
+#else
+using stat_type = struct ::stat;
+#endif
+
+/* Type of file */
+enum class file_type {
+	unknown,
+	regular,
+	directory,
+	symlink,
+	block,
+	character,
+	fifo,
+	socket
+};
+
+class directory_range;
+class directory_iterator;
+
+/*
+ * Entry in directory stream.
+ *
+ * The entry refers to memory owned by the directory stream and is valid
+ * until the iterator is advanced or the range is destroyed.  Copy the name
+ * to a std::string if you need to keep it.
+ */
+class directory_entry {
+public:
+	directory_entry(const directory_entry &) = delete;
+	directory_entry &operator=(const directory_entry &) = delete;
+
+	std::string_view name() const noexcept;
+	file_type type() const noexcept;
+	const stat_type &status() const;
+	const stat_type *status(std::error_code &ec) const noexcept;
+	unsigned long long size() const;
+	std::time_t mtime() const;
+	const struct dirent *native() const noexcept { return ent; }
+
+private:
+	friend class directory_range;
+
+	directory_entry() noexcept;
+	directory_entry(directory_entry &&other) noexcept;
+	directory_entry &operator=(directory_entry &&other) noexcept;
+
+	DIR *dir;
+	struct dirent *ent;
+
+	/* File information, valid if have_stat is true */
+	mutable stat_type st;
+	mutable bool have_stat;
+	mutable int stat_error;
+
+#if defined(_WIN32)
+	/* Directory name followed by file name of entry being stat'ed */
+	mutable std::string path;
+	std::size_t prefix;
+#endif
+};
+
+/* Input iterator over directory entries */
+class directory_iterator {
+public:
+	using iterator_category = std::input_iterator_tag;
+	using value_type = directory_entry;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const directory_entry *;
+	using reference = const directory_entry &;
+
+	directory_iterator() noexcept : range(nullptr) { }
+
+	reference operator*() const noexcept;
+	pointer operator->() const noexcept { return &**this; }
+	directory_iterator &operator++() noexcept;
+	void operator++(int) noexcept { ++*this; }
+
+	friend bool
+	operator==(const directory_iterator &a, const directory_iterator &b)
+		noexcept
+	{
+		return a.range == b.range;
+	}
+	friend bool
+	operator!=(const directory_iterator &a, const directory_iterator &b)
+		noexcept
+	{
+		return a.range != b.range;
+	}
+
+private:
+	friend class directory_range;
+
+	explicit directory_iterator(directory_range *range) noexcept
+		: range(range) { }
+
+	/* Range being iterated or null at the end */
+	directory_range *range;
+};
+
+/*
+ * Move-only handle to directory stream.
+ *
+ * Entries . and .. are skipped.  The range is a single-pass input range:
+ * begin() continues from the current position of the stream.
+ */
+class directory_range {
+public:
+	directory_range() noexcept { }
+	explicit directory_range(const char *dirname);
+	directory_range(const char *dirname, std::error_code &ec) noexcept;
+	directory_range(directory_range &&other) noexcept;
+	directory_range &operator=(directory_range &&other) noexcept;
+	directory_range(const directory_range &) = delete;
+	directory_range &operator=(const directory_range &) = delete;
+	~directory_range() { close(); }
+
+	directory_iterator begin() noexcept;
+	directory_iterator end() const noexcept { return directory_iterator(); }
+
+	bool is_open() const noexcept { return entry.dir != nullptr; }
+	explicit operator bool() const noexcept { return is_open(); }
+	DIR *native_handle() const noexcept { return entry.dir; }
+	std::error_code error() const noexcept { return last_error; }
+
+	void rewind() noexcept;
+	void close() noexcept;
+
+private:
+	friend class directory_iterator;
+	friend class tree_walker;
+
+	int open(const char *dirname) noexcept;
+	int open_at(DIR *parent, const char *name, const char *dirname)
+		noexcept;
+	int prepare(const char *dirname) noexcept;
+	DIR *release() noexcept;
+	bool next() noexcept;
+
+	directory_entry entry;
+	std::error_code last_error;
+};
+
+inline
+directory_entry::directory_entry() noexcept
+	: dir(nullptr), ent(nullptr), st(), have_stat(false), stat_error(0)
+#if defined(_WIN32)
+	, prefix(0)
+#endif
+{
+}
+
+inline
+directory_entry::directory_entry(directory_entry &&other) noexcept
+	: dir(other.dir), ent(other.ent), st(other.st),
+	have_stat(other.have_stat), stat_error(other.stat_error)
+#if defined(_WIN32)
+	, path(std::move(other.path)), prefix(other.prefix)
+#endif
+{
+	other.dir = nullptr;
+	other.ent = nullptr;
+	other.have_stat = false;
+}
+
+inline directory_entry &
+directory_entry::operator=(directory_entry &&other) noexcept
+{
+	dir = other.dir;
+	ent = other.ent;
+	st = other.st;
+	have_stat = other.have_stat;
+	stat_error = other.stat_error;
+#if defined(_WIN32)
+	path = std::move(other.path);
+	prefix = other.prefix;
+#endif
+	other.dir = nullptr;
+	other.ent = nullptr;
+	other.have_stat = false;
+	return *this;
+}
+
+/* Name of file without directory */
+inline std::string_view
+directory_entry::name() const noexcept
+{
+	return std::string_view(ent->d_name, DIRENT_CXX_NAMLEN(ent));
+}
+
+/*
+ * Type of file.  Symbolic links are not followed.  Retrieves file
+ * information only if the file system does not report the type in the
+ * directory entry.
+ */
+inline file_type
+directory_entry::type() const noexcept
+{
+#ifdef _DIRENT_HAVE_D_TYPE
+	int t = ent->d_type;
+	if (t == DT_REG)
+		return file_type::regular;
+	if (t == DT_DIR)
+		return file_type::directory;
+	if (t == DT_LNK)
+		return file_type::symlink;
+	if (t == DT_BLK)
+		return file_type::block;
+	if (t == DT_CHR)
+		return file_type::character;
+	if (t == DT_FIFO)
+		return file_type::fifo;
+	if (t == DT_SOCK)
+		return file_type::socket;
+#endif
+
+	/* Fall back to stat */
+	std::error_code ec;
+	const stat_type *p = status(ec);
+	if (!p)
+		return file_type::unknown;
+	if (S_ISREG(p->st_mode))
+		return file_type::regular;
+	if (S_ISDIR(p->st_mode))
+		return file_type::directory;
+#if defined(S_ISLNK)
+	if (S_ISLNK(p->st_mode))
+		return file_type::symlink;
+#endif
+#if defined(S_ISBLK)
+	if (S_ISBLK(p->st_mode))
+		return file_type::block;
+#endif
+	if (S_ISCHR(p->st_mode))
+		return file_type::character;
+#if defined(S_ISFIFO)
+	if (S_ISFIFO(p->st_mode))
+		return file_type::fifo;
+#endif
+#if defined(S_ISSOCK)
+	if (S_ISSOCK(p->st_mode))
+		return file_type::socket;
+#endif
+	return file_type::unknown;
+}
+
+/*
+ * Retrieve file information on first call and return the same information
+ * on subsequent calls.  Returns null and sets ec on error.
+ */
+inline const stat_type *
+directory_entry::status(std::error_code &ec) const noexcept
+{
+	if (!have_stat) {
+#if defined(_WIN32)
+		/* Append name to directory in reserved space */
+		path.resize(prefix);
+		path.append(ent->d_name, DIRENT_CXX_NAMLEN(ent));
+#	if defined(_MSC_VER)
+		int ok = _stat64(path.c_str(), &st);
+#	else
+		int ok = ::stat(path.c_str(), &st);
+#	endif
+#else
+		/* Stat relative to directory without composing path */
+		int ok = fstatat(dirfd(dir), ent->d_name, &st,
+			AT_SYMLINK_NOFOLLOW);
+#endif
+		stat_error = ok == 0 ? 0 : errno;
+		have_stat = true;
+	}
+
+	if (stat_error) {
+		ec.assign(stat_error, std::generic_category());
+		return nullptr;
+	}
+	ec.clear();
+	return &st;
+}
+
+/* Retrieve file information or throw std::system_error */
+inline const stat_type &
+directory_entry::status() const
+{
+	std::error_code ec;
+	const stat_type *p = status(ec);
+	if (!p)
+		throw std::system_error(ec, std::string(name()));
+	return *p;
+}
+
+/* Size of file in bytes */
+inline unsigned long long
+directory_entry::size() const
+{
+	return (unsigned long long) status().st_size;
+}
+
+/* Time of last modification */
+inline std::time_t
+directory_entry::mtime() const
+{
+	return (std::time_t) status().st_mtime;
+}
+
+inline directory_iterator::reference
+directory_iterator::operator*() const noexcept
+{
+	return range->entry;
+}
+
+/* Advance to next entry or to the end of directory */
+inline directory_iterator &
+directory_iterator::operator++() noexcept
+{
+	if (!range->next())
+		range = nullptr;
+	return *this;
+}
+
+/* Open directory or throw std::system_error */
+inline
+directory_range::directory_range(const char *dirname)
+{
+	int error = open(dirname);
+	if (error)
+		throw std::system_error(error, std::generic_category(), dirname);
+}
+
+/* Open directory or set ec */
+inline
+directory_range::directory_range(const char *dirname, std::error_code &ec)
+	noexcept
+{
+	int error = open(dirname);
+	if (error)
+		ec.assign(error, std::generic_category());
+	else
+		ec.clear();
+}
+
+inline
+directory_range::directory_range(directory_range &&other) noexcept
+	: entry(std::move(other.entry)), last_error(other.last_error)
+{
+}
+
+inline directory_range &
+directory_range::operator=(directory_range &&other) noexcept
+{
+	if (this != &other) {
+		close();
+		entry = std::move(other.entry);
+		last_error = other.last_error;
+	}
+	return *this;
+}
+
+/* Get iterator to the current entry, reading the first one if needed */
+inline directory_iterator
+directory_range::begin() noexcept
+{
+	if (!entry.dir)
+		return directory_iterator();
+	if (!entry.ent && !next())
+		return directory_iterator();
+	return directory_iterator(this);
+}
+
+/* Start reading from the beginning of directory again */
+inline void
+directory_range::rewind() noexcept
+{
+	if (entry.dir) {
+		rewinddir(entry.dir);
+		entry.ent = nullptr;
+		entry.have_stat = false;
+	}
+}
+
+/* Close directory stream, invalidating iterators and entries */
+inline void
+directory_range::close() noexcept
+{
+	if (entry.dir) {
+		closedir(entry.dir);
+		entry.dir = nullptr;
+		entry.ent = nullptr;
+		entry.have_stat = false;
+	}
+}
+
+/* Open directory stream, returns zero on success or error code */
+inline int
+directory_range::open(const char *dirname) noexcept
+{
+	entry.dir = opendir(dirname);
+	if (!entry.dir)
+		return errno;
+	return prepare(dirname);
+}
+
+/*
+ * Open sub-directory name of directory stream parent without resolving the
+ * full path dirname, if the system allows.  Returns zero on success or
+ * error code.
+ */
+inline int
+directory_range::open_at(DIR *parent, const char *name, const char *dirname)
+	noexcept
+{
+#if defined(_DIRENT_HAVE_OPENDIRAT)
+	entry.dir = opendirat(parent, name);
+	if (!entry.dir)
+		return errno;
+#elif !defined(_WIN32) && defined(O_DIRECTORY) && defined(O_CLOEXEC)
+	int fd = openat(dirfd(parent), name,
+		O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return errno;
+	entry.dir = fdopendir(fd);
+	if (!entry.dir) {
+		int error = errno;
+		::close(fd);
+		return error;
+	}
+#else
+	(void) parent;
+	(void) name;
+	entry.dir = opendir(dirname);
+	if (!entry.dir)
+		return errno;
+#endif
+	return prepare(dirname);
+}
+
+/* Prepare to retrieve file information, returns zero or error code */
+inline int
+directory_range::prepare(const char *dirname) noexcept
+{
+#if defined(_WIN32)
+	/* Reserve room for the longest file name up front */
+	try {
+		std::size_t n = strlen(dirname);
+		entry.path.reserve(n + PATH_MAX + 2);
+		entry.path.assign(dirname, n);
+		if (n > 0 && dirname[n - 1] != '/' && dirname[n - 1] != '\\'
+			&& dirname[n - 1] != ':')
+			entry.path += '/';
+		entry.prefix = entry.path.size();
+	} catch (...) {
+		closedir(entry.dir);
+		entry.dir = nullptr;
+		return ENOMEM;
+	}
+#else
+	(void) dirname;
+#endif
+	return 0;
+}
+
+/* Give up ownership of directory stream and return it */
+inline DIR *
+directory_range::release() noexcept
+{
+	DIR *dir = entry.dir;
+	entry.dir = nullptr;
+	entry.ent = nullptr;
+	entry.have_stat = false;
+	return dir;
+}
+
+/* Read next entry other than . or .., returns false at the end */
+inline bool
+directory_range::next() noexcept
+{
+	entry.have_stat = false;
+	while (true) {
+		errno = 0;
+		entry.ent = readdir(entry.dir);
+		if (!entry.ent) {
+			if (errno != 0)
+				last_error.assign(errno, std::generic_category());
+			return false;
+		}
+
+		/* Skip current and parent directory */
+		const char *p = entry.ent->d_name;
+		if (p[0] == '.' && (p[1] == '\0'
+			|| (p[1] == '.' && p[2] == '\0')))
+			continue;
+		return true;
+	}
+}
+
+/* Entry stored by scandir() */
+class scan_entry {
+public:
+	std::string_view name() const noexcept { return std::string_view(p, n); }
+	const char *c_str() const noexcept { return p; }
+	file_type type() const noexcept { return t; }
+
+private:
+	template <class Filter, class Compare>
+	friend class scanner;
+
+	const char *p;
+	std::size_t n;
+	file_type t;
+};
+
+/*
+ * Contiguous array of entries returned by scandir().  Names are stored in
+ * a single buffer owned by the list.
+ */
+class directory_list {
+public:
+	using value_type = scan_entry;
+	using const_iterator = const scan_entry *;
+	using iterator = const_iterator;
+
+	directory_list() noexcept { }
+	directory_list(directory_list &&) noexcept = default;
+	directory_list &operator=(directory_list &&) noexcept = default;
+	directory_list(const directory_list &) = delete;
+	directory_list &operator=(const directory_list &) = delete;
+
+	const scan_entry *begin() const noexcept { return entries.data(); }
+	const scan_entry *
+	end() const noexcept
+	{
+		return entries.data() + entries.size();
+	}
+	const scan_entry *data() const noexcept { return entries.data(); }
+	std::size_t size() const noexcept { return entries.size(); }
+	bool empty() const noexcept { return entries.empty(); }
+	const scan_entry &
+	operator[](std::size_t i) const noexcept
+	{
+		return entries[i];
+	}
+
+private:
+	template <class Filter, class Compare>
+	friend class scanner;
+
+	std::vector<char> names;
+	std::vector<scan_entry> entries;
+};
+
+/* Filter accepting every entry */
+struct accept_all {
+	bool
+	operator()(const directory_entry &) const noexcept
+	{
+		return true;
+	}
+};
+
+/* Keep entries in the order of the directory stream */
+struct no_sort {
+	bool
+	operator()(const scan_entry &, const scan_entry &) const noexcept
+	{
+		return false;
+	}
+};
+
+/* Alphabetical order according to current locale like alphasort() */
+struct alpha_less {
+	bool
+	operator()(const scan_entry &a, const scan_entry &b) const noexcept
+	{
+		return strcoll(a.c_str(), b.c_str()) < 0;
+	}
+};
+
+/* Order by byte values regardless of locale */
+struct byte_less {
+	bool
+	operator()(const scan_entry &a, const scan_entry &b) const noexcept
+	{
+		return a.name() < b.name();
+	}
+};
+
+#if defined(DIRENT_H) || defined(__GLIBC__)
+/* Order of version numbers like versionsort() */
+struct version_less {
+	bool
+	operator()(const scan_entry &a, const scan_entry &b) const noexcept
+	{
+		return strverscmp(a.c_str(), b.c_str()) < 0;
+	}
+};
+#endif
+
+/* Tells if comparison is version_less, which may not be available */
+template <class Compare>
+struct is_version_less : std::false_type { };
+#if defined(DIRENT_H) || defined(__GLIBC__)
+template <>
+struct is_version_less<version_less> : std::true_type { };
+#endif
+
+/* Implementation of scandir() */
+template <class Filter, class Compare>
+class scanner {
+public:
+	static directory_list scan(const char *dirname, Filter &filter,
+		Compare &compare, std::error_code &ec);
+
+private:
+	static bool collate_c() noexcept;
+};
+
+/* Read directory, filter and sort entries */
+template <class Filter, class Compare>
+directory_list
+scanner<Filter, Compare>::scan(const char *dirname, Filter &filter,
+	Compare &compare, std::error_code &ec)
+{
+	directory_list list;
+	directory_range dir(dirname, ec);
+	if (ec)
+		return list;
+
+	/* Append names to one buffer and fix pointers once it stops growing */
+	for (const directory_entry &entry : dir) {
+		if (!filter(entry))
+			continue;
+		std::string_view name = entry.name();
+		list.names.insert(list.names.end(), name.begin(), name.end());
+		list.names.push_back('\0');
+		scan_entry e;
+		e.p = nullptr;
+		e.n = name.size();
+		e.t = entry.type();
+		list.entries.push_back(e);
+	}
+	if (dir.error()) {
+		ec = dir.error();
+		return directory_list();
+	}
+	const char *p = list.names.data();
+	for (scan_entry &e : list.entries) {
+		e.p = p;
+		p += e.n + 1;
+	}
+
+	/* Sort entries */
+	if constexpr (std::is_same_v<Compare, no_sort>) {
+		return list;
+	} else if constexpr (std::is_same_v<Compare, byte_less>) {
+		std::sort(list.entries.begin(), list.entries.end(), compare);
+		return list;
+	} else if constexpr (std::is_same_v<Compare, alpha_less>
+		|| is_version_less<Compare>::value) {
+		/*
+		 * Collation in C locale equals byte order, so skip strcoll()
+		 * and its locale look-up on each comparison.
+		 */
+		if (std::is_same_v<Compare, alpha_less> && collate_c()) {
+			std::sort(list.entries.begin(), list.entries.end(),
+				byte_less());
+			return list;
+		}
+
+		/*
+		 * Library comparisons dominate the sort, so prefer merge sort
+		 * which needs fewer of them than std::sort.
+		 */
+		std::stable_sort(list.entries.begin(), list.entries.end(),
+			compare);
+		return list;
+	} else {
+		std::sort(list.entries.begin(), list.entries.end(), compare);
+		return list;
+	}
+}
+
+/* Return true if strings are collated in byte order */
+template <class Filter, class Compare>
+bool
+scanner<Filter, Compare>::collate_c() noexcept
+{
+	const char *locale = setlocale(LC_COLLATE, nullptr);
+	if (!locale)
+		return false;
+	return strcmp(locale, "C") == 0 || strcmp(locale, "POSIX") == 0;
+}
+
+/*
+ * Read entries accepted by filter and sort them with compare.  Filter is
+ * called with directory_entry and compare with two scan_entry objects and
+ * returns true if the first one goes before the second one.  Entries . and
+ * .. are not included.  Sets ec and returns empty list on error.
+ */
+template <class Filter, class Compare>
+directory_list
+scandir(const char *dirname, Filter filter, Compare compare,
+	std::error_code &ec)
+{
+	return scanner<Filter, Compare>::scan(dirname, filter, compare, ec);
+}
+
+/* Read and sort entries or throw std::system_error */
+template <class Filter, class Compare>
+directory_list
+scandir(const char *dirname, Filter filter, Compare compare)
+{
+	std::error_code ec;
+	directory_list list = scanner<Filter, Compare>::scan(
+		dirname, filter, compare, ec);
+	if (ec)
+		throw std::system_error(ec, dirname);
+	return list;
+}
+
+/*
+ * Cache of directory listings.
+ *
+ * Function get() returns a shared snapshot of directory entries in byte
+ * order.  Snapshots are never modified: once the directory changes, the
+ * next get() reads the directory again and returns a new snapshot while
+ * holders of the old one may continue using it.
+ *
+ * Directories are identified by device and inode numbers so different
+ * paths to the same directory share a snapshot.  On Linux, changes are
+ * detected with inotify.  Elsewhere, or if the inotify watch limit is
+ * reached, the modification time of directory is compared instead.  As
+ * the modification time has a limited resolution, directories modified
+ * within the second they were read are read again on every call until the
+ * second has passed.
+ *
+ * The least recently used directories are dropped when the cache is full.
+ * Member functions may be called from several threads at once.
+ */
+class listing_cache {
+public:
+	/* Counters for measuring the cache */
+	struct statistics {
+		/* Snapshot returned from cache */
+		unsigned long long hits;
+
+		/* Directory not in cache */
+		unsigned long long misses;
+
+		/* Directory read again because it changed */
+		unsigned long long stale;
+
+		/* Directory dropped because the cache was full */
+		unsigned long long evictions;
+
+		/* Nanoseconds spent in get() on hits and on other calls */
+		unsigned long long hit_ns;
+		unsigned long long miss_ns;
+
+		double hit_rate() const noexcept;
+		double mean_hit_ns() const noexcept;
+		double mean_miss_ns() const noexcept;
+	};
+
+	explicit listing_cache(std::size_t capacity = 4096, bool notify = true);
+	listing_cache(const listing_cache &) = delete;
+	listing_cache &operator=(const listing_cache &) = delete;
+	~listing_cache();
+
+	std::shared_ptr<const directory_list> get(const char *dirname);
+	std::shared_ptr<const directory_list> get(const char *dirname,
+		std::error_code &ec);
+	void clear();
+	std::size_t size() const;
+	statistics stats() const;
+
+	/* Returns true if changes are detected with notifications */
+	bool notifying() const noexcept { return fd >= 0; }
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	/* Identity of directory, path is only used if inode is not known */
+	struct key {
+		unsigned long long dev;
+		unsigned long long ino;
+		std::string path;
+
+		bool
+		operator==(const key &other) const noexcept
+		{
+			return dev == other.dev && ino == other.ino
+				&& path == other.path;
+		}
+	};
+	struct key_hash {
+		std::size_t
+		operator()(const key &k) const noexcept
+		{
+			std::size_t h = std::hash<std::string>()(k.path);
+			h ^= (std::size_t) (k.ino * 0x9e3779b97f4a7c15ULL);
+			h ^= (std::size_t) k.dev << 1;
+			return h;
+		}
+	};
+
+	/*
+	 * Cached directory.  Snapshot is valid if no change has been
+	 * reported since the directory was read.
+	 */
+	struct node {
+		key id;
+		std::shared_ptr<const directory_list> list;
+		std::time_t mtime;
+		std::time_t scanned;
+		int wd;
+		unsigned long changes;
+		unsigned long seen;
+		unsigned long long serial;
+	};
+	using node_list = std::list<node>;
+
+	static int stat_path(const char *path, stat_type *st) noexcept;
+	bool valid(const node &n, const stat_type &st) const noexcept;
+	void drain() noexcept;
+	void evict() noexcept;
+	void forget(node_list::iterator i) noexcept;
+	unsigned long long elapsed(clock::time_point start) const noexcept;
+
+	mutable std::mutex lock;
+
+	/* Nodes in order of use, most recently used first */
+	node_list nodes;
+	std::unordered_map<key, node_list::iterator, key_hash> index;
+
+	/* Nodes by inotify watch descriptor */
+	std::unordered_map<int, node_list::iterator> watches;
+
+	std::size_t capacity;
+	int fd;
+	unsigned long long serials;
+	statistics counters;
+};
+
+/* Fraction of calls answered from cache */
+inline double
+listing_cache::statistics::hit_rate() const noexcept
+{
+	unsigned long long n = hits + misses + stale;
+	return n ? (double) hits / (double) n : 0.0;
+}
+
+/* Mean time of get() when snapshot was found in cache */
+inline double
+listing_cache::statistics::mean_hit_ns() const noexcept
+{
+	return hits ? (double) hit_ns / (double) hits : 0.0;
+}
+
+/* Mean time of get() when directory was read */
+inline double
+listing_cache::statistics::mean_miss_ns() const noexcept
+{
+	unsigned long long n = misses + stale;
+	return n ? (double) miss_ns / (double) n : 0.0;
+}
+
+/*
+ * Create cache for at most capacity directories.  Set notify to false to
+ * validate snapshots with modification times only.
+ */
+inline
+listing_cache::listing_cache(std::size_t capacity, bool notify)
+	: capacity(capacity ? capacity : 1), fd(-1), serials(0), counters()
+{
+#ifdef DIRENT_CXX_HAVE_INOTIFY
+	if (notify)
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#else
+	(void) notify;
+#endif
+}
+
+inline
+listing_cache::~listing_cache()
+{
+#ifdef DIRENT_CXX_HAVE_INOTIFY
+	if (fd >= 0)
+		::close(fd);
+#endif
+}
+
+/* Get snapshot of directory or throw std::system_error */
+inline std::shared_ptr<const directory_list>
+listing_cache::get(const char *dirname)
+{
+	std::error_code ec;
+	std::shared_ptr<const directory_list> p = get(dirname, ec);
+	if (!p)
+		throw std::system_error(ec, dirname);
+	return p;
+}
+
+/* Get snapshot of directory or set ec and return null */
+inline std::shared_ptr<const directory_list>
+listing_cache::get(const char *dirname, std::error_code &ec)
+{
+	clock::time_point start = clock::now();
+
+	/* Identify directory */
+	stat_type st;
+	if (stat_path(dirname, &st) != 0) {
+		ec.assign(errno, std::generic_category());
+		return nullptr;
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		ec.assign(ENOTDIR, std::generic_category());
+		return nullptr;
+	}
+	key id;
+	id.dev = (unsigned long long) st.st_dev;
+	id.ino = (unsigned long long) st.st_ino;
+	if (id.ino == 0)
+		id.path = dirname;
+
+	/* Return snapshot if directory has not changed since it was read */
+	unsigned long seen;
+	unsigned long long serial;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		drain();
+		auto i = index.find(id);
+		if (i != index.end()) {
+			node &n = *i->second;
+			if (valid(n, st)) {
+				nodes.splice(nodes.begin(), nodes, i->second);
+				counters.hits++;
+				counters.hit_ns += elapsed(start);
+				ec.clear();
+				return n.list;
+			}
+			if (n.list)
+				counters.stale++;
+			else
+				counters.misses++;
+		} else {
+			/* Reserve node to collect changes during the scan */
+			nodes.push_front(
+				node{id, nullptr, 0, 0, -1, 0, 0, ++serials});
+			i = index.emplace(id, nodes.begin()).first;
+			counters.misses++;
+			evict();
+		}
+
+		/* Watch directory before reading so no change goes unnoticed */
+		node &n = *i->second;
+#ifdef DIRENT_CXX_HAVE_INOTIFY
+		if (fd >= 0 && n.wd < 0) {
+			n.wd = inotify_add_watch(fd, dirname,
+				IN_CREATE | IN_DELETE | IN_MOVED_FROM
+				| IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF
+				| IN_ONLYDIR);
+			if (n.wd >= 0)
+				watches[n.wd] = i->second;
+		}
+#endif
+		seen = n.changes;
+		serial = n.serial;
+	}
+
+	/* Read directory without holding the lock */
+	std::time_t scanned = std::time(nullptr);
+	std::shared_ptr<const directory_list> p;
+	{
+		directory_list list = scandir(
+			dirname, accept_all(), byte_less(), ec);
+		if (!ec) {
+			p = std::make_shared<const directory_list>(
+				std::move(list));
+		}
+	}
+
+	/* Store snapshot unless node was evicted during the scan */
+	std::lock_guard<std::mutex> guard(lock);
+	auto i = index.find(id);
+	if (i != index.end() && i->second->serial == serial) {
+		if (p) {
+			node &n = *i->second;
+			drain();
+			n.list = p;
+			n.mtime = (std::time_t) st.st_mtime;
+			n.scanned = scanned;
+			n.seen = seen;
+		} else {
+			forget(i->second);
+		}
+	}
+	counters.miss_ns += elapsed(start);
+	return p;
+}
+
+/* Drop all snapshots */
+inline void
+listing_cache::clear()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	while (!nodes.empty())
+		forget(std::prev(nodes.end()));
+}
+
+/* Number of directories in cache */
+inline std::size_t
+listing_cache::size() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return nodes.size();
+}
+
+/* Copy of counters */
+inline listing_cache::statistics
+listing_cache::stats() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return counters;
+}
+
+/* Retrieve information on file following symbolic links */
+inline int
+listing_cache::stat_path(const char *path, stat_type *st) noexcept
+{
+#if defined(_MSC_VER)
+	return _stat64(path, st);
+#else
+	return ::stat(path, st);
+#endif
+}
+
+/* Returns true if snapshot reflects the current state of directory */
+inline bool
+listing_cache::valid(const node &n, const stat_type &st) const noexcept
+{
+	if (!n.list || n.changes != n.seen)
+		return false;
+	if (n.wd >= 0)
+		return true;
+
+	/* Directory may have changed within the second it was read */
+	return (std::time_t) st.st_mtime == n.mtime && n.mtime < n.scanned;
+}
+
+/* Mark nodes changed according to pending notifications */
+inline void
+listing_cache::drain() noexcept
+{
+#ifdef DIRENT_CXX_HAVE_INOTIFY
+	if (fd < 0)
+		return;
+
+	alignas(struct inotify_event) char buffer[4096];
+	while (true) {
+		ssize_t n = read(fd, buffer, sizeof(buffer));
+		if (n <= 0)
+			break;
+
+		char *p = buffer;
+		while (p < buffer + n) {
+			const struct inotify_event *e
+				= (const struct inotify_event *) p;
+			p += sizeof(struct inotify_event) + e->len;
+
+			/* Events were lost so any directory may have changed */
+			if (e->mask & IN_Q_OVERFLOW) {
+				for (node &x : nodes)
+					x.changes++;
+				continue;
+			}
+
+			auto i = watches.find(e->wd);
+			if (i == watches.end())
+				continue;
+			i->second->changes++;
+
+			/* Watch was removed as directory was deleted */
+			if (e->mask & IN_IGNORED) {
+				i->second->wd = -1;
+				watches.erase(i);
+			}
+		}
+	}
+#endif
+}
+
+/* Drop least recently used directories until cache fits in capacity */
+inline void
+listing_cache::evict() noexcept
+{
+	while (nodes.size() > capacity) {
+		forget(std::prev(nodes.end()));
+		counters.evictions++;
+	}
+}
+
+/* Remove node and its watch */
+inline void
+listing_cache::forget(node_list::iterator i) noexcept
+{
+	if (i->wd >= 0) {
+#ifdef DIRENT_CXX_HAVE_INOTIFY
+		inotify_rm_watch(fd, i->wd);
+#endif
+		watches.erase(i->wd);
+	}
+	index.erase(i->id);
+	nodes.erase(i);
+}
+
+/* Nanoseconds since start */
+inline unsigned long long
+listing_cache::elapsed(clock::time_point start) const noexcept
+{
+	return (unsigned long long) std::chrono::duration_cast<
+		std::chrono::nanoseconds>(clock::now() - start).count();
+}
+
+/*
+ * Set of files identified by device and file number.
+ *
+ * Each device has an open-addressing hash table of its own with linear
+ * probing, so a key takes a single 64-bit slot and the table doubles when
+ * three quarters of the slots are in use.  File number zero marks an empty
+ * slot and is kept aside.  At most limit keys are stored so that memory
+ * stays bounded in huge trees.
+ */
+class visited_set {
+public:
+	/* Result of insert() */
+	enum result {
+		inserted,
+		found,
+		full
+	};
+
+	explicit visited_set(std::size_t limit = (std::size_t) -1) noexcept
+		: limit(limit), count(0) { }
+
+	result insert(unsigned long long dev, unsigned long long ino);
+	bool contains(unsigned long long dev, unsigned long long ino)
+		const noexcept;
+	void clear() noexcept;
+
+	/* Number of keys and bytes taken by hash tables */
+	std::size_t size() const noexcept { return count; }
+	std::size_t memory() const noexcept;
+
+private:
+	/* Hash table of one device */
+	struct table {
+		unsigned long long dev;
+		std::vector<unsigned long long> slots;
+		std::size_t used;
+		bool zero;
+	};
+
+	table *find_table(unsigned long long dev) noexcept;
+	const table *find_table(unsigned long long dev) const noexcept;
+	static std::size_t hash(unsigned long long ino) noexcept;
+	static void grow(table &t);
+
+	std::size_t limit;
+	std::size_t count;
+
+	/* Tables by device, there are usually only a few */
+	std::vector<table> tables;
+};
+
+/* Store key, returns found if the key was stored before */
+inline visited_set::result
+visited_set::insert(unsigned long long dev, unsigned long long ino)
+{
+	table *t = find_table(dev);
+	if (!t) {
+		if (count >= limit)
+			return full;
+		tables.push_back(table{ dev, { }, 0, false });
+		t = &tables.back();
+	}
+
+	if (ino == 0) {
+		if (t->zero)
+			return found;
+		if (count >= limit)
+			return full;
+		t->zero = true;
+		count++;
+		return inserted;
+	}
+
+	/* Find key or the empty slot where the key belongs */
+	if (t->slots.empty())
+		grow(*t);
+	std::size_t mask = t->slots.size() - 1;
+	std::size_t i = hash(ino) & mask;
+	while (t->slots[i] != 0) {
+		if (t->slots[i] == ino)
+			return found;
+		i = (i + 1) & mask;
+	}
+	if (count >= limit)
+		return full;
+
+	/* Keep at least one quarter of slots empty */
+	if ((t->used + 1) * 4 > t->slots.size() * 3) {
+		grow(*t);
+		mask = t->slots.size() - 1;
+		i = hash(ino) & mask;
+		while (t->slots[i] != 0)
+			i = (i + 1) & mask;
+	}
+	t->slots[i] = ino;
+	t->used++;
+	count++;
+	return inserted;
+}
+
+/* Returns true if key has been stored */
+inline bool
+visited_set::contains(unsigned long long dev, unsigned long long ino)
+	const noexcept
+{
+	const table *t = find_table(dev);
+	if (!t)
+		return false;
+	if (ino == 0)
+		return t->zero;
+	if (t->slots.empty())
+		return false;
+
+	std::size_t mask = t->slots.size() - 1;
+	std::size_t i = hash(ino) & mask;
+	while (t->slots[i] != 0) {
+		if (t->slots[i] == ino)
+			return true;
+		i = (i + 1) & mask;
+	}
+	return false;
+}
+
+/* Remove all keys and release memory */
+inline void
+visited_set::clear() noexcept
+{
+	tables.clear();
+	tables.shrink_to_fit();
+	count = 0;
+}
+
+inline std::size_t
+visited_set::memory() const noexcept
+{
+	std::size_t n = tables.capacity() * sizeof(table);
+	for (const table &t : tables)
+		n += t.slots.capacity() * sizeof(unsigned long long);
+	return n;
+}
+
+/* Get table of device or null, moving the table to front */
+inline visited_set::table *
+visited_set::find_table(unsigned long long dev) noexcept
+{
+	for (std::size_t i = 0; i < tables.size(); i++) {
+		if (tables[i].dev == dev) {
+			if (i > 0)
+				std::swap(tables[i], tables[0]);
+			return &tables[0];
+		}
+	}
+	return nullptr;
+}
+
+/* Get table of device or null without reordering */
+inline const visited_set::table *
+visited_set::find_table(unsigned long long dev) const noexcept
+{
+	for (const table &t : tables) {
+		if (t.dev == dev)
+			return &t;
+	}
+	return nullptr;
+}
+
+/* Mix bits of file number so that sequential numbers spread out */
+inline std::size_t
+visited_set::hash(unsigned long long ino) noexcept
+{
+	ino ^= ino >> 33;
+	ino *= 0xff51afd7ed558ccdULL;
+	ino ^= ino >> 33;
+	return (std::size_t) ino;
+}
+
+/* Double the number of slots and re-insert keys */
+inline void
+visited_set::grow(table &t)
+{
+	std::vector<unsigned long long> old(
+		t.slots.empty() ? 16 : t.slots.size() * 2, 0);
+	old.swap(t.slots);
+	std::size_t mask = t.slots.size() - 1;
+	for (unsigned long long ino : old) {
+		if (ino == 0)
+			continue;
+		std::size_t i = hash(ino) & mask;
+		while (t.slots[i] != 0)
+			i = (i + 1) & mask;
+		t.slots[i] = ino;
+	}
+}
+
+class walk_range;
+class tree_walker;
+
+/*
+ * Entry returned by walk() and tree_walker.
+ *
+ * The entry refers to the path buffer of the walk and to the directory
+ * stream being read, and is valid until the iterator is advanced.
+ */
+class walk_entry {
+public:
+	walk_entry(const walk_entry &) = delete;
+	walk_entry &operator=(const walk_entry &) = delete;
+
+	/* Path of file starting with the directory passed to walk() */
+	std::string_view path() const noexcept { return *buffer; }
+	std::string_view name() const noexcept { return entry->name(); }
+
+	/* Zero for files in the starting directory, one below that etc */
+	int depth() const noexcept { return level; }
+
+	file_type type() const noexcept { return entry->type(); }
+	const stat_type &status() const { return entry->status(); }
+	const stat_type *
+	status(std::error_code &ec) const noexcept
+	{
+		return entry->status(ec);
+	}
+	unsigned long long size() const { return entry->size(); }
+	std::time_t mtime() const { return entry->mtime(); }
+	const struct dirent *native() const noexcept { return entry->native(); }
+
+	/* Do not descend into this directory */
+	void prune() noexcept { pruned = true; }
+
+	/*
+	 * True if the file was returned before under another name, such as
+	 * a hard link or a directory mounted twice.  Only set by tree_walker
+	 * with option unique, which does not descend into duplicates.
+	 */
+	bool duplicate() const noexcept { return dup; }
+
+private:
+	friend class walk_range;
+	friend class tree_walker;
+
+	explicit walk_entry(std::string *buffer) noexcept
+		: buffer(buffer), entry(nullptr), level(0), pruned(false),
+		dup(false) { }
+
+	std::string *buffer;
+	const directory_entry *entry;
+	int level;
+	bool pruned;
+	bool dup;
+};
+
+#ifdef DIRENT_CXX_HAVE_WALK
+/*
+ * Range of entries in directory tree, returned by walk().
+ *
+ * Each directory is read by a coroutine of its own which yields the
+ * entries of the directory and then the range of each sub-directory.
+ * Nested ranges are resumed directly by the iterator so the cost of
+ * advancing does not depend on the depth of the tree.
+ */
+class walk_range {
+public:
+	class promise_type;
+	class iterator;
+
+	walk_range(walk_range &&other) noexcept
+		: coro(std::exchange(other.coro, nullptr)) { }
+	walk_range &operator=(walk_range &&other) noexcept;
+	walk_range(const walk_range &) = delete;
+	walk_range &operator=(const walk_range &) = delete;
+	~walk_range();
+
+	iterator begin();
+	std::default_sentinel_t end() const noexcept { return { }; }
+
+private:
+	using handle = std::coroutine_handle<promise_type>;
+
+	friend walk_range walk(const char *dirname);
+	friend walk_range walk(const char *dirname, std::error_code &ec);
+
+	explicit walk_range(handle coro) noexcept : coro(coro) { }
+
+	static walk_range root(std::string dirname, std::error_code *ec);
+	static walk_range descend(walk_entry &e, int depth, std::error_code *ec);
+	static void advance(handle coro);
+
+	handle coro;
+};
+
+class walk_range::promise_type {
+public:
+	/* Resumes parent when nested range completes */
+	struct final_awaiter {
+		bool await_ready() const noexcept { return false; }
+		std::coroutine_handle<> await_suspend(handle h) noexcept;
+		void await_resume() const noexcept { }
+	};
+
+	/* Starts nested range in place of the current one */
+	struct nested_awaiter {
+		handle child;
+
+		bool
+		await_ready() const noexcept
+		{
+			return !child || child.done();
+		}
+		std::coroutine_handle<> await_suspend(handle h) noexcept;
+		void await_resume() const;
+	};
+
+	promise_type() noexcept
+		: value(nullptr), root(this), parent(nullptr), leaf(this) { }
+
+	walk_range
+	get_return_object() noexcept
+	{
+		return walk_range(handle::from_promise(*this));
+	}
+	std::suspend_always initial_suspend() const noexcept { return { }; }
+	final_awaiter final_suspend() const noexcept { return { }; }
+	std::suspend_always
+	yield_value(walk_entry &e) noexcept
+	{
+		root->value = &e;
+		return { };
+	}
+	nested_awaiter
+	yield_value(walk_range &&child) noexcept
+	{
+		return nested_awaiter{child.coro};
+	}
+	void return_void() const noexcept { }
+	void
+	unhandled_exception() noexcept
+	{
+		exception = std::current_exception();
+	}
+
+private:
+	friend class walk_range;
+
+	/* Entry yielded last, maintained in outermost range only */
+	walk_entry *value;
+
+	/* Outermost range, enclosing range and innermost running range */
+	promise_type *root;
+	promise_type *parent;
+	promise_type *leaf;
+
+	std::exception_ptr exception;
+};
+
+/* Input iterator over entries of directory tree */
+class walk_range::iterator {
+public:
+	using iterator_category = std::input_iterator_tag;
+	using value_type = walk_entry;
+	using difference_type = std::ptrdiff_t;
+	using pointer = walk_entry *;
+	using reference = walk_entry &;
+
+	iterator() noexcept : coro(nullptr) { }
+
+	reference operator*() const noexcept { return *coro.promise().value; }
+	pointer operator->() const noexcept { return coro.promise().value; }
+	iterator &
+	operator++()
+	{
+		advance(coro);
+		return *this;
+	}
+	void operator++(int) { ++*this; }
+
+	friend bool
+	operator==(const iterator &i, std::default_sentinel_t) noexcept
+	{
+		return !i.coro || i.coro.done();
+	}
+
+private:
+	friend class walk_range;
+
+	explicit iterator(handle coro) noexcept : coro(coro) { }
+
+	handle coro;
+};
+
+inline std::coroutine_handle<>
+walk_range::promise_type::final_awaiter::await_suspend(handle h) noexcept
+{
+	promise_type &p = h.promise();
+	if (!p.parent)
+		return std::noop_coroutine();
+	p.root->leaf = p.parent;
+	return handle::from_promise(*p.parent);
+}
+
+inline std::coroutine_handle<>
+walk_range::promise_type::nested_awaiter::await_suspend(handle h) noexcept
+{
+	promise_type &p = h.promise();
+	promise_type &c = child.promise();
+	c.root = p.root;
+	c.parent = &p;
+	p.root->leaf = &c;
+	return child;
+}
+
+/* Propagate exception from nested range */
+inline void
+walk_range::promise_type::nested_awaiter::await_resume() const
+{
+	if (child && child.promise().exception)
+		std::rethrow_exception(child.promise().exception);
+}
+
+inline walk_range &
+walk_range::operator=(walk_range &&other) noexcept
+{
+	if (this != &other) {
+		if (coro)
+			coro.destroy();
+		coro = std::exchange(other.coro, nullptr);
+	}
+	return *this;
+}
+
+/* Destroy coroutine along with nested ranges and open directories */
+inline
+walk_range::~walk_range()
+{
+	if (coro)
+		coro.destroy();
+}
+
+/* Get iterator to the current entry, reading the first one if needed */
+inline walk_range::iterator
+walk_range::begin()
+{
+	if (coro && !coro.promise().value && !coro.done())
+		advance(coro);
+	return iterator(coro);
+}
+
+/* Resume innermost range until it yields the next entry */
+inline void
+walk_range::advance(handle coro)
+{
+	promise_type &p = coro.promise();
+	handle::from_promise(*p.leaf).resume();
+	if (p.exception)
+		std::rethrow_exception(std::exchange(p.exception, nullptr));
+}
+
+/* Outermost range owning the path buffer and the entry */
+inline walk_range
+walk_range::root(std::string dirname, std::error_code *ec)
+{
+	dirname.reserve(dirname.size() + PATH_MAX + 1);
+	walk_entry entry(&dirname);
+	co_yield descend(entry, 0, ec);
+}
+
+/* Yield entries in directory and descend into sub-directories */
+inline walk_range
+walk_range::descend(walk_entry &e, int depth, std::error_code *ec)
+{
+	std::string &path = *e.buffer;
+	std::error_code error;
+	directory_range dir(path.c_str(), error);
+	if (error) {
+		/* Starting directory must exist */
+		if (ec)
+			*ec = error;
+		else if (depth == 0)
+			throw std::system_error(error, path);
+		co_return;
+	}
+
+	/* Append directory separator if not already there */
+	std::size_t n = path.size();
+	if (n > 0 && path[n - 1] != '/' && path[n - 1] != '\\'
+		&& path[n - 1] != ':') {
+		path += '/';
+		n++;
+	}
+
+	for (const directory_entry &entry : dir) {
+		path.resize(n);
+		path.append(entry.name());
+		e.entry = &entry;
+		e.level = depth;
+		e.pruned = false;
+		co_yield e;
+
+		if (!e.pruned && entry.type() == file_type::directory)
+			co_yield descend(e, depth + 1, ec);
+	}
+	if (dir.error() && ec)
+		*ec = dir.error();
+}
+
+/*
+ * Walk directory tree in pre-order.  Throws std::system_error if the
+ * directory cannot be opened and skips sub-directories that cannot be
+ * opened.  Symbolic links are not followed.
+ */
+inline walk_range
+walk(const char *dirname)
+{
+	return walk_range::root(dirname, nullptr);
+}
+
+/*
+ * Walk directory tree and store the last error in ec, which must remain
+ * valid until the walk is complete.
+ */
+inline walk_range
+walk(const char *dirname, std::error_code &ec)
+{
+	ec.clear();
+	return walk_range::root(dirname, &ec);
+}
+#endif /*DIRENT_CXX_HAVE_WALK*/
+
+/* Options of tree_walker */
+struct walk_options {
+	/* Maximum number of directory streams open at once, at least one */
+	std::size_t max_handles = 8;
+
+	/*
+	 * Detect directories and files seen before by device and file number
+	 * and do not descend into duplicate directories.  Costs a stat for
+	 * each directory and regular file.  At most max_tracked directories
+	 * and hard-linked files are remembered.
+	 */
+	bool unique = false;
+	std::size_t max_tracked = (std::size_t) 1 << 24;
+
+	/*
+	 * Do not descend into directories on other devices than the starting
+	 * directory, except for mount roots listed in include_mounts and
+	 * directories below them.  Never descend into directories listed in
+	 * exclude_mounts.  Directories are listed by path starting with the
+	 * directory passed to the walker.
+	 */
+	bool one_filesystem = false;
+	std::vector<std::string> include_mounts;
+	std::vector<std::string> exclude_mounts;
+};
+
+/*
+ * Breadth-first walk of directory tree with a bounded number of open
+ * directory streams.
+ *
+ * Entries are returned level by level: first the entries of the starting
+ * directory, then the entries of its sub-directories and so on.  Instead of
+ * keeping a directory stream open for each pending sub-directory, the
+ * walker queues the names of sub-directories and opens them when their turn
+ * comes.  Directories with pending sub-directories are kept open while the
+ * budget of options.max_handles allows, so that their sub-directories are
+ * opened relative to the parent stream.  Other sub-directories are opened by
+ * path.  Memory use grows with the length of names in the queue, not with
+ * the number of directory streams.  Symbolic links are not followed.
+ */
+class tree_walker {
+public:
+	/* Counters for measuring the walk */
+	struct statistics {
+		/* Directories opened relative to parent stream and by path */
+		unsigned long long relative_opens;
+		unsigned long long path_opens;
+
+		/* Sub-directories which could not be opened */
+		unsigned long long errors;
+
+		/* Peak number of open directory streams */
+		std::size_t max_open;
+
+		/* Peak number of sub-directories waiting to be read */
+		std::size_t max_pending;
+
+		/* Peak number of bytes taken by the queue */
+		std::size_t max_queue_bytes;
+
+		/*
+		 * Duplicate directories and files found with option unique,
+		 * files which could not be remembered as the set was full,
+		 * and bytes taken by the set at the end.
+		 */
+		unsigned long long duplicate_dirs;
+		unsigned long long duplicate_files;
+		unsigned long long untracked;
+		std::size_t visited_bytes;
+
+		/*
+		 * Sub-directories not descended into as they are on another
+		 * device with option one_filesystem, or listed in
+		 * exclude_mounts
+		 */
+		unsigned long long skipped_mounts;
+		unsigned long long skipped_excluded;
+	};
+
+	/* Input iterator over entries of directory tree */
+	class iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = walk_entry;
+		using difference_type = std::ptrdiff_t;
+		using pointer = walk_entry *;
+		using reference = walk_entry &;
+
+		iterator() noexcept : walker(nullptr) { }
+
+		reference operator*() const noexcept { return walker->entry; }
+		pointer operator->() const noexcept { return &walker->entry; }
+		iterator &
+		operator++()
+		{
+			if (!walker->next())
+				walker = nullptr;
+			return *this;
+		}
+		void operator++(int) { ++*this; }
+
+		friend bool
+		operator==(const iterator &a, const iterator &b) noexcept
+		{
+			return a.walker == b.walker;
+		}
+		friend bool
+		operator!=(const iterator &a, const iterator &b) noexcept
+		{
+			return a.walker != b.walker;
+		}
+
+	private:
+		friend class tree_walker;
+
+		explicit iterator(tree_walker *walker) noexcept
+			: walker(walker) { }
+
+		/* Walker being iterated or null at the end */
+		tree_walker *walker;
+	};
+
+	explicit tree_walker(const char *dirname,
+		const walk_options &options = walk_options());
+	tree_walker(const char *dirname, std::error_code &ec,
+		const walk_options &options = walk_options());
+	tree_walker(const tree_walker &) = delete;
+	tree_walker &operator=(const tree_walker &) = delete;
+	~tree_walker();
+
+	walk_entry *next();
+	iterator begin();
+	iterator end() const noexcept { return iterator(); }
+
+	/* Last error from opening or reading a sub-directory */
+	std::error_code error() const noexcept { return last_error; }
+	statistics stats() const noexcept { return counters; }
+
+private:
+	/* Directory whose sub-directories are waiting to be read */
+	struct parent {
+		/* Open directory stream or null */
+		DIR *dir;
+
+		/* Number of sub-directories waiting */
+		std::size_t children;
+
+		/* Depth of entries in the directory */
+		int depth;
+	};
+
+	int start(const char *dirname);
+	void finish();
+	bool descend();
+	void check(const directory_entry &e);
+	bool enter(const directory_entry &e);
+	bool listed(const std::vector<std::string> &list) const noexcept;
+	int identify(const directory_entry *e, unsigned long long &dev,
+		unsigned long long &ino, unsigned long &links) const;
+	void measure() noexcept;
+	static void compact(std::string &fifo, std::size_t &head);
+
+	walk_options options;
+
+	/* Path of current directory with separator, followed by file name */
+	std::string path;
+	std::size_t prefix;
+
+	/* Directory being read and depth of its entries */
+	directory_range dir;
+	directory_iterator pos;
+	int level;
+
+	/* Sub-directories of current directory queued so far */
+	std::size_t children;
+
+	/* Entry returned last, or null entry before the first one */
+	walk_entry entry;
+	bool started;
+
+	/*
+	 * Queue of parent directories, paths of parent directories and names
+	 * of their sub-directories.  Paths and names are zero-terminated and
+	 * consumed from head offsets.
+	 */
+	std::deque<parent> parents;
+	std::string paths;
+	std::size_t paths_head;
+	std::string names;
+	std::size_t names_head;
+	std::size_t pending;
+
+	/* Number of parent directories kept open */
+	std::size_t open_parents;
+
+	/* Directories and hard-linked files seen so far */
+	visited_set visited;
+
+	/* Included mount root entered so far */
+	struct mount {
+		std::string path;
+		unsigned long long dev;
+	};
+
+	/* Device of starting directory and included mount roots */
+	unsigned long long device;
+	std::vector<mount> mounts;
+
+	std::error_code last_error;
+	statistics counters;
+};
+
+/* Open directory tree or throw std::system_error */
+inline
+tree_walker::tree_walker(const char *dirname, const walk_options &options)
+	: options(options), prefix(0), level(0), children(0), entry(&path),
+	started(false), paths_head(0), names_head(0), pending(0),
+	open_parents(0), visited(options.max_tracked), device(0), counters()
+{
+	int error = start(dirname);
+	if (error)
+		throw std::system_error(error, std::generic_category(), dirname);
+}
+
+/* Open directory tree or set ec */
+inline
+tree_walker::tree_walker(const char *dirname, std::error_code &ec,
+	const walk_options &options)
+	: options(options), prefix(0), level(0), children(0), entry(&path),
+	started(false), paths_head(0), names_head(0), pending(0),
+	open_parents(0), visited(options.max_tracked), device(0), counters()
+{
+	int error = start(dirname);
+	if (error)
+		ec.assign(error, std::generic_category());
+	else
+		ec.clear();
+}
+
+/* Close parent directories still waiting in queue */
+inline
+tree_walker::~tree_walker()
+{
+	for (parent &p : parents) {
+		if (p.dir)
+			closedir(p.dir);
+	}
+}
+
+/* Open starting directory, returns zero on success or error code */
+inline int
+tree_walker::start(const char *dirname)
+{
+	if (options.max_handles < 1)
+		options.max_handles = 1;
+
+	int error = dir.open(dirname);
+	if (error)
+		return error;
+	counters.path_opens++;
+
+	/* Append directory separator if not already there */
+	path.reserve(strlen(dirname) + PATH_MAX + 2);
+	path = dirname;
+	std::size_t n = path.size();
+	if (n > 0 && path[n - 1] != '/' && path[n - 1] != '\\'
+		&& path[n - 1] != ':')
+		path += '/';
+	prefix = path.size();
+
+	/*
+	 * Remember starting directory in case it is mounted below itself, and
+	 * its device for staying on the same file system
+	 */
+	if (options.unique || options.one_filesystem) {
+		unsigned long long dev = 0, ino = 0;
+		unsigned long links = 0;
+		error = identify(nullptr, dev, ino, links);
+		if (error)
+			return error;
+		if (options.unique)
+			visited.insert(dev, ino);
+		device = dev;
+	}
+
+	/* Compare listed directories without trailing separator */
+	for (auto *list : { &options.include_mounts, &options.exclude_mounts }) {
+		for (std::string &s : *list) {
+			while (s.size() > 1
+				&& (s.back() == '/' || s.back() == '\\')) {
+				s.pop_back();
+			}
+		}
+	}
+	measure();
+	return 0;
+}
+
+/* Get iterator to the current entry, reading the first one if needed */
+inline tree_walker::iterator
+tree_walker::begin()
+{
+	if (!started)
+		return iterator(next() ? this : nullptr);
+	return iterator(entry.entry ? this : nullptr);
+}
+
+/* Advance to the next entry, returns null at the end of tree */
+inline walk_entry *
+tree_walker::next()
+{
+	if (!started) {
+		started = true;
+		if (dir)
+			pos = dir.begin();
+	} else if (entry.entry) {
+		/* Queue sub-directory returned last unless pruned */
+		if (!entry.pruned && !entry.dup
+			&& entry.entry->type() == file_type::directory
+			&& enter(*entry.entry)) {
+			std::string_view name = entry.entry->name();
+			names.append(name.data(), name.size());
+			names += '\0';
+			children++;
+			pending++;
+			measure();
+		}
+		entry.entry = nullptr;
+		++pos;
+	}
+
+	while (true) {
+		if (pos != directory_iterator()) {
+			const directory_entry &e = *pos;
+			path.resize(prefix);
+			path.append(e.name());
+			entry.entry = &e;
+			entry.level = level;
+			entry.pruned = false;
+			entry.dup = false;
+			if (options.unique)
+				check(e);
+			return &entry;
+		}
+
+		/* End of directory */
+		if (dir && dir.error())
+			last_error = dir.error();
+		finish();
+		if (!descend()) {
+			entry.entry = nullptr;
+			return nullptr;
+		}
+	}
+}
+
+/*
+ * Move current directory to the queue of parents if it has sub-directories
+ * waiting.  The directory stream is kept open if the budget allows one
+ * more stream besides the one to be read next.
+ */
+inline void
+tree_walker::finish()
+{
+	if (children == 0) {
+		dir.close();
+		return;
+	}
+
+	parent p;
+	p.dir = nullptr;
+	p.children = children;
+	p.depth = level;
+	if (dir && open_parents + 2 <= options.max_handles) {
+		p.dir = dir.release();
+		open_parents++;
+	} else {
+		dir.close();
+	}
+	paths.append(path.data(), prefix);
+	paths += '\0';
+	parents.push_back(p);
+	children = 0;
+	measure();
+}
+
+/*
+ * Open the next sub-directory from queue.  Returns false if the queue is
+ * empty.  Sub-directories which cannot be opened are skipped.
+ */
+inline bool
+tree_walker::descend()
+{
+	while (!parents.empty()) {
+		parent &p = parents.front();
+
+		/* Compose path from parent directory and queued name */
+		const char *name = names.data() + names_head;
+		std::size_t k = strlen(name);
+		path.assign(paths.data() + paths_head);
+		path.append(name, k);
+		level = p.depth + 1;
+
+		int error;
+		if (p.dir) {
+			error = dir.open_at(p.dir, name, path.c_str());
+			counters.relative_opens++;
+		} else {
+			error = dir.open(path.c_str());
+			counters.path_opens++;
+		}
+		names_head += k + 1;
+		pending--;
+
+		/* Release parent after its last sub-directory */
+		if (--p.children == 0) {
+			if (p.dir) {
+				closedir(p.dir);
+				open_parents--;
+			}
+			paths_head += strlen(paths.data() + paths_head) + 1;
+			parents.pop_front();
+			compact(paths, paths_head);
+		}
+		compact(names, names_head);
+
+		if (error) {
+			last_error.assign(error, std::generic_category());
+			counters.errors++;
+			continue;
+		}
+
+		path += '/';
+		prefix = path.size();
+		pos = dir.begin();
+		measure();
+		return true;
+	}
+	return false;
+}
+
+/* Mark entry as duplicate if its file has been returned before */
+inline void
+tree_walker::check(const directory_entry &e)
+{
+	file_type t = e.type();
+	if (t != file_type::directory && t != file_type::regular)
+		return;
+
+	unsigned long long dev = 0, ino = 0;
+	unsigned long links = 0;
+	if (identify(&e, dev, ino, links) != 0)
+		return;
+
+	/* Regular file with a single name cannot repeat */
+	if (t == file_type::regular && links < 2)
+		return;
+
+	switch (visited.insert(dev, ino)) {
+	case visited_set::found:
+		entry.dup = true;
+		if (t == file_type::directory)
+			counters.duplicate_dirs++;
+		else
+			counters.duplicate_files++;
+		break;
+	case visited_set::full:
+		counters.untracked++;
+		break;
+	case visited_set::inserted:
+		counters.visited_bytes = visited.memory();
+		break;
+	}
+}
+
+/*
+ * Returns true if the walk may descend into directory e at path.  With
+ * option one_filesystem, only directories on the device of the starting
+ * directory, included mount roots and directories below them on the same
+ * device are entered.  Another mount of an included device elsewhere in
+ * the tree is skipped unless it is listed too.
+ */
+inline bool
+tree_walker::enter(const directory_entry &e)
+{
+	if (!options.exclude_mounts.empty() && listed(options.exclude_mounts)) {
+		counters.skipped_excluded++;
+		return false;
+	}
+	if (!options.one_filesystem)
+		return true;
+
+	/* Let opendir report directories which cannot be examined */
+	unsigned long long dev = 0, ino = 0;
+	unsigned long links = 0;
+	if (identify(&e, dev, ino, links) != 0)
+		return true;
+	if (dev == device)
+		return true;
+
+	/* Directory below included mount root */
+	for (const mount &m : mounts) {
+		std::size_t n = m.path.size();
+		if (m.dev == dev && path.size() > n
+			&& (path[n] == '/' || path[n] == '\\')
+			&& path.compare(0, n, m.path) == 0)
+			return true;
+	}
+
+	/* Mount root of another file system */
+	if (listed(options.include_mounts)) {
+		mounts.push_back(mount{ path, dev });
+		return true;
+	}
+	counters.skipped_mounts++;
+	return false;
+}
+
+/* Returns true if path of current entry is in list */
+inline bool
+tree_walker::listed(const std::vector<std::string> &list) const noexcept
+{
+	for (const std::string &s : list) {
+		if (s.size() == path.size() && s == path)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Get device, file number and number of links of entry e, or of the
+ * starting directory if e is null.  Returns zero or error code.
+ */
+inline int
+tree_walker::identify(const directory_entry *e, unsigned long long &dev,
+	unsigned long long &ino, unsigned long &links) const
+{
+#if defined(_WIN32)
+	/* Stat does not report file numbers on Windows */
+	(void) e;
+	wchar_t wpath[PATH_MAX + 1];
+	std::size_t n;
+	if (mbstowcs_s(&n, wpath, PATH_MAX + 1, path.c_str(), PATH_MAX + 1))
+		return ENAMETOOLONG;
+	HANDLE h = CreateFileW(wpath, FILE_READ_ATTRIBUTES,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, NULL);
+	if (h == INVALID_HANDLE_VALUE)
+		return EACCES;
+	BY_HANDLE_FILE_INFORMATION info;
+	BOOL ok = GetFileInformationByHandle(h, &info);
+	CloseHandle(h);
+	if (!ok)
+		return EACCES;
+	dev = info.dwVolumeSerialNumber;
+	ino = ((unsigned long long) info.nFileIndexHigh << 32)
+		| info.nFileIndexLow;
+	links = info.nNumberOfLinks;
+#else
+	const stat_type *p;
+	stat_type st;
+	if (e) {
+		std::error_code ec;
+		p = e->status(ec);
+		if (!p)
+			return ec.value();
+	} else {
+		if (::stat(path.c_str(), &st) != 0)
+			return errno;
+		p = &st;
+	}
+	dev = (unsigned long long) p->st_dev;
+	ino = (unsigned long long) p->st_ino;
+	links = (unsigned long) p->st_nlink;
+#endif
+	return 0;
+}
+
+/* Update peak counters */
+inline void
+tree_walker::measure() noexcept
+{
+	std::size_t open = open_parents + (dir ? 1 : 0);
+	if (open > counters.max_open)
+		counters.max_open = open;
+	if (pending > counters.max_pending)
+		counters.max_pending = pending;
+	std::size_t bytes = paths.capacity() + names.capacity()
+		+ parents.size() * sizeof(parent);
+	if (bytes > counters.max_queue_bytes)
+		counters.max_queue_bytes = bytes;
+}
+
+/* Drop consumed part of queue once it takes most of the buffer */
+inline void
+tree_walker::compact(std::string &fifo, std::size_t &head)
+{
+	if (head == fifo.size()) {
+		fifo.clear();
+		head = 0;
+	} else if (head >= 4096 && head > fifo.size() / 2) {
+		fifo.erase(0, head);
+		head = 0;
+	}
+}
+
+}
+
+#endif /*DIRENT_HPP*/
@@ -32,11 +32,60 @@
 #include <wchar.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <malloc.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <ctype.h>
+#include <locale.h>
+
+/*
+ * Compare strings 16 bytes at a time with SSE2 instructions.  Define
+ * DIRENT_NO_SIMD to disable vectorized code paths.  Vector code is also
+ * disabled under AddressSanitizer as the vectorized loop may read past the
+ * zero terminator (albeit never past the end of a memory page).
+ */
+#if !defined(DIRENT_NO_SIMD) && !defined(__SANITIZE_ADDRESS__)
+#	if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) \
+		|| (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#		define DIRENT_SSE2
+#		include <emmintrin.h>
+#		if defined(_MSC_VER)
+#			include <intrin.h>
+#		endif
+#	endif
+#endif
+
+/*
+ * Define DIRENT_POOL to recycle memory of closed directory streams through
+ * free lists local to each thread.  The free lists of a thread are released
+ * when the thread exits.  DIRENT_POOL_SIZE limits the number of free blocks
+ * kept for each kind of memory block.
+ *
+ * The pool is private to the translation unit which includes this file and
+ * each such unit takes a fiber local storage slot of its own.  Define
+ * DIRENT_POOL in every file of the program, or in none, because a stream
+ * opened with the pool cannot be closed in a file compiled without it.  Do
+ * not define DIRENT_POOL in a DLL that may be unloaded while other threads
+ * are running: the callback which releases the pool at thread exit would
+ * then point to unmapped code.
+ */
+#if defined(DIRENT_POOL)
+#	if defined(_MSC_VER)
+#		define DIRENT_THREAD __declspec(thread)
+#	elif defined(__GNUC__)
+#		define DIRENT_THREAD __thread
+#	elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#		define DIRENT_THREAD _Thread_local
+#	endif
+#endif
+#if defined(DIRENT_POOL) && defined(DIRENT_THREAD)
+#	define _DIRENT_HAVE_POOL
+#	if !defined(DIRENT_POOL_SIZE)
+#		define DIRENT_POOL_SIZE 8
+#	endif
+#endif
 
 /* Indicates that d_type field is available in dirent structure */
 #define _DIRENT_HAVE_D_TYPE
@@ -49,6 +98,12 @@
 #	define FILE_ATTRIBUTE_DEVICE 0x40
 #endif
 
+/* Entries missing from Windows SDK older than Windows 7 */
+#if !defined(FIND_FIRST_EX_LARGE_FETCH)
+#	define FIND_FIRST_EX_LARGE_FETCH 2
+#	define FindExInfoBasic ((FINDEX_INFO_LEVELS) 1)
+#endif
+
 /* File type and permission flags for stat(), general mask */
 #if !defined(S_IFMT)
 #	define S_IFMT _S_IFMT
@@ -196,8 +251,92 @@
 /* Return the exact length of the file name without zero terminator */
 #define _D_EXACT_NAMLEN(p) ((p)->d_namlen)
 
-/* Return the maximum size of a file name */
-#define _D_ALLOC_NAMLEN(p) ((PATH_MAX)+1)
+/*
+ * Return the maximum size of a file name.  Slim entries returned by
+ * readdir() only have room for their own name.
+ */
+#ifdef DIRENT_SLIM
+#	define _D_ALLOC_NAMLEN(p) \
+		((p)->d_reclen - offsetof(struct dirent, d_name))
+#else
+#	define _D_ALLOC_NAMLEN(p) ((PATH_MAX)+1)
+#endif
+
+/*
+ * Indicates that opendirat() and scandirat() functions are
+ * available.  Both are extensions of this package rather than POSIX.
+ */
+#define _DIRENT_HAVE_OPENDIRAT
+
+/* Indicates that opendir_pattern() function is available */
+#define _DIRENT_HAVE_OPENDIR_PATTERN
+
+/* Indicates that bytesort() function is available */
+#define _DIRENT_HAVE_BYTESORT
+
+/* Indicates that natural sorting functions are available */
+#define _DIRENT_HAVE_NATSORT
+
+/*
+ * Define DIRENT_STATS before including dirent.h to count the work done by
+ * directory streams.  Function dirent_getstats() then returns counters and
+ * cumulative times of a single stream or of all closed streams.
+ */
+#ifdef DIRENT_STATS
+#	define _DIRENT_HAVE_STATS
+#endif
+
+/*
+ * Define DIRENT_TRACE before including dirent.h to report the beginning and
+ * the end of directory operations to functions registered with
+ * dirent_settrace().
+ */
+#ifdef DIRENT_TRACE
+#	define _DIRENT_HAVE_TRACE
+#endif
+
+/* Indicates that opendir_fetch() is available */
+#define _DIRENT_HAVE_FETCH
+
+/* Flags of opendir_fetch() */
+#define DIRENT_FETCH_BASIC 1
+#define DIRENT_FETCH_LARGE 2
+
+/*
+ * Define DIRENT_BULK before including dirent.h to read directories with
+ * GetFileInformationByHandleEx() into a buffer of packed records instead of
+ * calling FindNextFileW() for each entry.  DIRENT_BULK_SIZE and
+ * DIRENT_BULK_LARGE give the size of buffer in bytes without and with
+ * DIRENT_FETCH_LARGE.  Requires Windows Vista or later.
+ */
+#ifdef DIRENT_BULK
+#	define _DIRENT_HAVE_BULK
+#	if !defined(DIRENT_BULK_SIZE)
+#		define DIRENT_BULK_SIZE 4096
+#	endif
+#	if !defined(DIRENT_BULK_LARGE)
+#		define DIRENT_BULK_LARGE 65536
+#	endif
+#endif
+
+/*
+ * Define DIRENT_SLIM before including dirent.h to keep the entry returned
+ * by readdir() and _wreaddir() in a buffer sized for the file name rather
+ * than embedding PATH_MAX characters in every directory stream.  A later
+ * call may then move the buffer, so the entry is only valid until the next
+ * call on the same stream.
+ */
+#ifdef DIRENT_SLIM
+#	define _DIRENT_HAVE_SLIM
+#endif
+
+/* Flags for natural sorting */
+#define DIRENT_NAT_CASE 1
+#define DIRENT_NAT_ZEROS 2
+#define DIRENT_NAT_UNICODE 4
+
+/* Size of buffer sufficient for dirent_natkey() given length of name */
+#define DIRENT_NATKEY_SIZE(n) ((n) * 6 + 1)
 
 
 #ifdef __cplusplus
@@ -227,12 +366,121 @@ struct _wdirent {
 };
 typedef struct _wdirent _wdirent;
 
+#ifdef DIRENT_STATS
+/* Counters of directory stream */
+struct dirent_stats {
+	/* Entries returned from readdir() and _wreaddir() */
+	unsigned long long entries;
+
+	/* Calls to FindFirstFileExW() and FindNextFileW() */
+	unsigned long long os_calls;
+
+	/* File names which could not be converted to multi-byte string */
+	unsigned long long conversion_errors;
+
+	/* Calls to seekdir() and entries read to find the position */
+	unsigned long long seeks;
+	unsigned long long seek_entries;
+
+	/* Bytes allocated by scandir() */
+	unsigned long long scan_bytes;
+
+	/*
+	 * Nanoseconds spent in the operating system, converting file names,
+	 * seeking and sorting.  Seek time includes the operating system calls
+	 * made while seeking.
+	 */
+	unsigned long long os_ns;
+	unsigned long long convert_ns;
+	unsigned long long seek_ns;
+	unsigned long long sort_ns;
+
+	/*
+	 * Memory blocks and bytes allocated with malloc() for directory
+	 * streams, and memory blocks released with free().  The counters are
+	 * only kept in totals and they are updated at once rather than when
+	 * the stream is closed.
+	 */
+	unsigned long long allocs;
+	unsigned long long alloc_bytes;
+	unsigned long long frees;
+};
+#endif
+
+#ifdef DIRENT_TRACE
+/* Operations reported to trace hooks */
+#define DIRENT_TRACE_OPENDIR 1
+#define DIRENT_TRACE_READDIR 2
+#define DIRENT_TRACE_SORT 3
+#define DIRENT_TRACE_SEEKDIR 4
+#define DIRENT_TRACE_CLOSEDIR 5
+
+/* Beginning or end of directory operation */
+struct dirent_trace {
+	/* Operation such as DIRENT_TRACE_OPENDIR */
+	int operation;
+
+	/* Monotonic time in nanoseconds */
+	unsigned long long time;
+
+	/* Absolute directory name of length characters, not zero-terminated */
+	const wchar_t *path;
+	size_t length;
+
+	/*
+	 * Number of entries returned from readdir, sorted by scandir or read
+	 * by seekdir.  Always zero for opendir and closedir.
+	 */
+	size_t count;
+
+	/* Directory stream which tells apart concurrent operations */
+	const void *stream;
+};
+
+/* Function called on the beginning or the end of an operation */
+typedef void dirent_trace_fn(const struct dirent_trace *event, void *data);
+#endif
+
+/* Directory entry as returned by the file system */
+#ifdef DIRENT_BULK
+typedef FILE_ID_BOTH_DIR_INFO dirent_data;
+#	define DIRENT_NAME(p) ((p)->FileName)
+#	define DIRENT_ATTR(p) ((p)->FileAttributes)
+#else
+typedef WIN32_FIND_DATAW dirent_data;
+#	define DIRENT_NAME(p) ((p)->cFileName)
+#	define DIRENT_ATTR(p) ((p)->dwFileAttributes)
+#endif
+
 struct _WDIR {
+#ifdef DIRENT_SLIM
+	/*
+	 * Buffer of current directory entry and its size in bytes.  The
+	 * buffer is shared by wide-character and multi-byte entries, and it
+	 * is enlarged on demand to fit the file name.
+	 */
+	void *entry;
+	size_t entsize;
+#else
 	/* Current directory entry */
 	struct _wdirent ent;
+#endif
+
+#ifdef DIRENT_BULK
+	/* Packed directory records and size of buffer in bytes */
+	char *buffer;
+	DWORD size;
 
+	/* Offset of current record and offset from it to the next record */
+	DWORD pos;
+	DWORD next;
+
+	/* Offset from the next record to the one following it */
+	DWORD after;
+#else
 	/* Private file data */
 	WIN32_FIND_DATAW data;
+#endif
 
 	/* True if data is valid */
 	int cached;
@@ -245,6 +493,27 @@ struct _WDIR {
 
 	/* Initial directory name */
 	wchar_t *patt;
+
+	/* Upper-case file name pattern or NULL to return all files */
+	wchar_t *filter;
+
+	/* Flags DIRENT_FETCH_BASIC and DIRENT_FETCH_LARGE */
+	int fetch;
+
+#ifdef DIRENT_STATS
+	/* Counters of this stream */
+	struct dirent_stats stats;
+#endif
+
+#ifdef DIRENT_TRACE
+	/*
+	 * State of readdir operation: 0 if not yet started, 1 while reading
+	 * and 2 after the end of directory.  Count is the number of entries
+	 * returned so far.
+	 */
+	int reading;
+	size_t count;
+#endif
 };
 typedef struct _WDIR _WDIR;
 
@@ -271,7 +540,9 @@ struct dirent {
 typedef struct dirent dirent;
 
 struct DIR {
+#ifndef DIRENT_SLIM
 	struct dirent ent;
+#endif
 	struct _WDIR *wdirp;
 };
 typedef struct DIR DIR;
@@ -281,6 +552,17 @@ typedef struct DIR DIR;
 static DIR *opendir(const char *dirname);
 static _WDIR *_wopendir(const wchar_t *dirname);
 
+/* Extension: open directory relative to directory stream */
+static DIR *opendirat(DIR *dirp, const char *name);
+static _WDIR *_wopendirat(_WDIR *dirp, const wchar_t *name);
+
+static DIR *opendir_pattern(const char *dirname, const char *pattern);
+static _WDIR *_wopendir_pattern(
+	const wchar_t *dirname, const wchar_t *pattern);
+
+static DIR *opendir_fetch(const char *dirname, int flags);
+static _WDIR *_wopendir_fetch(const wchar_t *dirname, int flags);
+
 static struct dirent *readdir(DIR *dirp);
 static struct _wdirent *_wreaddir(_WDIR *dirp);
 
@@ -305,16 +587,49 @@ static int scandir(const char *dirname, struct dirent ***namelist,
 	int (*filter)(const struct dirent*),
 	int (*compare)(const struct dirent**, const struct dirent**));
 
+/* Extension: scan directory relative to directory stream */
+static int scandirat(
+	DIR *dirp, const char *name, struct dirent ***namelist,
+	int (*filter)(const struct dirent*),
+	int (*compare)(const struct dirent**, const struct dirent**));
+
 static int alphasort(const struct dirent **a, const struct dirent **b);
 
+static int bytesort(const struct dirent **a, const struct dirent **b);
+
 static int versionsort(const struct dirent **a, const struct dirent **b);
 
 static int strverscmp(const char *a, const char *b);
 
+static int natsort(const struct dirent **a, const struct dirent **b);
+
+static int natcasesort(const struct dirent **a, const struct dirent **b);
+
+static int dirent_natcmp(const char *a, const char *b, int flags);
+
+static size_t dirent_natkey(
+	char *key, size_t size, const char *name, int flags);
+
+static void dirent_releasepool(void);
+
+#ifdef DIRENT_STATS
+static int dirent_getstats(DIR *dirp, struct dirent_stats *stats);
+static int _wdirent_getstats(_WDIR *dirp, struct dirent_stats *stats);
+static void dirent_resetstats(DIR *dirp);
+static void _wdirent_resetstats(_WDIR *dirp);
+#endif
+
+#ifdef DIRENT_TRACE
+static void dirent_settrace(
+	dirent_trace_fn *begin, dirent_trace_fn *end, void *data);
+#endif
+
 /* For compatibility with Symbian */
 #define wdirent _wdirent
 #define WDIR _WDIR
 #define wopendir _wopendir
+#define wopendirat _wopendirat
+#define wopendir_pattern _wopendir_pattern
 #define wreaddir _wreaddir
 #define wclosedir _wclosedir
 #define wrewinddir _wrewinddir
@@ -334,9 +649,39 @@ static int strverscmp(const char *a, const char *b);
 
 
 /* Internal utility functions */
-static WIN32_FIND_DATAW *dirent_first(_WDIR *dirp);
-static WIN32_FIND_DATAW *dirent_next(_WDIR *dirp);
-static long dirent_hash(WIN32_FIND_DATAW *datap);
+static DIR *dirent_open(const char *dirname, const char *pattern, int flags);
+static _WDIR *dirent_wopen(
+	const wchar_t *dirname, const wchar_t *pattern, int flags);
+static wchar_t *dirent_pattern(wchar_t *p, const wchar_t *pattern);
+static int dirent_scan(DIR *dir, struct dirent ***namelist,
+	int (*filter)(const struct dirent*),
+	int (*compare)(const struct dirent**, const struct dirent**));
+static void *dirent_alloc(int pool, size_t size);
+static void dirent_free(int pool, void *p);
+#ifdef DIRENT_SLIM
+static void *dirent_entry(_WDIR *dirp, size_t size);
+#endif
+static int dirent_wread(
+	_WDIR *dirp, struct _wdirent *entry, struct _wdirent **result);
+static int dirent_read(
+	DIR *dirp, struct dirent *entry, struct dirent **result);
+static int dirent_first(_WDIR *dirp);
+static dirent_data *dirent_next(_WDIR *dirp);
+#ifdef DIRENT_BULK
+static dirent_data *dirent_record(_WDIR *dirp, FILE_INFO_BY_HANDLE_CLASS cls);
+#endif
+static const wchar_t *dirent_altname(dirent_data *datap, wchar_t *buffer);
+static void dirent_fail(_WDIR *dirp, DWORD errorcode);
+static long dirent_hash(dirent_data *datap);
+static void dirent_fold(wchar_t *dest, const wchar_t *src, size_t n);
+static int dirent_matchseg(const wchar_t *name, const wchar_t *patt, size_t k);
+static int dirent_match(const wchar_t *name, const wchar_t *patt);
+static int dirent_matchname(const wchar_t *name, const wchar_t *patt);
+static int dirent_isdigit(char c);
+static size_t dirent_prefix(const char *a, const char *b);
+static int dirent_collate_c(void);
+static int dirent_natdigit(const unsigned char *p, size_t *len, int flags);
+static int dirent_natfold(int c, int flags);
 
 #if !defined(_MSC_VER) || _MSC_VER < 1400
 static int dirent_mbstowcs_s(
@@ -354,6 +699,94 @@ static int dirent_wcstombs_s(
 static void dirent_set_errno(int error);
 #endif
 
+/* Pools of memory blocks */
+#define DIRENT_POOL_DIR 0
+#define DIRENT_POOL_WDIR 1
+#define DIRENT_POOL_PATT 2
+#define DIRENT_POOL_BUFFER 3
+#define DIRENT_POOL_ENTRY 4
+#define DIRENT_POOLS 5
+
+#ifdef _DIRENT_HAVE_POOL
+/* Header of memory block allocated from pool */
+struct dirent_block {
+	/* Next free block in pool */
+	struct dirent_block *next;
+
+	/* Usable size of block in bytes */
+	size_t size;
+};
+
+/* Free blocks of each pool and number of blocks in the calling thread */
+static DIRENT_THREAD struct dirent_block *dirent_pool[DIRENT_POOLS];
+static DIRENT_THREAD size_t dirent_pooled[DIRENT_POOLS];
+
+/* Non-zero if the pool of the calling thread is released at thread exit */
+static DIRENT_THREAD int dirent_pool_hooked;
+
+/* Fiber local storage index with callback which releases the pool */
+static volatile LONG dirent_pool_index = (LONG) FLS_OUT_OF_INDEXES;
+
+static int dirent_pool_hook(void);
+static void WINAPI dirent_pool_exit(void *data);
+#endif
+
+/* Update counters of directory stream if DIRENT_STATS is defined */
+#if defined(DIRENT_STATS) || defined(DIRENT_TRACE)
+static unsigned long long dirent_clock(void);
+#endif
+#ifdef DIRENT_STATS
+static struct dirent_stats dirent_totals;
+static void dirent_addstats(
+	struct dirent_stats *dst, const struct dirent_stats *src);
+static void dirent_addtotal(unsigned long long *counter,
+	unsigned long long n);
+#	define DIRENT_COUNT(dirp, field, n) ((dirp)->stats.field += (n))
+#	define DIRENT_START(var) unsigned long long var = dirent_clock()
+#	define DIRENT_STOP(dirp, field, var) \
+		((dirp)->stats.field += dirent_clock() - (var))
+#else
+#	define DIRENT_COUNT(dirp, field, n) ((void) 0)
+#	define DIRENT_START(var) ((void) 0)
+#	define DIRENT_STOP(dirp, field, var) ((void) 0)
+#endif
+
+/*
+ * Call trace hooks if DIRENT_TRACE is defined.  Without registered hooks,
+ * each operation only tests a pointer.
+ */
+#ifdef DIRENT_TRACE
+static dirent_trace_fn *dirent_trace_begin;
+static dirent_trace_fn *dirent_trace_end;
+static void *dirent_trace_data;
+static void dirent_trace(
+	dirent_trace_fn *hook, int operation, _WDIR *dirp, size_t count);
+static void dirent_trace_read_begin(_WDIR *dirp);
+static void dirent_trace_read(_WDIR *dirp, int found);
+static void dirent_trace_stop(_WDIR *dirp);
+#	define DIRENT_BEGIN(op, dirp, n) \
+		(dirent_trace_begin \
+			? dirent_trace(dirent_trace_begin, (op), (dirp), (n)) \
+			: (void) 0)
+#	define DIRENT_END(op, dirp, n) \
+		(dirent_trace_end \
+			? dirent_trace(dirent_trace_end, (op), (dirp), (n)) \
+			: (void) 0)
+#	define DIRENT_READ_BEGIN(dirp) \
+		(dirent_trace_begin || dirent_trace_end \
+			? dirent_trace_read_begin(dirp) : (void) 0)
+#	define DIRENT_READ(dirp, found) \
+		(dirent_trace_begin || dirent_trace_end \
+			? dirent_trace_read((dirp), (found)) : (void) 0)
+#	define DIRENT_READ_STOP(dirp) dirent_trace_stop(dirp)
+#else
+#	define DIRENT_BEGIN(op, dirp, n) ((void) 0)
+#	define DIRENT_END(op, dirp, n) ((void) 0)
+#	define DIRENT_READ_BEGIN(dirp) ((void) 0)
+#	define DIRENT_READ(dirp, found) ((void) 0)
+#	define DIRENT_READ_STOP(dirp) ((void) 0)
+#endif
+
 
 /*
  * Open directory stream DIRNAME for read and return a pointer to the
@@ -363,24 +796,92 @@ static void dirent_set_errno(int error);
 static _WDIR *
 _wopendir(const wchar_t *dirname)
 {
-	wchar_t *p;
+	return _wopendir_pattern(dirname, NULL);
+}
+
+/*
+ * Open directory stream DIRNAME for reading file names that match
+ * PATTERN.  The pattern may contain wild-cards * and ? which match any
+ * number of characters and exactly one character, respectively.  File
+ * names are matched without regard to case.  Unlike with FindFirstFile(),
+ * pattern *.* only matches names that contain a dot.
+ *
+ * The pattern is passed on to the operating system so that most
+ * non-matching file names are never returned from the kernel.  The
+ * remaining file names are matched against the pattern before conversion
+ * such that readdir() only ever sees matching entries.  Pattern NULL
+ * returns all files just like opendir().
+ */
+static _WDIR *
+_wopendir_pattern(const wchar_t *dirname, const wchar_t *pattern)
+{
+	return dirent_wopen(dirname, pattern, 0);
+}
+
+/*
+ * Open directory stream DIRNAME and choose how the operating system
+ * retrieves directory entries.  Flag DIRENT_FETCH_BASIC skips the old 8+3
+ * file names, which saves work on file systems that store them.  Flag
+ * DIRENT_FETCH_LARGE retrieves directory entries in larger batches, which
+ * reduces round trips to network drives.  Directory streams opened with
+ * _wopendirat() inherit the flags of their parent.
+ *
+ * Be ware that without 8+3 file names, readdir() returns "?" for file names
+ * which cannot be represented in the current code page.
+ */
+static _WDIR *
+_wopendir_fetch(const wchar_t *dirname, int flags)
+{
+	return dirent_wopen(dirname, NULL, flags);
+}
 
+/* Open directory stream with pattern and flags */
+static _WDIR *
+dirent_wopen(const wchar_t *dirname, const wchar_t *pattern, int flags)
+{
 	/* Must have directory name */
 	if (dirname == NULL || dirname[0] == '\0') {
 		dirent_set_errno(ENOENT);
 		return NULL;
 	}
 
+	/* Pattern applies to file names only */
+	size_t k = 0;
+	if (pattern) {
+		k = wcslen(pattern);
+		if (wcspbrk(pattern, L"\\/:") != NULL) {
+			dirent_set_errno(EINVAL);
+			return NULL;
+		}
+	}
+
 	/* Allocate new _WDIR structure */
-	_WDIR *dirp = (_WDIR*) malloc(sizeof(struct _WDIR));
+	_WDIR *dirp = (_WDIR*) dirent_alloc(
+		DIRENT_POOL_WDIR, sizeof(struct _WDIR));
 	if (!dirp)
 		return NULL;
 
 	/* Reset _WDIR structure */
 	dirp->handle = INVALID_HANDLE_VALUE;
 	dirp->patt = NULL;
+	dirp->filter = NULL;
+	dirp->fetch = flags;
 	dirp->cached = 0;
 	dirp->invalid = 0;
+#ifdef DIRENT_BULK
+	dirp->buffer = NULL;
+#endif
+#ifdef DIRENT_SLIM
+	dirp->entry = NULL;
+	dirp->entsize = 0;
+#endif
+#ifdef DIRENT_STATS
+	memset(&dirp->stats, 0, sizeof(dirp->stats));
+#endif
+#ifdef DIRENT_TRACE
+	dirp->reading = 0;
+	dirp->count = 0;
+#endif
 
 	/*
 	 * Compute the length of full path plus zero terminator
@@ -396,8 +897,12 @@ _wopendir(const wchar_t *dirname)
 	size_t n = wcslen(dirname);
 #endif
 
-	/* Allocate room for absolute directory name and search pattern */
-	dirp->patt = (wchar_t*) malloc(sizeof(wchar_t) * n + 16);
+	/*
+	 * Allocate room for absolute directory name and search pattern,
+	 * followed by an upper-case copy of the pattern
+	 */
+	dirp->patt = (wchar_t*) dirent_alloc(
+		DIRENT_POOL_PATT, sizeof(wchar_t) * (n + 2 * k) + 16);
 	if (dirp->patt == NULL)
 		goto exit_closedir;
 
@@ -419,8 +924,137 @@ _wopendir(const wchar_t *dirname)
 	wcsncpy_s(dirp->patt, n+1, dirname, n);
 #endif
 
+	/* Append search pattern to the directory name */
+	dirp->filter = dirent_pattern(dirp->patt + n, pattern);
+
+	/* Open directory stream and retrieve the first entry */
+	DIRENT_BEGIN(DIRENT_TRACE_OPENDIR, dirp, 0);
+	int ok;
+	ok = dirent_first(dirp);
+	DIRENT_END(DIRENT_TRACE_OPENDIR, dirp, 0);
+	if (!ok)
+		goto exit_closedir;
+
+	/* Success */
+	return dirp;
+
+	/* Failure */
+exit_closedir:
+	_wclosedir(dirp);
+	return NULL;
+}
+
+/*
+ * Open directory stream NAME relative to directory stream DIRP.
+ *
+ * The function re-uses the absolute directory name already resolved for the
+ * parent directory, so opening sub-directories in a recursive scan doesn't
+ * require resolving the full path name again.  Absolute directory names are
+ * opened as with _wopendir().
+ *
+ * Unlike openat() in POSIX, the function takes a directory stream rather
+ * than a file descriptor as Windows has no file descriptors for directories.
+ * The function is an extension of this package and other systems don't
+ * provide it; check for macro _DIRENT_HAVE_OPENDIRAT before use.
+ */
+static _WDIR *
+_wopendirat(_WDIR *dirp, const wchar_t *name)
+{
+	/* Must have an open parent directory */
+	if (!dirp || !dirp->patt) {
+		dirent_set_errno(EBADF);
+		return NULL;
+	}
+
+	/* Must have directory name */
+	if (name == NULL || name[0] == '\0') {
+		dirent_set_errno(ENOENT);
+		return NULL;
+	}
+
+	/* Absolute directory name is not relative to parent */
+	if (name[0] == '\\' || name[0] == '/' || name[1] == ':')
+		return dirent_wopen(name, NULL, dirp->fetch);
+
+	/* Find the end of parent directory name in its search pattern */
+	size_t m = wcslen(dirp->patt);
+	while (m > 0) {
+		wchar_t c = dirp->patt[m - 1];
+		if (c == '\\' || c == '/' || c == ':')
+			break;
+		m--;
+	}
+
+	/* Allocate new _WDIR structure */
+	_WDIR *subdirp = (_WDIR*) dirent_alloc(
+		DIRENT_POOL_WDIR, sizeof(struct _WDIR));
+	if (!subdirp)
+		return NULL;
+
+	/* Reset _WDIR structure */
+	subdirp->handle = INVALID_HANDLE_VALUE;
+	subdirp->filter = NULL;
+	subdirp->fetch = dirp->fetch;
+	subdirp->cached = 0;
+	subdirp->invalid = 0;
+#ifdef DIRENT_BULK
+	subdirp->buffer = NULL;
+#endif
+#ifdef DIRENT_SLIM
+	subdirp->entry = NULL;
+	subdirp->entsize = 0;
+#endif
+#ifdef DIRENT_STATS
+	memset(&subdirp->stats, 0, sizeof(subdirp->stats));
+#endif
+#ifdef DIRENT_TRACE
+	subdirp->reading = 0;
+	subdirp->count = 0;
+#endif
+
+	/* Allocate room for directory names and search pattern */
+	size_t k = wcslen(name);
+	subdirp->patt = (wchar_t*) dirent_alloc(
+		DIRENT_POOL_PATT, sizeof(wchar_t) * (m + k) + 16);
+	if (subdirp->patt == NULL)
+		goto exit_closedir;
+
+	/* Concatenate parent directory name and sub-directory name */
+	memcpy(subdirp->patt, dirp->patt, sizeof(wchar_t) * m);
+	memcpy(subdirp->patt + m, name, sizeof(wchar_t) * k);
+
 	/* Append search pattern \* to the directory name */
-	p = dirp->patt + n;
+	dirent_pattern(subdirp->patt + m + k, NULL);
+
+	/* Open directory stream and retrieve the first entry */
+	DIRENT_BEGIN(DIRENT_TRACE_OPENDIR, subdirp, 0);
+	int ok;
+	ok = dirent_first(subdirp);
+	DIRENT_END(DIRENT_TRACE_OPENDIR, subdirp, 0);
+	if (!ok)
+		goto exit_closedir;
+
+	/* Success */
+	return subdirp;
+
+	/* Failure */
+exit_closedir:
+	_wclosedir(subdirp);
+	return NULL;
+}
+
+/*
+ * Append search pattern to a directory name ending at p.  Pattern NULL
+ * appends \*.  Otherwise, the pattern is appended to the directory name
+ * and an upper-case copy of the pattern is stored after the zero
+ * terminator.  The buffer must have room for twice the length of the
+ * pattern plus four more characters.
+ *
+ * Returns the upper-case copy or NULL if the pattern matches all files.
+ */
+static wchar_t *
+dirent_pattern(wchar_t *p, const wchar_t *pattern)
+{
 	switch (p[-1]) {
 	case '\\':
 	case '/':
@@ -433,20 +1067,28 @@ _wopendir(const wchar_t *dirname)
 		/* Directory name doesn't end in path separator */
 		*p++ = '\\';
 	}
-	*p++ = '*';
-	*p = '\0';
 
-	/* Open directory stream and retrieve the first entry */
-	if (!dirent_first(dirp))
-		goto exit_closedir;
+	/* Pattern consisting of asterisks only matches all files */
+	const wchar_t *q = pattern;
+	if (q) {
+		while (*q == '*')
+			q++;
+	}
+	if (q == NULL || *q == '\0') {
+		*p++ = '*';
+		*p = '\0';
+		return NULL;
+	}
 
-	/* Success */
-	return dirp;
+	/* Append pattern */
+	size_t k = wcslen(pattern);
+	memcpy(p, pattern, sizeof(wchar_t) * (k + 1));
 
-	/* Failure */
-exit_closedir:
-	_wclosedir(dirp);
-	return NULL;
+	/* Compile upper-case copy of pattern for dirent_match() */
+	wchar_t *filter = p + k + 1;
+	dirent_fold(filter, pattern, k);
+	filter[k] = '\0';
+	return filter;
 }
 
 /*
@@ -463,9 +1105,13 @@ _wreaddir(_WDIR *dirp)
 	 * value as entry will be set to NULL in case of error.
 	 */
 	struct _wdirent *entry;
-	(void) _wreaddir_r(dirp, &dirp->ent, &entry);
+#ifdef DIRENT_SLIM
+	(void) dirent_wread(dirp, NULL, &entry);
+#else
+	(void) dirent_wread(dirp, &dirp->ent, &entry);
+#endif
 
-	/* Return pointer to statically allocated directory entry */
+	/* Return pointer to directory entry of stream */
 	return entry;
 }
 
@@ -478,6 +1124,17 @@ _wreaddir(_WDIR *dirp)
 static int
 _wreaddir_r(
 	_WDIR *dirp, struct _wdirent *entry, struct _wdirent **result)
+{
+	return dirent_wread(dirp, entry, result);
+}
+
+/*
+ * Read next directory entry to entry, or to the buffer of stream if entry
+ * is NULL.
+ */
+static int
+dirent_wread(
+	_WDIR *dirp, struct _wdirent *entry, struct _wdirent **result)
 {
 	/* Validate directory handle */
 	if (!dirp || dirp->handle == INVALID_HANDLE_VALUE || !dirp->patt) {
@@ -487,7 +1144,9 @@ _wreaddir_r(
 	}
 
 	/* Read next directory entry */
-	WIN32_FIND_DATAW *datap = dirent_next(dirp);
+	DIRENT_READ_BEGIN(dirp);
+	dirent_data *datap = dirent_next(dirp);
+	DIRENT_READ(dirp, datap != NULL);
 	if (!datap) {
 		/* Return NULL to indicate end of directory */
 		*result = NULL;
@@ -499,9 +1158,29 @@ _wreaddir_r(
 	 * long to fit in to the destination buffer, then truncate file name
 	 * to PATH_MAX characters and zero-terminate the buffer.
 	 */
+	const wchar_t *name = DIRENT_NAME(datap);
+	size_t reclen = sizeof(struct _wdirent);
+#ifdef DIRENT_SLIM
+	if (!entry) {
+		/* Enlarge buffer of stream to fit the file name */
+		size_t k = wcslen(name);
+		if (k > PATH_MAX)
+			k = PATH_MAX;
+		reclen = offsetof(struct _wdirent, d_name)
+			+ (k + 1) * sizeof(wchar_t);
+		entry = (struct _wdirent*) dirent_entry(dirp, reclen);
+		if (!entry) {
+			/* Return the same entry again on next call */
+			dirp->cached = 1;
+			dirent_set_errno(ENOMEM);
+			*result = NULL;
+			return -1;
+		}
+	}
+#endif
 	size_t i = 0;
-	while (i < PATH_MAX && datap->cFileName[i] != 0) {
-		entry->d_name[i] = datap->cFileName[i];
+	while (i < PATH_MAX && name[i] != 0) {
+		entry->d_name[i] = name[i];
 		i++;
 	}
 	entry->d_name[i] = 0;
@@ -510,7 +1189,7 @@ _wreaddir_r(
 	entry->d_namlen = i;
 
 	/* Determine file type */
-	DWORD attr = datap->dwFileAttributes;
+	DWORD attr = DIRENT_ATTR(datap);
 	if ((attr & FILE_ATTRIBUTE_DEVICE) != 0)
 		entry->d_type = DT_CHR;
 	else if ((attr & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
@@ -535,7 +1214,8 @@ _wreaddir_r(
 
 	/* Reset other fields */
 	entry->d_ino = 0;
-	entry->d_reclen = sizeof(struct _wdirent);
+	entry->d_reclen = (unsigned short) reclen;
+	DIRENT_COUNT(dirp, entries, 1);
 
 	/* Set result address */
 	*result = entry;
@@ -561,18 +1241,36 @@ _wclosedir(_WDIR *dirp)
 	 * function to handle errors occurring within _wopendir.
 	 */
 	if (dirp->handle != INVALID_HANDLE_VALUE) {
+		DIRENT_READ_STOP(dirp);
+		DIRENT_BEGIN(DIRENT_TRACE_CLOSEDIR, dirp, 0);
+#ifdef DIRENT_BULK
+		CloseHandle(dirp->handle);
+#else
 		FindClose(dirp->handle);
+#endif
+		DIRENT_END(DIRENT_TRACE_CLOSEDIR, dirp, 0);
 	}
 
+#ifdef DIRENT_STATS
+	/* Add counters to totals of closed streams */
+	dirent_addstats(&dirent_totals, &dirp->stats);
+#endif
+
 	/*
 	 * Release search pattern.  Note that we don't need to care if
-	 * dirp->patt is NULL or not: function free is guaranteed to act
-	 * appropriately.
+	 * dirp->patt is NULL or not: function dirent_free is guaranteed to
+	 * act appropriately.
 	 */
-	free(dirp->patt);
+	dirent_free(DIRENT_POOL_PATT, dirp->patt);
+#ifdef DIRENT_BULK
+	dirent_free(DIRENT_POOL_BUFFER, dirp->buffer);
+#endif
+#ifdef DIRENT_SLIM
+	dirent_free(DIRENT_POOL_ENTRY, dirp->entry);
+#endif
 
 	/* Release directory structure */
-	free(dirp);
+	dirent_free(DIRENT_POOL_WDIR, dirp);
 	return /*success*/0;
 }
 
@@ -586,35 +1284,275 @@ static void _wrewinddir(_WDIR* dirp)
 	if (!dirp || dirp->handle == INVALID_HANDLE_VALUE || !dirp->patt)
 		return;
 
-	/* Release existing search handle */
-	FindClose(dirp->handle);
-
-	/* Open new search handle */
+	/* Restart directory stream from the beginning */
+	DIRENT_READ_STOP(dirp);
 	dirent_first(dirp);
 }
 
-/* Get first directory entry */
-static WIN32_FIND_DATAW *
+#ifndef DIRENT_BULK
+/* Open directory stream and read the first entry to cache */
+static int
 dirent_first(_WDIR *dirp)
 {
+	/* Release existing search handle */
+	if (dirp->handle != INVALID_HANDLE_VALUE)
+		FindClose(dirp->handle);
+
+	/* Select information level and batch size */
+	FINDEX_INFO_LEVELS level = FindExInfoStandard;
+	if ((dirp->fetch & DIRENT_FETCH_BASIC) != 0)
+		level = FindExInfoBasic;
+	DWORD flags = 0;
+	if ((dirp->fetch & DIRENT_FETCH_LARGE) != 0)
+		flags = FIND_FIRST_EX_LARGE_FETCH;
+
 	/* Open directory and retrieve the first entry */
+	DIRENT_START(start);
 	dirp->handle = FindFirstFileExW(
-		dirp->patt, FindExInfoStandard, &dirp->data,
-		FindExSearchNameMatch, NULL, 0);
-	if (dirp->handle == INVALID_HANDLE_VALUE)
-		goto error;
+		dirp->patt, level, &dirp->data,
+		FindExSearchNameMatch, NULL, flags);
+	DIRENT_STOP(dirp, os_ns, start);
+	DIRENT_COUNT(dirp, os_calls, 1);
+	if (dirp->handle == INVALID_HANDLE_VALUE) {
+		if (!dirp->filter || GetLastError() != ERROR_FILE_NOT_FOUND)
+			goto error;
+
+		/*
+		 * No file matches the pattern.  Re-open directory with \*
+		 * in order to return an empty directory stream rather than
+		 * an error.  The search pattern precedes the upper-case copy
+		 * in memory.
+		 */
+		size_t k = wcslen(dirp->filter);
+		wchar_t *p = dirp->filter - k - 1;
+		p[0] = '*';
+		p[1] = '\0';
+		DIRENT_START(retry);
+		dirp->handle = FindFirstFileExW(
+			dirp->patt, level, &dirp->data,
+			FindExSearchNameMatch, NULL, flags);
+		DIRENT_STOP(dirp, os_ns, retry);
+		DIRENT_COUNT(dirp, os_calls, 1);
+		memcpy(p, dirp->filter, sizeof(wchar_t) * (k + 1));
+		if (dirp->handle == INVALID_HANDLE_VALUE)
+			goto error;
+	}
 
 	/* A directory entry is now waiting in memory */
 	dirp->cached = 1;
-	return &dirp->data;
 
-error:
-	/* Failed to open directory: no directory entry in memory */
-	dirp->cached = 0;
+	/* Skip entries which do not match the pattern */
+	if (dirp->filter
+		&& !dirent_match(dirp->data.cFileName, dirp->filter)) {
+		dirp->cached = 0;
+		if (dirent_next(dirp))
+			dirp->cached = 1;
+	}
+	return /*success*/1;
+
+error:
+	/* Failed to open directory */
+	dirent_fail(dirp, GetLastError());
+	return /*failure*/0;
+}
+
+/* Get next directory entry */
+static dirent_data *
+dirent_next(_WDIR *dirp)
+{
+	/* Return NULL if seek position was invalid */
+	if (dirp->invalid)
+		return NULL;
+
+	/* Is the next directory entry already in cache? */
+	if (dirp->cached) {
+		/* Yes, a valid directory entry found in memory */
+		dirp->cached = 0;
+		return &dirp->data;
+	}
+
+	/* Read the next matching directory entry from stream */
+	do {
+		DIRENT_START(start);
+		BOOL ok = FindNextFileW(dirp->handle, &dirp->data);
+		DIRENT_STOP(dirp, os_ns, start);
+		DIRENT_COUNT(dirp, os_calls, 1);
+		if (ok == FALSE) {
+			/* End of directory stream */
+			return NULL;
+		}
+	} while (dirp->filter
+		&& !dirent_match(dirp->data.cFileName, dirp->filter));
+
+	/* Success */
+	return &dirp->data;
+}
+
+#else
+/* Open directory stream and read the first batch of records */
+static int
+dirent_first(_WDIR *dirp)
+{
+	dirent_data *datap;
+	DWORD errorcode;
+
+	/* Allocate buffer with room for zero terminator after last name */
+	if (!dirp->buffer) {
+		DWORD size = DIRENT_BULK_SIZE;
+		if ((dirp->fetch & DIRENT_FETCH_LARGE) != 0)
+			size = DIRENT_BULK_LARGE;
+		dirp->buffer = (char*) dirent_alloc(
+			DIRENT_POOL_BUFFER, size + sizeof(WCHAR));
+		if (!dirp->buffer) {
+			dirp->cached = 0;
+			dirp->invalid = 1;
+			return /*failure*/0;
+		}
+		dirp->size = size;
+	}
+
+	/* Restart an open directory stream from the beginning */
+	FILE_INFO_BY_HANDLE_CLASS cls = FileIdBothDirectoryRestartInfo;
+	if (dirp->handle == INVALID_HANDLE_VALUE) {
+		/*
+		 * Open the directory itself by replacing search pattern with
+		 * a dot for the duration of the call.
+		 */
+		wchar_t *p = dirp->patt + wcslen(dirp->patt);
+		while (p != dirp->patt
+			&& p[-1] != '\\' && p[-1] != '/' && p[-1] != ':')
+			p--;
+		wchar_t c0 = p[0];
+		wchar_t c1 = p[1];
+		p[0] = '.';
+		p[1] = '\0';
+		DIRENT_START(start);
+		dirp->handle = CreateFileW(
+			dirp->patt, FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+		DIRENT_STOP(dirp, os_ns, start);
+		DIRENT_COUNT(dirp, os_calls, 1);
+		p[0] = c0;
+		p[1] = c1;
+		if (dirp->handle == INVALID_HANDLE_VALUE)
+			goto error;
+		cls = FileIdBothDirectoryInfo;
+	}
+
+	/* Read the first batch of records */
+	dirp->next = 0;
+	dirp->cached = 0;
+	datap = dirent_record(dirp, cls);
+	if (!datap) {
+		/* Empty directory is not an error */
+		if (GetLastError() != ERROR_NO_MORE_FILES)
+			goto error;
+		return /*success*/1;
+	}
+
+	/* A directory entry is now waiting in memory */
+	dirp->cached = 1;
+
+	/* Skip entries which do not match the pattern */
+	if (dirp->filter && !dirent_match(datap->FileName, dirp->filter)) {
+		dirp->cached = 0;
+		if (dirent_next(dirp))
+			dirp->cached = 1;
+	}
+	return /*success*/1;
+
+error:
+	/* Failed to open directory: release handle, if any */
+	errorcode = GetLastError();
+	if (dirp->handle != INVALID_HANDLE_VALUE) {
+		CloseHandle(dirp->handle);
+		dirp->handle = INVALID_HANDLE_VALUE;
+	}
+	dirent_fail(dirp, errorcode);
+	return /*failure*/0;
+}
+
+/* Get next directory entry */
+static dirent_data *
+dirent_next(_WDIR *dirp)
+{
+	/* Return NULL if seek position was invalid */
+	if (dirp->invalid)
+		return NULL;
+
+	/* Is the next directory entry already in cache? */
+	if (dirp->cached) {
+		/* Yes, the current record is still valid */
+		dirp->cached = 0;
+		return (dirent_data*) (dirp->buffer + dirp->pos);
+	}
+
+	/* Step to the next matching record */
+	dirent_data *datap;
+	do {
+		datap = dirent_record(dirp, FileIdBothDirectoryInfo);
+		if (!datap) {
+			/* End of directory stream */
+			return NULL;
+		}
+	} while (dirp->filter && !dirent_match(datap->FileName, dirp->filter));
+
+	/* Success */
+	return datap;
+}
+
+/*
+ * Step to the next record in buffer and refill the buffer when all records
+ * have been read.
+ *
+ * File names are zero-terminated in place.  The terminator may overwrite
+ * NextEntryOffset of the following record, so the offset is saved to
+ * dirp->after before writing the terminator.
+ */
+static dirent_data *
+dirent_record(_WDIR *dirp, FILE_INFO_BY_HANDLE_CLASS cls)
+{
+	if (dirp->next == 0) {
+		/* Fetch the next batch of records */
+		DIRENT_START(start);
+		BOOL ok = GetFileInformationByHandleEx(
+			dirp->handle, cls, dirp->buffer, dirp->size);
+		DIRENT_STOP(dirp, os_ns, start);
+		DIRENT_COUNT(dirp, os_calls, 1);
+		if (ok == FALSE)
+			return NULL;
+		dirp->pos = 0;
+		dirp->next = ((dirent_data*) dirp->buffer)->NextEntryOffset;
+	} else {
+		/* Step to the next record in buffer */
+		dirp->pos += dirp->next;
+		dirp->next = dirp->after;
+	}
+
+	/* Save offset of the following record */
+	dirent_data *datap = (dirent_data*) (dirp->buffer + dirp->pos);
+	if (dirp->next != 0) {
+		dirent_data *nextp = (dirent_data*) (
+			dirp->buffer + dirp->pos + dirp->next);
+		dirp->after = nextp->NextEntryOffset;
+	}
+
+	/* Zero-terminate file name */
+	datap->FileName[datap->FileNameLength / sizeof(WCHAR)] = '\0';
+	return datap;
+}
+#endif
+
+/* Mark directory stream invalid and set errno from Windows error code */
+static void
+dirent_fail(_WDIR *dirp, DWORD errorcode)
+{
+	/* No directory entry in memory */
+	dirp->cached = 0;
 	dirp->invalid = 1;
 
 	/* Set error code */
-	DWORD errorcode = GetLastError();
 	switch (errorcode) {
 	case ERROR_ACCESS_DENIED:
 		/* No read access to directory */
@@ -622,6 +1560,9 @@ error:
 		break;
 
 	case ERROR_DIRECTORY:
+#ifdef DIRENT_BULK
+	case ERROR_INVALID_PARAMETER:
+#endif
 		/* Directory name is invalid */
 		dirent_set_errno(ENOTDIR);
 		break;
@@ -631,32 +1572,27 @@ error:
 		/* Cannot find the file */
 		dirent_set_errno(ENOENT);
 	}
-	return NULL;
 }
 
-/* Get next directory entry */
-static WIN32_FIND_DATAW *
-dirent_next(_WDIR *dirp)
+/*
+ * Get 8+3 file name of directory entry or an empty string.  Buffer must
+ * have room for 13 characters.
+ */
+static const wchar_t *
+dirent_altname(dirent_data *datap, wchar_t *buffer)
 {
-	/* Return NULL if seek position was invalid */
-	if (dirp->invalid)
-		return NULL;
-
-	/* Is the next directory entry already in cache? */
-	if (dirp->cached) {
-		/* Yes, a valid directory entry found in memory */
-		dirp->cached = 0;
-		return &dirp->data;
-	}
-
-	/* Read the next directory entry from stream */
-	if (FindNextFileW(dirp->handle, &dirp->data) == FALSE) {
-		/* End of directory stream */
-		return NULL;
-	}
-
-	/* Success */
-	return &dirp->data;
+#ifdef DIRENT_BULK
+	/* Short name is not zero-terminated in records */
+	size_t n = (size_t) datap->ShortNameLength / sizeof(WCHAR);
+	if (n > 12)
+		n = 12;
+	memcpy(buffer, datap->ShortName, n * sizeof(WCHAR));
+	buffer[n] = '\0';
+	return buffer;
+#else
+	(void) buffer;
+	return datap->cAlternateFileName;
+#endif
 }
 
 /*
@@ -665,11 +1601,11 @@ dirent_next(_WDIR *dirp)
  * See djb2 at http://www.cse.yorku.ca/~oz/hash.html
  */
 static long
-dirent_hash(WIN32_FIND_DATAW *datap)
+dirent_hash(dirent_data *datap)
 {
 	unsigned long hash = 5381;
 	unsigned long c;
-	const wchar_t *p = datap->cFileName;
+	const wchar_t *p = DIRENT_NAME(datap);
 	const wchar_t *e = p + MAX_PATH;
 	while (p != e && (c = *p++) != 0) {
 		hash = (hash << 5) + hash + c;
@@ -678,8 +1614,158 @@ dirent_hash(WIN32_FIND_DATAW *datap)
 	return (long) (hash & ((~0UL) >> 1));
 }
 
+/*
+ * Convert n wide characters from src to upper case into dest for matching
+ * file names.
+ *
+ * FindFirstFileExW() compares file names with the upper case table of the
+ * volume regardless of the locale of the process.  Characters outside ASCII
+ * are therefore converted with the invariant locale rather than towupper()
+ * so that the filter accepts the same names as the file system.  Names
+ * with characters outside ASCII take a single call to LCMapStringEx().
+ */
+static void
+dirent_fold(wchar_t *dest, const wchar_t *src, size_t n)
+{
+	/* Convert whole name at once if it has characters outside ASCII */
+	size_t i = 0;
+	while (i < n && src[i] < 0x80)
+		i++;
+	if (i < n && LCMapStringEx(LOCALE_NAME_INVARIANT, LCMAP_UPPERCASE,
+		src, (int) n, dest, (int) n, NULL, NULL, 0) == (int) n)
+		return;
+
+	/* Convert ASCII letters only */
+	for (i = 0; i < n; i++) {
+		wchar_t c = src[i];
+		if (c >= 'a' && c <= 'z')
+			c = (wchar_t) (c - ('a' - 'A'));
+		dest[i] = c;
+	}
+}
+
+/*
+ * Match K characters of name against pattern segment without asterisks.
+ * Returns zero if the name ends before K characters.
+ */
+static int
+dirent_matchseg(const wchar_t *name, const wchar_t *patt, size_t k)
+{
+	for (size_t i = 0; i < k; i++) {
+		if (name[i] == '\0')
+			return 0;
+		if (patt[i] != '?' && name[i] != patt[i])
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Match file name against upper-case pattern from dirent_pattern().  The
+ * name is converted to upper case once before matching.
+ */
+static int
+dirent_match(const wchar_t *name, const wchar_t *patt)
+{
+	/* File names of Windows file systems fit in MAX_PATH characters */
+	wchar_t buffer[MAX_PATH + 1];
+	wchar_t *upper = buffer;
+	size_t n = wcslen(name);
+	if (n > MAX_PATH) {
+		upper = (wchar_t*) malloc(sizeof(wchar_t) * (n + 1));
+		if (!upper)
+			return 0;
+	}
+	dirent_fold(upper, name, n);
+	upper[n] = '\0';
+
+	int ok = dirent_matchname(upper, patt);
+	if (upper != buffer)
+		free(upper);
+	return ok;
+}
+
+/*
+ * Match upper-case file name against upper-case pattern.
+ *
+ * Pattern is split into segments separated by asterisks.  Each segment
+ * is matched at the leftmost position after the previous one and the
+ * last segment is matched at the end of the name.  Since the asterisks
+ * between the segments absorb any characters, the leftmost match never
+ * needs to be reconsidered.  Hence, the matcher does not backtrack and
+ * runs in O(length of name * length of pattern) time at worst.
+ */
+static int
+dirent_matchname(const wchar_t *name, const wchar_t *patt)
+{
+	/* Match leading segment exactly */
+	while (*patt != '*') {
+		if (*patt == '\0')
+			return *name == '\0';
+		if (*name == '\0')
+			return 0;
+		if (*patt != '?' && *name != *patt)
+			return 0;
+		name++;
+		patt++;
+	}
+
+	while (1) {
+		/* Skip asterisks */
+		while (*patt == '*')
+			patt++;
+
+		/* Trailing asterisk matches rest of the name */
+		if (*patt == '\0')
+			return 1;
+
+		/* Find the end of segment */
+		size_t k = 0;
+		while (patt[k] != '*' && patt[k] != '\0')
+			k++;
+
+		/* Last segment must match the end of name */
+		if (patt[k] == '\0') {
+			size_t n = wcslen(name);
+			if (n < k)
+				return 0;
+			return dirent_matchseg(name + n - k, patt, k);
+		}
+
+		/* Find the leftmost match of segment */
+		while (!dirent_matchseg(name, patt, k)) {
+			if (*name == '\0')
+				return 0;
+			name++;
+		}
+		name += k;
+		patt += k;
+	}
+}
+
 /* Open directory stream using plain old C-string */
 static DIR *opendir(const char *dirname)
+{
+	return opendir_pattern(dirname, NULL);
+}
+
+/* Open directory stream for reading file names that match pattern */
+static DIR *
+opendir_pattern(const char *dirname, const char *pattern)
+{
+	return dirent_open(dirname, pattern, 0);
+}
+
+/* Open directory stream and choose how directory entries are retrieved */
+static DIR *
+opendir_fetch(const char *dirname, int flags)
+{
+	return dirent_open(dirname, NULL, flags);
+}
+
+/* Open directory stream with pattern and flags */
+static DIR *
+dirent_open(const char *dirname, const char *pattern, int flags)
 {
 	/* Must have directory name */
 	if (dirname == NULL || dirname[0] == '\0') {
@@ -688,19 +1774,29 @@ static DIR *opendir(const char *dirname)
 	}
 
 	/* Allocate memory for DIR structure */
-	struct DIR *dirp = (DIR*) malloc(sizeof(struct DIR));
+	struct DIR *dirp = (DIR*) dirent_alloc(
+		DIRENT_POOL_DIR, sizeof(struct DIR));
 	if (!dirp)
 		return NULL;
 
-	/* Convert directory name to wide-character string */
+	/* Convert directory name and pattern to wide-character strings */
 	wchar_t wname[PATH_MAX + 1];
+	wchar_t wpatt[PATH_MAX + 1];
+	const wchar_t *wp = NULL;
 	size_t n;
 	int error = mbstowcs_s(&n, wname, PATH_MAX + 1, dirname, PATH_MAX+1);
 	if (error)
 		goto exit_failure;
+	if (pattern) {
+		error = mbstowcs_s(
+			&n, wpatt, PATH_MAX + 1, pattern, PATH_MAX+1);
+		if (error)
+			goto exit_failure;
+		wp = wpatt;
+	}
 
-	/* Open directory stream using wide-character name */
-	dirp->wdirp = _wopendir(wname);
+	/* Open directory stream using wide-character names */
+	dirp->wdirp = dirent_wopen(wname, wp, flags);
 	if (!dirp->wdirp)
 		goto exit_failure;
 
@@ -709,7 +1805,50 @@ static DIR *opendir(const char *dirname)
 
 	/* Failure */
 exit_failure:
-	free(dirp);
+	dirent_free(DIRENT_POOL_DIR, dirp);
+	return NULL;
+}
+
+/* Open directory stream relative to another directory stream */
+static DIR *
+opendirat(DIR *dirp, const char *name)
+{
+	/* Must have an open parent directory */
+	if (!dirp) {
+		dirent_set_errno(EBADF);
+		return NULL;
+	}
+
+	/* Must have directory name */
+	if (name == NULL || name[0] == '\0') {
+		dirent_set_errno(ENOENT);
+		return NULL;
+	}
+
+	/* Allocate memory for DIR structure */
+	struct DIR *subdirp = (DIR*) dirent_alloc(
+		DIRENT_POOL_DIR, sizeof(struct DIR));
+	if (!subdirp)
+		return NULL;
+
+	/* Convert directory name to wide-character string */
+	wchar_t wname[PATH_MAX + 1];
+	size_t n;
+	int error = mbstowcs_s(&n, wname, PATH_MAX + 1, name, PATH_MAX+1);
+	if (error)
+		goto exit_failure;
+
+	/* Open directory stream using wide-character name */
+	subdirp->wdirp = _wopendirat(dirp->wdirp, wname);
+	if (!subdirp->wdirp)
+		goto exit_failure;
+
+	/* Success */
+	return subdirp;
+
+	/* Failure */
+exit_failure:
+	dirent_free(DIRENT_POOL_DIR, subdirp);
 	return NULL;
 }
 
@@ -722,9 +1861,13 @@ readdir(DIR *dirp)
 	 * value as entry will be set to NULL in case of error.
 	 */
 	struct dirent *entry;
-	(void) readdir_r(dirp, &dirp->ent, &entry);
+#ifdef DIRENT_SLIM
+	(void) dirent_read(dirp, NULL, &entry);
+#else
+	(void) dirent_read(dirp, &dirp->ent, &entry);
+#endif
 
-	/* Return pointer to statically allocated directory entry */
+	/* Return pointer to directory entry of stream */
 	return entry;
 }
 
@@ -737,20 +1880,61 @@ readdir(DIR *dirp)
 static int
 readdir_r(
 	DIR *dirp, struct dirent *entry, struct dirent **result)
+{
+	return dirent_read(dirp, entry, result);
+}
+
+/*
+ * Read next directory entry to entry, or to the buffer of wide-character
+ * stream if entry is NULL.
+ */
+static int
+dirent_read(
+	DIR *dirp, struct dirent *entry, struct dirent **result)
 {
 	/* Read next directory entry */
-	WIN32_FIND_DATAW *datap = dirent_next(dirp->wdirp);
+	DIRENT_READ_BEGIN(dirp->wdirp);
+	dirent_data *datap = dirent_next(dirp->wdirp);
+	DIRENT_READ(dirp->wdirp, datap != NULL);
 	if (!datap) {
 		/* No more directory entries */
 		*result = NULL;
 		return /*OK*/0;
 	}
 
+	/* Size of name buffer in bytes */
+	size_t size = PATH_MAX + 1;
+	size_t reclen = sizeof(struct dirent);
+#ifdef DIRENT_SLIM
+	if (!entry) {
+		/*
+		 * Make room for the longest multi-byte string of the file
+		 * name, and for the 8+3 file name should the conversion fail.
+		 */
+		size_t k = wcslen(DIRENT_NAME(datap));
+		if (k < 12)
+			k = 12;
+		if (k * MB_CUR_MAX < PATH_MAX)
+			size = k * MB_CUR_MAX + 1;
+		reclen = offsetof(struct dirent, d_name) + size;
+		entry = (struct dirent*) dirent_entry(dirp->wdirp, reclen);
+		if (!entry) {
+			/* Return the same entry again on next call */
+			dirp->wdirp->cached = 1;
+			dirent_set_errno(ENOMEM);
+			*result = NULL;
+			return -1;
+		}
+	}
+#endif
+
 	/* Attempt to convert file name to multi-byte string */
+	DIRENT_START(start);
 	size_t n;
 	int error = wcstombs_s(
-		&n, entry->d_name, PATH_MAX + 1,
-		datap->cFileName, PATH_MAX + 1);
+		&n, entry->d_name, size, DIRENT_NAME(datap), size);
+	if (error)
+		DIRENT_COUNT(dirp->wdirp, conversion_errors, 1);
 
 	/*
 	 * If the file name cannot be represented by a multi-byte string, then
@@ -761,18 +1945,21 @@ readdir_r(
 	 * unless the file system provides one.  At least VirtualBox shared
 	 * folders fail to do this.
 	 */
-	if (error && datap->cAlternateFileName[0] != '\0') {
+	wchar_t buffer[16];
+	const wchar_t *altname = dirent_altname(datap, buffer);
+	if (error && altname[0] != '\0') {
 		error = wcstombs_s(
-			&n, entry->d_name, PATH_MAX + 1,
-			datap->cAlternateFileName, PATH_MAX + 1);
+			&n, entry->d_name, size, altname, size);
 	}
+	DIRENT_STOP(dirp->wdirp, convert_ns, start);
+	DIRENT_COUNT(dirp->wdirp, entries, 1);
 
 	if (!error) {
 		/* Length of file name excluding zero terminator */
 		entry->d_namlen = n - 1;
 
 		/* Determine file type */
-		DWORD attr = datap->dwFileAttributes;
+		DWORD attr = DIRENT_ATTR(datap);
 		if ((attr & FILE_ATTRIBUTE_DEVICE) != 0)
 			entry->d_type = DT_CHR;
 		else if ((attr & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
@@ -797,7 +1984,7 @@ readdir_r(
 
 		/* Reset fields */
 		entry->d_ino = 0;
-		entry->d_reclen = sizeof(struct dirent);
+		entry->d_reclen = (unsigned short) reclen;
 	} else {
 		/*
 		 * Cannot convert file name to multi-byte string so construct
@@ -811,7 +1998,12 @@ readdir_r(
 		entry->d_type = DT_UNKNOWN;
 		entry->d_ino = 0;
 		entry->d_off = -1;
+#ifdef DIRENT_SLIM
+		/* Keep size of buffer for _D_ALLOC_NAMLEN */
+		entry->d_reclen = (unsigned short) reclen;
+#else
 		entry->d_reclen = 0;
+#endif
 	}
 
 	/* Return pointer to directory entry */
@@ -833,7 +2025,7 @@ closedir(DIR *dirp)
 	dirp->wdirp = NULL;
 
 	/* Release multi-byte character version */
-	free(dirp);
+	dirent_free(DIRENT_POOL_DIR, dirp);
 	return ok;
 
 exit_failure:
@@ -863,7 +2055,7 @@ _wtelldir(_WDIR *dirp)
 	}
 
 	/* Read next file entry */
-	WIN32_FIND_DATAW *datap = dirent_next(dirp);
+	dirent_data *datap = dirent_next(dirp);
 	if (!datap) {
 		/* End of directory stream */
 		return (long) ((~0UL) >> 1);
@@ -894,6 +2086,10 @@ _wseekdir(_WDIR *dirp, long loc)
 {
 	if (!dirp)
 		return;
+	DIRENT_START(start);
+	DIRENT_READ_STOP(dirp);
+	DIRENT_BEGIN(DIRENT_TRACE_SEEKDIR, dirp, 0);
+	size_t n = 0;
 
 	/* Directory must be open */
 	if (dirp->handle == INVALID_HANDLE_VALUE)
@@ -902,9 +2098,9 @@ _wseekdir(_WDIR *dirp, long loc)
 	/* Ensure that seek position is valid */
 	if (loc < 0)
 		goto exit_failure;
+	DIRENT_COUNT(dirp, seeks, 1);
 
 	/* Restart directory stream from the beginning */
-	FindClose(dirp->handle);
 	if (!dirent_first(dirp))
 		goto exit_failure;
 
@@ -921,7 +2117,7 @@ _wseekdir(_WDIR *dirp, long loc)
 	long hash;
 	do {
 		/* Read next directory entry */
-		WIN32_FIND_DATAW *datap = dirent_next(dirp);
+		dirent_data *datap = dirent_next(dirp);
 		if (!datap) {
 			/*
 			 * End of directory stream was reached before finding
@@ -930,6 +2126,8 @@ _wseekdir(_WDIR *dirp, long loc)
 			 */
 			goto exit_failure;
 		}
+		DIRENT_COUNT(dirp, seek_entries, 1);
+		n++;
 
 		/* Does the file name match the hash? */
 		hash = dirent_hash(datap);
@@ -941,11 +2139,15 @@ _wseekdir(_WDIR *dirp, long loc)
 	 */
 	dirp->cached = 1;
 	dirp->invalid = 0;
+	DIRENT_STOP(dirp, seek_ns, start);
+	DIRENT_END(DIRENT_TRACE_SEEKDIR, dirp, n);
 	return;
 
 exit_failure:
 	/* Ensure that readdir will return NULL */
 	dirp->invalid = 1;
+	DIRENT_STOP(dirp, seek_ns, start);
+	DIRENT_END(DIRENT_TRACE_SEEKDIR, dirp, n);
 }
 
 /* Seek directory stream to offset */
@@ -965,8 +2167,6 @@ scandir(
 	int (*filter)(const struct dirent*),
 	int (*compare)(const struct dirent**, const struct dirent**))
 {
-	int result;
-
 	/* Open directory stream */
 	DIR *dir = opendir(dirname);
 	if (!dir) {
@@ -974,6 +2174,41 @@ scandir(
 		return /*Error*/ -1;
 	}
 
+	/* Read entries and close directory stream */
+	return dirent_scan(dir, namelist, filter, compare);
+}
+
+/*
+ * Scan directory relative to another directory stream.  Unlike scandirat()
+ * of the GNU C library, the function takes a directory stream rather than
+ * a file descriptor.
+ */
+static int
+scandirat(
+	DIR *dirp, const char *name, struct dirent ***namelist,
+	int (*filter)(const struct dirent*),
+	int (*compare)(const struct dirent**, const struct dirent**))
+{
+	/* Open directory stream */
+	DIR *dir = opendirat(dirp, name);
+	if (!dir) {
+		/* Cannot open directory */
+		return /*Error*/ -1;
+	}
+
+	/* Read entries and close directory stream */
+	return dirent_scan(dir, namelist, filter, compare);
+}
+
+/* Read entries from directory stream and close the stream */
+static int
+dirent_scan(
+	DIR *dir, struct dirent ***namelist,
+	int (*filter)(const struct dirent*),
+	int (*compare)(const struct dirent**, const struct dirent**))
+{
+	int result;
+
 	/* Read directory entries to memory */
 	struct dirent *tmp = NULL;
 	struct dirent **files = NULL;
@@ -985,6 +2220,8 @@ scandir(
 			tmp = (struct dirent*) malloc(sizeof(struct dirent));
 			if (!tmp)
 				goto exit_failure;
+			DIRENT_COUNT(dir->wdirp, scan_bytes,
+				sizeof(struct dirent));
 		}
 
 		/* Read directory entry to temporary area */
@@ -1011,6 +2248,8 @@ scandir(
 				goto exit_failure;
 
 			/* Got the memory */
+			DIRENT_COUNT(dir->wdirp, scan_bytes,
+				sizeof(void*) * (num_entries - allocated));
 			files = (dirent**) p;
 			allocated = num_entries;
 		}
@@ -1037,8 +2276,19 @@ exit_failure:
 exit_success:
 	/* Sort directory entries */
 	if (size > 1 && compare) {
+		/*
+		 * Collation in C locale equals byte order, so skip strcoll()
+		 * and its locale look-up on each comparison.
+		 */
+		if (compare == alphasort && dirent_collate_c())
+			compare = bytesort;
+
+		DIRENT_START(start);
+		DIRENT_BEGIN(DIRENT_TRACE_SORT, dir->wdirp, size);
 		qsort(files, size, sizeof(void*),
 			(int (*) (const void*, const void*)) compare);
+		DIRENT_END(DIRENT_TRACE_SORT, dir->wdirp, size);
+		DIRENT_STOP(dir->wdirp, sort_ns, start);
 	}
 
 	/* Pass pointer table to caller */
@@ -1064,6 +2314,17 @@ alphasort(const struct dirent **a, const struct dirent **b)
 	return strcoll((*a)->d_name, (*b)->d_name);
 }
 
+/*
+ * Sorting by byte values.  Unlike alphasort(), the order does not depend
+ * on locale and the function is safe to use while another thread changes
+ * locale.
+ */
+static int
+bytesort(const struct dirent **a, const struct dirent **b)
+{
+	return strcmp((*a)->d_name, (*b)->d_name);
+}
+
 /* Sort versions */
 static int
 versionsort(const struct dirent **a, const struct dirent **b)
@@ -1075,21 +2336,18 @@ versionsort(const struct dirent **a, const struct dirent **b)
 static int
 strverscmp(const char *a, const char *b)
 {
-	size_t i = 0;
 	size_t j;
 
 	/* Find first difference */
-	while (a[i] == b[i]) {
-		if (a[i] == '\0') {
-			/* No difference */
-			return 0;
-		}
-		++i;
+	size_t i = dirent_prefix(a, b);
+	if (a[i] == b[i]) {
+		/* No difference */
+		return 0;
 	}
 
 	/* Count backwards and find the leftmost digit */
 	j = i;
-	while (j > 0 && isdigit(a[j-1])) {
+	while (j > 0 && dirent_isdigit(a[j-1])) {
 		--j;
 	}
 
@@ -1101,23 +2359,23 @@ strverscmp(const char *a, const char *b)
 		}
 
 		/* String with more digits is smaller, e.g 002 < 01 */
-		if (isdigit(a[j])) {
-			if (!isdigit(b[j])) {
+		if (dirent_isdigit(a[j])) {
+			if (!dirent_isdigit(b[j])) {
 				return -1;
 			}
-		} else if (isdigit(b[j])) {
+		} else if (dirent_isdigit(b[j])) {
 			return 1;
 		}
-	} else if (isdigit(a[j]) && isdigit(b[j])) {
+	} else if (dirent_isdigit(a[j]) && dirent_isdigit(b[j])) {
 		/* Numeric comparison */
 		size_t k1 = j;
 		size_t k2 = j;
 
 		/* Compute number of digits in each string */
-		while (isdigit(a[k1])) {
+		while (dirent_isdigit(a[k1])) {
 			k1++;
 		}
-		while (isdigit(b[k2])) {
+		while (dirent_isdigit(b[k2])) {
 			k2++;
 		}
 
@@ -1132,6 +2390,673 @@ strverscmp(const char *a, const char *b)
 	return (int) ((unsigned char) a[i]) - ((unsigned char) b[i]);
 }
 
+/* Return true if strings are collated in byte order */
+static int
+dirent_collate_c(void)
+{
+	const char *locale = setlocale(LC_COLLATE, NULL);
+	if (!locale)
+		return 0;
+	return strcmp(locale, "C") == 0 || strcmp(locale, "POSIX") == 0;
+}
+
+/*
+ * Return true if character is a decimal digit.  Unlike isdigit(), the
+ * function does not depend on locale and accepts negative char values.
+ */
+static int
+dirent_isdigit(char c)
+{
+	return (unsigned) ((unsigned char) c - '0') < 10u;
+}
+
+/*
+ * Return index of the first character which differs between strings a and
+ * b, or index of the zero terminator if the strings are identical.
+ */
+static size_t
+dirent_prefix(const char *a, const char *b)
+{
+	size_t i = 0;
+
+#ifdef DIRENT_SSE2
+	/*
+	 * Compare 16 characters at a time as long as neither string crosses
+	 * a page boundary.  Reading past the zero terminator cannot fault
+	 * within a page since memory protection works on page granularity.
+	 */
+	const __m128i zero = _mm_setzero_si128();
+	while ((((size_t) (a + i)) & 4095) <= 4096 - 16
+		&& (((size_t) (b + i)) & 4095) <= 4096 - 16) {
+		__m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+		__m128i y = _mm_loadu_si128((const __m128i*) (b + i));
+
+		/* Set bit for each character which differs or ends string */
+		unsigned mask = (unsigned) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(x, y));
+		mask = (~mask | (unsigned) _mm_movemask_epi8(
+			_mm_cmpeq_epi8(x, zero))) & 0xffffu;
+		if (mask != 0) {
+			/* Return index of the first set bit */
+#if defined(_MSC_VER)
+			unsigned long k;
+			_BitScanForward(&k, mask);
+			return i + k;
+#else
+			return i + (size_t) __builtin_ctz(mask);
+#endif
+		}
+		i += 16;
+	}
+#endif
+
+	/* Compare the rest one character at a time */
+	while (a[i] == b[i] && a[i] != '\0') {
+		++i;
+	}
+	return i;
+}
+
+/* Natural sorting */
+static int
+natsort(const struct dirent **a, const struct dirent **b)
+{
+	return dirent_natcmp((*a)->d_name, (*b)->d_name, 0);
+}
+
+/* Natural sorting ignoring case */
+static int
+natcasesort(const struct dirent **a, const struct dirent **b)
+{
+	return dirent_natcmp((*a)->d_name, (*b)->d_name, DIRENT_NAT_CASE);
+}
+
+/*
+ * Compare strings in natural order such that numbers are compared by value,
+ * e.g. file9.txt < file10.txt.  Numbers sort in place of ASCII digits among
+ * other characters and, if values are equal, the number with fewer leading
+ * zeros comes first.  Other characters are compared byte by byte without
+ * regard to locale.
+ *
+ * Flags modify the comparison as follows:
+ *
+ *     DIRENT_NAT_CASE      Ignore case of ASCII letters
+ *     DIRENT_NAT_ZEROS     Ignore leading zeros, e.g. 007 equals 7
+ *     DIRENT_NAT_UNICODE   Treat UTF-8 encoded Unicode decimal digits
+ *                          such as fullwidth digits as numbers
+ */
+static int
+dirent_natcmp(const char *a, const char *b, int flags)
+{
+	/* Skip identical characters */
+	size_t i = dirent_prefix(a, b);
+	if (a[i] == b[i]) {
+		/* No difference */
+		return 0;
+	}
+
+	/*
+	 * Start comparison from the beginning of the number which contains
+	 * the first difference.  Unicode digits are multi-byte sequences so
+	 * back up over any non-ASCII characters as well.
+	 */
+	const unsigned char *p = (const unsigned char*) a;
+	const unsigned char *q = (const unsigned char*) b;
+	while (i > 0 && (dirent_isdigit(a[i - 1])
+		|| ((flags & DIRENT_NAT_UNICODE) && p[i - 1] >= 0x80))) {
+		--i;
+	}
+	p += i;
+	q += i;
+
+	while (1) {
+		size_t n1;
+		size_t n2;
+		int d1 = dirent_natdigit(p, &n1, flags);
+		int d2 = dirent_natdigit(q, &n2, flags);
+		if (d1 < 0 || d2 < 0) {
+			/* Numbers sort in place of ASCII digits */
+			int c1 = d1 >= 0 ? '0' : dirent_natfold(*p, flags);
+			int c2 = d2 >= 0 ? '0' : dirent_natfold(*q, flags);
+			if (c1 != c2)
+				return c1 - c2;
+			if (c1 == '\0')
+				return 0;
+			p++;
+			q++;
+			continue;
+		}
+
+		/* Skip leading zeros */
+		size_t z1 = 0;
+		while (d1 == 0) {
+			p += n1;
+			z1++;
+			d1 = dirent_natdigit(p, &n1, flags);
+		}
+		size_t z2 = 0;
+		while (d2 == 0) {
+			q += n2;
+			z2++;
+			d2 = dirent_natdigit(q, &n2, flags);
+		}
+
+		/*
+		 * Compare significant digits.  The first difference decides
+		 * unless one number has more digits than the other.
+		 */
+		int diff = 0;
+		while (d1 >= 0 && d2 >= 0) {
+			if (diff == 0)
+				diff = d1 - d2;
+			p += n1;
+			q += n2;
+			d1 = dirent_natdigit(p, &n1, flags);
+			d2 = dirent_natdigit(q, &n2, flags);
+		}
+
+		/* Number with more digits is bigger, e.g 999 < 1000 */
+		if (d1 >= 0)
+			return 1;
+		if (d2 >= 0)
+			return -1;
+		if (diff != 0)
+			return diff;
+
+		/* Number with fewer leading zeros comes first, e.g. 7 < 007 */
+		if (!(flags & DIRENT_NAT_ZEROS) && z1 != z2)
+			return z1 < z2 ? -1 : 1;
+	}
+}
+
+/*
+ * Compute sort key for name such that comparing keys with strcmp() gives
+ * the same order as comparing names with dirent_natcmp() using the same
+ * flags.  Computing keys once allows large sets of names to be sorted
+ * without parsing the numbers on each comparison.
+ *
+ * The key is stored to buffer key of size bytes.  The key is always
+ * zero-terminated but it will be truncated if the buffer is too small.  A
+ * buffer of DIRENT_NATKEY_SIZE(strlen(name)) bytes is always sufficient.
+ * Returns length of the complete key excluding zero terminator.
+ */
+static size_t
+dirent_natkey(char *key, size_t size, const char *name, int flags)
+{
+	const unsigned char *p = (const unsigned char*) name;
+	size_t n = 0;
+	unsigned char tmp[4];
+	size_t k;
+	while (1) {
+		size_t len;
+		int d = dirent_natdigit(p, &len, flags);
+		if (d < 0) {
+			/* Copy other characters as such */
+			int c = dirent_natfold(*p, flags);
+			if (c == '\0')
+				break;
+			if (n + 1 < size)
+				key[n] = (char) c;
+			n++;
+			p++;
+			continue;
+		}
+
+		/* Skip leading zeros */
+		size_t zeros = 0;
+		while (d == 0) {
+			p += len;
+			zeros++;
+			d = dirent_natdigit(p, &len, flags);
+		}
+
+		/* Count significant digits */
+		const unsigned char *digits = p;
+		size_t count = 0;
+		while (d >= 0) {
+			p += len;
+			count++;
+			d = dirent_natdigit(p, &len, flags);
+		}
+
+		/*
+		 * Output number as '0' followed by the number of digits in
+		 * two non-zero bytes and the digits themselves.
+		 */
+		tmp[0] = '0';
+		tmp[1] = (unsigned char) ((count >> 7) + 1);
+		tmp[2] = (unsigned char) ((count & 127) + 1);
+		for (k = 0; k < 3; k++) {
+			if (n + 1 < size)
+				key[n] = (char) tmp[k];
+			n++;
+		}
+		while (count-- > 0) {
+			d = dirent_natdigit(digits, &len, flags);
+			digits += len;
+			if (n + 1 < size)
+				key[n] = (char) ('0' + d);
+			n++;
+		}
+
+		/* Output number of leading zeros as tie breaker */
+		if (!(flags & DIRENT_NAT_ZEROS)) {
+			tmp[0] = (unsigned char) ((zeros >> 7) + 1);
+			tmp[1] = (unsigned char) ((zeros & 127) + 1);
+			for (k = 0; k < 2; k++) {
+				if (n + 1 < size)
+					key[n] = (char) tmp[k];
+				n++;
+			}
+		}
+	}
+
+	/* Zero-terminate key */
+	if (size > 0)
+		key[n < size ? n : size - 1] = '\0';
+	return n;
+}
+
+/*
+ * Return value of decimal digit at p, or -1 if p does not point to a digit.
+ * Length of the digit in bytes is stored to len.
+ */
+static int
+dirent_natdigit(const unsigned char *p, size_t *len, int flags)
+{
+	/*
+	 * First code point of each sequence of ten decimal digits in
+	 * Unicode 13.0 (general category Nd), in ascending order.
+	 */
+	static const unsigned long zeros[] = {
+		0x0660, 0x06F0, 0x07C0, 0x0966, 0x09E6, 0x0A66, 0x0AE6,
+		0x0B66, 0x0BE6, 0x0C66, 0x0CE6, 0x0D66, 0x0DE6, 0x0E50,
+		0x0ED0, 0x0F20, 0x1040, 0x1090, 0x17E0, 0x1810, 0x1946,
+		0x19D0, 0x1A80, 0x1A90, 0x1B50, 0x1BB0, 0x1C40, 0x1C50,
+		0xA620, 0xA8D0, 0xA900, 0xA9D0, 0xA9F0, 0xAA50, 0xABF0,
+		0xFF10, 0x104A0, 0x10D30, 0x11066, 0x110F0, 0x11136,
+		0x111D0, 0x112F0, 0x11450, 0x114D0, 0x11650, 0x116C0,
+		0x11730, 0x118E0, 0x11950, 0x11C50, 0x11D50, 0x11DA0,
+		0x16A60, 0x16B50, 0x1D7CE, 0x1D7D8, 0x1D7E2, 0x1D7EC,
+		0x1D7F6, 0x1E140, 0x1E2F0, 0x1E950, 0x1FBF0
+	};
+
+	/* ASCII digit */
+	if ((unsigned) (*p - '0') < 10u) {
+		*len = 1;
+		return *p - '0';
+	}
+
+	/* Unicode digits are encoded as multi-byte sequences */
+	if (!(flags & DIRENT_NAT_UNICODE) || *p < 0xC2 || *p > 0xF4)
+		return -1;
+
+	/* Decode UTF-8 sequence */
+	size_t n;
+	unsigned long c;
+	if (*p < 0xE0) {
+		n = 2;
+		c = *p & 0x1F;
+	} else if (*p < 0xF0) {
+		n = 3;
+		c = *p & 0x0F;
+	} else {
+		n = 4;
+		c = *p & 0x07;
+	}
+	for (size_t i = 1; i < n; i++) {
+		if ((p[i] & 0xC0) != 0x80)
+			return -1;
+		c = (c << 6) | (p[i] & 0x3F);
+	}
+
+	/* Find the last sequence of digits starting at or before c */
+	size_t lo = 0;
+	size_t hi = sizeof(zeros) / sizeof(zeros[0]);
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (zeros[mid] <= c)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0 || c - zeros[lo - 1] >= 10)
+		return -1;
+
+	*len = n;
+	return (int) (c - zeros[lo - 1]);
+}
+
+/* Convert ASCII letter to lower case if case is to be ignored */
+static int
+dirent_natfold(int c, int flags)
+{
+	if ((flags & DIRENT_NAT_CASE) && (unsigned) (c - 'A') < 26u)
+		return c + ('a' - 'A');
+	return c;
+}
+
+/*
+ * Release free memory blocks kept for the calling thread.  The blocks are
+ * released automatically when the thread exits, so call the function only
+ * to give memory back to the system while the thread keeps running.
+ */
+static void
+dirent_releasepool(void)
+{
+#ifdef _DIRENT_HAVE_POOL
+	for (int i = 0; i < DIRENT_POOLS; i++) {
+		struct dirent_block *bp = dirent_pool[i];
+		while (bp) {
+			struct dirent_block *next = bp->next;
+			free(bp);
+#ifdef DIRENT_STATS
+			dirent_addtotal(&dirent_totals.frees, 1);
+#endif
+			bp = next;
+		}
+		dirent_pool[i] = NULL;
+		dirent_pooled[i] = 0;
+	}
+#endif
+}
+
+#ifdef _DIRENT_HAVE_POOL
+/*
+ * Have the pool of the calling thread released when the thread exits.
+ * Returns zero if the callback cannot be registered, in which case memory
+ * blocks are not to be kept in the pool.
+ */
+static int
+dirent_pool_hook(void)
+{
+	if (dirent_pool_hooked)
+		return 1;
+
+	/* Allocate index on first use, once for all threads */
+	DWORD index = (DWORD) dirent_pool_index;
+	if (index == FLS_OUT_OF_INDEXES) {
+		index = FlsAlloc(dirent_pool_exit);
+		if (index == FLS_OUT_OF_INDEXES)
+			return 0;
+		LONG prev = InterlockedCompareExchange(&dirent_pool_index,
+			(LONG) index, (LONG) FLS_OUT_OF_INDEXES);
+		if (prev != (LONG) FLS_OUT_OF_INDEXES) {
+			/* Another thread allocated index first */
+			FlsFree(index);
+			index = (DWORD) prev;
+		}
+	}
+
+	/* Callback is only called for threads with a non-NULL value */
+	if (!FlsSetValue(index, (void*) &dirent_pool_hooked))
+		return 0;
+	dirent_pool_hooked = 1;
+	return 1;
+}
+
+/* Release pool of exiting thread */
+static void WINAPI
+dirent_pool_exit(void *data)
+{
+	(void) data;
+	dirent_releasepool();
+}
+#endif
+
+/*
+ * Allocate memory block of at least size bytes.  A free block of the
+ * calling thread is re-used if it is large enough.
+ */
+static void *
+dirent_alloc(int pool, size_t size)
+{
+#ifdef _DIRENT_HAVE_POOL
+	/* Take the most recently released block */
+	struct dirent_block *bp = dirent_pool[pool];
+	if (bp) {
+		dirent_pool[pool] = bp->next;
+		dirent_pooled[pool]--;
+		if (bp->size >= size)
+			return bp + 1;
+
+		/* Block is too small for the request */
+		free(bp);
+#ifdef DIRENT_STATS
+		dirent_addtotal(&dirent_totals.frees, 1);
+#endif
+	}
+
+	/* Round size of pattern up so that a block fits most directory names */
+	if (pool == DIRENT_POOL_PATT)
+		size = (size + 511) & ~(size_t) 511;
+	bp = (struct dirent_block*) malloc(sizeof(struct dirent_block) + size);
+	if (!bp)
+		return NULL;
+#ifdef DIRENT_STATS
+	dirent_addtotal(&dirent_totals.allocs, 1);
+	dirent_addtotal(&dirent_totals.alloc_bytes,
+		sizeof(struct dirent_block) + size);
+#endif
+	bp->size = size;
+	return bp + 1;
+#else
+	(void) pool;
+#ifdef DIRENT_STATS
+	dirent_addtotal(&dirent_totals.allocs, 1);
+	dirent_addtotal(&dirent_totals.alloc_bytes, size);
+#endif
+	return malloc(size);
+#endif
+}
+
+#ifdef DIRENT_SLIM
+/*
+ * Get entry buffer of stream with room for at least size bytes.  Returns
+ * NULL and keeps the old buffer if memory runs out.
+ */
+static void *
+dirent_entry(_WDIR *dirp, size_t size)
+{
+	if (size > dirp->entsize) {
+		size = (size + 127) & ~(size_t) 127;
+		void *p = dirent_alloc(DIRENT_POOL_ENTRY, size);
+		if (!p)
+			return NULL;
+		dirent_free(DIRENT_POOL_ENTRY, dirp->entry);
+		dirp->entry = p;
+		dirp->entsize = size;
+	}
+	return dirp->entry;
+}
+#endif
+
+/* Release memory block p to pool, or to the system if the pool is full */
+static void
+dirent_free(int pool, void *p)
+{
+	if (!p)
+		return;
+#ifdef _DIRENT_HAVE_POOL
+	struct dirent_block *bp = (struct dirent_block*) p - 1;
+	if (dirent_pooled[pool] < DIRENT_POOL_SIZE && dirent_pool_hook()) {
+		bp->next = dirent_pool[pool];
+		dirent_pool[pool] = bp;
+		dirent_pooled[pool]++;
+		return;
+	}
+	p = bp;
+#else
+	(void) pool;
+#endif
+	free(p);
+#ifdef DIRENT_STATS
+	dirent_addtotal(&dirent_totals.frees, 1);
+#endif
+}
+
+#ifdef DIRENT_STATS
+/*
+ * Get counters of directory stream.  Directory stream NULL returns the
+ * totals of all streams closed so far, including those opened by
+ * scandir().  The totals are updated with interlocked operations, so
+ * streams may be closed in several threads at once, but the counters of a
+ * snapshot taken meanwhile need not add up.  Each source file including
+ * dirent.h keeps totals of its own.
+ */
+static int
+dirent_getstats(DIR *dirp, struct dirent_stats *stats)
+{
+	return _wdirent_getstats(dirp ? dirp->wdirp : NULL, stats);
+}
+
+static int
+_wdirent_getstats(_WDIR *dirp, struct dirent_stats *stats)
+{
+	if (!stats) {
+		dirent_set_errno(EINVAL);
+		return /*failure*/ -1;
+	}
+	*stats = dirp ? dirp->stats : dirent_totals;
+	return /*success*/ 0;
+}
+
+/* Set counters of directory stream or totals of closed streams to zero */
+static void
+dirent_resetstats(DIR *dirp)
+{
+	_wdirent_resetstats(dirp ? dirp->wdirp : NULL);
+}
+
+static void
+_wdirent_resetstats(_WDIR *dirp)
+{
+	struct dirent_stats *stats = dirp ? &dirp->stats : &dirent_totals;
+	memset(stats, 0, sizeof(*stats));
+}
+
+/* Add counters of src to totals dst, which other threads may update */
+static void
+dirent_addstats(struct dirent_stats *dst, const struct dirent_stats *src)
+{
+	dirent_addtotal(&dst->entries, src->entries);
+	dirent_addtotal(&dst->os_calls, src->os_calls);
+	dirent_addtotal(&dst->conversion_errors, src->conversion_errors);
+	dirent_addtotal(&dst->seeks, src->seeks);
+	dirent_addtotal(&dst->seek_entries, src->seek_entries);
+	dirent_addtotal(&dst->scan_bytes, src->scan_bytes);
+	dirent_addtotal(&dst->os_ns, src->os_ns);
+	dirent_addtotal(&dst->convert_ns, src->convert_ns);
+	dirent_addtotal(&dst->seek_ns, src->seek_ns);
+	dirent_addtotal(&dst->sort_ns, src->sort_ns);
+	dirent_addtotal(&dst->allocs, src->allocs);
+	dirent_addtotal(&dst->alloc_bytes, src->alloc_bytes);
+	dirent_addtotal(&dst->frees, src->frees);
+}
+
+/* Add n to counter of totals atomically */
+static void
+dirent_addtotal(unsigned long long *counter, unsigned long long n)
+{
+	if (n != 0)
+		InterlockedExchangeAdd64((volatile LONG64*) counter, (LONG64) n);
+}
+
+#endif
+
+#ifdef DIRENT_TRACE
+/*
+ * Register functions to be called on the beginning and the end of each
+ * directory operation.  Pass NULL to disable tracing.  Like the rest of
+ * this file, the hooks are static and only apply to directory functions
+ * called from the same source file.
+ */
+static void
+dirent_settrace(dirent_trace_fn *begin, dirent_trace_fn *end, void *data)
+{
+	dirent_trace_begin = begin;
+	dirent_trace_end = end;
+	dirent_trace_data = data;
+}
+
+/* Pass operation on directory stream to trace hook */
+static void
+dirent_trace(dirent_trace_fn *hook, int operation, _WDIR *dirp, size_t count)
+{
+	/* Strip search pattern from directory name */
+	size_t n = dirp->patt ? wcslen(dirp->patt) : 0;
+	while (n > 0) {
+		wchar_t c = dirp->patt[n - 1];
+		if (c == '\\' || c == '/' || c == ':')
+			break;
+		n--;
+	}
+	if (n > 1 && dirp->patt[n - 2] != ':')
+		n--;
+
+	struct dirent_trace event;
+	event.operation = operation;
+	event.time = dirent_clock();
+	event.path = dirp->patt;
+	event.length = n;
+	event.count = count;
+	event.stream = dirp;
+	hook(&event, dirent_trace_data);
+}
+
+/* Begin readdir operation on first call after opendir, rewind or seek */
+static void
+dirent_trace_read_begin(_WDIR *dirp)
+{
+	if (dirp->reading != 0)
+		return;
+
+	dirp->reading = 1;
+	dirp->count = 0;
+	DIRENT_BEGIN(DIRENT_TRACE_READDIR, dirp, 0);
+}
+
+/* Count entry or end readdir operation at the end of directory */
+static void
+dirent_trace_read(_WDIR *dirp, int found)
+{
+	if (dirp->reading != 1)
+		return;
+
+	if (found) {
+		dirp->count++;
+	} else {
+		dirp->reading = 2;
+		DIRENT_END(DIRENT_TRACE_READDIR, dirp, dirp->count);
+	}
+}
+
+/* End readdir operation before rewind, seek or close */
+static void
+dirent_trace_stop(_WDIR *dirp)
+{
+	if (dirp->reading == 1)
+		DIRENT_END(DIRENT_TRACE_READDIR, dirp, dirp->count);
+	dirp->reading = 0;
+}
+#endif
+
+#if defined(DIRENT_STATS) || defined(DIRENT_TRACE)
+/* Monotonic time in nanoseconds */
+static unsigned long long
+dirent_clock(void)
+{
+	static LARGE_INTEGER frequency;
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	unsigned long long t = (unsigned long long) counter.QuadPart;
+	unsigned long long f = (unsigned long long) frequency.QuadPart;
+	return t / f * 1000000000ULL + t % f * 1000000000ULL / f;
+}
+#endif
+
 /* Convert multi-byte string to wide character string */
 #if !defined(_MSC_VER) || _MSC_VER < 1400
 static int
@@ -0,0 +1,280 @@
+/*
+ * Make sure that the breadth-first tree_walker visits every file while
+ * keeping within its budget of open directory streams.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about fopen being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.hpp>
+#include "tempdir.hpp"
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+using namespace dirent_cxx;
+namespace fs = std::filesystem;
+
+static void test_walk(void);
+static void test_order(void);
+static void test_budget(void);
+static void test_prune(void);
+static void test_errors(void);
+static size_t open_streams(void);
+static string make_tree(int dirs, int subdirs, int files);
+static void initialize(void);
+static void cleanup(void);
+
+int
+main(void)
+{
+	initialize();
+
+	test_walk();
+	test_order();
+	test_budget();
+	test_prune();
+	test_errors();
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+/* Visit the same files as std::filesystem with any budget */
+static void
+test_walk(void)
+{
+	vector<string> expect;
+	for (const fs::directory_entry &entry
+		: fs::recursive_directory_iterator("tests")) {
+		expect.push_back(entry.path().generic_string());
+	}
+	sort(expect.begin(), expect.end());
+
+	for (size_t budget = 1; budget <= 4; budget++) {
+		vector<string> found;
+		walk_options options;
+		options.max_handles = budget;
+		tree_walker walker("tests", options);
+		for (walk_entry &entry : walker) {
+			string path(entry.path());
+
+			/* Name is the last component of path */
+			assert(path.size() > entry.name().size());
+			assert(path.compare(path.size() - entry.name().size(),
+				string::npos, entry.name()) == 0);
+
+			/* Depth equals the number of separators after tests */
+			int depth = (int) count(path.begin(), path.end(), '/') - 1;
+			assert(entry.depth() == depth);
+
+			found.push_back(path);
+		}
+		assert(!walker.error());
+		assert(walker.stats().max_open <= budget);
+
+		sort(found.begin(), found.end());
+		assert(found == expect);
+	}
+
+	/* Directory name with trailing separator */
+	int n = 0;
+	for (walk_entry &entry : tree_walker("tests/1/")) {
+		if (entry.name() == "readme.txt") {
+			assert(entry.path() == "tests/1/dir/readme.txt");
+			assert(entry.type() == file_type::regular);
+			assert(entry.size() == 198);
+			assert(entry.depth() == 1);
+		}
+		n++;
+	}
+	assert(n == 3);
+}
+
+/* Entries are returned level by level */
+static void
+test_order(void)
+{
+	string dirname = make_tree(5, 4, 3);
+
+	walk_options options;
+	options.max_handles = 3;
+	tree_walker walker(dirname.c_str(), options);
+	int depth = 0;
+	size_t n = 0;
+	for (walk_entry &entry : walker) {
+		assert(entry.depth() >= depth);
+		depth = entry.depth();
+		n++;
+	}
+	assert(depth == 2);
+	assert(n == 5 + 5 * 4 + 5 * 4 * 3);
+
+	/* Sub-directories are opened relative to open parent directories */
+	tree_walker::statistics s = walker.stats();
+	assert(s.relative_opens > 0);
+	assert(s.relative_opens + s.path_opens == 1 + 5 + 5 * 4);
+	assert(s.errors == 0);
+	assert(s.max_pending == 5 * 4);
+
+	fs::remove_all(dirname);
+}
+
+/* Number of open directory streams never exceeds the budget */
+static void
+test_budget(void)
+{
+	string dirname = make_tree(6, 6, 2);
+	size_t before = open_streams();
+
+	for (size_t budget = 1; budget <= 8; budget++) {
+		walk_options options;
+		options.max_handles = budget;
+		tree_walker walker(dirname.c_str(), options);
+		size_t peak = 0;
+		for (walk_entry &entry : walker) {
+			(void) entry;
+			size_t k = open_streams() - before;
+			if (k > peak)
+				peak = k;
+		}
+		assert(peak <= budget);
+
+		tree_walker::statistics s = walker.stats();
+		assert(s.max_open <= budget);
+		if (budget == 1) {
+			/* Every sub-directory is opened by path */
+			assert(s.relative_opens == 0);
+		}
+		assert(s.relative_opens + s.path_opens == 1 + 6 + 6 * 6);
+	}
+
+	/* Streams are closed at the end and on early exit */
+	{
+		walk_options options;
+		options.max_handles = 4;
+		tree_walker walker(dirname.c_str(), options);
+		for (walk_entry &entry : walker) {
+			if (entry.depth() == 1)
+				break;
+		}
+	}
+	assert(open_streams() == before);
+
+	fs::remove_all(dirname);
+}
+
+/* Skip sub-directories on request */
+static void
+test_prune(void)
+{
+	walk_options options;
+	options.max_handles = 1;
+	int n = 0;
+	for (walk_entry &entry : tree_walker("tests", options)) {
+		if (entry.depth() == 0) {
+			if (entry.name() != "1")
+				entry.prune();
+			continue;
+		}
+		/* Only entries below tests/1 remain */
+		assert(entry.path().substr(0, 8) == "tests/1/");
+		n++;
+	}
+	assert(n == 3);
+}
+
+static void
+test_errors(void)
+{
+	/* Starting directory does not exist */
+	error_code ec;
+	tree_walker walker("tests/invalid", ec);
+	assert(ec == errc::no_such_file_or_directory);
+	assert(walker.begin() == walker.end());
+
+	/* Throwing version */
+	bool thrown = false;
+	try {
+		tree_walker w("tests/1/file");
+	} catch (const system_error &e) {
+		assert(e.code() == errc::not_a_directory);
+		thrown = true;
+	}
+	assert(thrown);
+
+	/* Error is cleared on success */
+	tree_walker w2("tests/1", ec);
+	assert(!ec);
+	for (walk_entry &entry : w2)
+		(void) entry;
+	assert(!w2.error());
+}
+
+/* Number of open file descriptors, or zero if not known */
+static size_t
+open_streams(void)
+{
+#if defined(__linux__)
+	size_t n = 0;
+	for (const fs::directory_entry &entry
+		: fs::directory_iterator("/proc/self/fd")) {
+		(void) entry;
+		n++;
+	}
+	return n;
+#else
+	return 0;
+#endif
+}
+
+/* Create temporary tree with two levels of sub-directories */
+static string
+make_tree(int dirs, int subdirs, int files)
+{
+	string dirname = make_temp_directory();
+
+	for (int i = 0; i < dirs; i++) {
+		char name[64];
+		sprintf(name, "/dir-%02d", i);
+		fs::create_directory(dirname + name);
+		for (int j = 0; j < subdirs; j++) {
+			sprintf(name, "/dir-%02d/sub-%02d", i, j);
+			fs::create_directory(dirname + name);
+			for (int k = 0; k < files; k++) {
+				sprintf(name, "/dir-%02d/sub-%02d/file-%03d.dat",
+					i, j, k);
+				FILE *fp = fopen((dirname + name).c_str(), "w");
+				assert(fp != NULL);
+				fclose(fp);
+			}
+		}
+	}
+	return dirname;
+}
+
+static void
+initialize(void)
+{
+	/*NOP*/;
+}
+
+static void
+cleanup(void)
+{
+	cout << "OK" << endl;
+}
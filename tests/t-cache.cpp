@@ -0,0 +1,272 @@
+/*
+ * Make sure that listing_cache returns up-to-date snapshots.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about fopen being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <iostream>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.hpp>
+#include "tempdir.hpp"
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+using namespace dirent_cxx;
+namespace fs = std::filesystem;
+
+typedef shared_ptr<const directory_list> snapshot;
+
+static void test_snapshot(void);
+static void test_identity(void);
+static void test_notify(void);
+static void test_mtime(void);
+static void test_evict(void);
+static void test_errors(void);
+static void check_changes(listing_cache &cache);
+static bool contains(const snapshot &p, const char *name);
+static void create_file(const string &path);
+static void initialize(void);
+static void cleanup(void);
+
+int
+main(void)
+{
+	initialize();
+
+	test_snapshot();
+	test_identity();
+	test_notify();
+	test_mtime();
+	test_evict();
+	test_errors();
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+/* Repeated calls return the same snapshot */
+static void
+test_snapshot(void)
+{
+	listing_cache cache;
+	snapshot a = cache.get("tests/3");
+	assert(a->size() == 11);
+	assert((*a)[2].name() == "Qwerty-my-aunt.dat");
+	assert((*a)[10].name() == "zebra.dat");
+	assert(cache.size() == 1);
+
+	snapshot b = cache.get("tests/3");
+	assert(a == b);
+
+	listing_cache::statistics s = cache.stats();
+	assert(s.misses == 1);
+	assert(s.hits == 1);
+	assert(s.stale == 0);
+	assert(s.hit_rate() == 0.5);
+
+	/* Snapshot outlives cache */
+	cache.clear();
+	assert(cache.size() == 0);
+	assert(a->size() == 11);
+	snapshot c = cache.get("tests/3");
+	assert(c != a);
+	assert(c->size() == 11);
+}
+
+/* Different paths to the same directory share snapshot */
+static void
+test_identity(void)
+{
+	listing_cache cache;
+	snapshot a = cache.get("tests/1");
+	snapshot b = cache.get("tests/1/dir/..");
+	assert(b->size() == 2);
+	assert((*b)[0].name() == "dir");
+	assert((*b)[0].type() == file_type::directory);
+	assert((*b)[1].name() == "file");
+	assert((*b)[1].type() == file_type::regular);
+#if !defined(_WIN32)
+	/* Inode numbers are not available on Windows */
+	assert(a == b);
+	assert(cache.size() == 1);
+#endif
+}
+
+/* Changes are detected with notifications */
+static void
+test_notify(void)
+{
+	listing_cache cache;
+#ifdef DIRENT_CXX_HAVE_INOTIFY
+	assert(cache.notifying());
+#endif
+	check_changes(cache);
+}
+
+/* Changes are detected with modification time */
+static void
+test_mtime(void)
+{
+	listing_cache cache(16, /*notify*/ false);
+	assert(!cache.notifying());
+	check_changes(cache);
+
+	/* Snapshot of directory modified long ago is reused */
+	string dirname = make_temp_directory();
+	create_file(dirname + "/a");
+	fs::last_write_time(dirname,
+		fs::file_time_type::clock::now() - chrono::hours(1));
+	snapshot a = cache.get(dirname.c_str());
+	assert(a->size() == 1);
+	assert(cache.get(dirname.c_str()) == a);
+
+	/* Recently modified directory is read again until it settles */
+	create_file(dirname + "/b");
+	snapshot b = cache.get(dirname.c_str());
+	assert(b != a);
+	assert(b->size() == 2);
+	snapshot c = cache.get(dirname.c_str());
+	assert(c->size() == 2);
+
+	fs::remove_all(dirname);
+}
+
+/* Least recently used directories are dropped */
+static void
+test_evict(void)
+{
+	listing_cache cache(2);
+	snapshot a = cache.get("tests/1");
+	snapshot b = cache.get("tests/2");
+	assert(cache.get("tests/1") == a);
+	snapshot c = cache.get("tests/3");
+	assert(cache.size() == 2);
+	assert(cache.stats().evictions == 1);
+
+	/* Directory 2 was dropped but 1 was used recently */
+	assert(cache.get("tests/1") == a);
+	assert(cache.get("tests/2") != b);
+	assert(cache.stats().evictions == 2);
+}
+
+static void
+test_errors(void)
+{
+	listing_cache cache;
+
+	/* Directory does not exist */
+	error_code ec;
+	assert(cache.get("tests/invalid", ec) == nullptr);
+	assert(ec == errc::no_such_file_or_directory);
+
+	/* Name refers to a file */
+	assert(cache.get("tests/1/file", ec) == nullptr);
+	assert(ec == errc::not_a_directory);
+
+	/* Throwing version */
+	bool thrown = false;
+	try {
+		cache.get("tests/invalid");
+	} catch (const system_error &e) {
+		assert(e.code() == errc::no_such_file_or_directory);
+		thrown = true;
+	}
+	assert(thrown);
+
+	/* Removed directory is not returned from cache */
+	string dirname = make_temp_directory();
+	assert(cache.get(dirname.c_str(), ec) != nullptr);
+	fs::remove_all(dirname);
+	assert(cache.get(dirname.c_str(), ec) == nullptr);
+	assert(ec == errc::no_such_file_or_directory);
+}
+
+/* Create, rename and delete files and check that snapshots follow */
+static void
+check_changes(listing_cache &cache)
+{
+	string dirname = make_temp_directory();
+	snapshot a = cache.get(dirname.c_str());
+	assert(a->empty());
+
+	/* Create file */
+	create_file(dirname + "/new.txt");
+	snapshot b = cache.get(dirname.c_str());
+	assert(b != a);
+	assert(b->size() == 1);
+	assert(contains(b, "new.txt"));
+
+	/* Old snapshot is not modified */
+	assert(a->empty());
+
+	/* Rename file */
+	fs::rename(dirname + "/new.txt", dirname + "/old.txt");
+	snapshot c = cache.get(dirname.c_str());
+	assert(c->size() == 1);
+	assert(contains(c, "old.txt"));
+
+	/* Create sub-directory */
+	fs::create_directory(dirname + "/sub");
+	snapshot d = cache.get(dirname.c_str());
+	assert(d->size() == 2);
+	assert((*d)[1].name() == "sub");
+	assert((*d)[1].type() == file_type::directory);
+
+	/* Delete file */
+	fs::remove(dirname + "/old.txt");
+	snapshot e = cache.get(dirname.c_str());
+	assert(e->size() == 1);
+	assert(!contains(e, "old.txt"));
+
+	listing_cache::statistics s = cache.stats();
+	assert(s.stale >= 4);
+
+	fs::remove_all(dirname);
+}
+
+/* Returns true if snapshot has an entry with the name */
+static bool
+contains(const snapshot &p, const char *name)
+{
+	for (const scan_entry &e : *p) {
+		if (e.name() == name)
+			return true;
+	}
+	return false;
+}
+
+/* Create empty file */
+static void
+create_file(const string &path)
+{
+	FILE *fp = fopen(path.c_str(), "w");
+	assert(fp != NULL);
+	fclose(fp);
+}
+
+static void
+initialize(void)
+{
+	/*NOP*/;
+}
+
+static void
+cleanup(void)
+{
+	cout << "OK" << endl;
+}
@@ -0,0 +1,227 @@
+/*
+ * Make sure that opendir_fetch() returns the same entries as opendir().
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about strcpy being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+#ifdef _DIRENT_HAVE_FETCH
+static void test_fetch(void);
+static void test_wfetch(void);
+static void test_rewind(void);
+static void test_opendirat(void);
+static void test_errors(void);
+static size_t list(DIR *dir, char *names, size_t size);
+#endif
+static void initialize(void);
+static void cleanup(void);
+
+/* Flags to test */
+#ifdef _DIRENT_HAVE_FETCH
+static const int flags[] = {
+	0,
+	DIRENT_FETCH_BASIC,
+	DIRENT_FETCH_LARGE,
+	DIRENT_FETCH_BASIC | DIRENT_FETCH_LARGE
+};
+#define NUM_FLAGS (sizeof(flags) / sizeof(flags[0]))
+#endif
+
+int
+main(void)
+{
+	initialize();
+
+#ifdef _DIRENT_HAVE_FETCH
+	test_fetch();
+	test_wfetch();
+	test_rewind();
+	test_opendirat();
+	test_errors();
+#endif
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+#ifdef _DIRENT_HAVE_FETCH
+/* Each flag returns the same entries in the same order as opendir */
+static void
+test_fetch(void)
+{
+	static const char *dirs[] = {
+		"tests/1", "tests/2", "tests/3", "tests/4"
+	};
+
+	for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+		DIR *dir = opendir(dirs[i]);
+		assert(dir != NULL);
+		char expect[1024];
+		size_t n = list(dir, expect, sizeof(expect));
+		closedir(dir);
+		assert(n > 2);
+
+		for (size_t j = 0; j < NUM_FLAGS; j++) {
+			dir = opendir_fetch(dirs[i], flags[j]);
+			assert(dir != NULL);
+			char names[1024];
+			assert(list(dir, names, sizeof(names)) == n);
+			assert(strcmp(names, expect) == 0);
+			closedir(dir);
+		}
+	}
+}
+
+/* Wide-character version returns file types too */
+static void
+test_wfetch(void)
+{
+	for (size_t j = 0; j < NUM_FLAGS; j++) {
+		_WDIR *dir = _wopendir_fetch(L"tests/1", flags[j]);
+		assert(dir != NULL);
+
+		int found = 0;
+		struct _wdirent *ent;
+		while ((ent = _wreaddir(dir)) != NULL) {
+			if (wcscmp(ent->d_name, L"dir") == 0) {
+				assert(ent->d_type == DT_DIR);
+				found += 1;
+			} else if (wcscmp(ent->d_name, L"file") == 0) {
+				assert(ent->d_type == DT_REG);
+				found += 2;
+			}
+		}
+		assert(found == 3);
+		_wclosedir(dir);
+	}
+}
+
+/* Rewind and seek re-open the directory with the same flags */
+static void
+test_rewind(void)
+{
+	DIR *dir = opendir_fetch(
+		"tests/3", DIRENT_FETCH_BASIC | DIRENT_FETCH_LARGE);
+	assert(dir != NULL);
+
+	char first[1024];
+	size_t n = list(dir, first, sizeof(first));
+	assert(n == 13);
+
+	rewinddir(dir);
+	char second[1024];
+	assert(list(dir, second, sizeof(second)) == n);
+	assert(strcmp(first, second) == 0);
+
+	/* Seek to third entry */
+	rewinddir(dir);
+	assert(readdir(dir) != NULL);
+	assert(readdir(dir) != NULL);
+	long pos = telldir(dir);
+	struct dirent *ent = readdir(dir);
+	assert(ent != NULL);
+	char name[PATH_MAX + 1];
+	strcpy(name, ent->d_name);
+	while (readdir(dir) != NULL)
+		/*NOP*/;
+	seekdir(dir, pos);
+	ent = readdir(dir);
+	assert(ent != NULL);
+	assert(strcmp(ent->d_name, name) == 0);
+
+	closedir(dir);
+}
+
+/* Sub-directories opened with opendirat inherit flags */
+static void
+test_opendirat(void)
+{
+	DIR *dir = opendir_fetch("tests/1", DIRENT_FETCH_LARGE);
+	assert(dir != NULL);
+
+	DIR *subdir = opendirat(dir, "dir");
+	assert(subdir != NULL);
+	char names[1024];
+	assert(list(subdir, names, sizeof(names)) == 3);
+	closedir(subdir);
+
+	struct dirent **files;
+	int n = scandirat(dir, "dir", &files, NULL, alphasort);
+	assert(n == 3);
+	assert(strcmp(files[2]->d_name, "readme.txt") == 0);
+	for (int i = 0; i < n; i++)
+		free(files[i]);
+	free(files);
+
+	closedir(dir);
+}
+
+static void
+test_errors(void)
+{
+	/* Directory does not exist */
+	errno = 0;
+	assert(opendir_fetch("tests/invalid", DIRENT_FETCH_LARGE) == NULL);
+	assert(errno == ENOENT);
+
+	/* Not a directory */
+	errno = 0;
+	assert(opendir_fetch("tests/1/file", DIRENT_FETCH_BASIC) == NULL);
+	assert(errno == ENOTDIR);
+
+	/* Empty name */
+	errno = 0;
+	assert(opendir_fetch("", DIRENT_FETCH_LARGE) == NULL);
+	assert(errno == ENOENT);
+}
+
+/* Store names of directory to buffer separated by slashes */
+static size_t
+list(DIR *dir, char *names, size_t size)
+{
+	size_t count = 0;
+	size_t n = 0;
+	struct dirent *ent;
+	names[0] = '\0';
+	while ((ent = readdir(dir)) != NULL) {
+		size_t k = strlen(ent->d_name);
+		assert(n + k + 2 < size);
+		memcpy(names + n, ent->d_name, k);
+		names[n + k] = '/';
+		n += k + 1;
+		names[n] = '\0';
+		count++;
+	}
+	return count;
+}
+#endif
+
+static void
+initialize(void)
+{
+#ifndef _DIRENT_HAVE_FETCH
+	/* Fetch options are only available in dirent.h of this package */
+	fprintf(stderr, "Skipped\n");
+	exit(/*Skip*/ 77);
+#endif
+}
+
+static void
+cleanup(void)
+{
+	printf("OK\n");
+}
@@ -0,0 +1,266 @@
+/*
+ * Make sure that tree_walker stays on one file system when asked to.
+ *
+ * The test mounts a tmpfs file system and bind mounts a directory in a
+ * private mount namespace.  The test is skipped if the system does not
+ * allow mounting file systems.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about fopen being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#	define _GNU_SOURCE
+#endif
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.hpp>
+#include "tempdir.hpp"
+#if defined(__linux__)
+#	include <sched.h>
+#	include <sys/mount.h>
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+using namespace dirent_cxx;
+namespace fs = std::filesystem;
+
+#if defined(__linux__)
+static void test_one_filesystem(void);
+static void test_include(void);
+static void test_exclude(void);
+static void test_bind(void);
+static vector<string> walk_paths(const walk_options &options,
+	tree_walker::statistics *s);
+static void touch(const string &path);
+static bool mount_all(void);
+#endif
+static void initialize(void);
+static void cleanup(void);
+
+/* Temporary tree with tmpfs file system mounted at root/mnt */
+static string root;
+
+int
+main(void)
+{
+	initialize();
+
+#if defined(__linux__)
+	test_one_filesystem();
+	test_include();
+	test_exclude();
+	test_bind();
+#endif
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+#if defined(__linux__)
+/* Mount point is returned but not descended into */
+static void
+test_one_filesystem(void)
+{
+	walk_options options;
+	tree_walker::statistics s;
+	vector<string> all = walk_paths(options, &s);
+	assert(find(all.begin(), all.end(), "mnt/inner/file") != all.end());
+	assert(s.skipped_mounts == 0);
+
+	options.one_filesystem = true;
+	vector<string> found = walk_paths(options, &s);
+	vector<string> expect = {
+		"a", "a/file", "b", "b/sub", "b/sub/file", "mnt"
+	};
+	assert(found == expect);
+	assert(s.skipped_mounts == 1);
+	assert(s.skipped_excluded == 0);
+}
+
+/* Listed mount root is descended into with its sub-directories */
+static void
+test_include(void)
+{
+	walk_options options;
+	options.one_filesystem = true;
+	options.include_mounts.push_back(root + "/mnt/");
+	tree_walker::statistics s;
+	vector<string> found = walk_paths(options, &s);
+	assert(find(found.begin(), found.end(), "mnt/inner/file")
+		!= found.end());
+	assert(s.skipped_mounts == 0);
+
+	/* Other mount roots are still skipped */
+	options.include_mounts.clear();
+	options.include_mounts.push_back(root + "/a");
+	walk_paths(options, &s);
+	assert(s.skipped_mounts == 1);
+
+	/* Another mount of an included file system is not entered */
+	string copy = root + "/b/copy";
+	fs::create_directory(copy);
+	int ok = mount((root + "/mnt").c_str(), copy.c_str(), NULL, MS_BIND,
+		NULL);
+	assert(ok == 0);
+	options.include_mounts.clear();
+	options.include_mounts.push_back(root + "/mnt");
+	found = walk_paths(options, &s);
+	assert(find(found.begin(), found.end(), "mnt/inner/file")
+		!= found.end());
+	assert(find(found.begin(), found.end(), "b/copy") != found.end());
+	assert(find(found.begin(), found.end(), "b/copy/inner")
+		== found.end());
+	assert(s.skipped_mounts == 1);
+
+	umount(copy.c_str());
+	fs::remove(copy);
+}
+
+/* Excluded directories are skipped with or without one_filesystem */
+static void
+test_exclude(void)
+{
+	walk_options options;
+	options.exclude_mounts.push_back(root + "/mnt");
+	options.exclude_mounts.push_back(root + "/b/sub");
+	tree_walker::statistics s;
+	vector<string> found = walk_paths(options, &s);
+	vector<string> expect = { "a", "a/file", "b", "b/sub", "mnt" };
+	assert(found == expect);
+	assert(s.skipped_excluded == 2);
+	assert(s.skipped_mounts == 0);
+
+	options.one_filesystem = true;
+	found = walk_paths(options, &s);
+	assert(found == expect);
+	assert(s.skipped_excluded == 2);
+}
+
+/* Bind mount of ancestor is caught by option unique */
+static void
+test_bind(void)
+{
+	string loop = root + "/a/loop";
+	fs::create_directory(loop);
+	int ok = mount(root.c_str(), loop.c_str(), NULL, MS_BIND, NULL);
+	assert(ok == 0);
+
+	/* Same device so one_filesystem does not stop the loop */
+	walk_options options;
+	options.one_filesystem = true;
+	options.unique = true;
+	tree_walker::statistics s;
+	vector<string> found = walk_paths(options, &s);
+	assert(find(found.begin(), found.end(), "a/loop") != found.end());
+	assert(find(found.begin(), found.end(), "a/loop/a") == found.end());
+	assert(s.duplicate_dirs == 1);
+	assert(s.skipped_mounts == 1);
+
+	umount(loop.c_str());
+	fs::remove(loop);
+}
+
+/* Paths of files relative to root in sorted order */
+static vector<string>
+walk_paths(const walk_options &options, tree_walker::statistics *s)
+{
+	vector<string> paths;
+	tree_walker walker(root.c_str(), options);
+	for (walk_entry &entry : walker)
+		paths.push_back(string(entry.path().substr(root.size() + 1)));
+	assert(!walker.error());
+	*s = walker.stats();
+	sort(paths.begin(), paths.end());
+	return paths;
+}
+
+/* Create empty file */
+static void
+touch(const string &path)
+{
+	FILE *fp = fopen(path.c_str(), "w");
+	assert(fp != NULL);
+	fclose(fp);
+}
+
+/*
+ * Enter private mount namespace and mount tmpfs file system at root/mnt.
+ * Returns false if the system does not allow it.
+ */
+static bool
+mount_all(void)
+{
+	/* Mounts disappear when the process exits */
+	if (unshare(CLONE_NEWNS) != 0
+		&& unshare(CLONE_NEWUSER | CLONE_NEWNS) != 0)
+		return false;
+	if (mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) != 0)
+		return false;
+
+	string mnt = root + "/mnt";
+	if (mount("tmpfs", mnt.c_str(), "tmpfs", 0, "size=1m") != 0)
+		return false;
+
+	/* User namespace without mapped user may not create files */
+	error_code ec;
+	fs::create_directory(mnt + "/inner", ec);
+	if (ec)
+		return false;
+	FILE *fp = fopen((mnt + "/inner/file").c_str(), "w");
+	if (!fp)
+		return false;
+	fclose(fp);
+	return true;
+}
+#endif
+
+static void
+initialize(void)
+{
+#if defined(__linux__)
+	/* Create temporary tree */
+	root = make_temp_directory();
+	fs::create_directory(root + "/a");
+	touch(root + "/a/file");
+	fs::create_directory(root + "/b");
+	fs::create_directory(root + "/b/sub");
+	touch(root + "/b/sub/file");
+	fs::create_directory(root + "/mnt");
+
+	if (mount_all())
+		return;
+	error_code ec;
+	fs::remove_all(root, ec);
+#endif
+
+	/* Mounting requires Linux and privileges */
+	fprintf(stderr, "Skipped\n");
+	exit(/*Skip*/ 77);
+}
+
+static void
+cleanup(void)
+{
+#if defined(__linux__)
+	umount((root + "/mnt").c_str());
+	error_code ec;
+	fs::remove_all(root, ec);
+#endif
+	cout << "OK" << endl;
+}
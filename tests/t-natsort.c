@@ -0,0 +1,260 @@
+/*
+ * Make sure that natural sorting functions work correctly.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about strcpy being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+#ifdef _DIRENT_HAVE_NATSORT
+static void test_compare(void);
+static void test_flags(void);
+static void test_unicode(void);
+static void test_scandir(void);
+static void test_keys(void);
+static int sign(int x);
+#endif
+static void initialize(void);
+static void cleanup(void);
+
+int
+main(void)
+{
+	initialize();
+
+#ifdef _DIRENT_HAVE_NATSORT
+	test_compare();
+	test_flags();
+	test_unicode();
+	test_scandir();
+	test_keys();
+#endif
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+#ifdef _DIRENT_HAVE_NATSORT
+static void
+test_compare(void)
+{
+	/* Strings without digits are compared as in strcmp() */
+	assert(dirent_natcmp("", "", 0) == 0);
+	assert(dirent_natcmp("abc", "abc", 0) == 0);
+	assert(dirent_natcmp("a", "b", 0) < 0);
+	assert(dirent_natcmp("b", "a", 0) > 0);
+	assert(dirent_natcmp("a", "aa", 0) < 0);
+	assert(dirent_natcmp("B", "a", 0) < 0);
+
+	/* Numbers are compared by value */
+	assert(dirent_natcmp("file9.txt", "file10.txt", 0) < 0);
+	assert(dirent_natcmp("file10.txt", "file9.txt", 0) > 0);
+	assert(dirent_natcmp("file10.txt", "file10.txt", 0) == 0);
+	assert(dirent_natcmp("999", "1000", 0) < 0);
+	assert(dirent_natcmp("sane-1.2.30", "sane-1.12.0", 0) < 0);
+	assert(dirent_natcmp("sane-1.2.4", "sane-1.2.30", 0) < 0);
+	assert(dirent_natcmp("x2y10", "x2y9", 0) > 0);
+
+	/* Number with fewer leading zeros comes first */
+	assert(dirent_natcmp("7", "007", 0) < 0);
+	assert(dirent_natcmp("007", "7", 0) > 0);
+	assert(dirent_natcmp("007", "8", 0) < 0);
+	assert(dirent_natcmp("0", "00", 0) < 0);
+	assert(dirent_natcmp("00", "1", 0) < 0);
+
+	/* Numbers sort in place of ASCII digits */
+	assert(dirent_natcmp("1", "a", 0) < 0);
+	assert(dirent_natcmp("99", "a", 0) < 0);
+	assert(dirent_natcmp("1", "!", 0) > 0);
+	assert(dirent_natcmp("a1", "a.", 0) > 0);
+	assert(dirent_natcmp("a1", "a", 0) > 0);
+
+	/* Very long numbers */
+	assert(dirent_natcmp(
+		"123456789012345678901234567890",
+		"123456789012345678901234567891", 0) < 0);
+	assert(dirent_natcmp(
+		"923456789012345678901234567890",
+		"1123456789012345678901234567890", 0) < 0);
+
+	/* Non-ASCII characters compare as unsigned bytes */
+	assert(dirent_natcmp("\xe4", "a", 0) > 0);
+	assert(dirent_natcmp("a", "\xe4", 0) < 0);
+}
+
+static void
+test_flags(void)
+{
+	/* Ignore case */
+	assert(dirent_natcmp("B", "a", DIRENT_NAT_CASE) > 0);
+	assert(dirent_natcmp("README", "readme", DIRENT_NAT_CASE) == 0);
+	assert(dirent_natcmp("File10", "file9", DIRENT_NAT_CASE) > 0);
+	assert(dirent_natcmp("Z", "[", DIRENT_NAT_CASE) > 0);
+	assert(dirent_natcmp("\xc4", "\xe4", DIRENT_NAT_CASE) < 0);
+
+	/* Ignore leading zeros */
+	assert(dirent_natcmp("007", "7", DIRENT_NAT_ZEROS) == 0);
+	assert(dirent_natcmp("x007y", "x7z", DIRENT_NAT_ZEROS) < 0);
+	assert(dirent_natcmp("0", "000", DIRENT_NAT_ZEROS) == 0);
+	assert(dirent_natcmp("010", "9", DIRENT_NAT_ZEROS) > 0);
+
+	/* Combination of flags */
+	assert(dirent_natcmp("IMG_0010.JPG", "img_10.jpg",
+		DIRENT_NAT_CASE | DIRENT_NAT_ZEROS) == 0);
+}
+
+static void
+test_unicode(void)
+{
+	/* Fullwidth digits (U+FF10 - U+FF19) */
+	const char *fw2 = "file\xef\xbc\x92";
+	const char *fw10 = "file\xef\xbc\x91\xef\xbc\x90";
+	assert(dirent_natcmp(fw2, fw10, DIRENT_NAT_UNICODE) < 0);
+	assert(dirent_natcmp(fw10, fw2, DIRENT_NAT_UNICODE) > 0);
+	assert(dirent_natcmp(fw2, "file2", DIRENT_NAT_UNICODE) == 0);
+	assert(dirent_natcmp(fw10, "file9", DIRENT_NAT_UNICODE) > 0);
+
+	/* Without the flag, digits are just bytes */
+	assert(dirent_natcmp(fw2, fw10, 0) > 0);
+	assert(dirent_natcmp(fw2, "file9", 0) > 0);
+
+	/* Arabic-Indic digits (U+0660 - U+0669) */
+	const char *ar12 = "\xd9\xa1\xd9\xa2";
+	const char *ar3 = "\xd9\xa3";
+	assert(dirent_natcmp(ar3, ar12, DIRENT_NAT_UNICODE) < 0);
+	assert(dirent_natcmp(ar12, "12", DIRENT_NAT_UNICODE) == 0);
+
+	/* Mixed scripts form a single number */
+	assert(dirent_natcmp("1\xd9\xa2", "12", DIRENT_NAT_UNICODE) == 0);
+
+	/* Letters and invalid sequences are not digits */
+	assert(dirent_natcmp("\xef\xbc\xa1", "1", DIRENT_NAT_UNICODE) > 0);
+	assert(dirent_natcmp("\xef\xbc", "1", DIRENT_NAT_UNICODE) > 0);
+	assert(dirent_natcmp("\xd9", "\xd9\xa1", DIRENT_NAT_UNICODE) > 0);
+}
+
+static void
+test_scandir(void)
+{
+	static const char *natural[] = {
+		".", "..", "3zero.dat", "666.dat", "Qwerty-my-aunt.dat",
+		"README.txt", "aaa.dat", "dirent.dat", "empty.dat",
+		"sane-1.2.4.dat", "sane-1.2.30.dat", "sane-1.12.0.dat",
+		"zebra.dat"
+	};
+	static const char *caseless[] = {
+		".", "..", "3zero.dat", "666.dat", "aaa.dat", "dirent.dat",
+		"empty.dat", "Qwerty-my-aunt.dat", "README.txt",
+		"sane-1.2.4.dat", "sane-1.2.30.dat", "sane-1.12.0.dat",
+		"zebra.dat"
+	};
+	struct dirent **files;
+	int i;
+
+	/* Sort in natural order */
+	int n = scandir("tests/3", &files, NULL, natsort);
+	assert(n == 13);
+	for (i = 0; i < n; i++) {
+		assert(strcmp(files[i]->d_name, natural[i]) == 0);
+		free(files[i]);
+	}
+	free(files);
+
+	/* Sort in natural order ignoring case */
+	n = scandir("tests/3", &files, NULL, natcasesort);
+	assert(n == 13);
+	for (i = 0; i < n; i++) {
+		assert(strcmp(files[i]->d_name, caseless[i]) == 0);
+		free(files[i]);
+	}
+	free(files);
+}
+
+/* Keys must give the same order as dirent_natcmp() */
+static void
+test_keys(void)
+{
+	static const char *pieces[] = {
+		"0", "00", "1", "7", "9", "10", "a", "A", "b", "Z", ".", "-",
+		"\xef\xbc\x90", "\xef\xbc\x91", "\xd9\xa9", "\xc3\xa4",
+		"\xef\xbc\xa1", "\xef", "\xd9"
+	};
+	size_t n = sizeof(pieces) / sizeof(pieces[0]);
+
+	for (int i = 0; i < 200000; i++) {
+		char a[100];
+		char b[100];
+		char key1[DIRENT_NATKEY_SIZE(100)];
+		char key2[DIRENT_NATKEY_SIZE(100)];
+		int flags = rand() % 8;
+
+		/* Generate two random strings from pieces */
+		int len = rand() % 8;
+		a[0] = '\0';
+		for (int k = 0; k < len; k++)
+			strcat(a, pieces[rand() % n]);
+		len = rand() % 8;
+		b[0] = '\0';
+		for (int k = 0; k < len; k++)
+			strcat(b, pieces[rand() % n]);
+
+		/* Keys must compare like names */
+		size_t n1 = dirent_natkey(key1, sizeof(key1), a, flags);
+		size_t n2 = dirent_natkey(key2, sizeof(key2), b, flags);
+		assert(n1 < sizeof(key1) && strlen(key1) == n1);
+		assert(n2 < sizeof(key2) && strlen(key2) == n2);
+		assert(n1 < DIRENT_NATKEY_SIZE(strlen(a)));
+		int diff1 = dirent_natcmp(a, b, flags);
+		int diff2 = strcmp(key1, key2);
+		if (sign(diff1) != sign(diff2)) {
+			fprintf(stderr, "Mismatch %s %s %d: %d %d\n",
+				a, b, flags, diff1, diff2);
+			abort();
+		}
+
+		/* Comparison must be antisymmetric */
+		assert(sign(dirent_natcmp(b, a, flags)) == -sign(diff1));
+	}
+
+	/* Truncated key is still zero-terminated */
+	char small[4];
+	assert(dirent_natkey(small, sizeof(small), "abc10", 0) == 10);
+	assert(strcmp(small, "abc") == 0);
+	assert(dirent_natkey(NULL, 0, "abc10", 0) == 10);
+}
+
+/* Return -1, 0 or 1 depending on sign of x */
+static int
+sign(int x)
+{
+	return (x > 0) - (x < 0);
+}
+#endif
+
+static void
+initialize(void)
+{
+#ifndef _DIRENT_HAVE_NATSORT
+	/* Natural sorting is only available in dirent.h of this package */
+	fprintf(stderr, "Skipped\n");
+	exit(/*Skip*/ 77);
+#endif
+}
+
+static void
+cleanup(void)
+{
+	printf("OK\n");
+}
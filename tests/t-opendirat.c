@@ -0,0 +1,248 @@
+/*
+ * Make sure that opendirat() and scandirat() work correctly.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about strcpy being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#ifdef _MSC_VER
+#	include <direct.h>
+#	define chdir(path) _chdir(path)
+#	define getcwd(buffer, size) _getcwd(buffer, size)
+#else
+#	include <unistd.h>
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+
+#ifdef _DIRENT_HAVE_OPENDIRAT
+static void test_opendirat(void);
+static void test_nested(void);
+static void test_errors(void);
+static void test_chdir(void);
+static void test_scandirat(void);
+static int count_entries(DIR *dir);
+#endif
+static void initialize(void);
+static void cleanup(void);
+
+int
+main(void)
+{
+	initialize();
+
+#ifdef _DIRENT_HAVE_OPENDIRAT
+	test_opendirat();
+	test_nested();
+	test_errors();
+	test_chdir();
+	test_scandirat();
+#endif
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+#ifdef _DIRENT_HAVE_OPENDIRAT
+/* Open sub-directory relative to directory stream */
+static void
+test_opendirat(void)
+{
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+
+	/* Open sub-directory */
+	DIR *subdir = opendirat(dir, "dir");
+	assert(subdir != NULL);
+
+	/* Read entries from sub-directory */
+	int found = 0;
+	struct dirent *ent;
+	while ((ent = readdir(subdir)) != NULL) {
+		if (strcmp(ent->d_name, ".") == 0) {
+			assert(ent->d_type == DT_DIR);
+			found += 1;
+		} else if (strcmp(ent->d_name, "..") == 0) {
+			assert(ent->d_type == DT_DIR);
+			found += 2;
+		} else if (strcmp(ent->d_name, "readme.txt") == 0) {
+			assert(ent->d_type == DT_REG);
+			found += 4;
+		} else {
+			fprintf(stderr, "Unexpected file %s\n", ent->d_name);
+			abort();
+		}
+	}
+	assert(found == 7);
+
+	/* Rewind works on sub-directory */
+	rewinddir(subdir);
+	assert(count_entries(subdir) == 3);
+
+	/* Parent directory stream is not affected */
+	assert(count_entries(dir) == 4);
+
+	/* Sub-directory stays open after closing the parent */
+	rewinddir(subdir);
+	closedir(dir);
+	assert(count_entries(subdir) == 3);
+	closedir(subdir);
+}
+
+/* Open directories relative to directories opened with opendirat() */
+static void
+test_nested(void)
+{
+	DIR *dir = opendir("tests");
+	assert(dir != NULL);
+	DIR *dir1 = opendirat(dir, "1");
+	assert(dir1 != NULL);
+	DIR *dir2 = opendirat(dir1, "dir");
+	assert(dir2 != NULL);
+	assert(count_entries(dir2) == 3);
+
+	/* Path with several components */
+	DIR *dir3 = opendirat(dir, "1/dir");
+	assert(dir3 != NULL);
+	assert(count_entries(dir3) == 3);
+
+	/* Name with trailing separator */
+	DIR *dir4 = opendirat(dir, "1/dir/");
+	assert(dir4 != NULL);
+	assert(count_entries(dir4) == 3);
+
+	/* Parent directory */
+	DIR *dir5 = opendirat(dir2, "..");
+	assert(dir5 != NULL);
+	assert(count_entries(dir5) == 4);
+
+	closedir(dir5);
+	closedir(dir4);
+	closedir(dir3);
+	closedir(dir2);
+	closedir(dir1);
+	closedir(dir);
+}
+
+static void
+test_errors(void)
+{
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+
+	/* Sub-directory does not exist */
+	errno = 0;
+	assert(opendirat(dir, "invalid") == NULL);
+	assert(errno == ENOENT);
+
+	/* Name refers to a file */
+	errno = 0;
+	assert(opendirat(dir, "file") == NULL);
+	assert(errno == ENOTDIR);
+
+	/* Empty name */
+	errno = 0;
+	assert(opendirat(dir, "") == NULL);
+	assert(errno == ENOENT);
+
+	/* No parent directory */
+	errno = 0;
+	assert(opendirat(NULL, "dir") == NULL);
+	assert(errno == EBADF);
+
+	closedir(dir);
+}
+
+/* Sub-directories are relative to parent even if working dir changes */
+static void
+test_chdir(void)
+{
+	char cwd[PATH_MAX + 1];
+	assert(getcwd(cwd, sizeof(cwd)) != NULL);
+
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+
+	/* Change working directory */
+	int ok = chdir("tests/3");
+	assert(ok == /*success*/0);
+
+	/* Open sub-directory */
+	DIR *subdir = opendirat(dir, "dir");
+	assert(subdir != NULL);
+	assert(count_entries(subdir) == 3);
+	closedir(subdir);
+	closedir(dir);
+
+	/* Restore working directory */
+	ok = chdir(cwd);
+	assert(ok == /*success*/0);
+}
+
+static void
+test_scandirat(void)
+{
+	DIR *dir = opendir("tests");
+	assert(dir != NULL);
+
+	/* Scan sub-directory */
+	struct dirent **files;
+	int n = scandirat(dir, "3", &files, NULL, bytesort);
+	assert(n == 13);
+	assert(strcmp(files[0]->d_name, ".") == 0);
+	assert(strcmp(files[4]->d_name, "Qwerty-my-aunt.dat") == 0);
+	assert(strcmp(files[12]->d_name, "zebra.dat") == 0);
+	for (int i = 0; i < n; i++) {
+		free(files[i]);
+	}
+	free(files);
+
+	/* Scan non-existing directory */
+	files = NULL;
+	errno = 0;
+	n = scandirat(dir, "invalid", &files, NULL, bytesort);
+	assert(n == -1);
+	assert(files == NULL);
+	assert(errno == ENOENT);
+
+	closedir(dir);
+}
+
+/* Count entries in directory stream */
+static int
+count_entries(DIR *dir)
+{
+	int n = 0;
+	while (readdir(dir) != NULL) {
+		n++;
+	}
+	return n;
+}
+#endif
+
+static void
+initialize(void)
+{
+#ifndef _DIRENT_HAVE_OPENDIRAT
+	/* Functions are only available in dirent.h of this package */
+	fprintf(stderr, "Skipped\n");
+	exit(/*Skip*/ 77);
+#endif
+}
+
+static void
+cleanup(void)
+{
+	printf("OK\n");
+}
@@ -0,0 +1,353 @@
+/*
+ * Make sure that opendir_pattern() returns matching files only.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about strcpy being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <locale.h>
+#include <wchar.h>
+#include <sys/stat.h>
+#ifdef _MSC_VER
+#	include <direct.h>
+#	include <process.h>
+#	define getpid _getpid
+#else
+#	include <unistd.h>
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+
+#ifdef _DIRENT_HAVE_OPENDIR_PATTERN
+static void test_pattern(void);
+static void test_case(void);
+static void test_empty(void);
+static void test_rewind(void);
+static void test_errors(void);
+static void test_wide(void);
+static void test_unicode(void);
+static int count_pattern(const char *dirname, const char *pattern);
+static int wcount_pattern(const wchar_t *dirname, const wchar_t *pattern);
+#endif
+static void initialize(void);
+static void cleanup(void);
+
+int
+main(void)
+{
+	initialize();
+
+#ifdef _DIRENT_HAVE_OPENDIR_PATTERN
+	test_pattern();
+	test_case();
+	test_empty();
+	test_rewind();
+	test_errors();
+	test_wide();
+	test_unicode();
+#endif
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+#ifdef _DIRENT_HAVE_OPENDIR_PATTERN
+/* Match wild-cards */
+static void
+test_pattern(void)
+{
+	/* All files */
+	assert(count_pattern("tests/3", NULL) == 13);
+	assert(count_pattern("tests/3", "") == 13);
+	assert(count_pattern("tests/3", "*") == 13);
+	assert(count_pattern("tests/3", "**") == 13);
+
+	/* Exact name */
+	assert(count_pattern("tests/3", "empty.dat") == 1);
+	assert(count_pattern("tests/3", "empty") == 0);
+	assert(count_pattern("tests/3", "empty.dat2") == 0);
+
+	/* Suffix */
+	assert(count_pattern("tests/3", "*.dat") == 10);
+	assert(count_pattern("tests/3", "*.txt") == 1);
+
+	/* Prefix */
+	assert(count_pattern("tests/3", "sane-*") == 3);
+	assert(count_pattern("tests/3", "sane-1.2.*") == 2);
+
+	/* Several asterisks */
+	assert(count_pattern("tests/3", "*a*a*") == 6);
+	assert(count_pattern("tests/3", "s*1*0*.dat") == 2);
+	assert(count_pattern("tests/3", "a*a*a") == 0);
+
+	/* Dot only matches names with a dot */
+	assert(count_pattern("tests/3", "*.*") == 13);
+	assert(count_pattern("tests/1", "*.*") == 2);
+
+	/* Question mark matches exactly one character */
+	assert(count_pattern("tests/3", "?????.dat") == 3);
+	assert(count_pattern("tests/3", "???.dat") == 2);
+	assert(count_pattern("tests/3", "*-?.*.dat") == 3);
+	assert(count_pattern("tests/1", "fil?") == 1);
+	assert(count_pattern("tests/1", "fil??") == 0);
+
+	/* Only matching names are returned */
+	DIR *dir = opendir_pattern("tests/3", "sane-*.dat");
+	assert(dir != NULL);
+	struct dirent *ent;
+	int found = 0;
+	while ((ent = readdir(dir)) != NULL) {
+		if (strcmp(ent->d_name, "sane-1.12.0.dat") == 0) {
+			assert(ent->d_type == DT_REG);
+			found += 1;
+		} else if (strcmp(ent->d_name, "sane-1.2.30.dat") == 0) {
+			assert(ent->d_type == DT_REG);
+			found += 2;
+		} else if (strcmp(ent->d_name, "sane-1.2.4.dat") == 0) {
+			assert(ent->d_type == DT_REG);
+			found += 4;
+		} else {
+			fprintf(stderr, "Unexpected file %s\n", ent->d_name);
+			abort();
+		}
+	}
+	assert(found == 7);
+	closedir(dir);
+}
+
+/* File names are matched without regard to case */
+static void
+test_case(void)
+{
+	assert(count_pattern("tests/3", "readme.txt") == 1);
+	assert(count_pattern("tests/3", "*.TXT") == 1);
+	assert(count_pattern("tests/3", "QWERTY*") == 1);
+	assert(count_pattern("tests/3", "*MY-AUNT*") == 1);
+	assert(count_pattern("tests/2", "T*") == 1);
+}
+
+/* Pattern matching no files yields an empty directory stream */
+static void
+test_empty(void)
+{
+	DIR *dir = opendir_pattern("tests/3", "*.xyz");
+	assert(dir != NULL);
+	assert(readdir(dir) == NULL);
+	assert(readdir(dir) == NULL);
+	rewinddir(dir);
+	assert(readdir(dir) == NULL);
+	closedir(dir);
+
+	/* Matching files found after the first entry */
+	assert(count_pattern("tests/1", "file") == 1);
+	assert(count_pattern("tests/1", "dir") == 1);
+}
+
+/* Rewind and seek only consider matching files */
+static void
+test_rewind(void)
+{
+	DIR *dir = opendir_pattern("tests/3", "sane-*");
+	assert(dir != NULL);
+
+	/* Remember position of second entry */
+	struct dirent *ent = readdir(dir);
+	assert(ent != NULL);
+	long pos = telldir(dir);
+	ent = readdir(dir);
+	assert(ent != NULL);
+	char name[PATH_MAX + 1];
+	strcpy(name, ent->d_name);
+
+	/* Read rest of the entries */
+	int n = 2;
+	while (readdir(dir) != NULL)
+		n++;
+	assert(n == 3);
+
+	/* Seek back to the second entry */
+	seekdir(dir, pos);
+	ent = readdir(dir);
+	assert(ent != NULL);
+	assert(strcmp(ent->d_name, name) == 0);
+
+	/* Rewind to the beginning */
+	rewinddir(dir);
+	n = 0;
+	while ((ent = readdir(dir)) != NULL) {
+		assert(strncmp(ent->d_name, "sane-", 5) == 0);
+		n++;
+	}
+	assert(n == 3);
+
+	closedir(dir);
+}
+
+static void
+test_errors(void)
+{
+	/* Directory does not exist */
+	errno = 0;
+	assert(opendir_pattern("tests/invalid", "*.dat") == NULL);
+	assert(errno == ENOENT);
+
+	/* Directory name refers to a file */
+	errno = 0;
+	assert(opendir_pattern("tests/1/file", "*") == NULL);
+	assert(errno == ENOTDIR);
+	errno = 0;
+	assert(opendir_pattern("tests/1/file", "*.xyz") == NULL);
+	assert(errno == ENOTDIR);
+
+	/* Pattern must not contain path separators */
+	errno = 0;
+	assert(opendir_pattern("tests", "3/*.dat") == NULL);
+	assert(errno == EINVAL);
+	errno = 0;
+	assert(opendir_pattern("tests", "3\\*.dat") == NULL);
+	assert(errno == EINVAL);
+
+	/* Empty directory name */
+	errno = 0;
+	assert(opendir_pattern("", "*") == NULL);
+	assert(errno == ENOENT);
+}
+
+/* Wide-character version */
+static void
+test_wide(void)
+{
+	_WDIR *dir = _wopendir_pattern(L"tests/3", L"*.DAT");
+	assert(dir != NULL);
+	struct _wdirent *ent;
+	int n = 0;
+	while ((ent = _wreaddir(dir)) != NULL) {
+		size_t len = wcslen(ent->d_name);
+		assert(len > 4);
+		assert(wcscmp(ent->d_name + len - 4, L".dat") == 0);
+		n++;
+	}
+	assert(n == 10);
+	_wclosedir(dir);
+}
+
+/* Characters outside ASCII are matched regardless of case and locale */
+static void
+test_unicode(void)
+{
+	/* Create temporary directory with a random name */
+	wchar_t dirname[PATH_MAX + 1];
+#ifdef WIN32
+	size_t n = GetTempPathW(PATH_MAX, dirname);
+	assert(n > 0);
+#else
+	wcscpy(dirname, L"/tmp/");
+	size_t n = wcslen(dirname);
+#endif
+	for (int i = 0; i < 10; i++) {
+		dirname[n++] = L"abcdefghijklmnopqrstuvwxyz"[rand() % 26];
+	}
+	dirname[n] = '\0';
+
+	/* Create file \u00c4pfel.txt in the directory */
+#ifdef _MSC_VER
+	wchar_t path[PATH_MAX + 1];
+	swprintf(path, PATH_MAX, L"%ls\\\u00c4pfel.txt", dirname);
+	int ok = _wmkdir(dirname);
+	assert(ok == /*success*/0);
+	FILE *fp = _wfopen(path, L"w");
+#else
+	/* Directory name is plain ASCII and file name is UTF-8 */
+	char path[PATH_MAX + 1];
+	wcstombs(path, dirname, PATH_MAX);
+	int ok = mkdir(path, 0700);
+	assert(ok == /*success*/0);
+	size_t k = strlen(path);
+	strcpy(path + k, "/\xc3\x84pfel.txt");
+	FILE *fp = fopen(path, "w");
+#endif
+	assert(fp != NULL);
+	fclose(fp);
+
+	/* Match in C locale and then in UTF-8 locale */
+	for (int round = 0; round < 2; round++) {
+		assert(wcount_pattern(dirname, L"\u00e4*") == 1);
+		assert(wcount_pattern(dirname, L"\u00c4PFEL.TXT") == 1);
+		assert(wcount_pattern(dirname, L"*\u00e4pfel*") == 1);
+		assert(wcount_pattern(dirname, L"?PFEL.txt") == 1);
+		assert(wcount_pattern(dirname, L"\u00f6*") == 0);
+
+		if (!setlocale(LC_CTYPE, ".utf8")
+			&& !setlocale(LC_CTYPE, "C.UTF-8"))
+			setlocale(LC_CTYPE, "");
+	}
+	setlocale(LC_CTYPE, "C");
+
+	/* Remove file and directory */
+#ifdef _MSC_VER
+	_wremove(path);
+	_wrmdir(dirname);
+#else
+	remove(path);
+	path[k] = '\0';
+	rmdir(path);
+#endif
+}
+
+/* Count files matching pattern */
+static int
+count_pattern(const char *dirname, const char *pattern)
+{
+	DIR *dir = opendir_pattern(dirname, pattern);
+	assert(dir != NULL);
+	int n = 0;
+	while (readdir(dir) != NULL)
+		n++;
+	closedir(dir);
+	return n;
+}
+
+/* Count files matching pattern with wide-character functions */
+static int
+wcount_pattern(const wchar_t *dirname, const wchar_t *pattern)
+{
+	_WDIR *dir = _wopendir_pattern(dirname, pattern);
+	assert(dir != NULL);
+	int n = 0;
+	while (_wreaddir(dir) != NULL)
+		n++;
+	_wclosedir(dir);
+	return n;
+}
+#endif
+
+static void
+initialize(void)
+{
+#ifdef _DIRENT_HAVE_OPENDIR_PATTERN
+	/* Initialize random number generator */
+	srand(((unsigned) time(NULL)) * 257 + ((unsigned) getpid()));
+#else
+	/* Functions are only available in dirent.h of this package */
+	fprintf(stderr, "Skipped\n");
+	exit(/*Skip*/ 77);
+#endif
+}
+
+static void
+cleanup(void)
+{
+	printf("OK\n");
+}
@@ -0,0 +1,300 @@
+/*
+ * Make sure that closed directory streams are recycled through the pool.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about strcmp being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+/* Count memory allocations */
+#define DIRENT_STATS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#ifndef _WIN32
+#	include <pthread.h>
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+
+#ifdef _DIRENT_HAVE_STATS
+static void test_reuse(void);
+static void test_wide(void);
+static void test_limit(void);
+static void test_errors(void);
+static void test_release(void);
+static void test_threads(void);
+static void run_thread(void);
+#ifdef _WIN32
+static DWORD WINAPI thread_main(LPVOID arg);
+#else
+static void *thread_main(void *arg);
+#endif
+static unsigned long long allocs(void);
+static unsigned long long blocks(void);
+#endif
+static void initialize(void);
+static void cleanup(void);
+
+/*
+ * Memory blocks of one directory stream: DIR, _WDIR and pattern, plus the
+ * buffer of records with the bulk backend.
+ */
+#ifdef _DIRENT_HAVE_BULK
+#	define BLOCKS 4
+#else
+#	define BLOCKS 3
+#endif
+
+/* Entry buffer allocated by the first readdir() of a slim stream */
+#ifdef _DIRENT_HAVE_SLIM
+#	define ENTRY_BLOCKS 1
+#else
+#	define ENTRY_BLOCKS 0
+#endif
+
+int
+main(void)
+{
+	initialize();
+
+#ifdef _DIRENT_HAVE_STATS
+	test_reuse();
+	test_wide();
+	test_limit();
+	test_errors();
+	test_release();
+	test_threads();
+#endif
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+#ifdef _DIRENT_HAVE_STATS
+/* Re-opening a directory uses memory of the closed stream */
+static void
+test_reuse(void)
+{
+	dirent_releasepool();
+	unsigned long long before = allocs();
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+	assert(allocs() - before == BLOCKS);
+	closedir(dir);
+
+	for (int i = 0; i < 10; i++) {
+		dir = opendir("tests/1");
+		assert(dir != NULL);
+		size_t n = 0;
+		while (readdir(dir) != NULL)
+			n++;
+		assert(n == 4);
+		closedir(dir);
+	}
+#ifdef _DIRENT_HAVE_POOL
+	assert(allocs() - before == BLOCKS + ENTRY_BLOCKS);
+#else
+	assert(allocs() - before == 11 * BLOCKS + 10 * ENTRY_BLOCKS);
+#endif
+}
+
+/* Wide-character streams share the pool of multi-byte streams */
+static void
+test_wide(void)
+{
+	dirent_releasepool();
+	_WDIR *wdir = _wopendir(L"tests/2");
+	assert(wdir != NULL);
+	_wclosedir(wdir);
+
+	/* Only DIR structure is missing from pool */
+	unsigned long long before = allocs();
+	DIR *dir = opendir("tests/2");
+	assert(dir != NULL);
+#ifdef _DIRENT_HAVE_POOL
+	assert(allocs() - before == 1);
+#else
+	assert(allocs() - before == BLOCKS);
+#endif
+
+	/* Sub-directory takes the same kind of blocks */
+	closedir(dir);
+	dir = opendir("tests/1");
+	assert(dir != NULL);
+	before = allocs();
+	DIR *subdir = opendirat(dir, "dir");
+	assert(subdir != NULL);
+	assert(allocs() - before == BLOCKS);
+	closedir(subdir);
+	closedir(dir);
+}
+
+/* Pool keeps a limited number of free blocks */
+#ifdef _DIRENT_HAVE_POOL
+#	define STREAMS (DIRENT_POOL_SIZE + 2)
+#else
+#	define STREAMS 10
+#endif
+static void
+test_limit(void)
+{
+	dirent_releasepool();
+	DIR *dirs[STREAMS];
+	for (int i = 0; i < STREAMS; i++) {
+		dirs[i] = opendir("tests/3");
+		assert(dirs[i] != NULL);
+	}
+	for (int i = 0; i < STREAMS; i++)
+		closedir(dirs[i]);
+
+	/* Two streams do not fit in the pool */
+	unsigned long long before = allocs();
+	for (int i = 0; i < STREAMS; i++) {
+		dirs[i] = opendir("tests/3");
+		assert(dirs[i] != NULL);
+	}
+#ifdef _DIRENT_HAVE_POOL
+	assert(allocs() - before == 2 * BLOCKS);
+#else
+	assert(allocs() - before == STREAMS * BLOCKS);
+#endif
+	for (int i = 0; i < STREAMS; i++)
+		closedir(dirs[i]);
+}
+
+/* Failed opendir returns its memory to the pool */
+static void
+test_errors(void)
+{
+	dirent_releasepool();
+	errno = 0;
+	assert(opendir("tests/invalid") == NULL);
+	assert(errno == ENOENT);
+
+	unsigned long long before = allocs();
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+#ifdef _DIRENT_HAVE_POOL
+	assert(allocs() - before == 0);
+#else
+	assert(allocs() - before == BLOCKS);
+#endif
+	closedir(dir);
+}
+
+/* Releasing the pool returns memory to the system */
+static void
+test_release(void)
+{
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+	closedir(dir);
+	dirent_releasepool();
+
+	unsigned long long before = allocs();
+	dir = opendir("tests/1");
+	assert(dir != NULL);
+	assert(allocs() - before == BLOCKS);
+	closedir(dir);
+	dirent_releasepool();
+}
+
+/* Pool of exiting thread is released */
+static void
+test_threads(void)
+{
+	dirent_releasepool();
+	unsigned long long before = blocks();
+	for (int i = 0; i < 4; i++) {
+		run_thread();
+		assert(blocks() == before);
+	}
+}
+
+/* Run thread_main in a new thread and wait for the thread to exit */
+static void
+run_thread(void)
+{
+#ifdef _WIN32
+	HANDLE thread = CreateThread(NULL, 0, thread_main, NULL, 0, NULL);
+	assert(thread != NULL);
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_t thread;
+	int ok = pthread_create(&thread, NULL, thread_main, NULL);
+	assert(ok == 0);
+	pthread_join(thread, NULL);
+#endif
+}
+
+/* Fill pool of the thread and exit without releasing it */
+#ifdef _WIN32
+static DWORD WINAPI
+thread_main(LPVOID arg)
+#else
+static void *
+thread_main(void *arg)
+#endif
+{
+	(void) arg;
+	unsigned long long before = blocks();
+	DIR *a = opendir("tests/1");
+	assert(a != NULL);
+	DIR *b = opendir("tests/2");
+	assert(b != NULL);
+	while (readdir(a) != NULL)
+		/*NOP*/;
+	closedir(a);
+	closedir(b);
+#ifdef _DIRENT_HAVE_POOL
+	assert(blocks() - before == 2 * BLOCKS + ENTRY_BLOCKS);
+#else
+	assert(blocks() == before);
+#endif
+	return 0;
+}
+
+/* Number of memory blocks allocated so far */
+static unsigned long long
+allocs(void)
+{
+	struct dirent_stats s;
+	assert(dirent_getstats(NULL, &s) == 0);
+	return s.allocs;
+}
+
+/* Number of memory blocks allocated and not released to the system */
+static unsigned long long
+blocks(void)
+{
+	struct dirent_stats s;
+	assert(dirent_getstats(NULL, &s) == 0);
+	return s.allocs - s.frees;
+}
+#endif
+
+static void
+initialize(void)
+{
+#ifndef _DIRENT_HAVE_STATS
+	/* Pool is only available in dirent.h of this package */
+	fprintf(stderr, "Skipped\n");
+	exit(/*Skip*/ 77);
+#endif
+}
+
+static void
+cleanup(void)
+{
+	printf("OK\n");
+}
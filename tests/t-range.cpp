@@ -0,0 +1,283 @@
+/*
+ * Make sure that the C++ directory_range works correctly.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about fopen being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <iostream>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <utility>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.hpp>
+#include "tempdir.hpp"
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+using namespace dirent_cxx;
+namespace fs = std::filesystem;
+
+static void test_retrieval(void);
+static void test_status(void);
+static void test_move(void);
+static void test_errors(void);
+static void test_rewind(void);
+static void test_allocation(void);
+static string make_directory(int files);
+static void initialize(void);
+static void cleanup(void);
+
+/* Number of calls to operator new */
+static unsigned long allocations = 0;
+
+void *
+operator new(size_t size)
+{
+	allocations++;
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw bad_alloc();
+	return p;
+}
+
+void
+operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void
+operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+int
+main(void)
+{
+	initialize();
+
+	test_retrieval();
+	test_status();
+	test_move();
+	test_errors();
+	test_rewind();
+	test_allocation();
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+/* Iterate over entries with range-based for loop */
+static void
+test_retrieval(void)
+{
+	directory_range dir("tests/1");
+	assert(dir.is_open());
+
+	int found = 0;
+	for (const directory_entry &entry : dir) {
+		if (entry.name() == "file") {
+			assert(entry.name().size() == 4);
+			assert(entry.type() == file_type::regular);
+			found += 1;
+		} else if (entry.name() == "dir") {
+			assert(entry.name().size() == 3);
+			assert(entry.type() == file_type::directory);
+			found += 2;
+		} else {
+			/* Current and parent directory are skipped */
+			cerr << "Unexpected file " << entry.name() << endl;
+			abort();
+		}
+	}
+	assert(found == 3);
+	assert(!dir.error());
+
+	/* Range is exhausted */
+	assert(dir.begin() == dir.end());
+}
+
+/* Retrieve file information on demand */
+static void
+test_status(void)
+{
+	directory_range dir("tests/1/dir");
+	directory_iterator i = dir.begin();
+	assert(i != dir.end());
+	assert(i->name() == "readme.txt");
+	assert(i->size() == 198);
+	assert(i->mtime() > 0);
+	assert((i->status().st_mode & S_IFMT) == S_IFREG);
+
+	/* Same information is returned on subsequent calls */
+	error_code ec;
+	const stat_type *p = i->status(ec);
+	assert(p == &i->status());
+	assert(!ec);
+
+	/* Native entry is available too */
+	assert(strcmp(i->native()->d_name, "readme.txt") == 0);
+
+	++i;
+	assert(i == dir.end());
+}
+
+/* Handle can be moved but not copied */
+static void
+test_move(void)
+{
+	directory_range a("tests/1");
+	DIR *handle = a.native_handle();
+	assert(handle != NULL);
+
+	/* Move construct */
+	directory_range b(std::move(a));
+	assert(!a.is_open());
+	assert(a.begin() == a.end());
+	assert(b.native_handle() == handle);
+
+	/* Continue iteration in another range */
+	directory_iterator i = b.begin();
+	assert(i != b.end());
+	string first(i->name());
+	directory_range c;
+	assert(!c);
+	c = std::move(b);
+	assert(c);
+	assert(!b);
+	i = c.begin();
+	assert(i != c.end());
+	assert(i->name() == first);
+	++i;
+	assert(i != c.end());
+	assert(i->name() != first);
+	++i;
+	assert(i == c.end());
+
+	/* Move assignment closes the previous directory */
+	c = directory_range("tests/1/dir");
+	int n = 0;
+	for (const directory_entry &entry : c) {
+		assert(entry.name() == "readme.txt");
+		n++;
+	}
+	assert(n == 1);
+
+	/* Explicit close */
+	c.close();
+	assert(!c.is_open());
+	c.close();
+}
+
+static void
+test_errors(void)
+{
+	/* Directory does not exist */
+	error_code ec;
+	directory_range a("tests/invalid", ec);
+	assert(ec == errc::no_such_file_or_directory);
+	assert(!a.is_open());
+	assert(a.begin() == a.end());
+
+	/* Name refers to a file */
+	directory_range b("tests/1/file", ec);
+	assert(ec == errc::not_a_directory);
+	assert(!b.is_open());
+
+	/* Error code is cleared on success */
+	directory_range c("tests/1", ec);
+	assert(!ec);
+
+	/* Throwing constructor */
+	bool thrown = false;
+	try {
+		directory_range d("tests/invalid");
+	} catch (const system_error &e) {
+		assert(e.code() == errc::no_such_file_or_directory);
+		thrown = true;
+	}
+	assert(thrown);
+}
+
+/* Read entries again from the beginning */
+static void
+test_rewind(void)
+{
+	directory_range dir("tests/3");
+	int n = 0;
+	for (const directory_entry &entry : dir) {
+		assert(entry.name() != "." && entry.name() != "..");
+		n++;
+	}
+	assert(n == 11);
+
+	dir.rewind();
+	int m = 0;
+	for (directory_iterator i = dir.begin(); i != dir.end(); i++)
+		m++;
+	assert(m == n);
+}
+
+/* Iterating and retrieving file information allocates no memory */
+static void
+test_allocation(void)
+{
+#define FILES 1000
+	string dirname = make_directory(FILES);
+
+	directory_range dir(dirname.c_str());
+	unsigned long before = allocations;
+	int n = 0;
+	unsigned long long total = 0;
+	for (const directory_entry &entry : dir) {
+		assert(entry.type() == file_type::regular);
+		total += entry.size();
+		n++;
+	}
+	assert(allocations == before);
+	assert(n == FILES);
+	assert(total == 0);
+
+	fs::remove_all(dirname);
+#undef FILES
+}
+
+/* Create temporary directory with empty files file-00000.dat etc */
+static string
+make_directory(int files)
+{
+	string dirname = make_temp_directory();
+
+	for (int i = 0; i < files; i++) {
+		char name[32];
+		sprintf(name, "/file-%05d.dat", i);
+		FILE *fp = fopen((dirname + name).c_str(), "w");
+		assert(fp != NULL);
+		fclose(fp);
+	}
+	return dirname;
+}
+
+static void
+initialize(void)
+{
+	/*NOP*/;
+}
+
+static void
+cleanup(void)
+{
+	cout << "OK" << endl;
+}
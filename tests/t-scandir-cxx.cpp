@@ -0,0 +1,237 @@
+/*
+ * Make sure that the C++ scandir() template agrees with the C function.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about fopen being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.hpp>
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+using namespace dirent_cxx;
+
+static void test_sort(void);
+static void test_filter(void);
+static void test_types(void);
+static void test_errors(void);
+static vector<string> scan_c(const char *dirname,
+	int (*compare)(const struct dirent **, const struct dirent **));
+static vector<string> names(const directory_list &list);
+static bool has_suffix(string_view name, string_view suffix);
+static void initialize(void);
+static void cleanup(void);
+
+int
+main(void)
+{
+	initialize();
+
+	test_sort();
+	test_filter();
+	test_types();
+	test_errors();
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+/* Sort in the same order as the C functions */
+static void
+test_sort(void)
+{
+	directory_list list = dirent_cxx::scandir("tests/3", accept_all(),
+		alpha_less());
+	assert(list.size() == 11);
+	assert(names(list) == scan_c("tests/3", alphasort));
+
+	list = dirent_cxx::scandir("tests/3", accept_all(), byte_less());
+	assert(list[2].name() == "Qwerty-my-aunt.dat");
+	assert(list[10].name() == "zebra.dat");
+	assert(strcmp(list[10].c_str(), "zebra.dat") == 0);
+#ifdef _DIRENT_HAVE_BYTESORT
+	assert(names(list) == scan_c("tests/3", bytesort));
+#endif
+
+#if defined(DIRENT_H) || defined(__GLIBC__)
+	list = dirent_cxx::scandir("tests/3", accept_all(), version_less());
+	assert(names(list) == scan_c("tests/3", versionsort));
+	vector<string> v = names(list);
+	size_t a = 0, b = 0, c = 0;
+	for (size_t i = 0; i < v.size(); i++) {
+		if (v[i] == "sane-1.2.4.dat")
+			a = i;
+		else if (v[i] == "sane-1.2.30.dat")
+			b = i;
+		else if (v[i] == "sane-1.12.0.dat")
+			c = i;
+	}
+	assert(a < b && b < c);
+#endif
+
+	/* Lambda in reverse order */
+	list = dirent_cxx::scandir("tests/3", accept_all(),
+		[](const scan_entry &x, const scan_entry &y) {
+			return y.name() < x.name();
+		});
+	assert(list[0].name() == "zebra.dat");
+	assert(list[10].name() == "3zero.dat");
+
+	/* Unsorted list has the entries in directory order */
+	list = dirent_cxx::scandir("tests/3", accept_all(), no_sort());
+	directory_range dir("tests/3");
+	size_t i = 0;
+	for (const directory_entry &entry : dir) {
+		assert(i < list.size());
+		assert(list[i].name() == entry.name());
+		i++;
+	}
+	assert(i == list.size());
+}
+
+/* Filter entries with lambdas and function objects */
+static void
+test_filter(void)
+{
+	/* Lambda with captured state */
+	int calls = 0;
+	directory_list list = dirent_cxx::scandir("tests/3",
+		[&calls](const directory_entry &e) {
+			calls++;
+			return has_suffix(e.name(), ".dat");
+		},
+		byte_less());
+	assert(calls == 11);
+	for (const scan_entry &e : list)
+		assert(has_suffix(e.name(), ".dat"));
+	size_t k = 0;
+	for (const string &name : scan_c("tests/3", NULL)) {
+		if (has_suffix(name, ".dat"))
+			k++;
+	}
+	assert(k > 0 && list.size() == k);
+
+	/* Filter by file information */
+	list = dirent_cxx::scandir("tests/1/dir",
+		[](const directory_entry &e) { return e.size() > 100; },
+		no_sort());
+	assert(list.size() == 1);
+	assert(list[0].name() == "readme.txt");
+
+	/* Filter rejecting everything */
+	list = dirent_cxx::scandir("tests/3",
+		[](const directory_entry &) { return false; }, alpha_less());
+	assert(list.empty());
+	assert(list.begin() == list.end());
+}
+
+/* File type is stored with each entry */
+static void
+test_types(void)
+{
+	directory_list list = dirent_cxx::scandir("tests/1", accept_all(),
+		byte_less());
+	assert(list.size() == 2);
+	assert(list[0].name() == "dir");
+	assert(list[0].type() == file_type::directory);
+	assert(list[1].name() == "file");
+	assert(list[1].type() == file_type::regular);
+
+	/* List can be moved */
+	directory_list other(std::move(list));
+	assert(other.size() == 2);
+	assert(other[1].name() == "file");
+	assert(other.data() == other.begin());
+}
+
+static void
+test_errors(void)
+{
+	/* Directory does not exist */
+	error_code ec;
+	directory_list list = dirent_cxx::scandir("tests/invalid",
+		accept_all(), alpha_less(), ec);
+	assert(ec == errc::no_such_file_or_directory);
+	assert(list.empty());
+
+	/* Name refers to a file */
+	list = dirent_cxx::scandir("tests/1/file", accept_all(), no_sort(),
+		ec);
+	assert(ec == errc::not_a_directory);
+
+	/* Throwing version */
+	bool thrown = false;
+	try {
+		list = dirent_cxx::scandir("tests/invalid", accept_all(),
+			no_sort());
+	} catch (const system_error &e) {
+		assert(e.code() == errc::no_such_file_or_directory);
+		thrown = true;
+	}
+	assert(thrown);
+}
+
+/* Scan directory with C function, omitting . and .. */
+static vector<string>
+scan_c(const char *dirname,
+	int (*compare)(const struct dirent **, const struct dirent **))
+{
+	struct dirent **files;
+	int n = ::scandir(dirname, &files, NULL, compare);
+	assert(n >= 0);
+	vector<string> v;
+	for (int i = 0; i < n; i++) {
+		if (strcmp(files[i]->d_name, ".") != 0
+			&& strcmp(files[i]->d_name, "..") != 0)
+			v.push_back(files[i]->d_name);
+		free(files[i]);
+	}
+	free(files);
+	return v;
+}
+
+/* Copy names from list */
+static vector<string>
+names(const directory_list &list)
+{
+	vector<string> v;
+	for (const scan_entry &e : list)
+		v.push_back(string(e.name()));
+	return v;
+}
+
+/* Returns true if name ends with suffix */
+static bool
+has_suffix(string_view name, string_view suffix)
+{
+	return name.size() >= suffix.size()
+		&& name.compare(name.size() - suffix.size(), string_view::npos,
+			suffix) == 0;
+}
+
+static void
+initialize(void)
+{
+	/* Initialize random number generator */
+	srand((unsigned) time(NULL));
+}
+
+static void
+cleanup(void)
+{
+	cout << "OK" << endl;
+}
@@ -21,6 +21,13 @@
 #include <errno.h>
 #include <time.h>
 #include <limits.h>
+#include <locale.h>
+#ifdef _MSC_VER
+#	include <process.h>
+#	define getpid _getpid
+#else
+#	include <unistd.h>
+#endif
 
 #undef NDEBUG
 #include <assert.h>
@@ -34,6 +41,9 @@ static void test_versionsort(void);
 static void test_large(void);
 static void test_match(void);
 static void test_null(void);
+#ifdef _DIRENT_HAVE_BYTESORT
+static void test_bytesort(void);
+#endif
 static int only_readme(const struct dirent *entry);
 static int no_directories(const struct dirent *entry);
 static int reverse_alpha(const struct dirent **a, const struct dirent **b);
@@ -55,6 +65,9 @@ main(void)
 	test_large();
 	test_match();
 	test_null();
+#ifdef _DIRENT_HAVE_BYTESORT
+	test_bytesort();
+#endif
 
 	cleanup();
 	return EXIT_SUCCESS;
@@ -445,11 +458,50 @@ match(const char *name, const char *patt)
 	/*NOTREACHED*/
 }
 
+#ifdef _DIRENT_HAVE_BYTESORT
+static void
+test_bytesort(void)
+{
+	static const char *expect[] = {
+		".", "..", "3zero.dat", "666.dat", "Qwerty-my-aunt.dat",
+		"README.txt", "aaa.dat", "dirent.dat", "empty.dat",
+		"sane-1.12.0.dat", "sane-1.2.30.dat", "sane-1.2.4.dat",
+		"zebra.dat"
+	};
+
+	/* Sort file names by byte values */
+	struct dirent **files;
+	int n = scandir("tests/3", &files, NULL, bytesort);
+	assert(n == 13);
+	for (int i = 0; i < n; i++) {
+		assert(strcmp(files[i]->d_name, expect[i]) == 0);
+		free(files[i]);
+	}
+	free(files);
+
+	/* Order does not depend on locale */
+	char *saved = setlocale(LC_COLLATE, NULL);
+	assert(saved != NULL);
+	char locale[100];
+	strncpy(locale, saved, sizeof(locale) - 1);
+	locale[sizeof(locale) - 1] = '\0';
+	setlocale(LC_COLLATE, "");
+	n = scandir("tests/3", &files, NULL, bytesort);
+	assert(n == 13);
+	for (int i = 0; i < n; i++) {
+		assert(strcmp(files[i]->d_name, expect[i]) == 0);
+		free(files[i]);
+	}
+	free(files);
+	setlocale(LC_COLLATE, locale);
+}
+#endif
+
 static void
 initialize(void)
 {
 	/* Initialize random number generator */
-	srand((unsigned) time(NULL));
+	srand(((unsigned) time(NULL)) * 257 + ((unsigned) getpid()));
 }
 
 static void
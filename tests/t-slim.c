@@ -0,0 +1,187 @@
+/*
+ * Make sure that slim directory streams return the same entries as streams
+ * with an embedded entry.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about strcmp being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+/* Size entries to fit the file name */
+#define DIRENT_SLIM
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <dirent.h>
+#include <errno.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+#ifdef _DIRENT_HAVE_SLIM
+static void test_size(void);
+static void test_read(void);
+static void test_wread(void);
+static void test_rewind(void);
+#endif
+static void initialize(void);
+static void cleanup(void);
+
+int
+main(void)
+{
+	initialize();
+
+#ifdef _DIRENT_HAVE_SLIM
+	test_size();
+	test_read();
+	test_wread();
+	test_rewind();
+#endif
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+#ifdef _DIRENT_HAVE_SLIM
+/* Directory stream does not embed a directory entry */
+static void
+test_size(void)
+{
+	assert(sizeof(DIR) < sizeof(struct dirent));
+}
+
+/* Entries match those of readdir_r with a full-size buffer */
+static void
+test_read(void)
+{
+	static const char *dirs[] = {
+		"tests/1", "tests/2", "tests/3", "tests/4"
+	};
+
+	for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+		DIR *dir = opendir(dirs[i]);
+		assert(dir != NULL);
+		DIR *dir2 = opendir(dirs[i]);
+		assert(dir2 != NULL);
+
+		struct dirent *ent;
+		size_t n = 0;
+		while ((ent = readdir(dir)) != NULL) {
+			static struct dirent buffer;
+			struct dirent *ent2;
+			assert(readdir_r(dir2, &buffer, &ent2) == 0);
+			assert(ent2 == &buffer);
+
+			/* Entry only takes room for the file name */
+			assert(strcmp(ent->d_name, ent2->d_name) == 0);
+			assert(ent->d_namlen == strlen(ent->d_name));
+			assert(ent->d_type == ent2->d_type);
+			assert(ent->d_off == ent2->d_off);
+			assert(ent->d_reclen >= offsetof(struct dirent, d_name)
+				+ ent->d_namlen + 1);
+			assert(ent->d_reclen < sizeof(struct dirent));
+			assert(ent2->d_reclen == sizeof(struct dirent));
+
+			/* Allocated size follows the size of the entry */
+			assert(_D_ALLOC_NAMLEN(ent) >= ent->d_namlen + 1);
+			assert(_D_ALLOC_NAMLEN(ent) < PATH_MAX + 1);
+			assert(offsetof(struct dirent, d_name)
+				+ _D_ALLOC_NAMLEN(ent) == ent->d_reclen);
+			assert(_D_ALLOC_NAMLEN(ent2) >= PATH_MAX + 1);
+			n++;
+		}
+		assert(n > 2);
+
+		/* Both streams end at the same time */
+		struct dirent buffer;
+		struct dirent *ent2;
+		assert(readdir_r(dir2, &buffer, &ent2) == 0);
+		assert(ent2 == NULL);
+
+		closedir(dir2);
+		closedir(dir);
+	}
+}
+
+/* Wide-character entries are sized the same way */
+static void
+test_wread(void)
+{
+	_WDIR *wdir = _wopendir(L"tests/3");
+	assert(wdir != NULL);
+
+	struct _wdirent *wentry;
+	size_t n = 0;
+	int found = 0;
+	while ((wentry = _wreaddir(wdir)) != NULL) {
+		assert(wentry->d_namlen == wcslen(wentry->d_name));
+		assert(wentry->d_reclen == offsetof(struct _wdirent, d_name)
+			+ (wentry->d_namlen + 1) * sizeof(wchar_t));
+		if (wcscmp(wentry->d_name, L"Qwerty-my-aunt.dat") == 0)
+			found++;
+		n++;
+	}
+	assert(n == 13);
+	assert(found == 1);
+
+	_wclosedir(wdir);
+}
+
+/* Entry buffer survives rewind and seek */
+static void
+test_rewind(void)
+{
+	DIR *dir = opendir("tests/3");
+	assert(dir != NULL);
+
+	char first[64];
+	struct dirent *ent = readdir(dir);
+	assert(ent != NULL);
+	assert(strlen(ent->d_name) < sizeof(first));
+	strcpy(first, ent->d_name);
+	long pos = telldir(dir);
+
+	char second[64];
+	ent = readdir(dir);
+	assert(ent != NULL);
+	assert(strlen(ent->d_name) < sizeof(second));
+	strcpy(second, ent->d_name);
+	while (readdir(dir) != NULL)
+		/*NOP*/;
+
+	rewinddir(dir);
+	ent = readdir(dir);
+	assert(ent != NULL);
+	assert(strcmp(ent->d_name, first) == 0);
+
+	seekdir(dir, pos);
+	ent = readdir(dir);
+	assert(ent != NULL);
+	assert(strcmp(ent->d_name, second) == 0);
+
+	closedir(dir);
+}
+#endif
+
+static void
+initialize(void)
+{
+#ifndef _DIRENT_HAVE_SLIM
+	/* Slim streams are only available in dirent.h of this package */
+	fprintf(stderr, "Skipped\n");
+	exit(/*Skip*/ 77);
+#endif
+}
+
+static void
+cleanup(void)
+{
+	printf("OK\n");
+}
@@ -0,0 +1,301 @@
+/*
+ * Make sure that DIRENT_STATS counts the work done by directory streams.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about strcmp being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+/* Enable counters */
+#define DIRENT_STATS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+#ifdef _DIRENT_HAVE_STATS
+static void test_readdir(void);
+static void test_wreaddir(void);
+static void test_seekdir(void);
+static void test_scandir(void);
+static void test_totals(void);
+static void test_errors(void);
+#endif
+static void initialize(void);
+static void cleanup(void);
+
+/*
+ * Calls to open a directory and calls to read a small directory to the end.
+ * The bulk backend opens the directory and reads all records in one batch,
+ * and then makes one call for each attempt to read past the end.
+ */
+#ifdef _DIRENT_HAVE_BULK
+#	define OPEN_CALLS 2
+#	define READ_CALLS(n) 4
+#else
+#	define OPEN_CALLS 1
+#	define READ_CALLS(n) ((n) + 2)
+#endif
+
+int
+main(void)
+{
+	initialize();
+
+#ifdef _DIRENT_HAVE_STATS
+	test_readdir();
+	test_wreaddir();
+	test_seekdir();
+	test_scandir();
+	test_totals();
+	test_errors();
+#endif
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+#ifdef _DIRENT_HAVE_STATS
+/* Count entries and calls to the operating system */
+static void
+test_readdir(void)
+{
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+
+	/* Opening the directory reads the first entry */
+	struct dirent_stats s;
+	assert(dirent_getstats(dir, &s) == 0);
+	assert(s.entries == 0);
+	assert(s.os_calls == OPEN_CALLS);
+
+	/* Each readdir also reads the following entry to compute d_off */
+	unsigned long long n = 0;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		n++;
+		assert(dirent_getstats(dir, &s) == 0);
+		assert(s.entries == n);
+#ifdef _DIRENT_HAVE_BULK
+		assert(s.os_calls == (n < 4 ? 2 : 3));
+#else
+		assert(s.os_calls == n + 1);
+#endif
+	}
+
+	/* Directory, file, current and parent directory */
+	assert(n == 4);
+	assert(dirent_getstats(dir, &s) == 0);
+	assert(s.entries == 4);
+
+	/* Last readdir retries reading after the end */
+	assert(s.os_calls == READ_CALLS(n));
+	assert(s.conversion_errors == 0);
+	assert(s.seeks == 0);
+	assert(s.seek_entries == 0);
+	assert(s.scan_bytes == 0);
+	assert(s.seek_ns == 0);
+	assert(s.sort_ns == 0);
+
+	/* Rewind restarts the search */
+	rewinddir(dir);
+	assert(dirent_getstats(dir, &s) == 0);
+	assert(s.entries == 4);
+	assert(s.os_calls == READ_CALLS(n) + 1);
+
+	/* Counters of stream can be reset */
+	dirent_resetstats(dir);
+	assert(dirent_getstats(dir, &s) == 0);
+	assert(s.entries == 0 && s.os_calls == 0 && s.os_ns == 0);
+	assert(readdir(dir) != NULL);
+	assert(dirent_getstats(dir, &s) == 0);
+#ifdef _DIRENT_HAVE_BULK
+	assert(s.entries == 1 && s.os_calls == 0);
+#else
+	assert(s.entries == 1 && s.os_calls == 1);
+#endif
+
+	closedir(dir);
+}
+
+/* Wide-character functions use the same counters */
+static void
+test_wreaddir(void)
+{
+	_WDIR *dir = _wopendir(L"tests/2");
+	assert(dir != NULL);
+
+	unsigned long long n = 0;
+	while (_wreaddir(dir) != NULL)
+		n++;
+	assert(n == 4);
+
+	struct dirent_stats s;
+	assert(_wdirent_getstats(dir, &s) == 0);
+	assert(s.entries == n);
+	assert(s.os_calls == READ_CALLS(n));
+	assert(s.conversion_errors == 0);
+
+	/* Wide-character names need no conversion */
+	assert(s.convert_ns == 0);
+
+	_wclosedir(dir);
+}
+
+/* Count entries read while seeking */
+static void
+test_seekdir(void)
+{
+	DIR *dir = opendir("tests/4");
+	assert(dir != NULL);
+
+	/* Remember position of each entry */
+	long pos[16];
+	size_t n = 0;
+	for (;;) {
+		assert(n < 16);
+		pos[n] = telldir(dir);
+		if (!readdir(dir))
+			break;
+		n++;
+	}
+	assert(n == 5);
+
+	/* Seeking to kth entry reads k + 1 entries from the beginning */
+	struct dirent_stats before;
+	assert(dirent_getstats(dir, &before) == 0);
+	assert(before.seeks == 0);
+	seekdir(dir, pos[3]);
+	struct dirent_stats s;
+	assert(dirent_getstats(dir, &s) == 0);
+	assert(s.seeks == 1);
+	assert(s.seek_entries == 4);
+	assert(s.os_calls > before.os_calls);
+	assert(s.seek_ns >= s.os_ns - before.os_ns);
+
+	seekdir(dir, pos[0]);
+	assert(dirent_getstats(dir, &s) == 0);
+	assert(s.seeks == 2);
+	assert(s.seek_entries == 5);
+
+	/* Invalid position counts the whole directory */
+	seekdir(dir, 12345);
+	assert(dirent_getstats(dir, &s) == 0);
+	assert(s.seeks == 3);
+	assert(s.seek_entries == 5 + n);
+	assert(readdir(dir) == NULL);
+
+	closedir(dir);
+}
+
+/* Count memory allocated by scandir */
+static void
+test_scandir(void)
+{
+	struct dirent_stats before;
+	assert(dirent_getstats(NULL, &before) == 0);
+
+	struct dirent **files;
+	int n = scandir("tests/3", &files, NULL, alphasort);
+	assert(n == 13);
+
+	/* Stream of scandir is closed so its counters are in totals */
+	struct dirent_stats s;
+	assert(dirent_getstats(NULL, &s) == 0);
+	assert(s.entries - before.entries == (unsigned long long) n);
+	assert(s.os_calls - before.os_calls
+		== (unsigned long long) READ_CALLS(n));
+
+	/* One entry per file, one more for end, and table of 16 pointers */
+	assert(s.scan_bytes - before.scan_bytes
+		== (n + 1) * sizeof(struct dirent) + 16 * sizeof(void*));
+
+	for (int i = 0; i < n; i++)
+		free(files[i]);
+	free(files);
+}
+
+/* Totals include closed streams only */
+static void
+test_totals(void)
+{
+	dirent_resetstats(NULL);
+	struct dirent_stats s;
+	assert(dirent_getstats(NULL, &s) == 0);
+	assert(s.entries == 0 && s.os_calls == 0 && s.scan_bytes == 0);
+
+	DIR *a = opendir("tests/1");
+	assert(a != NULL);
+	DIR *b = opendir("tests/3");
+	assert(b != NULL);
+	while (readdir(a) != NULL)
+		/*NOP*/;
+	while (readdir(b) != NULL)
+		/*NOP*/;
+
+	struct dirent_stats sa;
+	assert(dirent_getstats(a, &sa) == 0);
+	struct dirent_stats sb;
+	assert(dirent_getstats(b, &sb) == 0);
+	assert(sa.entries == 4);
+	assert(sb.entries == 13);
+
+	/* Open streams are not yet counted */
+	assert(dirent_getstats(NULL, &s) == 0);
+	assert(s.entries == 0);
+
+	closedir(a);
+	assert(dirent_getstats(NULL, &s) == 0);
+	assert(s.entries == 4);
+	assert(s.os_calls == sa.os_calls);
+
+	closedir(b);
+	assert(dirent_getstats(NULL, &s) == 0);
+	assert(s.entries == 17);
+	assert(s.os_calls == sa.os_calls + sb.os_calls);
+	assert(s.os_ns == sa.os_ns + sb.os_ns);
+	assert(s.convert_ns == sa.convert_ns + sb.convert_ns);
+}
+
+static void
+test_errors(void)
+{
+	/* Must have room for counters */
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+	assert(dirent_getstats(dir, NULL) == -1);
+	closedir(dir);
+
+	/* Failed opendir is counted in totals */
+	dirent_resetstats(NULL);
+	assert(opendir("tests/invalid") == NULL);
+	struct dirent_stats s;
+	assert(dirent_getstats(NULL, &s) == 0);
+	assert(s.os_calls == 1);
+	assert(s.entries == 0);
+}
+#endif
+
+static void
+initialize(void)
+{
+#ifndef _DIRENT_HAVE_STATS
+	/* Counters are only available in dirent.h of this package */
+	fprintf(stderr, "Skipped\n");
+	exit(/*Skip*/ 77);
+#endif
+}
+
+static void
+cleanup(void)
+{
+	printf("OK\n");
+}
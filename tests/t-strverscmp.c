@@ -20,7 +20,13 @@
 #include <assert.h>
 
 static void test_compare(void);
+static void test_prefix(void);
+static void test_fuzz(void);
 static void test_performance(void);
+#ifdef DIRENT_H
+static int reference(const char *a, const char *b);
+static int sign(int x);
+#endif
 static void initialize(void);
 static void cleanup(void);
 
@@ -30,6 +36,8 @@ main(void)
 	initialize();
 
 	test_compare();
+	test_prefix();
+	test_fuzz();
 	test_performance();
 
 	cleanup();
@@ -182,6 +190,93 @@ test_compare(void)
 	assert(strverscmp("9", "10") < 0);
 }
 
+/* Long common prefixes and differences at every position */
+static void
+test_prefix(void)
+{
+	/* Strings longer than one vector */
+	assert(strverscmp("sane-backends-1.2.30.dat", "sane-backends-1.12.0.dat") < 0);
+	assert(strverscmp("sane-backends-1.12.0.dat", "sane-backends-1.2.30.dat") > 0);
+	assert(strverscmp("sane-backends-1.2.4.dat", "sane-backends-1.2.30.dat") < 0);
+	assert(strverscmp("sane-backends-1.2.30.dat", "sane-backends-1.2.30.dat") == 0);
+	assert(strverscmp("abcdefghijklmnopqrstuvwxyz-009", "abcdefghijklmnopqrstuvwxyz-1") < 0);
+	assert(strverscmp("abcdefghijklmnopqrstuvwxyz-1", "abcdefghijklmnopqrstuvwxyz-009") > 0);
+
+	/* Non-ASCII characters are not digits and compare as unsigned */
+	assert(strverscmp("file-\xe4", "file-a") > 0);
+	assert(strverscmp("file-a", "file-\xe4") < 0);
+	assert(strverscmp("\xb2\xb3", "\xb2\xb3") == 0);
+	assert(strverscmp("1\xb2", "10") < 0);
+
+	/* Difference at each position of a long string */
+	char a[100];
+	char b[100];
+	for (size_t i = 0; i < sizeof(a) - 1; i++) {
+		memset(a, 'x', sizeof(a) - 1);
+		a[sizeof(a) - 1] = '\0';
+		memcpy(b, a, sizeof(a));
+		b[i] = 'y';
+		assert(strverscmp(a, b) < 0);
+		assert(strverscmp(b, a) > 0);
+
+		/* Shorter string is smaller */
+		b[i] = '\0';
+		assert(strverscmp(a, b) > 0);
+		assert(strverscmp(b, a) < 0);
+	}
+}
+
+/*
+ * Compare results against the simple reference implementation.  The test
+ * only applies to dirent.h of this package as, for example, GNU C library
+ * orders "-" and "0" differently.
+ */
+static void
+test_fuzz(void)
+{
+#ifdef DIRENT_H
+#define FUZZ 100000
+	/*
+	 * Place strings at varying offsets of a buffer so as to exercise
+	 * both vectorized and character-by-character code paths.
+	 */
+	static char buffer[8192];
+	char letters[] = "0001234567890abcz.-_";
+	size_t n = strlen(letters);
+
+	for (size_t i = 0; i < FUZZ; i++) {
+		size_t len = (size_t) (rand() % 48);
+		size_t prefix = len ? (size_t) (rand() % (len + 1)) : 0;
+		size_t k;
+
+		/* Generate string a */
+		char *a = buffer + rand() % (sizeof(buffer) / 2 - 64);
+		for (k = 0; k < len; k++) {
+			a[k] = letters[rand() % n];
+		}
+		a[k] = '\0';
+
+		/* Generate string b sharing prefix with string a */
+		char *b = buffer + sizeof(buffer) / 2
+			+ rand() % (sizeof(buffer) / 2 - 64);
+		size_t len2 = prefix + (size_t) (rand() % 8);
+		for (k = 0; k < len2; k++) {
+			b[k] = k < prefix ? a[k] : letters[rand() % n];
+		}
+		b[k] = '\0';
+
+		/* Result must agree with the reference implementation */
+		int diff1 = strverscmp(a, b);
+		int diff2 = reference(a, b);
+		if (sign(diff1) != sign(diff2)) {
+			fprintf(stderr, "Mismatch %s %s: %d %d\n",
+				a, b, diff1, diff2);
+			abort();
+		}
+	}
+#endif
+}
+
 static void
 test_performance(void)
 {
@@ -218,6 +313,68 @@ test_performance(void)
 	}
 }
 
+#ifdef DIRENT_H
+/* Original character-by-character implementation of strverscmp */
+static int
+reference(const char *a, const char *b)
+{
+	size_t i = 0;
+	size_t j;
+
+	/* Find first difference */
+	while (a[i] == b[i]) {
+		if (a[i] == '\0')
+			return 0;
+		++i;
+	}
+
+	/* Count backwards and find the leftmost digit */
+	j = i;
+	while (j > 0 && isdigit((unsigned char) a[j-1]))
+		--j;
+
+	/* Determine mode of comparison */
+	if (a[j] == '0' || b[j] == '0') {
+		/* Find the next non-zero digit */
+		while (a[j] == '0' && a[j] == b[j])
+			j++;
+
+		/* String with more digits is smaller, e.g 002 < 01 */
+		if (isdigit((unsigned char) a[j])) {
+			if (!isdigit((unsigned char) b[j]))
+				return -1;
+		} else if (isdigit((unsigned char) b[j])) {
+			return 1;
+		}
+	} else if (isdigit((unsigned char) a[j])
+		&& isdigit((unsigned char) b[j])) {
+		/* Numeric comparison */
+		size_t k1 = j;
+		size_t k2 = j;
+		while (isdigit((unsigned char) a[k1]))
+			k1++;
+		while (isdigit((unsigned char) b[k2]))
+			k2++;
+
+		/* Number with more digits is bigger, e.g 999 < 1000 */
+		if (k1 < k2)
+			return -1;
+		else if (k1 > k2)
+			return 1;
+	}
+
+	/* Alphabetical comparison */
+	return (int) ((unsigned char) a[i]) - ((unsigned char) b[i]);
+}
+
+/* Return -1, 0 or 1 depending on sign of x */
+static int
+sign(int x)
+{
+	return (x > 0) - (x < 0);
+}
+#endif
+
 static void
 initialize(void)
 {
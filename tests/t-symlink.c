@@ -21,6 +21,8 @@
 #ifdef _MSC_VER
 #	include <direct.h>
 #	include <io.h>
+#	include <process.h>
+#	define getpid _getpid
 #	define mkdir(path, mode) _mkdir(path)
 #	define stat _stat64
 #	define fstat _fstat64
@@ -194,8 +196,8 @@ initialize(void)
 	 */
 	setlocale(LC_ALL, "LC_CTYPE=.utf8");
 
-	/* Initialize random number generator from time */
-	srand(((int) time(NULL)) * 257 + 5555);
+	/* Initialize random number generator from time and process id */
+	srand(((int) time(NULL)) * 257 + ((int) getpid()));
 
 	/* Get system temporary directory */
 #ifdef WIN32
@@ -0,0 +1,318 @@
+/*
+ * Make sure that DIRENT_TRACE reports directory operations to trace hooks.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about strcmp being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+/* Enable trace hooks */
+#define DIRENT_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <dirent.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+#ifdef _DIRENT_HAVE_TRACE
+/* Event passed to a hook */
+struct record {
+	/* Non-zero for the beginning of operation */
+	int begin;
+
+	/* Copy of event with path pointing to name */
+	struct dirent_trace event;
+	wchar_t name[PATH_MAX + 1];
+};
+
+static void test_readdir(void);
+static void test_close(void);
+static void test_seekdir(void);
+static void test_scandir(void);
+static void test_streams(void);
+static void test_disable(void);
+static void expect(size_t i, int begin, int operation, size_t count,
+	const char *dirname);
+static const void *stream(size_t i);
+static void begin(const struct dirent_trace *event, void *data);
+static void end(const struct dirent_trace *event, void *data);
+static void record(const struct dirent_trace *event, void *data, int begin);
+#endif
+static void initialize(void);
+static void cleanup(void);
+
+#ifdef _DIRENT_HAVE_TRACE
+/* Events recorded since the last reset */
+static struct record records[32];
+static size_t record_count = 0;
+#endif
+
+int
+main(void)
+{
+	initialize();
+
+#ifdef _DIRENT_HAVE_TRACE
+	test_readdir();
+	test_close();
+	test_seekdir();
+	test_scandir();
+	test_streams();
+	test_disable();
+#endif
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+#ifdef _DIRENT_HAVE_TRACE
+/* Open, read to the end and close directory */
+static void
+test_readdir(void)
+{
+	record_count = 0;
+	dirent_settrace(begin, end, &record_count);
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+	expect(0, 1, DIRENT_TRACE_OPENDIR, 0, "tests/1");
+	expect(1, 0, DIRENT_TRACE_OPENDIR, 0, "tests/1");
+	assert(record_count == 2);
+
+	/* First readdir begins reading and the end of directory ends it */
+	int n = 0;
+	while (readdir(dir) != NULL) {
+		assert(record_count == 3);
+		n++;
+	}
+	assert(n == 4);
+	expect(2, 1, DIRENT_TRACE_READDIR, 0, "tests/1");
+	expect(3, 0, DIRENT_TRACE_READDIR, 4, "tests/1");
+
+	/* Reading past the end does not report another batch */
+	assert(readdir(dir) == NULL);
+	assert(record_count == 4);
+
+	closedir(dir);
+	expect(4, 1, DIRENT_TRACE_CLOSEDIR, 0, "tests/1");
+	expect(5, 0, DIRENT_TRACE_CLOSEDIR, 0, "tests/1");
+	assert(record_count == 6);
+	dirent_settrace(NULL, NULL, NULL);
+
+	/* Every event comes from the same stream in order of time */
+	for (size_t i = 1; i < record_count; i++) {
+		assert(stream(i) == stream(0));
+		assert(records[i].event.time >= records[i - 1].event.time);
+	}
+}
+
+/* Close directory in the middle of reading */
+static void
+test_close(void)
+{
+	record_count = 0;
+	dirent_settrace(begin, end, &record_count);
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+	assert(readdir(dir) != NULL);
+	closedir(dir);
+	dirent_settrace(NULL, NULL, NULL);
+
+	/* Reading ends before the directory is closed */
+	assert(record_count == 6);
+	expect(2, 1, DIRENT_TRACE_READDIR, 0, "tests/1");
+	expect(3, 0, DIRENT_TRACE_READDIR, 1, "tests/1");
+	expect(4, 1, DIRENT_TRACE_CLOSEDIR, 0, "tests/1");
+	expect(5, 0, DIRENT_TRACE_CLOSEDIR, 0, "tests/1");
+}
+
+/* Seek ends reading and the next readdir begins a new batch */
+static void
+test_seekdir(void)
+{
+	record_count = 0;
+	dirent_settrace(begin, end, &record_count);
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+	assert(readdir(dir) != NULL);
+	long pos = telldir(dir);
+	assert(readdir(dir) != NULL);
+	assert(readdir(dir) != NULL);
+	assert(record_count == 3);
+
+	/* Seekdir reads entries from the beginning up to the position */
+	seekdir(dir, pos);
+	assert(record_count == 6);
+	expect(3, 0, DIRENT_TRACE_READDIR, 3, "tests/1");
+	expect(4, 1, DIRENT_TRACE_SEEKDIR, 0, "tests/1");
+	expect(5, 0, DIRENT_TRACE_SEEKDIR, 2, "tests/1");
+
+	assert(readdir(dir) != NULL);
+	expect(6, 1, DIRENT_TRACE_READDIR, 0, "tests/1");
+	closedir(dir);
+	expect(7, 0, DIRENT_TRACE_READDIR, 1, "tests/1");
+	expect(8, 1, DIRENT_TRACE_CLOSEDIR, 0, "tests/1");
+	expect(9, 0, DIRENT_TRACE_CLOSEDIR, 0, "tests/1");
+	assert(record_count == 10);
+	dirent_settrace(NULL, NULL, NULL);
+}
+
+/* Scandir reads the whole directory and sorts it before closing */
+static void
+test_scandir(void)
+{
+	record_count = 0;
+	dirent_settrace(begin, end, &record_count);
+	struct dirent **files;
+	int n = scandir("tests/3", &files, NULL, alphasort);
+	assert(n == 13);
+	for (int i = 0; i < n; i++)
+		free(files[i]);
+	free(files);
+	dirent_settrace(NULL, NULL, NULL);
+
+	assert(record_count == 8);
+	expect(0, 1, DIRENT_TRACE_OPENDIR, 0, "tests/3");
+	expect(1, 0, DIRENT_TRACE_OPENDIR, 0, "tests/3");
+	expect(2, 1, DIRENT_TRACE_READDIR, 0, "tests/3");
+	expect(3, 0, DIRENT_TRACE_READDIR, 13, "tests/3");
+	expect(4, 1, DIRENT_TRACE_SORT, 13, "tests/3");
+	expect(5, 0, DIRENT_TRACE_SORT, 13, "tests/3");
+	expect(6, 1, DIRENT_TRACE_CLOSEDIR, 0, "tests/3");
+	expect(7, 0, DIRENT_TRACE_CLOSEDIR, 0, "tests/3");
+}
+
+/* Concurrent streams are told apart */
+static void
+test_streams(void)
+{
+	record_count = 0;
+	dirent_settrace(begin, end, &record_count);
+	DIR *a = opendir("tests/1");
+	assert(a != NULL);
+	_WDIR *b = _wopendir(L"tests/2");
+	assert(b != NULL);
+	expect(0, 1, DIRENT_TRACE_OPENDIR, 0, "tests/1");
+	expect(2, 1, DIRENT_TRACE_OPENDIR, 0, "tests/2");
+	assert(stream(0) != stream(2));
+
+	assert(readdir(a) != NULL);
+	assert(_wreaddir(b) != NULL);
+	expect(4, 1, DIRENT_TRACE_READDIR, 0, "tests/1");
+	expect(5, 1, DIRENT_TRACE_READDIR, 0, "tests/2");
+	assert(stream(4) == stream(0));
+	assert(stream(5) == stream(2));
+
+	_wclosedir(b);
+	closedir(a);
+	expect(6, 0, DIRENT_TRACE_READDIR, 1, "tests/2");
+	expect(9, 0, DIRENT_TRACE_READDIR, 1, "tests/1");
+	assert(record_count == 12);
+	dirent_settrace(NULL, NULL, NULL);
+}
+
+/* Hooks are not called after tracing is disabled */
+static void
+test_disable(void)
+{
+	record_count = 0;
+	dirent_settrace(begin, NULL, &record_count);
+	DIR *dir = opendir("tests/1");
+	assert(dir != NULL);
+	assert(record_count == 1);
+
+	dirent_settrace(NULL, NULL, NULL);
+	while (readdir(dir) != NULL)
+		/*NOP*/;
+	closedir(dir);
+	assert(record_count == 1);
+}
+
+/*
+ * Check event i.  Directory name is compared to the end of the absolute
+ * path with either slash as separator.
+ */
+static void
+expect(size_t i, int begin, int operation, size_t count, const char *dirname)
+{
+	assert(i < record_count);
+	const struct record *r = &records[i];
+	assert(r->begin == begin);
+	assert(r->event.operation == operation);
+	assert(r->event.count == count);
+	assert(r->event.stream != NULL);
+
+	/* Search pattern is stripped from the absolute path */
+	size_t n = strlen(dirname);
+	size_t k = r->event.length;
+	assert(k > n);
+	for (size_t j = 0; j < n; j++) {
+		wchar_t c = r->name[k - n + j];
+		if (dirname[j] == '/')
+			assert(c == '/' || c == '\\');
+		else
+			assert(c == (wchar_t) dirname[j]);
+	}
+	assert(r->name[k - n - 1] == '/' || r->name[k - n - 1] == '\\');
+}
+
+/* Stream of event i */
+static const void *
+stream(size_t i)
+{
+	assert(i < record_count);
+	return records[i].event.stream;
+}
+
+/* Called on the beginning of directory operation */
+static void
+begin(const struct dirent_trace *event, void *data)
+{
+	record(event, data, 1);
+}
+
+/* Called on the end of directory operation */
+static void
+end(const struct dirent_trace *event, void *data)
+{
+	record(event, data, 0);
+}
+
+/* Store event and its path */
+static void
+record(const struct dirent_trace *event, void *data, int begin)
+{
+	assert(data == &record_count);
+	assert(record_count < sizeof(records) / sizeof(records[0]));
+	struct record *r = &records[record_count++];
+	r->begin = begin;
+	r->event = *event;
+	assert(event->length <= PATH_MAX);
+	wmemcpy(r->name, event->path, event->length);
+	r->name[event->length] = '\0';
+	r->event.path = r->name;
+}
+#endif
+
+static void
+initialize(void)
+{
+#ifndef _DIRENT_HAVE_TRACE
+	/* Trace hooks are only available in dirent.h of this package */
+	fprintf(stderr, "Skipped\n");
+	exit(/*Skip*/ 77);
+#endif
+}
+
+static void
+cleanup(void)
+{
+	printf("OK\n");
+}
@@ -0,0 +1,197 @@
+/*
+ * Make sure that visited_set remembers files and that tree_walker reports
+ * hard-linked files only once with option unique.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about fopen being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.hpp>
+#include "tempdir.hpp"
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+using namespace dirent_cxx;
+namespace fs = std::filesystem;
+
+static void test_set(void);
+static void test_limit(void);
+static void test_links(void);
+static void test_tracked(void);
+static void touch(const string &path);
+static void initialize(void);
+static void cleanup(void);
+
+int
+main(void)
+{
+	initialize();
+
+	test_set();
+	test_limit();
+	test_links();
+	test_tracked();
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+/* Keys are found after insertion and only after insertion */
+static void
+test_set(void)
+{
+	visited_set set;
+	assert(set.size() == 0);
+	assert(!set.contains(1, 1));
+
+	/* Sequential file numbers on three devices, including zero */
+	const unsigned long long n = 100000;
+	for (unsigned long long dev = 1; dev <= 3; dev++) {
+		for (unsigned long long ino = 0; ino < n; ino++)
+			assert(set.insert(dev, ino) == visited_set::inserted);
+	}
+	assert(set.size() == 3 * n);
+
+	for (unsigned long long dev = 1; dev <= 3; dev++) {
+		for (unsigned long long ino = 0; ino < n; ino++) {
+			assert(set.contains(dev, ino));
+			assert(set.insert(dev, ino) == visited_set::found);
+		}
+		assert(!set.contains(dev, n));
+		assert(!set.contains(dev, ~0ULL));
+	}
+	assert(!set.contains(4, 0));
+	assert(set.size() == 3 * n);
+
+	/* Key takes at most 8 / 0.375 bytes right after table doubles */
+	assert(set.memory() <= 3 * n * 22 + 1024);
+
+	set.clear();
+	assert(set.size() == 0);
+	assert(!set.contains(1, 1));
+	assert(set.memory() == 0);
+}
+
+/* Set refuses new keys when full */
+static void
+test_limit(void)
+{
+	visited_set set(10);
+	for (unsigned long long ino = 1; ino <= 10; ino++)
+		assert(set.insert(7, ino * 1000) == visited_set::inserted);
+	assert(set.insert(7, 11000) == visited_set::full);
+	assert(set.insert(8, 1) == visited_set::full);
+	assert(set.insert(7, 0) == visited_set::full);
+
+	/* Old keys are still found */
+	assert(set.insert(7, 5000) == visited_set::found);
+	assert(set.size() == 10);
+}
+
+/* Hard-linked file is reported as duplicate once */
+static void
+test_links(void)
+{
+	string dirname = make_temp_directory();
+	fs::create_directory(dirname + "/a");
+	fs::create_directory(dirname + "/b");
+	touch(dirname + "/a/file");
+	touch(dirname + "/b/other");
+	error_code ec;
+	fs::create_hard_link(dirname + "/a/file", dirname + "/b/link", ec);
+	if (ec) {
+		/* File system does not support hard links */
+		fs::remove_all(dirname);
+		return;
+	}
+
+	walk_options options;
+	options.unique = true;
+	tree_walker walker(dirname.c_str(), options);
+	int n = 0;
+	int dups = 0;
+	for (walk_entry &entry : walker) {
+		if (entry.duplicate()) {
+			assert(entry.name() == "file" || entry.name() == "link");
+			dups++;
+		}
+		n++;
+	}
+	assert(n == 5);
+	assert(dups == 1);
+	tree_walker::statistics s = walker.stats();
+	assert(s.duplicate_files == 1);
+	assert(s.duplicate_dirs == 0);
+	assert(s.untracked == 0);
+	assert(s.visited_bytes > 0);
+
+	/* Duplicates are not detected by default */
+	dups = 0;
+	for (walk_entry &entry : tree_walker(dirname.c_str())) {
+		if (entry.duplicate())
+			dups++;
+	}
+	assert(dups == 0);
+
+	fs::remove_all(dirname);
+}
+
+/* Files beyond max_tracked are counted but not remembered */
+static void
+test_tracked(void)
+{
+	string dirname = make_temp_directory();
+	for (int i = 0; i < 5; i++)
+		fs::create_directory(dirname + "/dir-" + to_string(i));
+
+	walk_options options;
+	options.unique = true;
+	options.max_tracked = 3;
+	tree_walker walker(dirname.c_str(), options);
+	int n = 0;
+	for (walk_entry &entry : walker) {
+		assert(!entry.duplicate());
+		n++;
+	}
+	assert(n == 5);
+
+	/* Starting directory and two sub-directories fit in the set */
+	assert(walker.stats().untracked == 3);
+
+	fs::remove_all(dirname);
+}
+
+/* Create empty file */
+static void
+touch(const string &path)
+{
+	FILE *fp = fopen(path.c_str(), "w");
+	assert(fp != NULL);
+	fclose(fp);
+}
+
+static void
+initialize(void)
+{
+	/*NOP*/;
+}
+
+static void
+cleanup(void)
+{
+	cout << "OK" << endl;
+}
@@ -0,0 +1,281 @@
+/*
+ * Make sure that the C++ coroutine walk() traverses directory trees.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+
+/* Silence warning about fopen being insecure (MS Visual Studio) */
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.hpp>
+#include "tempdir.hpp"
+
+#undef NDEBUG
+#include <assert.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+#ifdef DIRENT_CXX_HAVE_WALK
+using namespace dirent_cxx;
+
+static void test_walk(void);
+static void test_prune(void);
+static void test_errors(void);
+static void test_early_exit(void);
+static void test_allocation(void);
+static string make_tree(int dirs, int subdirs, int files);
+
+/* Number of calls to operator new */
+static unsigned long allocations = 0;
+
+void *
+operator new(size_t size)
+{
+	allocations++;
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw bad_alloc();
+	return p;
+}
+
+void
+operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void
+operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+#endif
+static void initialize(void);
+static void cleanup(void);
+
+int
+main(void)
+{
+	initialize();
+
+#ifdef DIRENT_CXX_HAVE_WALK
+	test_walk();
+	test_prune();
+	test_errors();
+	test_early_exit();
+	test_allocation();
+#endif
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+#ifdef DIRENT_CXX_HAVE_WALK
+/* Visit the same files as std::filesystem */
+static void
+test_walk(void)
+{
+	vector<string> found;
+	for (walk_entry &entry : walk("tests")) {
+		string path(entry.path());
+
+		/* Name is the last component of path */
+		assert(path.size() > entry.name().size());
+		assert(path.compare(path.size() - entry.name().size(),
+			string::npos, entry.name()) == 0);
+
+		/* Depth equals the number of separators after tests */
+		int depth = (int) count(path.begin(), path.end(), '/') - 1;
+		assert(entry.depth() == depth);
+
+		found.push_back(path);
+	}
+
+	vector<string> expect;
+	for (const fs::directory_entry &entry
+		: fs::recursive_directory_iterator("tests")) {
+		string path = entry.path().generic_string();
+		expect.push_back(path);
+	}
+
+	sort(found.begin(), found.end());
+	sort(expect.begin(), expect.end());
+	assert(found == expect);
+	assert(find(found.begin(), found.end(), "tests/1/dir/readme.txt")
+		!= found.end());
+
+	/* Directory name with trailing separator */
+	int n = 0;
+	for (walk_entry &entry : walk("tests/1/")) {
+		if (entry.name() == "readme.txt") {
+			assert(entry.path() == "tests/1/dir/readme.txt");
+			assert(entry.type() == file_type::regular);
+			assert(entry.size() == 198);
+			assert(entry.depth() == 1);
+		}
+		n++;
+	}
+	assert(n == 3);
+}
+
+/* Skip sub-directories on request */
+static void
+test_prune(void)
+{
+	int n = 0;
+	for (walk_entry &entry : walk("tests")) {
+		if (entry.depth() == 0) {
+			if (entry.name() != "1")
+				entry.prune();
+			continue;
+		}
+		/* Only entries below tests/1 remain */
+		assert(entry.path().substr(0, 8) == "tests/1/");
+		n++;
+	}
+	assert(n == 3);
+
+	/* Prune a nested directory */
+	n = 0;
+	for (walk_entry &entry : walk("tests/1")) {
+		if (entry.name() == "dir")
+			entry.prune();
+		assert(entry.name() != "readme.txt");
+		n++;
+	}
+	assert(n == 2);
+}
+
+static void
+test_errors(void)
+{
+	/* Starting directory does not exist */
+	error_code ec;
+	int n = 0;
+	for (walk_entry &entry : walk("tests/invalid", ec)) {
+		(void) entry;
+		n++;
+	}
+	assert(n == 0);
+	assert(ec == errc::no_such_file_or_directory);
+
+	/* Throwing version */
+	bool thrown = false;
+	try {
+		walk_range range = walk("tests/1/file");
+		for (walk_entry &entry : range)
+			(void) entry;
+	} catch (const system_error &e) {
+		assert(e.code() == errc::not_a_directory);
+		thrown = true;
+	}
+	assert(thrown);
+
+	/* Error is cleared on success */
+	walk_range range = walk("tests/1", ec);
+	for (walk_entry &entry : range)
+		(void) entry;
+	assert(!ec);
+}
+
+/* Leave walk in the middle of a deep tree */
+static void
+test_early_exit(void)
+{
+	for (walk_entry &entry : walk("tests")) {
+		if (entry.name() == "readme.txt")
+			break;
+	}
+
+	/* Walk can be moved and continued */
+	walk_range a = walk("tests/1");
+	walk_range::iterator i = a.begin();
+	assert(i != a.end());
+	walk_range b(std::move(a));
+	assert(b.begin() != b.end());
+	int n = 0;
+	for (walk_entry &entry : b) {
+		(void) entry;
+		n++;
+	}
+	assert(n == 3);
+}
+
+/* Only directories allocate memory */
+static void
+test_allocation(void)
+{
+	string dirname = make_tree(10, 10, 20);
+
+	unsigned long before = allocations;
+	size_t n = 0;
+	for (walk_entry &entry : walk(dirname.c_str())) {
+		if (entry.type() == file_type::regular)
+			n++;
+	}
+	unsigned long k = allocations - before;
+	assert(n == 10 * 10 * 20);
+
+	/*
+	 * One coroutine frame per directory and, on Windows, a buffer for
+	 * retrieving file information in each directory
+	 */
+	assert(k <= 2 * (10 * 10 + 10 + 1) + 4);
+
+	fs::remove_all(dirname);
+}
+
+/* Create temporary tree with two levels of sub-directories */
+static string
+make_tree(int dirs, int subdirs, int files)
+{
+	string dirname = make_temp_directory();
+
+	for (int i = 0; i < dirs; i++) {
+		char name[64];
+		sprintf(name, "/dir-%02d", i);
+		fs::create_directory(dirname + name);
+		for (int j = 0; j < subdirs; j++) {
+			sprintf(name, "/dir-%02d/sub-%02d", i, j);
+			fs::create_directory(dirname + name);
+			for (int k = 0; k < files; k++) {
+				sprintf(name, "/dir-%02d/sub-%02d/file-%03d.dat",
+					i, j, k);
+				FILE *fp = fopen((dirname + name).c_str(), "w");
+				assert(fp != NULL);
+				fclose(fp);
+			}
+		}
+	}
+	return dirname;
+}
+#endif
+
+static void
+initialize(void)
+{
+#ifndef DIRENT_CXX_HAVE_WALK
+	/* Coroutines require C++20 */
+	fprintf(stderr, "Skipped\n");
+	exit(/*Skip*/ 77);
+#endif
+}
+
+static void
+cleanup(void)
+{
+	cout << "OK" << endl;
+}
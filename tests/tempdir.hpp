@@ -0,0 +1,48 @@
+/*
+ * Temporary directories for C++ tests.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#ifndef TEMPDIR_HPP
+#define TEMPDIR_HPP
+
+#include <filesystem>
+#include <random>
+#include <string>
+#include <system_error>
+
+#undef NDEBUG
+#include <assert.h>
+
+/*
+ * Create empty directory with a random name under the temporary directory
+ * and return its path with forward slashes.  Tests run in parallel, so a
+ * name already taken by another process is skipped rather than treated as
+ * an error.
+ */
+static inline std::string
+make_temp_directory(void)
+{
+	static std::mt19937 random(std::random_device{}());
+
+	std::string base
+		= std::filesystem::temp_directory_path().generic_string();
+	if (base.back() != '/')
+		base += '/';
+
+	while (true) {
+		std::string dirname = base;
+		for (int i = 0; i < 10; i++)
+			dirname += "abcdefghijklmnopqrstuvwxyz"[random() % 26];
+
+		std::error_code ec;
+		if (std::filesystem::create_directory(dirname, ec))
+			return dirname;
+		assert(!ec);
+	}
+}
+
+#endif /*TEMPDIR_HPP*/
@@ -0,0 +1,708 @@
+/*
+ * Emulate the subset of Win32 API used by dirent.h on top of Linux.
+ *
+ * Directory entries are read with getdents64 into a buffer of 4 KB, or
+ * with FIND_FIRST_EX_LARGE_FETCH into a buffer of 64 KB.  Environment
+ * variable DIRENT_WIN32_FETCH changes the size of the large buffer in
+ * bytes.  Like the real FindNextFileW, most calls are then served from the
+ * buffer.
+ *
+ * Functions CreateFileW and GetFileInformationByHandleEx return the same
+ * entries as packed FILE_ID_BOTH_DIR_INFO records, filling as much of the
+ * caller's buffer as possible on each call.
+ *
+ * Environment variable DIRENT_WIN32_LATENCY gives a delay in nanoseconds
+ * added to each refill of the buffer and to each call of FindFirstFileExW,
+ * FindClose, CreateFileW, GetFileInformationByHandleEx, CloseHandle and
+ * GetFullPathNameW.  The delay keeps the processor busy like
+ * a system call would, so benchmarks can simulate slow file systems such
+ * as network drives where each batch of entries costs a round trip.
+ *
+ * File names are matched against patterns with an upper case table which
+ * does not depend on the locale of the process, like the upper case table
+ * of an NTFS volume.  LCMapStringEx converts to upper case with the same
+ * table.
+ *
+ * Fiber local storage is emulated with keys of POSIX threads, whose
+ * destructors are likewise called when a thread exits.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <wctype.h>
+#include "windows.h"
+
+/* Buffer sizes of standard and large fetch */
+#define FETCH_STANDARD 4096
+#define FETCH_LARGE 65536
+
+/* Smallest buffer which fits any directory entry */
+#define FETCH_MIN 280
+
+/* Directory entry returned from getdents64 */
+struct linux_dirent64 {
+	unsigned long long d_ino;
+	long long d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/* Search handle returned by FindFirstFileExW() and CreateFileW() */
+struct find {
+	/* Open directory */
+	int fd;
+
+	/* Directory entries from getdents64 and current position */
+	char *buf;
+	size_t size;
+	size_t pos;
+	size_t end;
+
+	/* Pattern of file names */
+	wchar_t patt[MAX_PATH];
+};
+
+static __thread DWORD last_error;
+
+/* Locale of upper case table or zero if not created yet */
+static locale_t upcase_locale = (locale_t) 0;
+
+/* Delay of each call in nanoseconds or -1 if not read yet */
+static long long latency = -1;
+
+/* Wait for the time given in DIRENT_WIN32_LATENCY */
+static void
+delay(void)
+{
+	if (latency < 0) {
+		const char *s = getenv("DIRENT_WIN32_LATENCY");
+		latency = s ? atoll(s) : 0;
+		if (latency < 0)
+			latency = 0;
+	}
+	if (latency == 0)
+		return;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long long t = (now.tv_sec - start.tv_sec) * 1000000000LL
+			+ (now.tv_nsec - start.tv_nsec);
+		if (t >= latency)
+			break;
+	}
+}
+
+/* Convert wide-character string to UTF-8 */
+static int
+to_utf8(char *out, size_t size, const wchar_t *in)
+{
+	size_t n = 0;
+	while (*in) {
+		unsigned long c = (unsigned long) *in++;
+		unsigned char tmp[4];
+		size_t k;
+		if (c < 0x80) {
+			tmp[0] = (unsigned char) c;
+			k = 1;
+		} else if (c < 0x800) {
+			tmp[0] = (unsigned char) (0xC0 | (c >> 6));
+			tmp[1] = (unsigned char) (0x80 | (c & 0x3F));
+			k = 2;
+		} else if (c < 0x10000) {
+			tmp[0] = (unsigned char) (0xE0 | (c >> 12));
+			tmp[1] = (unsigned char) (0x80 | ((c >> 6) & 0x3F));
+			tmp[2] = (unsigned char) (0x80 | (c & 0x3F));
+			k = 3;
+		} else {
+			tmp[0] = (unsigned char) (0xF0 | (c >> 18));
+			tmp[1] = (unsigned char) (0x80 | ((c >> 12) & 0x3F));
+			tmp[2] = (unsigned char) (0x80 | ((c >> 6) & 0x3F));
+			tmp[3] = (unsigned char) (0x80 | (c & 0x3F));
+			k = 4;
+		}
+		if (n + k >= size)
+			return -1;
+		memcpy(out + n, tmp, k);
+		n += k;
+	}
+	out[n] = '\0';
+	return 0;
+}
+
+/* Convert UTF-8 string to wide-character string */
+static size_t
+from_utf8(wchar_t *out, size_t size, const char *in)
+{
+	const unsigned char *p = (const unsigned char*) in;
+	size_t n = 0;
+	while (*p && n + 1 < size) {
+		unsigned long c = *p++;
+		int k = 0;
+		if (c >= 0xF0) {
+			c &= 0x07;
+			k = 3;
+		} else if (c >= 0xE0) {
+			c &= 0x0F;
+			k = 2;
+		} else if (c >= 0xC0) {
+			c &= 0x1F;
+			k = 1;
+		}
+		while (k-- > 0 && (*p & 0xC0) == 0x80)
+			c = (c << 6) | (*p++ & 0x3F);
+		out[n++] = (wchar_t) c;
+	}
+	out[n] = 0;
+	return n;
+}
+
+/* Convert character to upper case regardless of the process locale */
+static wchar_t
+upcase(wchar_t c)
+{
+	if (c < 0x80)
+		return c >= 'a' && c <= 'z' ? (wchar_t) (c - ('a' - 'A')) : c;
+
+	/* Fold ASCII only if the system has no C.UTF-8 locale */
+	if (upcase_locale == (locale_t) 0) {
+		upcase_locale = newlocale(
+			LC_CTYPE_MASK, "C.UTF-8", (locale_t) 0);
+		if (upcase_locale == (locale_t) 0)
+			return c;
+	}
+	return (wchar_t) towupper_l((wint_t) c, upcase_locale);
+}
+
+/* Match file name against Windows wild-card pattern */
+static int
+match(const wchar_t *name, const wchar_t *patt)
+{
+	const wchar_t *star = NULL;
+	const wchar_t *retry = NULL;
+	while (*name) {
+		if (*patt == '*') {
+			star = ++patt;
+			retry = name;
+		} else if (*patt == '?'
+			|| upcase(*patt) == upcase(*name)) {
+			patt++;
+			name++;
+		} else if (star) {
+			patt = star;
+			name = ++retry;
+		} else {
+			return 0;
+		}
+	}
+	while (*patt == '*')
+		patt++;
+	return *patt == 0;
+}
+
+/* Convert errno to Win32 error code */
+static DWORD
+error_code(int error)
+{
+	switch (error) {
+	case EACCES:
+	case EPERM:
+		return ERROR_ACCESS_DENIED;
+	case ENOTDIR:
+		return ERROR_DIRECTORY;
+	case ENOMEM:
+		return ERROR_NOT_ENOUGH_MEMORY;
+	case ENOENT:
+	default:
+		return ERROR_PATH_NOT_FOUND;
+	}
+}
+
+/* Convert seconds since 1970 to FILETIME */
+static void
+file_time(FILETIME *ft, const struct timespec *ts)
+{
+	unsigned long long t = (unsigned long long) ts->tv_sec * 10000000ULL
+		+ (unsigned long long) ts->tv_nsec / 100ULL
+		+ 116444736000000000ULL;
+	ft->dwLowDateTime = (DWORD) t;
+	ft->dwHighDateTime = (DWORD) (t >> 32);
+}
+
+/* Size of large fetch buffer */
+static size_t
+fetch_size(void)
+{
+	const char *s = getenv("DIRENT_WIN32_FETCH");
+	if (!s)
+		return FETCH_LARGE;
+	long long n = atoll(s);
+	if (n < FETCH_MIN)
+		return FETCH_MIN;
+	return (size_t) n;
+}
+
+/* Read next batch of directory entries to buffer */
+static BOOL
+refill(struct find *fp)
+{
+	long n = syscall(SYS_getdents64, fp->fd, fp->buf, fp->size);
+	if (n < 0) {
+		last_error = error_code(errno);
+		return FALSE;
+	}
+	if (n == 0) {
+		last_error = ERROR_NO_MORE_FILES;
+		return FALSE;
+	}
+	fp->pos = 0;
+	fp->end = (size_t) n;
+	return TRUE;
+}
+
+/* Get attributes and status of file in directory fd */
+static DWORD
+file_attributes(int fd, const char *name, struct stat *st)
+{
+	if (fstatat(fd, name, st, AT_SYMLINK_NOFOLLOW) != 0) {
+		memset(st, 0, sizeof(*st));
+		return FILE_ATTRIBUTE_NORMAL;
+	}
+	DWORD attr = 0;
+	if (S_ISLNK(st->st_mode)) {
+		struct stat target;
+		attr |= FILE_ATTRIBUTE_REPARSE_POINT;
+		if (fstatat(fd, name, &target, 0) == 0
+			&& S_ISDIR(target.st_mode))
+			attr |= FILE_ATTRIBUTE_DIRECTORY;
+	} else if (S_ISDIR(st->st_mode)) {
+		attr |= FILE_ATTRIBUTE_DIRECTORY;
+	} else if (S_ISCHR(st->st_mode) || S_ISBLK(st->st_mode)) {
+		attr |= FILE_ATTRIBUTE_DEVICE;
+	}
+	if (attr == 0)
+		attr = FILE_ATTRIBUTE_ARCHIVE;
+	return attr;
+}
+
+/* Convert FILETIME to LARGE_INTEGER */
+static void
+large_time(LARGE_INTEGER *li, const struct timespec *ts)
+{
+	FILETIME ft;
+	file_time(&ft, ts);
+	li->QuadPart = (long long) (((unsigned long long) ft.dwHighDateTime << 32)
+		| ft.dwLowDateTime);
+}
+
+/* Read next matching entry from directory */
+static BOOL
+next_entry(struct find *fp, WIN32_FIND_DATAW *data)
+{
+	struct linux_dirent64 *ent;
+	wchar_t name[MAX_PATH];
+	do {
+		if (fp->pos >= fp->end) {
+			delay();
+			if (!refill(fp))
+				return FALSE;
+		}
+		ent = (struct linux_dirent64*) (fp->buf + fp->pos);
+		fp->pos += ent->d_reclen;
+		from_utf8(name, MAX_PATH, ent->d_name);
+	} while (!match(name, fp->patt));
+
+	memset(data, 0, sizeof(*data));
+	wcscpy(data->cFileName, name);
+
+	/* Get file attributes */
+	struct stat st;
+	data->dwFileAttributes = file_attributes(fp->fd, ent->d_name, &st);
+	if (data->dwFileAttributes == FILE_ATTRIBUTE_NORMAL)
+		return TRUE;
+	data->nFileSizeHigh = (DWORD) ((unsigned long long) st.st_size >> 32);
+	data->nFileSizeLow = (DWORD) st.st_size;
+	file_time(&data->ftCreationTime, &st.st_ctim);
+	file_time(&data->ftLastAccessTime, &st.st_atim);
+	file_time(&data->ftLastWriteTime, &st.st_mtim);
+	return TRUE;
+}
+
+HANDLE
+FindFirstFileExW(
+	LPCWSTR lpFileName, FINDEX_INFO_LEVELS fInfoLevelId,
+	LPVOID lpFindFileData, FINDEX_SEARCH_OPS fSearchOp,
+	LPVOID lpSearchFilter, DWORD dwAdditionalFlags)
+{
+	(void) fInfoLevelId;
+	(void) fSearchOp;
+	(void) lpSearchFilter;
+
+	/* Split path into directory and pattern */
+	char path[PATH_MAX];
+	if (to_utf8(path, sizeof(path), lpFileName) != 0) {
+		last_error = ERROR_INVALID_PARAMETER;
+		return INVALID_HANDLE_VALUE;
+	}
+	char *sep = NULL;
+	for (char *p = path; *p; p++) {
+		if (*p == '\\')
+			*p = '/';
+		if (*p == '/')
+			sep = p;
+	}
+	const char *patt = sep ? sep + 1 : path;
+	const char *dirname = sep ? path : ".";
+
+	struct find *fp = (struct find*) malloc(sizeof(struct find));
+	if (!fp) {
+		last_error = ERROR_NOT_ENOUGH_MEMORY;
+		return INVALID_HANDLE_VALUE;
+	}
+	from_utf8(fp->patt, MAX_PATH, patt);
+	if (sep) {
+		if (sep == path)
+			sep[1] = '\0';
+		else
+			*sep = '\0';
+	}
+
+	/* Allocate buffer for directory entries */
+	fp->size = FETCH_STANDARD;
+	if ((dwAdditionalFlags & FIND_FIRST_EX_LARGE_FETCH) != 0)
+		fp->size = fetch_size();
+	fp->pos = 0;
+	fp->end = 0;
+	fp->buf = (char*) malloc(fp->size);
+	if (!fp->buf) {
+		last_error = ERROR_NOT_ENOUGH_MEMORY;
+		free(fp);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	fp->fd = open(dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fp->fd < 0) {
+		delay();
+		last_error = error_code(errno);
+		free(fp->buf);
+		free(fp);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	/* Read first entry, which costs a round trip */
+	if (!next_entry(fp, (WIN32_FIND_DATAW*) lpFindFileData)) {
+		if (last_error == ERROR_NO_MORE_FILES)
+			last_error = ERROR_FILE_NOT_FOUND;
+		close(fp->fd);
+		free(fp->buf);
+		free(fp);
+		return INVALID_HANDLE_VALUE;
+	}
+	return (HANDLE) fp;
+}
+
+BOOL
+FindNextFileW(HANDLE hFindFile, WIN32_FIND_DATAW *lpFindFileData)
+{
+	return next_entry((struct find*) hFindFile, lpFindFileData);
+}
+
+BOOL
+FindClose(HANDLE hFindFile)
+{
+	delay();
+	struct find *fp = (struct find*) hFindFile;
+	close(fp->fd);
+	free(fp->buf);
+	free(fp);
+	return TRUE;
+}
+
+HANDLE
+CreateFileW(
+	LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
+	LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+	DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes,
+	HANDLE hTemplateFile)
+{
+	(void) dwDesiredAccess;
+	(void) dwShareMode;
+	(void) lpSecurityAttributes;
+	(void) dwCreationDisposition;
+	(void) dwFlagsAndAttributes;
+	(void) hTemplateFile;
+
+	delay();
+	char path[PATH_MAX];
+	if (to_utf8(path, sizeof(path), lpFileName) != 0) {
+		last_error = ERROR_INVALID_PARAMETER;
+		return INVALID_HANDLE_VALUE;
+	}
+	size_t n = 0;
+	for (char *p = path; *p; p++) {
+		if (*p == '\\')
+			*p = '/';
+		n++;
+	}
+
+	/* Windows removes trailing dot so that files open too, e.g. file\. */
+	if (n > 2 && path[n - 1] == '.' && path[n - 2] == '/')
+		path[n - 2] = '\0';
+
+	struct find *fp = (struct find*) malloc(sizeof(struct find));
+	if (!fp) {
+		last_error = ERROR_NOT_ENOUGH_MEMORY;
+		return INVALID_HANDLE_VALUE;
+	}
+	fp->patt[0] = '\0';
+	fp->size = FETCH_LARGE;
+	fp->pos = 0;
+	fp->end = 0;
+	fp->buf = (char*) malloc(fp->size);
+	if (!fp->buf) {
+		last_error = ERROR_NOT_ENOUGH_MEMORY;
+		free(fp);
+		return INVALID_HANDLE_VALUE;
+	}
+
+	/* Backup semantics open files as well as directories */
+	fp->fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fp->fd < 0) {
+		last_error = error_code(errno);
+		free(fp->buf);
+		free(fp);
+		return INVALID_HANDLE_VALUE;
+	}
+	return (HANDLE) fp;
+}
+
+BOOL
+GetFileInformationByHandleEx(
+	HANDLE hFile, FILE_INFO_BY_HANDLE_CLASS FileInformationClass,
+	LPVOID lpFileInformation, DWORD dwBufferSize)
+{
+	struct find *fp = (struct find*) hFile;
+	delay();
+	switch (FileInformationClass) {
+	case FileIdBothDirectoryRestartInfo:
+		lseek(fp->fd, 0, SEEK_SET);
+		fp->pos = 0;
+		fp->end = 0;
+		break;
+
+	case FileIdBothDirectoryInfo:
+		break;
+
+	default:
+		last_error = ERROR_INVALID_PARAMETER;
+		return FALSE;
+	}
+
+	/* Pack as many entries as fit in the buffer */
+	char *out = (char*) lpFileInformation;
+	size_t used = 0;
+	FILE_ID_BOTH_DIR_INFO *prev = NULL;
+	for (;;) {
+		if (fp->pos >= fp->end && !refill(fp)) {
+			if (prev)
+				break;
+
+			/* Windows fails like this on a file */
+			if (last_error == ERROR_DIRECTORY)
+				last_error = ERROR_INVALID_PARAMETER;
+			return FALSE;
+		}
+		struct linux_dirent64 *ent
+			= (struct linux_dirent64*) (fp->buf + fp->pos);
+		wchar_t name[MAX_PATH];
+		size_t k = from_utf8(name, MAX_PATH, ent->d_name);
+
+		/* Stop when the record doesn't fit in the buffer */
+		size_t need = offsetof(FILE_ID_BOTH_DIR_INFO, FileName)
+			+ k * sizeof(WCHAR);
+		if (used + need > dwBufferSize) {
+			if (!prev) {
+				last_error = ERROR_MORE_DATA;
+				return FALSE;
+			}
+			break;
+		}
+
+		FILE_ID_BOTH_DIR_INFO *rec
+			= (FILE_ID_BOTH_DIR_INFO*) (out + used);
+		memset(rec, 0, offsetof(FILE_ID_BOTH_DIR_INFO, FileName));
+		struct stat st;
+		rec->FileAttributes = file_attributes(fp->fd, ent->d_name, &st);
+		rec->FileNameLength = (DWORD) (k * sizeof(WCHAR));
+		rec->FileId.QuadPart = (long long) ent->d_ino;
+		rec->EndOfFile.QuadPart = (long long) st.st_size;
+		rec->AllocationSize.QuadPart = (long long) st.st_blocks * 512;
+		large_time(&rec->CreationTime, &st.st_ctim);
+		large_time(&rec->LastAccessTime, &st.st_atim);
+		large_time(&rec->LastWriteTime, &st.st_mtim);
+		large_time(&rec->ChangeTime, &st.st_ctim);
+		memcpy(rec->FileName, name, k * sizeof(WCHAR));
+
+		/* Link previous record to this one */
+		if (prev)
+			prev->NextEntryOffset = (DWORD) ((char*) rec - (char*) prev);
+		prev = rec;
+		used = (used + need + 7) & ~(size_t) 7;
+		fp->pos += ent->d_reclen;
+	}
+	return TRUE;
+}
+
+BOOL
+CloseHandle(HANDLE hObject)
+{
+	return FindClose(hObject);
+}
+
+DWORD
+GetFullPathNameW(
+	LPCWSTR lpFileName, DWORD nBufferLength, LPWSTR lpBuffer,
+	LPWSTR *lpFilePart)
+{
+	delay();
+	wchar_t full[PATH_MAX];
+	size_t n = 0;
+
+	/* Prepend current working directory to relative path */
+	if (lpFileName[0] != '/' && lpFileName[0] != '\\') {
+		char cwd[PATH_MAX];
+		if (!getcwd(cwd, sizeof(cwd))) {
+			last_error = error_code(errno);
+			return 0;
+		}
+		n = from_utf8(full, PATH_MAX, cwd);
+		if (n > 0 && full[n - 1] != '/')
+			full[n++] = '/';
+	}
+	size_t k = wcslen(lpFileName);
+	if (n + k >= PATH_MAX) {
+		last_error = ERROR_INVALID_PARAMETER;
+		return 0;
+	}
+	wcscpy(full + n, lpFileName);
+	n += k;
+
+	if (lpFilePart)
+		*lpFilePart = NULL;
+
+	/* Return required size with zero terminator if buffer is too small */
+	if (!lpBuffer || nBufferLength <= n)
+		return (DWORD) (n + 1);
+
+	wcscpy(lpBuffer, full);
+	return (DWORD) n;
+}
+
+int
+LCMapStringEx(
+	LPCWSTR lpLocaleName, DWORD dwMapFlags, LPCWSTR lpSrcStr, int cchSrc,
+	LPWSTR lpDestStr, int cchDest, LPVOID lpVersionInformation,
+	LPVOID lpReserved, LPARAM sortHandle)
+{
+	(void) lpVersionInformation;
+	(void) lpReserved;
+	(void) sortHandle;
+
+	/* Only upper case with the invariant locale is supported */
+	if (lpLocaleName[0] != 0 || dwMapFlags != LCMAP_UPPERCASE) {
+		last_error = ERROR_INVALID_PARAMETER;
+		return 0;
+	}
+	if (cchSrc < 0)
+		cchSrc = (int) wcslen(lpSrcStr) + 1;
+	if (cchDest < cchSrc) {
+		last_error = ERROR_INSUFFICIENT_BUFFER;
+		return 0;
+	}
+	for (int i = 0; i < cchSrc; i++)
+		lpDestStr[i] = upcase(lpSrcStr[i]);
+	return cchSrc;
+}
+
+DWORD
+FlsAlloc(PFLS_CALLBACK_FUNCTION lpCallback)
+{
+	pthread_key_t key;
+	if (pthread_key_create(&key, lpCallback) != 0) {
+		last_error = ERROR_NOT_ENOUGH_MEMORY;
+		return FLS_OUT_OF_INDEXES;
+	}
+	return (DWORD) key;
+}
+
+BOOL
+FlsFree(DWORD dwFlsIndex)
+{
+	return pthread_key_delete((pthread_key_t) dwFlsIndex) == 0;
+}
+
+BOOL
+FlsSetValue(DWORD dwFlsIndex, LPVOID lpFlsData)
+{
+	return pthread_setspecific((pthread_key_t) dwFlsIndex, lpFlsData) == 0;
+}
+
+LONG
+InterlockedCompareExchange(
+	LONG volatile *Destination, LONG Exchange, LONG Comperand)
+{
+	return __sync_val_compare_and_swap(Destination, Comperand, Exchange);
+}
+
+LONG64
+InterlockedExchangeAdd64(LONG64 volatile *Addend, LONG64 Value)
+{
+	return __sync_fetch_and_add(Addend, Value);
+}
+
+BOOL
+QueryPerformanceCounter(LARGE_INTEGER *lpPerformanceCount)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	lpPerformanceCount->QuadPart = (long long) ts.tv_sec * 1000000000LL
+		+ ts.tv_nsec;
+	return TRUE;
+}
+
+BOOL
+QueryPerformanceFrequency(LARGE_INTEGER *lpFrequency)
+{
+	lpFrequency->QuadPart = 1000000000LL;
+	return TRUE;
+}
+
+DWORD
+GetLastError(void)
+{
+	return last_error;
+}
+
+void
+SetLastError(DWORD dwErrCode)
+{
+	last_error = dwErrCode;
+}
@@ -0,0 +1,184 @@
+/*
+ * Minimal windows.h for compiling include/dirent.h on other systems.
+ *
+ * Declares the subset of Win32 API used by dirent.h.  The functions are
+ * implemented in win32.c on top of POSIX opendir and readdir, so the
+ * Windows implementation of dirent.h can be tested and benchmarked on
+ * Linux.  Test programs are compiled with this directory and the include
+ * directory in front of the system include path.
+ *
+ * Copyright (C) 1998-2019 Toni Ronkko
+ * This file is part of dirent.  Dirent may be freely distributed
+ * under the MIT license.  For all details and documentation, see
+ * https://github.com/tronkko/dirent
+ */
+#ifndef DIRENT_SHIM_WINDOWS_H
+#define DIRENT_SHIM_WINDOWS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wchar.h>
+
+/* Avoid clash with strverscmp() from GNU C library */
+#define strverscmp dirent_strverscmp
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WINAPI
+#define TRUE 1
+#define FALSE 0
+#define MAX_PATH 260
+
+/* Emulate desktop application */
+#define WINAPI_PARTITION_DESKTOP 1
+#define WINAPI_FAMILY_PARTITION(x) (x)
+
+typedef int BOOL;
+typedef char CCHAR;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef int64_t LONG64;
+typedef void *HANDLE;
+typedef void *LPVOID;
+typedef wchar_t WCHAR;
+typedef const wchar_t *LPCWSTR;
+typedef wchar_t *LPWSTR;
+typedef intptr_t LPARAM;
+
+#define INVALID_HANDLE_VALUE ((HANDLE) (intptr_t) -1)
+#define FLS_OUT_OF_INDEXES ((DWORD) 0xFFFFFFFF)
+
+/* Function called at thread exit for a non-NULL fiber local value */
+typedef void (WINAPI *PFLS_CALLBACK_FUNCTION)(void *lpFlsData);
+
+#define FILE_ATTRIBUTE_READONLY 0x01
+#define FILE_ATTRIBUTE_HIDDEN 0x02
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+#define FILE_ATTRIBUTE_ARCHIVE 0x20
+#define FILE_ATTRIBUTE_DEVICE 0x40
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_ATTRIBUTE_REPARSE_POINT 0x400
+
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_PATH_NOT_FOUND 3L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_NOT_ENOUGH_MEMORY 8L
+#define ERROR_NO_MORE_FILES 18L
+#define ERROR_MORE_DATA 234L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_DIRECTORY 267L
+#define ERROR_INSUFFICIENT_BUFFER 122L
+
+#define LOCALE_NAME_INVARIANT L""
+#define LCMAP_UPPERCASE 0x00000200
+
+typedef union _LARGE_INTEGER {
+	long long QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _FILETIME {
+	DWORD dwLowDateTime;
+	DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct _WIN32_FIND_DATAW {
+	DWORD dwFileAttributes;
+	FILETIME ftCreationTime;
+	FILETIME ftLastAccessTime;
+	FILETIME ftLastWriteTime;
+	DWORD nFileSizeHigh;
+	DWORD nFileSizeLow;
+	DWORD dwReserved0;
+	DWORD dwReserved1;
+	WCHAR cFileName[MAX_PATH];
+	WCHAR cAlternateFileName[14];
+} WIN32_FIND_DATAW;
+
+typedef enum _FINDEX_INFO_LEVELS {
+	FindExInfoStandard,
+	FindExInfoBasic,
+	FindExInfoMaxInfoLevel
+} FINDEX_INFO_LEVELS;
+
+typedef enum _FINDEX_SEARCH_OPS {
+	FindExSearchNameMatch,
+	FindExSearchLimitToDirectories,
+	FindExSearchLimitToDevices,
+	FindExSearchMaxSearchOp
+} FINDEX_SEARCH_OPS;
+
+#define FIND_FIRST_EX_CASE_SENSITIVE 1
+#define FIND_FIRST_EX_LARGE_FETCH 2
+
+/* Directory entry returned by GetFileInformationByHandleEx() */
+typedef struct _FILE_ID_BOTH_DIR_INFO {
+	DWORD NextEntryOffset;
+	DWORD FileIndex;
+	LARGE_INTEGER CreationTime;
+	LARGE_INTEGER LastAccessTime;
+	LARGE_INTEGER LastWriteTime;
+	LARGE_INTEGER ChangeTime;
+	LARGE_INTEGER EndOfFile;
+	LARGE_INTEGER AllocationSize;
+	DWORD FileAttributes;
+	DWORD FileNameLength;
+	DWORD EaSize;
+	CCHAR ShortNameLength;
+	WCHAR ShortName[12];
+	LARGE_INTEGER FileId;
+	WCHAR FileName[1];
+} FILE_ID_BOTH_DIR_INFO;
+
+typedef enum _FILE_INFO_BY_HANDLE_CLASS {
+	FileIdBothDirectoryInfo = 10,
+	FileIdBothDirectoryRestartInfo = 11
+} FILE_INFO_BY_HANDLE_CLASS;
+
+typedef struct _SECURITY_ATTRIBUTES *LPSECURITY_ATTRIBUTES;
+
+#define FILE_LIST_DIRECTORY 0x0001
+#define FILE_SHARE_READ 0x00000001
+#define FILE_SHARE_WRITE 0x00000002
+#define FILE_SHARE_DELETE 0x00000004
+#define OPEN_EXISTING 3
+#define FILE_FLAG_BACKUP_SEMANTICS 0x02000000
+
+HANDLE FindFirstFileExW(
+	LPCWSTR lpFileName, FINDEX_INFO_LEVELS fInfoLevelId,
+	LPVOID lpFindFileData, FINDEX_SEARCH_OPS fSearchOp,
+	LPVOID lpSearchFilter, DWORD dwAdditionalFlags);
+BOOL FindNextFileW(HANDLE hFindFile, WIN32_FIND_DATAW *lpFindFileData);
+BOOL FindClose(HANDLE hFindFile);
+HANDLE CreateFileW(
+	LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode,
+	LPSECURITY_ATTRIBUTES lpSecurityAttributes,
+	DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes,
+	HANDLE hTemplateFile);
+BOOL GetFileInformationByHandleEx(
+	HANDLE hFile, FILE_INFO_BY_HANDLE_CLASS FileInformationClass,
+	LPVOID lpFileInformation, DWORD dwBufferSize);
+BOOL CloseHandle(HANDLE hObject);
+DWORD GetFullPathNameW(
+	LPCWSTR lpFileName, DWORD nBufferLength, LPWSTR lpBuffer,
+	LPWSTR *lpFilePart);
+int LCMapStringEx(
+	LPCWSTR lpLocaleName, DWORD dwMapFlags, LPCWSTR lpSrcStr, int cchSrc,
+	LPWSTR lpDestStr, int cchDest, LPVOID lpVersionInformation,
+	LPVOID lpReserved, LPARAM sortHandle);
+DWORD FlsAlloc(PFLS_CALLBACK_FUNCTION lpCallback);
+BOOL FlsFree(DWORD dwFlsIndex);
+BOOL FlsSetValue(DWORD dwFlsIndex, LPVOID lpFlsData);
+LONG InterlockedCompareExchange(
+	LONG volatile *Destination, LONG Exchange, LONG Comperand);
+LONG64 InterlockedExchangeAdd64(LONG64 volatile *Addend, LONG64 Value);
+BOOL QueryPerformanceCounter(LARGE_INTEGER *lpPerformanceCount);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *lpFrequency);
+DWORD GetLastError(void);
+void SetLastError(DWORD dwErrCode);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*DIRENT_SHIM_WINDOWS_H*/